@@ -103,7 +103,8 @@ BloomFilter::BloomFilter(uint32_t nElements, double falsePositiveRate, uint32_t
     bEmpty(false),
     nHashFuncs(std::min((uint)(filter.size() * 8 / nElements * LN2), MAX_BLOOM_FILTER_HASH_FUNCS)),
     nTweak(_nTweak),
-    nFlags(_nFlags)
+    nFlags(_nFlags),
+    nInserted(0)
 {
 }
 
@@ -115,6 +116,7 @@ void BloomFilter::set(uint32_t nElements, double falsePositiveRate, uint32_t _nT
     nHashFuncs = std::min((uint)(filter.size() * 8 / nElements * LN2), MAX_BLOOM_FILTER_HASH_FUNCS);
     nTweak = _nTweak;
     nFlags = _nFlags;
+    nInserted = 0;
     bSet = true;
 }
 
@@ -126,6 +128,7 @@ void BloomFilter::insert(const uchar_vector& data)
         filter[index >> 3] |= bit_mask[7 & index];
     }
     bEmpty = false;
+    nInserted++;
 }
 
 bool BloomFilter::match(const uchar_vector& data) const
@@ -139,3 +142,13 @@ bool BloomFilter::match(const uchar_vector& data) const
     }
     return true;
 }
+
+double BloomFilter::getFalsePositiveRate(uint32_t nExtraElements) const
+{
+    if (filter.empty()) return 1.0;
+
+    // (1 - e^(-kn/m))^k
+    double m = filter.size() * 8;
+    double kn = (double)nHashFuncs * (nInserted + nExtraElements);
+    return pow(1.0 - exp(-kn / m), (double)nHashFuncs);
+}
@@ -32,6 +32,7 @@ namespace Coin {
 // 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
 static const unsigned int MAX_BLOOM_FILTER_HASH_FUNCS = 50;
+static const unsigned int MAX_FILTERADD_DATA_SIZE = 520; // bytes, peers reject larger filteradd elements
 
 class BloomFilter
 {
@@ -42,11 +43,12 @@ private:
     uint32_t nHashFuncs;
     uint32_t nTweak;
     uint8_t nFlags;
+    uint32_t nInserted;
 
     uint32_t hash(uint n, const uchar_vector& data) const;
 
 public:
-    BloomFilter() : bSet(false) { }
+    BloomFilter() : bSet(false), nInserted(0) { }
     BloomFilter(uint32_t nElements, double falsePositiveRate, uint32_t _nTweak, uint8_t _nFlags);
 
     void set(uint32_t nElements, double falsePositiveRate, uint32_t _nTweak, uint8_t _nFlags);
@@ -57,6 +59,11 @@ public:
     void insert(const uchar_vector& data);
     bool match(const uchar_vector& data) const;
 
+    // Expected false positive rate once nExtraElements more elements have been inserted
+    double getFalsePositiveRate(uint32_t nExtraElements = 0) const;
+    uint32_t getNInserted() const { return nInserted; }
+    bool isMaxSize() const { return filter.size() >= MAX_BLOOM_FILTER_SIZE; }
+
     const uchar_vector& getFilter() const { return filter; }
     uint32_t getNHashFuncs() const { return nHashFuncs; }
     uint32_t getNTweak() const { return nTweak; }
@@ -103,19 +103,117 @@ string satoshisToBtcString(uint64_t satoshis, bool trailing_zeros)
     return ss.str();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// class DataCursor implementation
+//
+uint64_t DataCursor::readVarInt(const char* error)
+{
+    require(MIN_VAR_INT_SIZE, error);
+    unsigned char prefix = data_[pos_];
+    if (prefix < 0xfd) { pos_++; return prefix; }
+
+    require(prefix == 0xfd ? 3 : (prefix == 0xfe ? 5 : 9), error);
+    pos_++;
+    if (prefix == 0xfd) return readUint<uint16_t>(error);
+    if (prefix == 0xfe) return readUint<uint32_t>(error);
+    return readUint<uint64_t>(error);
+}
+
+void DataCursor::readBytes(unsigned char* dest, std::size_t n, const char* error)
+{
+    require(n, error);
+    memcpy(dest, data_ + pos_, n);
+    pos_ += n;
+}
+
+void DataCursor::readBytes(uchar_vector& dest, std::size_t n, const char* error)
+{
+    require(n, error);
+    dest.assign(data_ + pos_, data_ + pos_ + n);
+    pos_ += n;
+}
+
+void DataCursor::readBytesReversed(unsigned char* dest, std::size_t n, const char* error)
+{
+    require(n, error);
+    std::reverse_copy(data_ + pos_, data_ + pos_ + n, dest);
+    pos_ += n;
+}
+
+void DataCursor::readBytesReversed(uchar_vector& dest, std::size_t n, const char* error)
+{
+    require(n, error);
+    dest.assign(data_ + pos_, data_ + pos_ + n);
+    std::reverse(dest.begin(), dest.end());
+    pos_ += n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class DataWriter implementation
+//
+void DataWriter::writeVarInt(uint64_t n)
+{
+    if (n < 0xfd) { writeUint((uint8_t)n); return; }
+    if (n <= 0xffff) { writeUint((uint8_t)0xfd); writeUint((uint16_t)n); return; }
+    if (n <= 0xffffffff) { writeUint((uint8_t)0xfe); writeUint((uint32_t)n); return; }
+    writeUint((uint8_t)0xff);
+    writeUint(n);
+}
+
+void DataWriter::writeBytesReversed(const unsigned char* data, std::size_t n)
+{
+    // Hashes fit in one chunk. Longer data goes through the buffer back to front.
+    unsigned char chunk[64];
+    while (n > 0)
+    {
+        std::size_t len = std::min(n, sizeof(chunk));
+        std::reverse_copy(data + n - len, data + n, chunk);
+        write(chunk, len);
+        n -= len;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class HashWriter implementation
+//
+hash256_t HashWriter::getHash()
+{
+    hash256_t hash;
+    ctx_.final(hash.data());
+    CoinCrypto::sha256(hash.data(), hash.data(), hash.size());
+    return hash;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // class CoinNodeStructure implementation
 //
+uchar_vector CoinNodeStructure::getSerialized() const
+{
+    uchar_vector rval(getSize());
+    BufferWriter writer(rval.data(), rval.size());
+    serialize(writer);
+    if (writer.pos() != rval.size())
+        throw runtime_error("CoinNodeStructure::getSerialized - size does not match getSize().");
+    return rval;
+}
+
 const uchar_vector& CoinNodeStructure::getHash() const
 {
-    hash_ = sha256_2(getSerialized());
+    HashWriter writer;
+    serialize(writer);
+    hash_ = writer.getHash().bytes();
     return hash_;
 }
 
 const uchar_vector& CoinNodeStructure::getHashLittleEndian() const
 {
-    hashLittleEndian_ = sha256_2(getSerialized()).getReverse();
+    HashWriter writer;
+    serialize(writer);
+    hashLittleEndian_ = writer.getHash().reversedBytes();
     return hashLittleEndian_;
 }
 
@@ -149,43 +247,23 @@ uint64_t VarInt::getSize() const
     return 9;
 }
 
-uchar_vector VarInt::getSerialized() const
+void VarInt::serialize(DataWriter& writer) const
 {
-    uchar_vector rval;
-    if (this->value < 0xfd) {
-        rval.push_back(value);
-        return rval;
-    }
-    if (this->value <= 0xffff) {
-        rval.push_back(0xfd);
-        rval += uint_to_vch<uint16_t>(this->value, _BIG_ENDIAN);
-        return rval;
-    }
-    if (this->value <= 0xffffffff) {
-        rval.push_back(0xfe);
-        rval += uint_to_vch<uint32_t>(this->value, _BIG_ENDIAN);
-        return rval;
-    }
-    rval.push_back(0xff);
-    rval += uint_to_vch<uint64_t>(this->value, _BIG_ENDIAN);
-    return rval;
+    writer.writeVarInt(this->value);
 }
 
 void VarInt::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_VAR_INT_SIZE)
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void VarInt::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_VAR_INT_SIZE)
         throw runtime_error("Invalid data - VarInt too small.");
 
-    if (bytes[0] < 0xfd)
-        this->value = bytes[0];
-    else if ((bytes[0] == 0xfd) && (bytes.size() >= 3))
-        this->value = vch_to_uint<uint16_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 3), _BIG_ENDIAN);
-    else if ((bytes[0] == 0xfe) && (bytes.size() >= 5))
-        this->value = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 5), _BIG_ENDIAN);
-    else if (bytes.size() >= 9)
-        this->value = vch_to_uint<uint64_t>(uchar_vector(bytes.begin() + 1, bytes.begin() + 9), _BIG_ENDIAN);
-    else
-        throw runtime_error("Invalid data - VarInt length is wrong.");
+    this->value = cursor.readVarInt("Invalid data - VarInt length is wrong.");
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -198,13 +276,10 @@ uint64_t VarString::getSize() const
     return length.getSize() + this->value.size();
 }
 
-uchar_vector VarString::getSerialized() const
+void VarString::serialize(DataWriter& writer) const
 {
-    uchar_vector rval;
-    VarInt length(this->value.size());
-    rval += length.getSerialized();
-    rval += uchar_vector(this->value.begin(), this->value.end());
-    return rval;
+    writer.writeVarInt(this->value.size());
+    if (!this->value.empty()) writer.write((const unsigned char*)this->value.data(), this->value.size());
 }
 
 void VarString::setSerialized(const uchar_vector& bytes)
@@ -246,16 +321,14 @@ NetworkAddress::NetworkAddress(const NetworkAddress& netaddr)
     this->port = netaddr.port;
 }
 
-uchar_vector NetworkAddress::getSerialized() const
+void NetworkAddress::serialize(DataWriter& writer) const
 {
-    uchar_vector rval;
     if (this->hasTime)
-        rval += uint_to_vch(this->time, _BIG_ENDIAN);
-    rval += uint_to_vch(this->services, _BIG_ENDIAN);
-    uchar_vector ipv6vch(this->ipv6.getBytes(), 16);
-    rval += ipv6vch;
-    rval += uint_to_vch(this->port, _LITTLE_ENDIAN);
-    return rval;
+        writer.writeUint(this->time);
+    writer.writeUint(this->services);
+    writer.write(this->ipv6.getBytes(), 16);
+    unsigned char portBytes[2] = { (unsigned char)(this->port >> 8), (unsigned char)this->port }; // network byte order
+    writer.write(portBytes, 2);
 }
 
 void NetworkAddress::set(uint64_t services, const unsigned char ipv6_bytes[], uint16_t port)
@@ -345,27 +418,31 @@ MessageHeader::MessageHeader(const MessageHeader& header)
     this->checksum = header.checksum; // will be ignored if hasChecksum == false
 }
 
-uchar_vector MessageHeader::getSerialized() const
+void MessageHeader::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(this->magic, _BIG_ENDIAN);
-    rval += uchar_vector((unsigned char*)this->command, 12);
-    rval += uint_to_vch(this->length, _BIG_ENDIAN);
+    writer.writeUint(this->magic);
+    writer.write((const unsigned char*)this->command, 12);
+    writer.writeUint(this->length);
     if (this->hasChecksum)
-        rval += uint_to_vch(this->checksum, _BIG_ENDIAN);
-    return rval;
+        writer.writeUint(this->checksum);
 }
 
 void MessageHeader::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_MESSAGE_HEADER_SIZE)
-        throw runtime_error("Invalid data - MessageHeader too small.");
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
 
-    this->magic = vch_to_uint<uint32_t>(bytes, _BIG_ENDIAN);
-    uchar_vector(bytes.begin() + 4, bytes.begin() + 16).copyToArray((unsigned char*)this->command);
-    this->length = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 16, bytes.begin() + 20), _BIG_ENDIAN);
-    this->hasChecksum = (bytes.size() >= 24);
-    if (this->hasChecksum)
-        this->checksum = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 20, bytes.begin() + 24), _BIG_ENDIAN);
+void MessageHeader::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - MessageHeader too small.";
+    cursor.require(MIN_MESSAGE_HEADER_SIZE, error);
+
+    this->magic = cursor.readUint<uint32_t>(error);
+    cursor.readBytes((unsigned char*)this->command, 12, error);
+    this->length = cursor.readUint<uint32_t>(error);
+    this->hasChecksum = true;
+    this->checksum = cursor.readUint<uint32_t>(error);
 }
 
 string MessageHeader::toString() const
@@ -504,34 +581,45 @@ uint64_t CoinNodeMessage::getSize() const
     return this->header.getSize() + this->pPayload->getSize();
 }
 
-uchar_vector CoinNodeMessage::getSerialized() const
+void CoinNodeMessage::serialize(DataWriter& writer) const
 {
     if (!pPayload) throw runtime_error("Message not initialized.");
-    uchar_vector rval = this->header.getSerialized();
-    rval += this->pPayload->getSerialized();
-    return rval;
+    this->header.serialize(writer);
+    this->pPayload->serialize(writer);
 }
 
 void CoinNodeMessage::setSerialized(const uchar_vector& bytes)
 {
-    this->header.setSerialized(bytes);
-    string command = this->header.command;
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void CoinNodeMessage::setSerialized(DataCursor& cursor)
+{
+    this->header.setSerialized(cursor);
+    string command(this->header.command, strnlen(this->header.command, 12));
 //      if ((command == "version") || (command == "verack"))
 // VERSION_CHECKSUM_CHANGE
 /*      if (command == "verack")
             this->header.removeChecksum();
 */
-    if (bytes.size() < header.getSize() + header.length)
+    if (cursor.remaining() < header.length)
         throw runtime_error("Invalid data - CoinNodeMessage too small.");
 
+    // The payload is parsed in place. Types without a cursor parser get a copy of just the payload.
+    DataCursor payload(cursor.ptr(), header.length);
+    uchar_vector bytes;
+    if (command != "inv" && command != "tx" && command != "block" && command != "merkleblock" && command != "headers")
+        bytes.assign(payload.ptr(), payload.ptr() + header.length);
+    cursor.skip(header.length, "Invalid data - CoinNodeMessage too small.");
+
     if (pPayload) {
         delete pPayload;
         pPayload = NULL;
     }
 
     if (command == "version") {
-        this->pPayload =
-        new VersionMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new VersionMessage(bytes);
     }
     else if (command == "verack") {
         this->pPayload = new BlankMessage("verack");
@@ -540,66 +628,52 @@ void CoinNodeMessage::setSerialized(const uchar_vector& bytes)
         this->pPayload = new BlankMessage("mempool");
     }
     else if (command == "addr") {
-        this->pPayload =
-            new AddrMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new AddrMessage(bytes);
     }
     else if (command == "inv") {
-        this->pPayload =
-            new Inventory(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new Inventory(payload);
     }
     else if (command == "getdata") {
-        this->pPayload =
-            new GetDataMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new GetDataMessage(bytes);
     }
     else if (command == "notfound") {
-        this->pPayload =
-            new NotFoundMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new NotFoundMessage(bytes);
     }
     else if (command == "getblocks") {
-        this->pPayload =
-            new GetBlocksMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new GetBlocksMessage(bytes);
     }
     else if (command == "getheaders") {
-        this->pPayload =
-            new GetHeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new GetHeadersMessage(bytes);
     }
     else if (command == "tx") {
-        this->pPayload =
-            new Transaction(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new Transaction(payload);
     }
     else if (command == "block") {
-        this->pPayload =
-            new CoinBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new CoinBlock(payload);
     }
     else if (command == "merkleblock") {
-        this->pPayload =
-            new MerkleBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new MerkleBlock(payload);
     }
     else if (command == "headers") {
-        this->pPayload =
-            new HeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new HeadersMessage(payload);
     }
     else if (command == "getaddr") {
         this->pPayload = new GetAddrMessage();
     }
     else if (command == "filterload") {
-        this->pPayload =
-            new FilterLoadMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new FilterLoadMessage(bytes);
     }
     else if (command == "filteradd") {
-        this->pPayload =
-            new FilterAddMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new FilterAddMessage(bytes);
     }
     else if (command == "filterclear") {
         this->pPayload = new BlankMessage("filterclear");
     }
     else if (command == "ping") {
-        this->pPayload =
-            new PingMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new PingMessage(bytes);
     }
     else if (command == "pong") {
-        this->pPayload =
-            new PongMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
+        this->pPayload = new PongMessage(bytes);
     }
     else {
         string error_msg = "Unrecognized command: ";
@@ -671,23 +745,23 @@ VersionMessage::VersionMessage(
 
 uint64_t VersionMessage::getSize() const
 {
-    uint64_t size = subVersion_.getSize() + MIN_VERSION_MESSAGE_SIZE;
+    // version, services, timestamp, nonce, start height
+    uint64_t size = 32 + recipientAddress_.getSize() + senderAddress_.getSize() + subVersion_.getSize();
     if (version_ >= 70001) { size++; }
     return size;
 }
 
-uchar_vector VersionMessage::getSerialized() const
+void VersionMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(version_, _BIG_ENDIAN);
-    rval += uint_to_vch(services_, _BIG_ENDIAN);
-    rval += uint_to_vch(timestamp_, _BIG_ENDIAN);
-    rval += recipientAddress_.getSerialized();
-    rval += senderAddress_.getSerialized();
-    rval += uint_to_vch(nonce_, _BIG_ENDIAN);
-    rval += subVersion_.getSerialized();
-    rval += uint_to_vch(startHeight_, _BIG_ENDIAN);
-    if (version_ >= 70001) { rval.push_back(relay_ ? 1 : 0); }
-    return rval;
+    writer.writeUint((uint32_t)version_);
+    writer.writeUint(services_);
+    writer.writeUint((uint64_t)timestamp_);
+    recipientAddress_.serialize(writer);
+    senderAddress_.serialize(writer);
+    writer.writeUint(nonce_);
+    subVersion_.serialize(writer);
+    writer.writeUint((uint32_t)startHeight_);
+    if (version_ >= 70001) { writer.writeUint((uint8_t)(relay_ ? 1 : 0)); }
 }
 
 void VersionMessage::setSerialized(const uchar_vector& bytes)
@@ -762,13 +836,12 @@ string VersionMessage::toIndentedString(uint spaces) const
 //
 // class AddrMessage implementation
 //
-uchar_vector AddrMessage::getSerialized() const
+void AddrMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = VarInt(addrList.size()).getSerialized();
+    writer.writeVarInt(addrList.size());
     for (uint i = 0; i < addrList.size(); i++) {
-        rval += addrList[i].getSerialized();
+        addrList[i].serialize(writer);
     }
-    return rval;
 }
 
 void AddrMessage::setSerialized(const uchar_vector& bytes)
@@ -813,24 +886,25 @@ string AddrMessage::toIndentedString(uint spaces) const
 //
 // class InventoryItem implementation
 //
-uchar_vector InventoryItem::getSerialized() const
+void InventoryItem::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(itemType, _BIG_ENDIAN);
-    uchar_vector hashBytes((unsigned char*)hash, 32);
-    hashBytes.reverse(); // to little endian
-    rval += hashBytes;
-    return rval;
+    writer.writeUint(itemType);
+    writer.writeBytesReversed(hash, 32); // to little endian
 }
 
 void InventoryItem::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_INVENTORY_ITEM_SIZE)
-        throw runtime_error("Invalid data - InventoryItem too small.");
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void InventoryItem::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - InventoryItem too small.";
+    cursor.require(MIN_INVENTORY_ITEM_SIZE, error);
 
-    this->itemType = vch_to_uint<uint32_t>(bytes, _BIG_ENDIAN);
-    uchar_vector hashBytes(bytes.begin() + 4, bytes.begin() + 36);
-    hashBytes.reverse(); // to big endian
-    hashBytes.copyToArray((unsigned char*)this->hash);
+    this->itemType = cursor.readUint<uint32_t>(error);
+    cursor.readBytesReversed(this->hash, 32, error); // to big endian
 }
 
 string InventoryItem::toString() const
@@ -852,26 +926,31 @@ string InventoryItem::toIndentedString(uint spaces) const
 //
 // class Inventory implementation
 //
-uchar_vector Inventory::getSerialized() const
+void Inventory::serialize(DataWriter& writer) const
 {
-    uchar_vector data = VarInt(this->items.size()).getSerialized();
+    writer.writeVarInt(this->items.size());
 
     for (uint i = 0; i < this->items.size(); i++)
-        data += (this->items)[i].getSerialized();
-
-    return data;
+        (this->items)[i].serialize(writer);
 }
 
 void Inventory::setSerialized(const uchar_vector& bytes)
 {
-    VarInt count(bytes);
-    uint pos = count.getSize();
-    if (bytes.size() < pos + MIN_INVENTORY_ITEM_SIZE*count.value)
-        throw runtime_error("Invalid data - message too small.");
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
 
-    for (uint i = 0; i < count.value; i++) {
-        uchar_vector field(bytes.begin() + pos, bytes.end());
-        InventoryItem item(field); pos += item.getSerialized().size();
+void Inventory::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - message too small.";
+    uint64_t count = cursor.readVarInt(error);
+    if (count > cursor.remaining() / MIN_INVENTORY_ITEM_SIZE)
+        throw runtime_error(error);
+
+    this->items.reserve(this->items.size() + count);
+    for (uint64_t i = 0; i < count; i++) {
+        InventoryItem item;
+        item.setSerialized(cursor);
         (this->items).push_back(item);
     }
 }
@@ -960,14 +1039,13 @@ GetBlocksMessage::GetBlocksMessage(const string& hex)
     this->setSerialized(bytes);
 }
 
-uchar_vector GetBlocksMessage::getSerialized() const
+void GetBlocksMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(this->version, _BIG_ENDIAN);
-    rval += VarInt(this->blockLocatorHashes.size()).getSerialized();
+    writer.writeUint(this->version);
+    writer.writeVarInt(this->blockLocatorHashes.size());
     for (uint i = 0; i < this->blockLocatorHashes.size(); i++)
-        rval += uchar_vector(this->blockLocatorHashes[i].begin(), this->blockLocatorHashes[i].begin() + 32).getReverse();
-    rval += uchar_vector(this->hashStop).getReverse();
-    return rval;
+        writer.writeBytesReversed(&this->blockLocatorHashes[i][0], 32);
+    writer.writeBytesReversed(this->hashStop);
 }
 
 void GetBlocksMessage::setSerialized(const uchar_vector& bytes)
@@ -1021,14 +1099,13 @@ string GetBlocksMessage::toIndentedString(uint spaces) const
 //
 // class GetHeadersMessage implementation
 //
-uchar_vector GetHeadersMessage::getSerialized() const
+void GetHeadersMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(this->version, _BIG_ENDIAN);
-    rval += VarInt(this->blockLocatorHashes.size()).getSerialized();
+    writer.writeUint(this->version);
+    writer.writeVarInt(this->blockLocatorHashes.size());
     for (uint i = 0; i < this->blockLocatorHashes.size(); i++)
-        rval += uchar_vector(this->blockLocatorHashes[i].begin(), this->blockLocatorHashes[i].begin() + 32).getReverse();
-    rval += uchar_vector(this->hashStop).getReverse();
-    return rval;
+        writer.writeBytesReversed(&this->blockLocatorHashes[i][0], 32);
+    writer.writeBytesReversed(this->hashStop);
 }
 
 void GetHeadersMessage::setSerialized(const uchar_vector& bytes)
@@ -1087,24 +1164,25 @@ void OutPoint::setPoint(const uchar_vector& hashBytes, uint index)
     this->index = index;
 }
 
-uchar_vector OutPoint::getSerialized() const
+void OutPoint::serialize(DataWriter& writer) const
 {
-    uchar_vector rval(this->hash, 32);
-    rval.reverse(); // to big endian
-    rval += uint_to_vch(this->index, _BIG_ENDIAN);
-    return rval;
+    writer.writeBytesReversed(this->hash, 32); // to big endian
+    writer.writeUint(this->index);
 }
 
 void OutPoint::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_OUT_POINT_SIZE)
-        throw runtime_error("Invalid data - OutPoint too small.");
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
 
-    uchar_vector hashBytes(bytes.begin(), bytes.begin() + 32);
-    hashBytes.reverse(); // to little endian
+void OutPoint::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - OutPoint too small.";
+    cursor.require(MIN_OUT_POINT_SIZE, error);
 
-    memcpy(this->hash, &hashBytes[0], 32);
-    this->index = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 32, bytes.begin() + 36), _BIG_ENDIAN);
+    cursor.readBytesReversed(this->hash, 32, error); // to little endian
+    this->index = cursor.readUint<uint32_t>(error);
 }
 
 string OutPoint::toDelimited(const string& delimiter) const
@@ -1144,30 +1222,43 @@ TxIn::TxIn(const OutPoint& previousOut, const string& scriptSigHex, uint32_t seq
 
 uchar_vector TxIn::getSerialized(bool includeScriptSigLength) const
 {
-    uchar_vector rval = this->previousOut.getSerialized();
-    if (includeScriptSigLength)
-        rval += VarInt(this->scriptSig.size()).getSerialized();
-    rval += this->scriptSig;
-    rval += uint_to_vch(this->sequence, _BIG_ENDIAN);
+    if (includeScriptSigLength) return CoinNodeStructure::getSerialized();
+
+    uchar_vector rval(this->getSize() - VarInt(this->scriptSig.size()).getSize());
+    BufferWriter writer(&rval[0], rval.size());
+    this->serialize(writer, false);
     return rval;
 }
 
+void TxIn::serialize(DataWriter& writer, bool includeScriptSigLength) const
+{
+    this->previousOut.serialize(writer);
+    if (includeScriptSigLength)
+        writer.writeVarInt(this->scriptSig.size());
+    writer.writeBytes(this->scriptSig);
+    writer.writeUint(this->sequence);
+}
+
 void TxIn::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_TX_IN_SIZE)
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void TxIn::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_TX_IN_SIZE)
         throw runtime_error("Invalid data - TxIn too small.");
 
-    this->previousOut.setSerialized(bytes);
-    VarInt scriptLength(uchar_vector(bytes.begin() + 36, bytes.end()));
-    uint pos =  scriptLength.getSize() + 36;
-    if (bytes.size() < pos + scriptLength.value) {
-        cout << "TxIn: " << bytes.getHex() << endl;
-        throw runtime_error("Invalid data - TxIn script length too small.");
-    }
+    this->previousOut.setSerialized(cursor);
 
-    this->scriptSig.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
-    pos += scriptLength.value;
-    this->sequence = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN);
+    const char* error = "Invalid data - TxIn script length too small.";
+    uint64_t scriptLength = cursor.readVarInt(error);
+    if (scriptLength > cursor.remaining())
+        throw runtime_error(error);
+
+    cursor.readBytes(this->scriptSig, scriptLength, error);
+    this->sequence = cursor.readUint<uint32_t>(error);
 }
 
 string TxIn::getAddress() const
@@ -1234,26 +1325,31 @@ TxOut::TxOut(uint64_t value, const string& scriptPubKeyHex)
     this->scriptPubKey = script;
 }
 
-uchar_vector TxOut::getSerialized() const
+void TxOut::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = uint_to_vch(this->value, _BIG_ENDIAN);
-    rval += VarInt(this->scriptPubKey.size()).getSerialized();
-    rval += this->scriptPubKey;
-    return rval;
+    writer.writeUint(this->value);
+    writer.writeVarInt(this->scriptPubKey.size());
+    writer.writeBytes(this->scriptPubKey);
 }
 
 void TxOut::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_TX_OUT_SIZE)
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void TxOut::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_TX_OUT_SIZE)
         throw runtime_error("Invalid data - TxOut too small.");
 
-    this->value = vch_to_uint<uint64_t>(bytes, _BIG_ENDIAN);
-    VarInt scriptLength(uchar_vector(bytes.begin() + 8, bytes.end()));
-    uint pos = scriptLength.getSize() + 8;
-    if (bytes.size() < pos + scriptLength.value)
-        throw runtime_error("Invalid data - TxOut script length too small.");
+    const char* error = "Invalid data - TxOut script length too small.";
+    this->value = cursor.readUint<uint64_t>(error);
+    uint64_t scriptLength = cursor.readVarInt(error);
+    if (scriptLength > cursor.remaining())
+        throw runtime_error(error);
 
-    this->scriptPubKey.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    cursor.readBytes(this->scriptPubKey, scriptLength, error);
 }
 
 string TxOut::getAddress() const
@@ -1335,26 +1431,44 @@ uint64_t Transaction::getSize() const
     return count;
 }
 
+hash256_t Transaction::hash256() const
+{
+    HashWriter writer;
+    this->serialize(writer);
+    return writer.getHash().getReverse();
+}
+
 uchar_vector Transaction::getSerialized(bool includeScriptSigLength) const
+{
+    if (includeScriptSigLength) return CoinNodeStructure::getSerialized();
+
+    uint64_t size = this->getSize();
+    for (auto& input: this->inputs) { size -= VarInt(input.scriptSig.size()).getSize(); }
+
+    uchar_vector rval(size);
+    BufferWriter writer(&rval[0], rval.size());
+    this->serialize(writer, false);
+    return rval;
+}
+
+void Transaction::serialize(DataWriter& writer, bool includeScriptSigLength) const
 {
     // version
-    uchar_vector rval = uint_to_vch(this->version, _BIG_ENDIAN);
+    writer.writeUint(this->version);
 
     uint64_t i;
     // inputs
-    rval += VarInt(this->inputs.size()).getSerialized();
+    writer.writeVarInt(this->inputs.size());
     for (i = 0; i < this->inputs.size(); i++)
-        rval += this->inputs[i].getSerialized(includeScriptSigLength);
+        this->inputs[i].serialize(writer, includeScriptSigLength);
 
     // outputs
-    rval += VarInt(this->outputs.size()).getSerialized();
+    writer.writeVarInt(this->outputs.size());
     for (i = 0; i < this->outputs.size(); i++)
-        rval += this->outputs[i].getSerialized();
+        this->outputs[i].serialize(writer);
 
     // lock time
-    rval += uint_to_vch(this->lockTime, _BIG_ENDIAN);
-
-    return rval;
+    writer.writeUint(this->lockTime);
 }
 
 void Transaction::setSerialized(const uchar_vector& bytes)
@@ -1362,35 +1476,43 @@ void Transaction::setSerialized(const uchar_vector& bytes)
     if (bytes.size() < MIN_TRANSACTION_SIZE)
         throw runtime_error(string("Invalid data - Transaction too small: ") + bytes.getHex());
 
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void Transaction::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_TRANSACTION_SIZE)
+        throw runtime_error("Invalid data - Transaction too small.");
+
+    const char* error = "Invalid data - Transaction too small.";
+
     // version
-    this->version = vch_to_uint<uint32_t>(uchar_vector(bytes.begin(), bytes.begin() + 4), _BIG_ENDIAN);
+    this->version = cursor.readUint<uint32_t>(error);
 
     uint64_t i;
     // inputs
     this->inputs.clear();
-    VarInt count(uchar_vector(bytes.begin() + 4, bytes.end()));
-    uint pos = count.getSize() + 4;
-    for (i = 0; i < count.value; i++) {
-        TxIn txIn(uchar_vector(bytes.begin() + pos, bytes.end()));
-        this->addInput(txIn);
-        pos += txIn.getSize();
-    }
+    uint64_t count = cursor.readVarInt(error);
+    if (count > cursor.remaining() / MIN_TX_IN_SIZE)
+        throw runtime_error("Invalid data - TxIn too small.");
+
+    this->inputs.resize(count);
+    for (i = 0; i < count; i++)
+        this->inputs[i].setSerialized(cursor);
 
     // outputs
     this->outputs.clear();
-    count.setSerialized(uchar_vector(bytes.begin() + pos, bytes.end()));
-    pos = pos + count.getSize();
-    for (i = 0; i < count.value; i++) {
-        TxOut txOut(uchar_vector(bytes.begin() + pos, bytes.end()));
-        this->addOutput(txOut);
-        pos += txOut.getSize();
-    }
+    count = cursor.readVarInt(error);
+    if (count > cursor.remaining() / MIN_TX_OUT_SIZE)
+        throw runtime_error("Invalid data - TxOut too small.");
 
-    if (bytes.size() < pos + 4)
-        throw runtime_error("Invalid data - Transaction missing lockTime.");
+    this->outputs.resize(count);
+    for (i = 0; i < count; i++)
+        this->outputs[i].setSerialized(cursor);
 
     // lock time
-    this->lockTime = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN);
+    this->lockTime = cursor.readUint<uint32_t>("Invalid data - Transaction missing lockTime.");
 }
 
 string Transaction::toString() const
@@ -1473,7 +1595,61 @@ uint64_t Transaction::getTotalSent() const
 
 uchar_vector Transaction::getHashWithAppendedCode(uint32_t code) const
 {
-    return sha256_2(this->getSerialized() + uint_to_vch(code, _BIG_ENDIAN));
+    HashWriter writer;
+    this->serialize(writer);
+    writer.writeUint(code);
+    return writer.getHash().bytes();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class SigHashCache implementation
+//
+SigHashCache::SigHashCache(const Transaction& tx)
+{
+    Transaction skeleton(tx);
+    skeleton.clearScriptSigs();
+    skeleton_ = skeleton.getSerialized();
+
+    CoinCrypto::sha256_ctx ctx;
+
+    uint64_t pos = 4 + VarInt(skeleton.inputs.size()).getSize();
+    uint64_t hashed = 0;
+    scriptOffsets_.reserve(skeleton.inputs.size());
+    midstates_.reserve(skeleton.inputs.size());
+    for (uint i = 0; i < skeleton.inputs.size(); i++)
+    {
+        // outpoint, empty script length, sequence
+        uint64_t offset = pos + 36;
+        ctx.update(&skeleton_[hashed], offset - hashed);
+        hashed = offset;
+
+        scriptOffsets_.push_back(offset);
+        midstates_.push_back(ctx);
+        pos = offset + 1 + 4;
+    }
+}
+
+uchar_vector SigHashCache::getHash(uint index, const uchar_vector& scriptCode, uint32_t code) const
+{
+    if (index >= scriptOffsets_.size()) throw runtime_error("SigHashCache::getHash - input index out of range.");
+
+    CoinCrypto::sha256_ctx ctx = midstates_[index];
+
+    uchar_vector scriptLength = VarInt(scriptCode.size()).getSerialized();
+    ctx.update(&scriptLength[0], scriptLength.size());
+    if (!scriptCode.empty()) { ctx.update(&scriptCode[0], scriptCode.size()); }
+
+    uint64_t suffix = scriptOffsets_[index] + 1;
+    ctx.update(&skeleton_[suffix], skeleton_.size() - suffix);
+
+    unsigned char codeBytes[4] = { (unsigned char)code, (unsigned char)(code >> 8), (unsigned char)(code >> 16), (unsigned char)(code >> 24) };
+    ctx.update(codeBytes, 4);
+
+    unsigned char hash[32];
+    ctx.final(hash);
+    CoinCrypto::sha256(hash, hash, 32);
+    return uchar_vector(hash, hash + 32);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1493,89 +1669,80 @@ CoinBlockHeader::CoinBlockHeader(const string& hex)
     resetHash();
 }
 
-uchar_vector CoinBlockHeader::getSerialized() const
+hash256_t CoinBlockHeader::hash256() const
 {
-    uchar_vector rval = uint_to_vch(version_, _BIG_ENDIAN);
-    rval += prevBlockHash_.getReverse(); // all big endian
-    rval += merkleRoot_.getReverse();
-    rval += uint_to_vch(timestamp_, _BIG_ENDIAN);
-    rval += uint_to_vch(bits_, _BIG_ENDIAN);
-    rval += uint_to_vch(nonce_, _BIG_ENDIAN);
-    return rval;
+    if (isHashSet_) return hash256_t(&hashLittleEndian_[0]);
+    if (!isHashFuncSha256d() || prevBlockHash_.size() != 32 || merkleRoot_.size() != 32) return hash256_t(getHashLittleEndian());
+
+    // Serialize onto the stack rather than through getSerialized().
+    unsigned char header[MIN_COIN_BLOCK_HEADER_SIZE];
+    const uint32_t fields[] = { timestamp_, bits_, nonce_ };
+    for (int i = 0; i < 4; i++) { header[i] = (unsigned char)(version_ >> (8 * i)); }
+    std::reverse_copy(prevBlockHash_.begin(), prevBlockHash_.end(), header + 4);
+    std::reverse_copy(merkleRoot_.begin(), merkleRoot_.end(), header + 36);
+    for (int j = 0; j < 3; j++)
+    {
+        for (int i = 0; i < 4; i++) { header[68 + 4 * j + i] = (unsigned char)(fields[j] >> (8 * i)); }
+    }
+
+    return ::hash256(header, MIN_COIN_BLOCK_HEADER_SIZE).getReverse();
 }
 
-void CoinBlockHeader::setSerialized(const uchar_vector& bytes)
+void CoinBlockHeader::serialize(DataWriter& writer) const
 {
-    if (bytes.size() < MIN_COIN_BLOCK_HEADER_SIZE)
-        throw runtime_error("Invalid data - CoinBlockHeader too small.");
-
-    version_ = vch_to_uint<uint32_t>(bytes, _BIG_ENDIAN); uint pos = 4;
+    writer.writeUint(version_);
+    writer.writeBytesReversed(prevBlockHash_); // all big endian
+    writer.writeBytesReversed(merkleRoot_);
+    writer.writeUint(timestamp_);
+    writer.writeUint(bits_);
+    writer.writeUint(nonce_);
+}
 
-    uchar_vector subbytes(bytes.begin() + pos, bytes.begin() + pos + 32); pos += 32;
-    subbytes.reverse();
-    prevBlockHash_ = subbytes;
+void CoinBlockHeader::setSerialized(const uchar_vector& bytes)
+{
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
 
-    subbytes.assign(bytes.begin() + pos, bytes.begin() + pos + 32); pos += 32;
-    subbytes.reverse();
-    merkleRoot_ = subbytes;
+void CoinBlockHeader::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - CoinBlockHeader too small.";
+    cursor.require(MIN_COIN_BLOCK_HEADER_SIZE, error);
 
-    timestamp_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN); pos += 4;
-    bits_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN); pos += 4;
-    nonce_ = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN); pos += 4;
+    version_ = cursor.readUint<uint32_t>(error);
+    cursor.readBytesReversed(prevBlockHash_, 32, error);
+    cursor.readBytesReversed(merkleRoot_, 32, error);
+    timestamp_ = cursor.readUint<uint32_t>(error);
+    bits_ = cursor.readUint<uint32_t>(error);
+    nonce_ = cursor.readUint<uint32_t>(error);
 
     resetHash();
 }
 
-const BigInt CoinBlockHeader::getTarget() const
+const uint256 CoinBlockHeader::getTarget() const
 {
-    uint32_t nExp = bits_ >> 24;
-    uint32_t nMantissa = bits_ & 0x007fffff;
-    if (nExp <= 3)
-    {
-        nMantissa >>= 8*(3 - nExp);
-        BigInt target(nMantissa);
-        return target;
-    }
-    else
-    {
-        BigInt target(nMantissa);
-        return target << (8*(nExp - 3));
-    }    
+    // The sign bit is ignored and targets too big for 256 bits saturate, so any hash meets them.
+    bool fOverflow;
+    uint256 target;
+    target.SetCompact(bits_ & 0xff7fffff, NULL, &fOverflow);
+    if (fOverflow) return ~uint256();
+    return target;
 }
 
-void CoinBlockHeader::setTarget(const BigInt& target)
+void CoinBlockHeader::setTarget(const uint256& target)
 {
-    uint32_t nExp =  target.numBytes();
-    uint32_t nMantissa;
-    if (nExp <= 3)
-    {
-        nMantissa = target.getWord() << 8*(3 - nExp);
-    }
-    else
-    {
-        nMantissa = (target >> (8*(nExp - 3))).getWord();
-    }
-
-    if (nMantissa >> 24) throw std::runtime_error("Mantissa too large.");
-
-    if (nMantissa & 0x00800000)
-    {
-        nMantissa >>= 8;
-        nExp++;
-    }
-
-    if (nExp >> 8) throw std::runtime_error("Exponent too large.");
-
-    bits_ = (nExp << 24) | nMantissa;
-
+    bits_ = target.GetCompact();
     resetHash();
 }
 
-const BigInt CoinBlockHeader::getWork() const
+const uint256 CoinBlockHeader::getWork() const
 {
-    BigInt target = getTarget();
-    if (target <= 0) return 0;
-    return (BigInt(1) << 256) / (getTarget() + 1);
+    // 2^256 / (target + 1) does not fit in 256 bits but equals ~target / (target + 1) + 1.
+    bool fOverflow;
+    uint256 target;
+    target.SetCompact(bits_ & 0xff7fffff, NULL, &fOverflow);
+    if (fOverflow || target == 0) return uint256();
+    return (~target / (target + 1)) + 1;
 }
 
 string CoinBlockHeader::toString() const
@@ -1622,11 +1789,88 @@ const uchar_vector& CoinBlockHeader::getHashLittleEndian() const
     return hashLittleEndian_; 
 }
 
+typedef uchar_vector (*hashfunc_ptr_t)(const uchar_vector&);
+
+static bool isSha256d(const hashfunc_t& hashfunc)
+{
+    const hashfunc_ptr_t* target = hashfunc.target<hashfunc_ptr_t>();
+    return target && *target == &sha256_2;
+}
+
+static bool isScrypt(const hashfunc_t& hashfunc)
+{
+    const hashfunc_ptr_t* target = hashfunc.target<hashfunc_ptr_t>();
+    return target && *target == &scrypt_1024_1_1_256;
+}
+
+bool CoinBlockHeader::isHashFuncSha256d()
+{
+    return isSha256d(hashfunc_);
+}
+
+void CoinBlockHeader::setHash(const uchar_vector& hash) const
+{
+    hash_ = hash;
+    hashLittleEndian_ = hash_.getReverse();
+    isHashSet_ = true;
+
+    if (isSha256d(powhashfunc_))
+    {
+        POWHash_ = hash_;
+        POWHashLittleEndian_ = hashLittleEndian_;
+        isPOWHashSet_ = true;
+    }
+}
+
+bool CoinBlockHeader::isPOWHashFuncScrypt()
+{
+    return isScrypt(powhashfunc_);
+}
+
+void CoinBlockHeader::setPOWHashes(const std::vector<CoinBlockHeader>& headers, std::size_t begin, std::size_t end)
+{
+    if (begin > end || end > headers.size()) throw runtime_error("CoinBlockHeader::setPOWHashes - invalid range.");
+
+    if (!isScrypt(powhashfunc_))
+    {
+        for (std::size_t i = begin; i < end; i++) { headers[i].getPOWHash(); }
+        return;
+    }
+
+    std::vector<const CoinBlockHeader*> pending;
+    pending.reserve(end - begin);
+    for (std::size_t i = begin; i < end; i++)
+    {
+        if (!headers[i].isPOWHashSet_) { pending.push_back(&headers[i]); }
+    }
+    if (pending.empty()) return;
+
+    uchar_vector data(pending.size() * 80);
+    for (std::size_t i = 0; i < pending.size(); i++)
+    {
+        BufferWriter writer(&data[i * 80], 80);
+        pending[i]->serialize(writer);
+    }
+
+    uchar_vector hashes(pending.size() * 32);
+    scrypt_1024_1_1_256_batch((const char*)&data[0], (char*)&hashes[0], pending.size());
+
+    for (std::size_t i = 0; i < pending.size(); i++)
+    {
+        const CoinBlockHeader& header = *pending[i];
+        header.POWHash_.assign(hashes.begin() + i * 32, hashes.begin() + (i + 1) * 32);
+        header.POWHashLittleEndian_ = header.POWHash_.getReverse();
+        header.isPOWHashSet_ = true;
+    }
+}
+
+// The POW hash is computed directly rather than through CoinNodeStructure::getHash(),
+// which would overwrite the cached block hash when the two hash functions differ.
 const uchar_vector& CoinBlockHeader::getPOWHash() const
 {
     if (!isPOWHashSet_)
     {
-        POWHash_ = CoinNodeStructure::getHash(powhashfunc_);
+        POWHash_ = powhashfunc_(getSerialized());
         POWHashLittleEndian_ = POWHash_.getReverse();
         isPOWHashSet_ = true;
     }
@@ -1637,7 +1881,7 @@ const uchar_vector& CoinBlockHeader::getPOWHashLittleEndian() const
 {
     if (!isPOWHashSet_)
     {
-        POWHash_ = CoinNodeStructure::getHash(powhashfunc_);
+        POWHash_ = powhashfunc_(getSerialized());
         POWHashLittleEndian_ = POWHash_.getReverse();
         isPOWHashSet_ = true;
     }
@@ -1663,33 +1907,42 @@ uint64_t CoinBlock::getSize() const
     return size;
 }
 
-uchar_vector CoinBlock::getSerialized() const
+void CoinBlock::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = this->blockHeader.getSerialized();
+    this->blockHeader.serialize(writer);
 
     // add transactions
-    rval += VarInt(this->txs.size()).getSerialized();
+    writer.writeVarInt(this->txs.size());
     for (uint i = 0; i < this->txs.size(); i++)
-        rval += this->txs[i].getSerialized();
-    return rval;
+        this->txs[i].serialize(writer);
 }
 
 void CoinBlock::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_COIN_BLOCK_SIZE)
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void CoinBlock::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_COIN_BLOCK_SIZE)
         throw runtime_error("Invalid data - CoinBlock too small.");
 
-    this->blockHeader.setSerialized(bytes);
-    uint pos = MIN_COIN_BLOCK_HEADER_SIZE;
+    this->blockHeader.setSerialized(cursor);
+
+    const char* error = "Invalid data - CoinBlock transactions exceed block size.";
+    uint64_t count = cursor.readVarInt(error);
+    if (count > cursor.remaining() / MIN_TRANSACTION_SIZE)
+        throw runtime_error(error);
 
+    // Transactions are hashed straight from the message bytes rather than reserialized.
     MerkleTree txMerkleTree;
-    VarInt count(uchar_vector(bytes.begin() + pos, bytes.end())); pos += count.getSize();
-    for (uint i = 0; i < count.value; i++) {
-        Transaction tx(uchar_vector(bytes.begin() + pos, bytes.end())); pos += tx.getSize();
-        this->txs.push_back(tx);
-        txMerkleTree.addHash(tx.getHash());
-        if (bytes.size() < pos)
-            throw runtime_error("Invalid data - CoinBlock transactions exceed block size.");
+    this->txs.clear();
+    this->txs.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        const unsigned char* txBegin = cursor.ptr();
+        this->txs[i].setSerialized(cursor);
+        txMerkleTree.addHash(sha256_2(uchar_vector(txBegin, cursor.ptr())));
     }
     if (blockHeader.merkleRoot() != txMerkleTree.getRootLittleEndian()) {
         throw runtime_error("Invalid data - CoinBlock merkle root mismatch.");
@@ -1802,47 +2055,50 @@ uint64_t MerkleBlock::getSize() const
     return MIN_COIN_BLOCK_HEADER_SIZE + 4 + VarInt(hashes.size()).getSize() + (hashes.size() * 32) + VarInt(flags.size()).getSize() + flags.size();
 }
 
-uchar_vector MerkleBlock::getSerialized() const
+void MerkleBlock::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = blockHeader.getSerialized();
-    rval += uint_to_vch(nTxs, _BIG_ENDIAN);
-    rval += VarInt(hashes.size()).getSerialized();
+    blockHeader.serialize(writer);
+    writer.writeUint(nTxs);
+    writer.writeVarInt(hashes.size());
     for (uint i = 0; i < hashes.size(); i++) {
         // TODO: make sure hashes are all 32 bytes
-        rval += hashes[i];
+        writer.writeBytes(hashes[i]);
     }
-    rval += VarInt(flags.size()).getSerialized();
-    rval += flags;
-    return rval;
+    writer.writeVarInt(flags.size());
+    writer.writeBytes(flags);
 }
 
 void MerkleBlock::setSerialized(const uchar_vector& bytes)
 {
-    if (bytes.size() < MIN_MERKLE_BLOCK_SIZE)
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void MerkleBlock::setSerialized(DataCursor& cursor)
+{
+    if (cursor.remaining() < MIN_MERKLE_BLOCK_SIZE)
         throw runtime_error("Invalid data - MerkleBlock too small.");
 
-    this->blockHeader.setSerialized(bytes);
-    uint pos = MIN_COIN_BLOCK_HEADER_SIZE;
+    this->blockHeader.setSerialized(cursor);
 
-    nTxs = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN); pos += 4;
+    const char* error = "Invalid data - MerkleBlock hash count invalid.";
+    nTxs = cursor.readUint<uint32_t>(error);
 
-    VarInt nHashes(uchar_vector(bytes.begin() + pos, bytes.end())); pos += nHashes.getSize();
-    if (bytes.size() < pos + (nHashes.value * 32) + 1)
-        throw runtime_error("Invalid data - MerkleBlock hash count invalid.");
+    uint64_t nHashes = cursor.readVarInt(error);
+    if (cursor.remaining() == 0 || nHashes > (cursor.remaining() - 1) / 32)
+        throw runtime_error(error);
 
-    hashes.clear();
-    for (uint i = 0; i < nHashes.value; i++) {
-        hashes.push_back(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 32)); pos += 32;
+    hashes.resize(nHashes);
+    for (uint64_t i = 0; i < nHashes; i++) {
+        cursor.readBytes(hashes[i], 32, error);
     }
-        
-    VarInt nFlags(uchar_vector(bytes.begin() + pos, bytes.end())); pos += nFlags.getSize();
-    if (bytes.size() < pos + nFlags.value)
-        throw runtime_error("Invalid data - MerkleBlock flag count invalid.");
 
-    flags.clear();
-    for (uint i = 0; i < nFlags.value; i++) {
-        flags.push_back(bytes[pos + i]);
-    }
+    error = "Invalid data - MerkleBlock flag count invalid.";
+    uint64_t nFlags = cursor.readVarInt(error);
+    if (nFlags > cursor.remaining())
+        throw runtime_error(error);
+
+    cursor.readBytes(flags, nFlags, error);
 }
 
 string MerkleBlock::toString() const
@@ -1900,28 +2156,33 @@ uint64_t HeadersMessage::getSize() const
     return VarInt(this->headers.size()).getSize() + this->headers.size()*(MIN_COIN_BLOCK_HEADER_SIZE + 1);
 }
 
-uchar_vector HeadersMessage::getSerialized() const
+void HeadersMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = VarInt(this->headers.size()).getSerialized();
+    writer.writeVarInt(this->headers.size());
     for (uint i = 0; i < this->headers.size(); i++) {
-        rval += this->headers[i].getSerialized();
-        rval.push_back(0);
+        this->headers[i].serialize(writer);
+        writer.writeUint((uint8_t)0);
     }
-    return rval;
 }
 
 void HeadersMessage::setSerialized(const uchar_vector& bytes)
 {
-    VarInt count(bytes);
-    if (bytes.size() < count.getSize() + count.value*(MIN_COIN_BLOCK_HEADER_SIZE + 1))
-        throw runtime_error("Invalid data - HeadersMessage too small.");
+    DataCursor cursor(bytes);
+    setSerialized(cursor);
+}
+
+void HeadersMessage::setSerialized(DataCursor& cursor)
+{
+    const char* error = "Invalid data - HeadersMessage too small.";
+    uint64_t count = cursor.readVarInt(error);
+    if (count > cursor.remaining() / (MIN_COIN_BLOCK_HEADER_SIZE + 1))
+        throw runtime_error(error);
 
-    uint pos = count.getSize();
     this->headers.clear();
-    for (uint i = 0; i < count.value; i++) {
-        CoinBlockHeader header(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + MIN_COIN_BLOCK_HEADER_SIZE));
-        this->headers.push_back(header);
-        pos += MIN_COIN_BLOCK_HEADER_SIZE + 1; // an extra blank byte is added.
+    this->headers.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        this->headers[i].setSerialized(cursor);
+        cursor.skip(1, error); // an extra blank byte is added.
     }
 }
 
@@ -1956,14 +2217,13 @@ uint64_t FilterLoadMessage::getSize() const
     return VarInt(filter.size()).getSize() + filter.size() + 9; 
 }
 
-uchar_vector FilterLoadMessage::getSerialized() const
+void FilterLoadMessage::serialize(DataWriter& writer) const
 {
-    uchar_vector rval = VarInt(filter.size()).getSerialized();
-    rval += filter;
-    rval += uint_to_vch(nHashFuncs, _BIG_ENDIAN);
-    rval += uint_to_vch(nTweak, _BIG_ENDIAN);
-    rval.push_back(nFlags);
-    return rval;
+    writer.writeVarInt(filter.size());
+    writer.writeBytes(filter);
+    writer.writeUint(nHashFuncs);
+    writer.writeUint(nTweak);
+    writer.writeUint(nFlags);
 }
 
 void FilterLoadMessage::setSerialized(const uchar_vector& bytes)
@@ -2033,9 +2293,9 @@ PingMessage::PingMessage()
     nonce = 0; // TODO: set to random value
 }
 
-uchar_vector PingMessage::getSerialized() const
+void PingMessage::serialize(DataWriter& writer) const
 {
-    return uint_to_vch(nonce, _BIG_ENDIAN);
+    writer.writeUint(nonce);
 }
 
 void PingMessage::setSerialized(const uchar_vector& bytes)
@@ -2061,9 +2321,9 @@ std::string PingMessage::toIndentedString(uint spaces) const
 //
 // class PongMessage implementation
 //
-uchar_vector PongMessage::getSerialized() const
+void PongMessage::serialize(DataWriter& writer) const
 {
-    return uint_to_vch(nonce, _BIG_ENDIAN);
+    writer.writeUint(nonce);
 }
 
 void PongMessage::setSerialized(const uchar_vector& bytes)
@@ -25,10 +25,12 @@
 #pragma once
 
 #include "hash.h"
+#include "hashtypes.h"
 #include "IPv6.h"
 #include "MerkleTree.h"
 
 #include "BigInt.h"
+#include "uint256.h"
 
 #include <stdutils/uchar_vector.h>
 
@@ -41,6 +43,7 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <sstream>
+#include <stdexcept>
 #include <time.h>
 
 void SetAddressVersion(unsigned char version);
@@ -92,6 +95,106 @@ namespace Coin
 
 typedef std::function<uchar_vector(const uchar_vector&)> hashfunc_t;
 
+// Read position in a serialized buffer. Structures parse their fields in place through a cursor
+// rather than copying the remainder of the buffer for every field. The buffer must outlive the cursor.
+class DataCursor
+{
+public:
+    DataCursor(const unsigned char* data, std::size_t size) : data_(data), size_(size), pos_(0) { }
+    explicit DataCursor(const uchar_vector& bytes) : data_(bytes.data()), size_(bytes.size()), pos_(0) { }
+
+    std::size_t size() const { return size_; }
+    std::size_t pos() const { return pos_; }
+    std::size_t remaining() const { return size_ - pos_; }
+    const unsigned char* ptr() const { return data_ + pos_; }
+
+    void require(std::size_t n, const char* error) const { if (remaining() < n) throw std::runtime_error(error); }
+    void skip(std::size_t n, const char* error) { require(n, error); pos_ += n; }
+
+    // Integers are serialized least significant byte first.
+    template<typename T>
+    T readUint(const char* error)
+    {
+        require(sizeof(T), error);
+        T n = 0;
+        for (std::size_t i = sizeof(T); i > 0; i--) { n = (n << 8) | data_[pos_ + i - 1]; }
+        pos_ += sizeof(T);
+        return n;
+    }
+
+    uint64_t readVarInt(const char* error);
+
+    void readBytes(unsigned char* dest, std::size_t n, const char* error);
+    void readBytes(uchar_vector& dest, std::size_t n, const char* error);
+    void readBytesReversed(unsigned char* dest, std::size_t n, const char* error);
+    void readBytesReversed(uchar_vector& dest, std::size_t n, const char* error);
+
+private:
+    const unsigned char* data_;
+    std::size_t size_;
+    std::size_t pos_;
+};
+
+// Output side of DataCursor. Structures write their fields straight into the sink, so nested fields
+// don't build temporary vectors and the result can go into a preallocated buffer or a hash.
+class DataWriter
+{
+public:
+    virtual ~DataWriter() { }
+
+    virtual void write(const unsigned char* data, std::size_t n) = 0;
+
+    // Integers are serialized least significant byte first.
+    template<typename T>
+    void writeUint(T n)
+    {
+        unsigned char bytes[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); i++) { bytes[i] = (unsigned char)(n >> (8 * i)); }
+        write(bytes, sizeof(T));
+    }
+
+    void writeVarInt(uint64_t n);
+
+    void writeBytes(const uchar_vector& bytes) { if (!bytes.empty()) write(&bytes[0], bytes.size()); }
+    void writeBytesReversed(const unsigned char* data, std::size_t n);
+    void writeBytesReversed(const uchar_vector& bytes) { if (!bytes.empty()) writeBytesReversed(&bytes[0], bytes.size()); }
+};
+
+// Writes into a caller provided buffer. Throws if the buffer is too small.
+class BufferWriter : public DataWriter
+{
+public:
+    BufferWriter(unsigned char* data, std::size_t size) : data_(data), size_(size), pos_(0) { }
+
+    std::size_t size() const { return size_; }
+    std::size_t pos() const { return pos_; }
+
+    void write(const unsigned char* data, std::size_t n)
+    {
+        if (size_ - pos_ < n) throw std::runtime_error("BufferWriter - buffer too small.");
+        if (n) memcpy(data_ + pos_, data, n);
+        pos_ += n;
+    }
+
+private:
+    unsigned char* data_;
+    std::size_t size_;
+    std::size_t pos_;
+};
+
+// Streams the serialization through double SHA-256 without materializing it.
+class HashWriter : public DataWriter
+{
+public:
+    void write(const unsigned char* data, std::size_t n) { ctx_.update(data, n); }
+
+    // Raw digest order, same as sha256_2(). Only call once.
+    hash256_t getHash();
+
+private:
+    CoinCrypto::sha256_ctx ctx_;
+};
+
 class CoinNodeStructure
 {
 public:
@@ -110,7 +213,9 @@ public:
 
     virtual uint32_t getChecksum() const; // 4 least significant bytes, big endian
 
-    virtual uchar_vector getSerialized() const = 0;
+    // Sized with getSize() and filled in with serialize(), so getSize() must be exact.
+    virtual uchar_vector getSerialized() const;
+    virtual void serialize(DataWriter& writer) const = 0;
     virtual void setSerialized(const uchar_vector& bytes) = 0;
 
     virtual std::string toString() const = 0;
@@ -136,8 +241,9 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const
     {
@@ -164,7 +270,7 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const { return value; }
@@ -190,7 +296,7 @@ public:
 	
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return hasTime ? 30 : 26; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string getName() const; 
@@ -212,8 +318,9 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return hasChecksum ? 24 : 20; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -238,14 +345,16 @@ public:
     CoinNodeMessage(const CoinNodeMessage& message) { this->setMessage(message.header.magic, message.pPayload); }
     CoinNodeMessage(uint32_t magic, CoinNodeStructure* pPayload) { this->setMessage(magic, pPayload); }
     CoinNodeMessage(const uchar_vector& bytes) { this->pPayload = NULL; this->setSerialized(bytes); }
+    explicit CoinNodeMessage(DataCursor& cursor) { this->pPayload = NULL; this->setSerialized(cursor); }
     ~CoinNodeMessage();
 
     void setMessage(uint32_t magic, CoinNodeStructure* pPayload);
 
     const char* getCommand() const { return this->pPayload->getCommand(); }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -285,7 +394,7 @@ public:
 
     const char* getCommand() const { return "version"; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -313,7 +422,7 @@ public:
     const char* getCommand() const { return this->command.c_str(); }
     uint64_t getSize() const { return 0; }
 
-    uchar_vector getSerialized() const { uchar_vector rval; return rval; }
+    void serialize(DataWriter& /*writer*/) const { }
     void setSerialized(const uchar_vector& /*bytes*/) { }
 
     std::string toString() const { return ""; }
@@ -328,7 +437,7 @@ public:
     const char* getCommand() const { return "verack"; }
     uint64_t getSize() const { return 0; }
 
-    uchar_vector getSerialized() const { uchar_vector rval; return rval; }
+    void serialize(DataWriter& /*writer*/) const { }
     void setSerialized(const uchar_vector& /*bytes*/) { }
 
     std::string toString() const { return ""; }
@@ -346,7 +455,7 @@ public:
     const char* getCommand() const { return "addr"; }
     uint64_t getSize() const { return VarInt(this->addrList.size()).getSize() + 30*this->addrList.size(); }
 
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -376,6 +485,11 @@ public:
         this->itemType = itemType;
         memcpy(this->hash, (unsigned char*)&hashBytes[0], 32);
     }
+    InventoryItem(uint32_t itemType, const hash256_t& hashBytes)
+    {
+        this->itemType = itemType;
+        memcpy(this->hash, hashBytes.data(), 32);
+    }
     InventoryItem(uint32_t itemType, const std::string& hashHex)
     {
         this->itemType = itemType;
@@ -386,10 +500,13 @@ public:
         memcpy(this->hash, &hashBytes[0], 32);
     }
 
+    hash256_t hash256() const { return hash256_t(hash); }
+
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 36; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -406,6 +523,7 @@ public:
     Inventory() { }
     Inventory(const std::vector<InventoryItem> items) { this->items = items; }
     Inventory(const uchar_vector& bytes) { this->setSerialized(bytes); }
+    explicit Inventory(DataCursor& cursor) { this->setSerialized(cursor); }
     Inventory(const Inventory& inv) { this->items = inv.getItems(); }
 
     void addItem(const InventoryItem& item) { (this->items).push_back(item); }
@@ -416,8 +534,9 @@ public:
 
     const char* getCommand() const { return "inv"; }
     uint64_t getSize() const { return VarInt(this->items.size()).getSize() + 36*this->items.size(); }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -498,7 +617,7 @@ public:
 
     const char* getCommand() const { return "getblocks"; }
     uint64_t getSize() const { return VarInt(this->blockLocatorHashes.size()).getSize() + 32*this->blockLocatorHashes.size() + 36; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -532,7 +651,7 @@ public:
 
     const char* getCommand() const { return "getheaders"; }
     uint64_t getSize() const { return VarInt(this->blockLocatorHashes.size()).getSize() + 32*this->blockLocatorHashes.size() + 36; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -561,8 +680,9 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 36; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string getTxHash() const { return uchar_vector(this->hash, 32).getHex(); }
 	
@@ -588,9 +708,12 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return VarInt(this->scriptSig.size()).getSize() + scriptSig.size() + 40; } // 40 = previousOut + sequence
-    uchar_vector getSerialized() const { return this->getSerialized(true); }
+    uchar_vector getSerialized() const { return CoinNodeStructure::getSerialized(); }
     uchar_vector getSerialized(bool includeScriptSigLength) const;
+    void serialize(DataWriter& writer) const { this->serialize(writer, true); }
+    void serialize(DataWriter& writer, bool includeScriptSigLength) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     uchar_vector getOutpointHash() const { return uchar_vector(this->previousOut.hash, 32); }
     uint32_t getOutpointIndex() const { return this->previousOut.index; }
@@ -616,8 +739,9 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return VarInt(this->scriptPubKey.size()).getSize() + scriptPubKey.size() + 8; } // 8 = sizeof(value)
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string getAddress() const;
     std::string toString() const;
@@ -635,17 +759,22 @@ public:
 
     Transaction() { this->version = 1; lockTime = 0; }
     Transaction(const uchar_vector& bytes) { this->setSerialized(bytes); }
+    explicit Transaction(DataCursor& cursor) { this->setSerialized(cursor); }
     Transaction(const std::string& hex);
     Transaction(const Transaction& tx)
         : version(tx.version), inputs(tx.inputs), outputs(tx.outputs), lockTime(tx.lockTime) { }
 
     const uchar_vector& hash() const { return getHashLittleEndian(); }
+    hash256_t hash256() const; // same byte order as hash()
 
     const char* getCommand() const { return "tx"; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const { return this->getSerialized(true); }
+    uchar_vector getSerialized() const { return CoinNodeStructure::getSerialized(); }
     uchar_vector getSerialized(bool includeScriptSigLength) const;
+    void serialize(DataWriter& writer) const { this->serialize(writer, true); }
+    void serialize(DataWriter& writer, bool includeScriptSigLength) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -666,6 +795,26 @@ public:
     uchar_vector getHashWithAppendedCode(uint32_t code) const; // in little endian
 };
 
+// Computes the legacy signing hash of each input without reserializing the transaction for every one.
+// The transaction is serialized once with empty scriptSigs and the SHA-256 state is saved at the start
+// of every input's script, so each hash only streams the script code and the rest of the serialization.
+class SigHashCache
+{
+public:
+    explicit SigHashCache(const Transaction& tx);
+
+    // Same result as getHashWithAppendedCode(code) on a copy of the transaction in which input index
+    // has scriptCode as its scriptSig and all other scriptSigs are empty.
+    uchar_vector getHash(uint index, const uchar_vector& scriptCode, uint32_t code) const;
+
+    uint getInputCount() const { return scriptOffsets_.size(); }
+
+private:
+    uchar_vector skeleton_;
+    std::vector<uint64_t> scriptOffsets_; // offset of each input's script length byte
+    std::vector<CoinCrypto::sha256_ctx> midstates_;
+};
+
 class CoinBlock;
 class MerkleBlock;
 
@@ -694,6 +843,7 @@ public:
     }
 
     const uchar_vector& hash() const { return getHashLittleEndian(); }
+    hash256_t hash256() const; // same byte order as hash(), computed without allocating
     uint32_t version() const { return version_; }
     const uchar_vector&  prevBlockHash() const { return prevBlockHash_; }
     const uchar_vector& merkleRoot() const { return merkleRoot_; }
@@ -703,8 +853,9 @@ public:
 
     const char* getCommand() const { return ""; }
     uint64_t getSize() const { return 80; }
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -712,10 +863,11 @@ public:
     void nonce(uint32_t nonce) { nonce_ = nonce; isHashSet_ = false; isPOWHashSet_ = false; }
     void incrementNonce() { nonce_++; isHashSet_ = false; isPOWHashSet_ = false; }
 
-    const BigInt getTarget() const;
-    void setTarget(const BigInt& target);
+    const uint256 getTarget() const;
+    void setTarget(const uint256& target);
 
-    const BigInt getWork() const;
+    const uint256 getWork() const;
+    bool hasValidPOW() const { return uint256(getPOWHash()) <= getTarget(); }
 
     static void setHashFunc(hashfunc_t hashfunc) { hashfunc_ = hashfunc; }
     static void setPOWHashFunc(hashfunc_t hashfunc) { powhashfunc_ = hashfunc; }
@@ -726,6 +878,17 @@ public:
     const uchar_vector& getPOWHash() const;
     const uchar_vector& getPOWHashLittleEndian() const;
 
+    // For callers that hash many headers at once with CoinCrypto::sha256d_batch.
+    // setHash() takes the raw digest and is only valid while isHashFuncSha256d() holds.
+    static bool isHashFuncSha256d();
+    void setHash(const uchar_vector& hash) const;
+
+    // Computes the POW hashes of headers [begin, end) that do not have one yet. With scrypt
+    // the headers are hashed several at a time by scrypt_1024_1_1_256_batch, other POW hash
+    // functions are computed one header at a time.
+    static bool isPOWHashFuncScrypt();
+    static void setPOWHashes(const std::vector<CoinBlockHeader>& headers, std::size_t begin, std::size_t end);
+
 private:
     friend class CoinBlock;
     friend class MerkleBlock;
@@ -770,9 +933,11 @@ public:
         this->blockHeader = CoinBlockHeader(version, timestamp, bits, 0, prevBlockHash);
     }
     CoinBlock(const uchar_vector& bytes) { this->setSerialized(bytes); }
+    explicit CoinBlock(DataCursor& cursor) { this->setSerialized(cursor); }
     CoinBlock(const std::string& hex);
 
     const uchar_vector& hash() const { return blockHeader.getHashLittleEndian(); }
+    hash256_t hash256() const { return blockHeader.hash256(); }
     uint32_t version() const { return blockHeader.version(); }
     const uchar_vector& prevBlockHash() const { return blockHeader.prevBlockHash(); }
     const uchar_vector& merkleRoot() const { return blockHeader.merkleRoot(); }
@@ -780,13 +945,14 @@ public:
     uint32_t bits() const { return blockHeader.bits(); }
     uint32_t nonce() const { return blockHeader.nonce(); } 
 
-    const BigInt getTarget() const { return blockHeader.getTarget(); }
-    const BigInt getWork() const { return blockHeader.getWork(); }
+    const uint256 getTarget() const { return blockHeader.getTarget(); }
+    const uint256 getWork() const { return blockHeader.getWork(); }
     
     const char* getCommand() const { return "block"; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -821,8 +987,10 @@ public:
         : blockHeader(merkleBlock.blockHeader), nTxs(merkleBlock.nTxs), hashes(merkleBlock.hashes), flags(merkleBlock.flags) { }
     MerkleBlock(const PartialMerkleTree& merkleTree, uint32_t version, const uchar_vector& prevBlockHash, uint32_t timestamp, uint32_t bits, uint32_t nonce);
     explicit MerkleBlock(const uchar_vector& bytes) { setSerialized(bytes); }
+    explicit MerkleBlock(DataCursor& cursor) { setSerialized(cursor); }
 
     const uchar_vector& hash() const { return blockHeader.getHashLittleEndian(); }
+    hash256_t hash256() const { return blockHeader.hash256(); }
     uint32_t version() const { return blockHeader.version(); }
     const uchar_vector& prevBlockHash() const { return blockHeader.prevBlockHash(); }
     const uchar_vector& merkleRoot() const { return blockHeader.merkleRoot(); }
@@ -832,13 +1000,14 @@ public:
 
     PartialMerkleTree merkleTree() const;
 
-    const BigInt getTarget() const { return blockHeader.getTarget(); }
-    const BigInt getWork() const { return blockHeader.getWork(); }
+    const uint256 getTarget() const { return blockHeader.getTarget(); }
+    const uint256 getWork() const { return blockHeader.getWork(); }
 
     const char* getCommand() const { return "merkleblock"; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -855,12 +1024,14 @@ public:
     HeadersMessage() { }
     HeadersMessage(const std::vector<CoinBlockHeader>& headers) { this->headers = headers; }
     HeadersMessage(const uchar_vector& bytes) { this->setSerialized(bytes); }
+    explicit HeadersMessage(DataCursor& cursor) { this->setSerialized(cursor); }
     HeadersMessage(const std::string& hex);
 
     const char* getCommand() const { return "headers"; }
     uint64_t getSize() const;
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(DataCursor& cursor);
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -877,7 +1048,7 @@ public:
     const char* getCommand() const { return "getaddr"; }
     uint64_t getSize() const { return 0; }
 
-    uchar_vector getSerialized() const { uchar_vector rval; return rval; }
+    void serialize(DataWriter& /*writer*/) const { }
     void setSerialized(const uchar_vector& /*bytes*/) { }
 
     std::string toString() const { return ""; }
@@ -899,7 +1070,7 @@ public:
     const char* getCommand() const { return "filterload"; }
     uint64_t getSize() const;
 
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -917,7 +1088,7 @@ public:
     const char* getCommand() const { return "filteradd"; }
     uint64_t getSize() const { return VarInt(data.size()).getSize() + data.size(); }
 
-    uchar_vector getSerialized() const { return VarInt(data.size()).getSerialized() + data; }
+    void serialize(DataWriter& writer) const { writer.writeVarInt(data.size()); writer.writeBytes(data); }
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -941,7 +1112,7 @@ public:
     const char* getCommand() const { return "ping"; }
     uint64_t getSize() const { return sizeof(uint64_t); }
 
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -959,7 +1130,7 @@ public:
     const char* getCommand() const { return "pong"; }
     uint64_t getSize() const { return sizeof(uint64_t); }
 
-    uchar_vector getSerialized() const;
+    void serialize(DataWriter& writer) const;
     void setSerialized(const uchar_vector& bytes);
 
     std::string toString() const;
@@ -38,29 +38,34 @@ using namespace Coin;
 //
 uchar_vector MerkleTree::getRoot() const
 {
-    uchar_vector pairedHashes;
     if (hashes_.size() == 0)
-        return pairedHashes; // empty vector
+        return uchar_vector(); // empty vector
 
     if (hashes_.size() == 1)
         return hashes_[0];
 
-    MerkleTree tree;
-    for (unsigned int i = 0; i < hashes_.size(); i += 2) {
-        pairedHashes = hashes_[i];
-        if (i + 1 < hashes_.size()) {
-            // two different nodes
-            pairedHashes += hashes_[i + 1];
-        }
-        else {
-            // the same node with itself
-            pairedHashes += hashes_[i];
+    // Each level is hashed in one batch, in place: node pairs are laid out back to back and
+    // the parent of pair i overwrites slot i. An odd node at the end of a level is paired with itself.
+    std::vector<unsigned char> level;
+    level.reserve((hashes_.size() + 1) * 32);
+    for (auto& hash: hashes_) {
+        if (hash.size() != 32) throw std::runtime_error("MerkleTree::getRoot() - hashes must be 32 bytes.");
+        level.insert(level.end(), hash.begin(), hash.end());
+    }
+
+    std::size_t nNodes = hashes_.size();
+    while (nNodes > 1) {
+        if (nNodes & 1) {
+            level.resize((nNodes + 1) * 32);
+            std::copy(level.begin() + (nNodes - 1) * 32, level.begin() + nNodes * 32, level.begin() + nNodes * 32);
+            nNodes++;
         }
-        //pairedHashes.reverse();
-        tree.addHash(sha256_2(pairedHashes));
+
+        nNodes /= 2;
+        CoinCrypto::sha256d_batch(&level[0], &level[0], 64, nNodes);
     }
 
-    return tree.getRoot(); // recurse
+    return uchar_vector(level.begin(), level.begin() + 32);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -70,18 +75,18 @@ uchar_vector MerkleTree::getRoot() const
 std::string PartialMerkleTree::toIndentedString(bool showIndices) const
 {
     std::stringstream ss;
-    ss << "root: " << uchar_vector(root_).getReverse().getHex() << std::endl;
+    ss << "root: " << root_.getReverse().getHex() << std::endl;
     ss << "nTxs: " << nTxs_ << std::endl;
     ss << "merkleHashes: " << std::endl;
     unsigned int i = 0;
     for (auto& hash: merkleHashes_) {
-        ss << "  " << i++ << ": " << uchar_vector(hash).getReverse().getHex() << std::endl; 
+        ss << "  " << i++ << ": " << hash.getReverse().getHex() << std::endl; 
     }
 
     ss << "txHashes: " << std::endl;
     i = 0;
     for (auto& hash: txHashes_) {
-        ss << "  " << i++ << ": " << uchar_vector(hash).getReverse().getHex() << std::endl;
+        ss << "  " << i++ << ": " << hash.getReverse().getHex() << std::endl;
     }
 
     if (showIndices)
@@ -97,86 +102,97 @@ std::string PartialMerkleTree::toIndentedString(bool showIndices) const
     return ss.str();
 }
 
+// Levels of a tree are stored back to back in a flat array of hashes, one slot per node.
+static_assert(sizeof(hash256_t) == 32, "hash256_t slots must be contiguous 32 byte hashes.");
+
+// Number of nodes at the given height of a tree with nTxs leaves.
+static std::size_t levelWidth(unsigned int nTxs, unsigned int height)
+{
+    return ((std::size_t)nTxs + ((std::size_t)1 << height) - 1) >> height;
+}
+
+static unsigned int treeDepth(unsigned int nTxs)
+{
+    // Compute depth = ceiling(log_2(nTxs))
+    unsigned int depth = 0;
+    unsigned int n = nTxs - 1;
+    while (n > 0) { depth++; n >>= 1; }
+    return depth;
+}
+
+void PartialMerkleTree::addNode(const hash256_t& hash, bool bit)
+{
+    if (bit) {
+        txIndices_.push_back(merkleHashes_.size());
+        txHashes_.push_back(hash);
+    }
+    merkleHashes_.push_back(hash);
+}
+
 void PartialMerkleTree::setCompressed(unsigned int nTxs, const std::vector<uchar_vector>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot)
+{
+    std::vector<hash256_t> fixedHashes;
+    fixedHashes.reserve(hashes.size());
+    for (auto& hash: hashes) { fixedHashes.push_back(hash256_t(hash)); }
+    setCompressed(nTxs, fixedHashes, flags, merkleRoot);
+}
+
+void PartialMerkleTree::setCompressed(unsigned int nTxs, const std::vector<hash256_t>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot)
 {
     if (nTxs == 0) {
         throw std::runtime_error("PartialMerkleTree::setCompressed - Transaction count is zero.");
     }
 
-    // Compute depth = ceiling(log_2(leaves.size()))
     nTxs_ = nTxs;
-    unsigned int depth = 0;
-    unsigned int n = nTxs_ - 1;
-    while (n > 0) { depth++; n >>= 1; }
+    depth_ = treeDepth(nTxs);
+
+    std::vector<bool> flagBits(flags.size() * 8);
+    for (std::size_t i = 0; i < flagBits.size(); i++) {
+        flagBits[i] = (flags[i / 8] >> (i % 8)) & 0x01;
+    }
 
     merkleHashes_.clear();
+    merkleHashes_.reserve(hashes.size());
     txHashes_.clear();
+    txIndices_.clear();
     bits_.clear();
+    bits_.reserve(flagBits.size());
 
-    std::queue<uchar_vector> hashQueue;
-    for (auto& hash: hashes) { hashQueue.push(hash); }
-
-    std::queue<bool> bitQueue; 
-    for (auto& flag: flags) {
-        for (unsigned int i = 0; i < 8; i++) {
-            bool bit = ((flag >> i) & (unsigned char)0x01);
-            bitQueue.push(bit);
-        }
-    }
-
-    setCompressed(hashQueue, bitQueue, depth);
-    if (!merkleRoot.empty() && merkleRoot != getRootLittleEndian()) {
+    Cursor cursor(hashes, flagBits);
+    root_ = setCompressed(cursor, depth_);
+    if (!merkleRoot.empty() && root_.getReverse() != merkleRoot) {
         throw std::runtime_error("PartialMerkleTree::setCompressed - Invalid merkle root.");
     }
-
-    updateTxIndices();
 }
 
-void PartialMerkleTree::setCompressed(std::queue<uchar_vector>& hashQueue, std::queue<bool>& bitQueue, unsigned int depth)
+hash256_t PartialMerkleTree::setCompressed(Cursor& cursor, unsigned int depth)
 {
-    depth_ = depth;
-
-    if (hashQueue.empty() || bitQueue.empty()) {
+    if (cursor.hashPos >= cursor.hashes->size() || cursor.bitPos >= cursor.bits->size()) {
         throw std::runtime_error("PartialMerkleTree::setCompressed - Invalid compressed partial merkle tree data.");
     }
 
-    bool bit = bitQueue.front();
+    bool bit = (*cursor.bits)[cursor.bitPos++];
     bits_.push_back(bit);
-    bitQueue.pop();
 
     // We've reached a leaf of the partial merkle tree
     if (depth == 0 || !bit) {
-        root_ = hashQueue.front();
-        merkleHashes_.push_back(hashQueue.front());
-        if (bit) txHashes_.push_back(hashQueue.front());
-        hashQueue.pop();
-        return;
+        const hash256_t& hash = (*cursor.hashes)[cursor.hashPos++];
+        addNode(hash, bit);
+        return hash;
     }
 
     depth--;
 
-    // we're not at a leaf and bit is set so recurse
-    PartialMerkleTree leftSubtree;
-    leftSubtree.setCompressed(hashQueue, bitQueue, depth);
-
-    merkleHashes_.swap(leftSubtree.merkleHashes_);
-    txHashes_.swap(leftSubtree.txHashes_);
-    bits_.splice(bits_.end(), leftSubtree.bits_);
-
-    if (!hashQueue.empty()) {
-        // A right subtree also exists, so find it
-        PartialMerkleTree rightSubtree;
-        rightSubtree.setCompressed(hashQueue, bitQueue, depth);
+    // we're not at a leaf and bit is set so descend
+    hash256_t left = setCompressed(cursor, depth);
 
-        root_ = sha256_2(leftSubtree.root_ + rightSubtree.root_);
-        merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
-        txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
-        bits_.splice(bits_.end(), rightSubtree.bits_);
-    }
-    else {
-        // There's no right subtree - copy over this node's hash
-        root_ = sha256_2(leftSubtree.root_ + leftSubtree.root_);
+    // A right subtree exists if there are hashes left, otherwise this node's hash is paired with itself
+    if (!cursor.empty()) {
+        hash256_t right = setCompressed(cursor, depth);
+        return hash256(left, right);
     }
+
+    return hash256(left, left);
 }
 
 void PartialMerkleTree::setUncompressed(const std::vector<MerkleLeaf>& leaves)
@@ -186,75 +202,65 @@ void PartialMerkleTree::setUncompressed(const std::vector<MerkleLeaf>& leaves)
     }
 
     nTxs_ = leaves.size();
-    merkleHashes_.clear();
-    txHashes_.clear();
-    bits_.clear();
-
-    // Compute depth = ceiling(log_2(leaves.size()))
-    unsigned int depth = 0;
-    unsigned int n = nTxs_ - 1;
-    while (n > 0) { depth++; n >>= 1; }
-
-    setUncompressed(leaves, 0, leaves.size(), depth);
-
-    updateTxIndices();
-}
+    depth_ = treeDepth(nTxs_);
+
+    // Lay out every level of the full tree, leaves first, with a spare slot at the end of each
+    // level below the root so an odd node can be paired with itself. Each level is then hashed
+    // in one batch into the next.
+    std::size_t offsets[33];
+    offsets[0] = 0;
+    for (unsigned int height = 0; height < depth_; height++) {
+        std::size_t width = levelWidth(nTxs_, height);
+        offsets[height + 1] = offsets[height] + width + (width & 1);
+    }
 
-void PartialMerkleTree::setUncompressed(const std::vector<MerkleLeaf>& leaves, std::size_t begin, std::size_t end, unsigned int depth)
-{
-    depth_ = depth;
-/*
-    std::cout << std::endl << "----Creating PartialMerkleTree----" << std::endl;
-    std::cout << "depth: " << depth << std::endl;
-    std::cout << "leaves: " << std::endl;
-    for (unsigned int i = begin; i < end; i++) { std::cout << leaves[i].first.getHex() << ", " << (leaves[i].second ? "true" : "false") << std::endl; }
-*/
-    // We've hit a leaf. Store the hash and push a true bit if matched, a false bit if unmatched.
-    if (depth == 0) {
-        root_ = leaves[begin].first;
-        merkleHashes_.push_back(leaves[begin].first);
-        if (leaves[begin].second) txHashes_.push_back(leaves[begin].first);
-        bits_.push_back(leaves[begin].second);
-        return;
+    std::vector<hash256_t> nodes(offsets[depth_] + 1);
+    std::vector<bool> matched(nodes.size());
+    for (std::size_t i = 0; i < leaves.size(); i++) {
+        nodes[i] = hash256_t(leaves[i].first);
+        matched[i] = leaves[i].second;
     }
 
-    depth--; // Descend a level
+    for (unsigned int height = 0; height < depth_; height++) {
+        std::size_t width = levelWidth(nTxs_, height);
+        std::size_t offset = offsets[height];
+        if (width & 1) {
+            nodes[offset + width] = nodes[offset + width - 1];
+            matched[offset + width] = false;
+        }
 
-    // For a full tree, each subtree should have 2^depth leaves. The total number of leaves is end - begin.
-    // We want to partition the leaves into a left set that contains 2^depth elemments
-    // and a right set with the remainder. If we have 2^depth or fewer total leaves, we need to duplicate
-    // the subtree merkle hash to compute the merkle hash but we only include the hashes, txids, and bits one time.
-    std::size_t partitionPos = std::min((std::size_t)1 << depth, end - begin);
-    PartialMerkleTree leftSubtree;
-    leftSubtree.setUncompressed(leaves, begin, begin + partitionPos, depth);
+        std::size_t nextOffset = offsets[height + 1];
+        std::size_t nextWidth = levelWidth(nTxs_, height + 1);
+        CoinCrypto::sha256d_batch(nodes[nextOffset].data(), nodes[offset].data(), 64, nextWidth);
+        for (std::size_t i = 0; i < nextWidth; i++) {
+            matched[nextOffset + i] = matched[offset + 2 * i] || matched[offset + 2 * i + 1];
+        }
+    }
 
-    merkleHashes_.swap(leftSubtree.merkleHashes_);
-    txHashes_.swap(leftSubtree.txHashes_);
-    bits_.swap(leftSubtree.bits_);
+    merkleHashes_.clear();
+    txHashes_.clear();
+    txIndices_.clear();
+    bits_.clear();
 
-    if (begin + partitionPos < end) {
-        PartialMerkleTree rightSubtree;
-        rightSubtree.setUncompressed(leaves, begin + partitionPos, end, depth);
+    root_ = nodes[offsets[depth_]];
+    setUncompressed(nodes, matched, offsets, depth_, 0);
+}
 
-        root_ = sha256_2(leftSubtree.root_ + rightSubtree.root_);
+void PartialMerkleTree::setUncompressed(const std::vector<hash256_t>& nodes, const std::vector<bool>& matched, const std::size_t* offsets, unsigned int height, std::size_t pos)
+{
+    std::size_t i = offsets[height] + pos;
+    bits_.push_back(matched[i]);
 
-        merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
-        txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
-        bits_.splice(bits_.end(), rightSubtree.bits_);
-    }
-    else {
-        root_ = sha256_2(leftSubtree.root_ + leftSubtree.root_);
+    // Leaves and subtrees without matches are stored as a single hash.
+    if (height == 0 || !matched[i]) {
+        addNode(nodes[i], height == 0 && matched[i]);
+        return;
     }
 
-    if (txHashes_.empty()) {
-        // No matched leaves in subtree, so prepend the root to hashes and a false to bits
-        merkleHashes_.clear();
-        merkleHashes_.push_front(root_);
-        bits_.clear();
-        bits_.push_front(false);     
-    }
-    else {
-        bits_.push_front(true);
+    height--;
+    setUncompressed(nodes, matched, offsets, height, 2 * pos);
+    if (2 * pos + 1 < levelWidth(nTxs_, height)) {
+        setUncompressed(nodes, matched, offsets, height, 2 * pos + 1);
     }
 }
 
@@ -269,70 +275,52 @@ void PartialMerkleTree::merge(const PartialMerkleTree& other)
     if (root_ != other.root_)
         throw std::runtime_error("PartialMerkleTree::merge - root does not match.");
 
-    std::queue<uchar_vector> hashQueue1;
-    for (auto& hash: merkleHashes_) { hashQueue1.push(hash); }
-    std::queue<bool> bitQueue1;
-    for (auto& bit: bits_) { bitQueue1.push(bit); }
-
-    std::queue<uchar_vector> hashQueue2;
-    for (auto& hash: other.merkleHashes_) { hashQueue2.push(hash); }
-    std::queue<bool> bitQueue2;
-    for (auto& bit: other.bits_) { bitQueue2.push(bit); }
+    // Our own hashes and bits are moved out and read from while the merged tree is built.
+    std::vector<hash256_t> merkleHashes;
+    merkleHashes.swap(merkleHashes_);
+    std::vector<bool> bits;
+    bits.swap(bits_);
 
-    merkleHashes_.clear();
     txHashes_.clear();
-    bits_.clear();
-
-    merge(hashQueue1, hashQueue2, bitQueue1, bitQueue2, depth_);
+    txIndices_.clear();
 
-    updateTxIndices();
+    Cursor cursor1(merkleHashes, bits);
+    Cursor cursor2(other.merkleHashes_, other.bits_);
+    merge(&cursor1, &cursor2, depth_);
 }
 
-void PartialMerkleTree::merge(std::queue<uchar_vector>& hashQueue1, std::queue<uchar_vector>& hashQueue2, std::queue<bool>& bitQueue1, std::queue<bool>& bitQueue2, unsigned int depth)
+void PartialMerkleTree::merge(Cursor* cursor1, Cursor* cursor2, unsigned int depth)
 {
-    if (hashQueue1.empty())
-    {
-        hashQueue1.swap(hashQueue2);
-        bitQueue1.swap(bitQueue2);
-    }
+    if (cursor1->empty()) std::swap(cursor1, cursor2);
 
-    if (hashQueue2.empty())
+    if (cursor2->empty())
     {
-        if (hashQueue1.empty()) return;
-
-        PartialMerkleTree tree;
-        tree.setCompressed(hashQueue1, bitQueue1, depth);
-
-        merkleHashes_.splice(merkleHashes_.end(), tree.merkleHashes_);
-        txHashes_.splice(txHashes_.end(), tree.txHashes_);
-        bits_.splice(bits_.end(), tree.bits_);
+        if (cursor1->empty()) return;
+        setCompressed(*cursor1, depth);
         return;
     }
 
-    bool bit1 = bitQueue1.front();
-    bool bit2 = bitQueue2.front();
-    bool hasMatch = (bit1 || bit2);
+    if (cursor1->bitPos >= cursor1->bits->size() || cursor2->bitPos >= cursor2->bits->size())
+        throw std::runtime_error("PartialMerkleTree::merge - Invalid compressed partial merkle tree data.");
 
-    bitQueue1.pop();
-    bitQueue2.pop();
+    bool bit1 = (*cursor1->bits)[cursor1->bitPos++];
+    bool bit2 = (*cursor2->bits)[cursor2->bitPos++];
+    bool hasMatch = (bit1 || bit2);
 
     // We've reached a leaf of the partial merkle tree
     if (depth == 0 || !hasMatch)
     {
-        if (hashQueue1.front() != hashQueue2.front())
+        const hash256_t& hash1 = (*cursor1->hashes)[cursor1->hashPos++];
+        const hash256_t& hash2 = (*cursor2->hashes)[cursor2->hashPos++];
+        if (hash1 != hash2)
         {
             std::stringstream error;
-            error << "PartialMerkleTree::merge - leaves do not match: " << hashQueue1.front().getReverse().getHex() << ", " << hashQueue2.front().getReverse().getHex() << std::endl;
+            error << "PartialMerkleTree::merge - leaves do not match: " << hash1.getReverse().getHex() << ", " << hash2.getReverse().getHex() << std::endl;
             throw std::runtime_error(error.str());
         }
 
-        merkleHashes_.push_back(hashQueue1.front());
-        std::cout << hashQueue1.front().getReverse().getHex() << std::endl;
-        if (hasMatch) { txHashes_.push_back(hashQueue1.front()); }
+        addNode(hash1, hasMatch);
         bits_.push_back(hasMatch);
-
-        hashQueue1.pop();
-        hashQueue2.pop();
         return;
     }
 
@@ -342,50 +330,25 @@ void PartialMerkleTree::merge(std::queue<uchar_vector>& hashQueue1, std::queue<u
     // Both trees continue down this branch.
     if (bit1 && bit2)
     {
-        merge(hashQueue1, hashQueue2, bitQueue1, bitQueue2, depth);
-        merge(hashQueue1, hashQueue2, bitQueue1, bitQueue2, depth);
+        merge(cursor1, cursor2, depth);
+        merge(cursor1, cursor2, depth);
         return;
     }
 
     // Only one tree continues down this branch. Swap them if it's the second.
-    if (bit2)
-    {
-        hashQueue1.swap(hashQueue2);
-        bitQueue1.swap(bitQueue2);
-    }
-
-    PartialMerkleTree leftSubtree;
-    leftSubtree.setCompressed(hashQueue1, bitQueue1, depth);
-
-    merkleHashes_.splice(merkleHashes_.end(), leftSubtree.merkleHashes_);
-    txHashes_.splice(txHashes_.end(), leftSubtree.txHashes_);
-    bits_.splice(bits_.end(), leftSubtree.bits_);
-
-    uchar_vector root;
-    if (!hashQueue1.empty())
-    {
-        PartialMerkleTree rightSubtree;
-        rightSubtree.setCompressed(hashQueue1, bitQueue1, depth);
+    if (bit2) std::swap(cursor1, cursor2);
 
-        root = sha256_2(leftSubtree.root_ + rightSubtree.root_);
-        merkleHashes_.splice(merkleHashes_.end(), rightSubtree.merkleHashes_);
-        txHashes_.splice(txHashes_.end(), rightSubtree.txHashes_);
-        bits_.splice(bits_.end(), rightSubtree.bits_);
-    }
-    else
-    {
-        root = sha256_2(leftSubtree.root_ + leftSubtree.root_);
-    }
+    hash256_t left = setCompressed(*cursor1, depth);
+    hash256_t root = cursor1->empty() ? hash256(left, left) : hash256(left, setCompressed(*cursor1, depth));
 
-    if (root != hashQueue2.front())
+    const hash256_t& hash2 = (*cursor2->hashes)[cursor2->hashPos++];
+    if (root != hash2)
     {
         std::stringstream error;
-        error << "PartialMerkleTree::merge - inner nodes do not match: " << root.getHex() << ", " << hashQueue2.front().getReverse().getHex();
+        error << "PartialMerkleTree::merge - inner nodes do not match: " << root.getHex() << ", " << hash2.getReverse().getHex();
         
         throw std::runtime_error(error.str());
     }
-
-    hashQueue2.pop();
 }
 
 uchar_vector PartialMerkleTree::getFlags() const
@@ -408,19 +371,6 @@ uchar_vector PartialMerkleTree::getFlags() const
     return flags;
 }
 
-void PartialMerkleTree::updateTxIndices()
-{
-    // TODO: optimize
-    std::set<uchar_vector> txHashesSet = getTxHashesSet();
-    txIndices_.clear();
-    unsigned int i = 0;
-    for (auto& hash: merkleHashes_)
-    {
-        if (txHashesSet.count(hash)) { txIndices_.push_back(i); } 
-        i++;
-    }
-}
-
 // For testing
 PartialMerkleTree Coin::randomPartialMerkleTree(const std::vector<uchar_vector>& txHashes, unsigned int nTxs)
 {
@@ -28,10 +28,9 @@
 
 #include <stdutils/uchar_vector.h>
 
-#include <list>
 #include <set>
-#include <queue>
 #include <sstream>
+#include <vector>
 
 namespace Coin
 {
@@ -59,81 +58,98 @@ private:
 class PartialMerkleTree
 {
 public:
-    PartialMerkleTree() { }
+    PartialMerkleTree() : nTxs_(0), depth_(0) { }
     PartialMerkleTree(unsigned int nTxs, const std::vector<uchar_vector>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot = uchar_vector()) { setCompressed(nTxs, hashes, flags, merkleRoot); }
+    PartialMerkleTree(unsigned int nTxs, const std::vector<hash256_t>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot = uchar_vector()) { setCompressed(nTxs, hashes, flags, merkleRoot); }
     PartialMerkleTree(const std::vector<MerkleLeaf>& leaves) { setUncompressed(leaves); }
 
+    // Hashes are in raw digest order, merkleRoot in little endian order as it appears in block headers.
     void setCompressed(unsigned int nTxs, const std::vector<uchar_vector>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot = uchar_vector());
+    void setCompressed(unsigned int nTxs, const std::vector<hash256_t>& hashes, const uchar_vector& flags, const uchar_vector& merkleRoot = uchar_vector());
     void setUncompressed(const std::vector<MerkleLeaf>& leaves);
 
     void merge(const PartialMerkleTree& other);
 
     unsigned int getNTxs() const { return nTxs_; }
     unsigned int getDepth() const { return depth_; }
-    const std::list<uchar_vector>& getMerkleHashes() const { return merkleHashes_; }
+    const std::vector<hash256_t>& getMerkleHashes() const { return merkleHashes_; }
     std::vector<uchar_vector> getMerkleHashesVector() const
     {
         std::vector<uchar_vector> rval;
-        for (auto& hash: merkleHashes_) { rval.push_back(hash); }
+        rval.reserve(merkleHashes_.size());
+        for (auto& hash: merkleHashes_) { rval.push_back(hash.bytes()); }
         return rval;
     }
 
-    const std::list<uchar_vector>& getTxHashes() const { return txHashes_; }
+    const std::vector<hash256_t>& getTxHashes() const { return txHashes_; }
     std::vector<uchar_vector> getTxHashesVector() const
     {
         std::vector<uchar_vector> rval;
-        for (auto& hash: txHashes_) { rval.push_back(hash); }
+        rval.reserve(txHashes_.size());
+        for (auto& hash: txHashes_) { rval.push_back(hash.bytes()); }
         return rval;
     }
     std::vector<uchar_vector> getTxHashesLittleEndianVector() const
     {
         std::vector<uchar_vector> rval;
-        for (auto& hash: txHashes_) { rval.push_back(uchar_vector(hash).getReverse()); }
+        rval.reserve(txHashes_.size());
+        for (auto& hash: txHashes_) { rval.push_back(hash.reversedBytes()); }
         return rval;
     }
 
     std::set<uchar_vector> getTxHashesSet() const
     {
         std::set<uchar_vector> rval;
-        for (auto& hash: txHashes_) { rval.insert(hash); }
+        for (auto& hash: txHashes_) { rval.insert(hash.bytes()); }
         return rval;
     }
     std::set<uchar_vector> getTxHashesLittleEndianSet() const
     {
         std::set<uchar_vector> rval;
-        for (auto& hash: txHashes_) { rval.insert(uchar_vector(hash).getReverse()); }
+        for (auto& hash: txHashes_) { rval.insert(hash.reversedBytes()); }
         return rval;
     }
 
-    const std::list<unsigned int>& getTxIndices() const { return txIndices_; }
-    std::vector<unsigned int> getTxIndicesVector() const
-    {
-        std::vector<unsigned int> rval;
-        for (auto& index: txIndices_) { rval.push_back(index); }
-        return rval;
-    }
+    // Positions of the matched tx hashes within getMerkleHashes().
+    const std::vector<unsigned int>& getTxIndices() const { return txIndices_; }
+    std::vector<unsigned int> getTxIndicesVector() const { return txIndices_; }
 
     uchar_vector getFlags() const;
 
-    const uchar_vector& getRoot() const { return root_; }
-    uchar_vector getRootLittleEndian() const { return uchar_vector(root_).getReverse(); }
+    const hash256_t& getRootHash() const { return root_; }
+    uchar_vector getRoot() const { return root_.bytes(); }
+    uchar_vector getRootLittleEndian() const { return root_.reversedBytes(); }
 
     std::string toIndentedString(bool showIndices = false) const;
 
 private:
     unsigned int nTxs_;
     unsigned int depth_;
-    std::list<uchar_vector> merkleHashes_;
-    std::list<uchar_vector> txHashes_;
-    std::list<unsigned int> txIndices_;
-    std::list<bool> bits_;
-    uchar_vector root_;
+    std::vector<hash256_t> merkleHashes_;
+    std::vector<hash256_t> txHashes_;
+    std::vector<unsigned int> txIndices_;
+    std::vector<bool> bits_;
+    hash256_t root_;
+
+    // Read position in the hashes and bits of a compressed tree.
+    struct Cursor
+    {
+        Cursor(const std::vector<hash256_t>& hashes, const std::vector<bool>& bits) : hashes(&hashes), bits(&bits), hashPos(0), bitPos(0) { }
+
+        bool empty() const { return hashPos >= hashes->size(); }
+
+        const std::vector<hash256_t>* hashes;
+        const std::vector<bool>* bits;
+        std::size_t hashPos;
+        std::size_t bitPos;
+    };
 
-    void setCompressed(std::queue<uchar_vector>& hashQueue, std::queue<bool>& bitQueue, unsigned int depth);
-    void setUncompressed(const std::vector<MerkleLeaf>& leaves, std::size_t begin, std::size_t end, unsigned int depth);
-    void merge(std::queue<uchar_vector>& hashQueue1, std::queue<uchar_vector>& hashQueue2, std::queue<bool>& bitQueue1, std::queue<bool>& bitQueue2, unsigned int depth);
+    // Each of these appends the nodes it visits to merkleHashes_, txHashes_, txIndices_ and bits_.
+    hash256_t setCompressed(Cursor& cursor, unsigned int depth);
+    void setUncompressed(const std::vector<hash256_t>& nodes, const std::vector<bool>& matched, const std::size_t* offsets, unsigned int height, std::size_t pos);
+    void merge(Cursor* cursor1, Cursor* cursor2, unsigned int depth);
 
-    void updateTxIndices();
+    void addNode(const hash256_t& hash, bool bit);
 };
 
 // For testing
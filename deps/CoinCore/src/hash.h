@@ -31,6 +31,8 @@
 
 #include <stdutils/uchar_vector.h>
 
+#include "hashtypes.h"
+#include "sha256.h"
 #include "hashblock.h" // for Hash9
 #include "scrypt/scrypt.h" // for scrypt_1024_1_1_256
 
@@ -38,26 +40,15 @@
 
 inline uchar_vector sha256(const uchar_vector& data)
 {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, &data[0], data.size());
-    SHA256_Final(hash, &sha256);
-    uchar_vector rval(hash, SHA256_DIGEST_LENGTH);
+    uchar_vector rval(32);
+    CoinCrypto::sha256(&rval[0], data.data(), data.size());
     return rval;
 }
 
 inline uchar_vector sha256_2(const uchar_vector& data)
 {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, &data[0], data.size());
-    SHA256_Final(hash, &sha256);
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, hash, SHA256_DIGEST_LENGTH);
-    SHA256_Final(hash, &sha256);
-    uchar_vector rval(hash, SHA256_DIGEST_LENGTH);
+    uchar_vector rval(32);
+    CoinCrypto::sha256d(&rval[0], data.data(), data.size());
     return rval;
 }
 
@@ -77,6 +68,40 @@ inline uchar_vector mdsha(const uchar_vector& data)
     return ripemd160(sha256(data));
 }
 
+// Fixed-size variants for raw buffers, which do not allocate. They have their own
+// names so &sha256_2 and friends still resolve for hashfunc_t.
+
+// Same as sha256_2()
+inline hash256_t hash256(const unsigned char* data, std::size_t len)
+{
+    hash256_t rval;
+    CoinCrypto::sha256d(rval.data(), data, len);
+    return rval;
+}
+
+// Parent of two merkle tree nodes
+inline hash256_t hash256(const hash256_t& left, const hash256_t& right)
+{
+    unsigned char pair[64];
+    memcpy(pair, left.data(), 32);
+    memcpy(pair + 32, right.data(), 32);
+    return hash256(pair, 64);
+}
+
+// Same as mdsha()
+inline hash160_t hash160(const unsigned char* data, std::size_t len)
+{
+    unsigned char sha[32];
+    CoinCrypto::sha256(sha, data, len);
+
+    hash160_t rval;
+    RIPEMD160_CTX ripemd160;
+    RIPEMD160_Init(&ripemd160);
+    RIPEMD160_Update(&ripemd160, sha, 32);
+    RIPEMD160_Final(rval.data(), &ripemd160);
+    return rval;
+}
+
 inline uchar_vector sha1(const uchar_vector& data)
 {
     unsigned char hash[SHA_DIGEST_LENGTH];
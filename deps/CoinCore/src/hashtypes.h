@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// hashtypes.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Fixed-size byte strings for hashes. Unlike bytes_t they keep their
+// bytes inline, so they can be copied, compared and used as map keys without
+// touching the heap.
+
+#ifndef __HASHTYPES_H___
+#define __HASHTYPES_H___
+
+#include "typedefs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+template<std::size_t N>
+class fixed_bytes_t
+{
+public:
+    static const std::size_t SIZE = N;
+
+    fixed_bytes_t() { memset(bytes_, 0, N); }
+    explicit fixed_bytes_t(const unsigned char* bytes) { memcpy(bytes_, bytes, N); }
+    explicit fixed_bytes_t(const bytes_t& bytes)
+    {
+        if (bytes.size() != N) throw std::runtime_error("fixed_bytes_t - invalid length.");
+        memcpy(bytes_, &bytes[0], N);
+    }
+
+    static fixed_bytes_t fromReversed(const unsigned char* bytes)
+    {
+        fixed_bytes_t rval;
+        std::reverse_copy(bytes, bytes + N, rval.bytes_);
+        return rval;
+    }
+
+    std::size_t size() const { return N; }
+    unsigned char* data() { return bytes_; }
+    const unsigned char* data() const { return bytes_; }
+    unsigned char* begin() { return bytes_; }
+    unsigned char* end() { return bytes_ + N; }
+    const unsigned char* begin() const { return bytes_; }
+    const unsigned char* end() const { return bytes_ + N; }
+    unsigned char& operator[](std::size_t i) { return bytes_[i]; }
+    const unsigned char& operator[](std::size_t i) const { return bytes_[i]; }
+
+    bool isZero() const
+    {
+        for (std::size_t i = 0; i < N; i++) { if (bytes_[i]) return false; }
+        return true;
+    }
+
+    // The byte order used on the wire is the reverse of the one used for display.
+    fixed_bytes_t getReverse() const { return fromReversed(bytes_); }
+    void reverse() { std::reverse(bytes_, bytes_ + N); }
+
+    bytes_t bytes() const { return bytes_t(bytes_, bytes_ + N); }
+    bytes_t reversedBytes() const { return bytes_t(std::reverse_iterator<const unsigned char*>(end()), std::reverse_iterator<const unsigned char*>(begin())); }
+
+    std::string getHex() const
+    {
+        static const char hexdigits[] = "0123456789abcdef";
+        std::string hex(2 * N, '0');
+        for (std::size_t i = 0; i < N; i++)
+        {
+            hex[2 * i] = hexdigits[bytes_[i] >> 4];
+            hex[2 * i + 1] = hexdigits[bytes_[i] & 0x0f];
+        }
+        return hex;
+    }
+
+    bool operator==(const fixed_bytes_t& rhs) const { return memcmp(bytes_, rhs.bytes_, N) == 0; }
+    bool operator!=(const fixed_bytes_t& rhs) const { return memcmp(bytes_, rhs.bytes_, N) != 0; }
+    bool operator<(const fixed_bytes_t& rhs) const { return memcmp(bytes_, rhs.bytes_, N) < 0; }
+
+    // Comparisons against variable length bytes are false unless the length matches.
+    bool operator==(const bytes_t& rhs) const { return rhs.size() == N && memcmp(bytes_, &rhs[0], N) == 0; }
+    bool operator!=(const bytes_t& rhs) const { return !(*this == rhs); }
+
+private:
+    unsigned char bytes_[N];
+};
+
+typedef fixed_bytes_t<32> hash256_t;
+typedef fixed_bytes_t<20> hash160_t;
+
+namespace std
+{
+    // Hashes are already uniformly distributed, so any few of their bytes make a good hash.
+    template<std::size_t N>
+    struct hash<fixed_bytes_t<N>>
+    {
+        std::size_t operator()(const fixed_bytes_t<N>& key) const
+        {
+            std::size_t rval;
+            memcpy(&rval, key.data() + N - sizeof(rval), sizeof(rval));
+            return rval;
+        }
+    };
+}
+
+#endif // __HASHTYPES_H__
@@ -27,10 +27,13 @@
 
 #include "hash.h"
 #include "secp256k1.h"
+#include "secp256k1_group.h"
 #include "BigInt.h"
 
 #include <stdutils/uchar_vector.h>
 
+#include <openssl/crypto.h>
+
 #include <sstream>
 #include <stdexcept>
 
@@ -70,7 +73,11 @@ HDKeychain::HDKeychain(const bytes_t& key, const bytes_t& chain_code, uint32_t c
     else if (key_.size() == 33) {
         // key is public
         try {
+#ifdef SECP256K1_GROUP_NATIVE
+            secp256k1_affine K(key_);
+#else
             secp256k1_point K(key_);
+#endif
         }
         catch (...) {
             throw std::runtime_error("Invalid key.");
@@ -115,7 +122,7 @@ HDKeychain::HDKeychain(const HDKeychain& source)
     child_num_ = source.child_num_;
     chain_code_ = source.chain_code_;
     key_ = source.key_;
-    updatePubkey();
+    pubkey_ = source.pubkey_;
 }
 
 HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
@@ -128,11 +135,21 @@ HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
         child_num_ = rhs.child_num_;
         chain_code_ = rhs.chain_code_;
         key_ = rhs.key_;
-        updatePubkey();
+        pubkey_ = rhs.pubkey_;
     }
     return *this;
 }
 
+void HDKeychain::wipe()
+{
+    OPENSSL_cleanse(key_.data(), key_.size());
+    OPENSSL_cleanse(chain_code_.data(), chain_code_.size());
+    key_.clear();
+    chain_code_.clear();
+    pubkey_.clear();
+    valid_ = false;
+}
+
 bool HDKeychain::operator==(const HDKeychain& rhs) const
 {
     return (valid_ && rhs.valid_ &&
@@ -267,12 +284,20 @@ HDKeychain HDKeychain::getChild(uint32_t i) const
         child.updatePubkey();
     }
     else {
+#ifdef SECP256K1_GROUP_NATIVE
+        // Il*G comes from the precomputed generator tables of the shared context.
+        bytes_t child_pubkey = secp256k1_context::get().generator_mul_add(left32, secp256k1_affine(pubkey_));
+        if (child_pubkey.empty()) throw InvalidHDKeychainException();
+
+        child.key_ = child.pubkey_ = child_pubkey;
+#else
         secp256k1_point K;
         K.bytes(pubkey_);
         K.generator_mul(left32);
         if (K.is_at_infinity()) throw InvalidHDKeychainException();
 
         child.key_ = child.pubkey_ = K.bytes();
+#endif
     }
 
     child.version_ = version_; 
@@ -79,6 +79,9 @@ public:
 
     HDKeychain& operator=(const HDKeychain& rhs);    
 
+    // Overwrites the key and chain code in place, e.g. before a cached private node is dropped.
+    void wipe();
+
     explicit operator bool() const { return valid_; }
 
 
@@ -33,6 +33,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <openssl/sha.h>
+#include <new>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCRYPT_X86_KERNELS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 static inline uint32_t be32dec(const void *pp)
 {
@@ -321,3 +328,269 @@ void scrypt_1024_1_1_256_(const char *input, char *output)
         scrypt_1024_1_1_256_sp_generic(input, output, scratchpad);
 #endif
 }
+
+
+/*
+ * Multi-lane scrypt for checking many block headers at once.
+ *
+ * The SIMD kernels are word-sliced: vector register k holds word k of the
+ * salsa20/8 state of every lane, so one instruction advances all the lanes.
+ * The scratchpad uses the same layout, V[(i * 32 + k) * lanes + lane], and
+ * the data dependent reads of the second loop gather each lane's word from
+ * its own row.
+ */
+#define SALSA8_DOUBLE_ROUND(QR) \
+	do { \
+		/* Operate on columns. */ \
+		QR( 4,  0, 12,  7);  QR( 9,  5,  1,  7); \
+		QR(14, 10,  6,  7);  QR( 3, 15, 11,  7); \
+		QR( 8,  4,  0,  9);  QR(13,  9,  5,  9); \
+		QR( 2, 14, 10,  9);  QR( 7,  3, 15,  9); \
+		QR(12,  8,  4, 13);  QR( 1, 13,  9, 13); \
+		QR( 6,  2, 14, 13);  QR(11,  7,  3, 13); \
+		QR( 0, 12,  8, 18);  QR( 5,  1, 13, 18); \
+		QR(10,  6,  2, 18);  QR(15, 11,  7, 18); \
+		/* Operate on rows. */ \
+		QR( 1,  0,  3,  7);  QR( 6,  5,  4,  7); \
+		QR(11, 10,  9,  7);  QR(12, 15, 14,  7); \
+		QR( 2,  1,  0,  9);  QR( 7,  6,  5,  9); \
+		QR( 8, 11, 10,  9);  QR(13, 12, 15,  9); \
+		QR( 3,  2,  1, 13);  QR( 4,  7,  6, 13); \
+		QR( 9,  8, 11, 13);  QR(14, 13, 12, 13); \
+		QR( 0,  3,  2, 18);  QR( 5,  4,  7, 18); \
+		QR(10,  9,  8, 18);  QR(15, 14, 13, 18); \
+	} while (0)
+
+#ifdef SCRYPT_X86_KERNELS
+
+/*
+ * SSE2 kernel, four lanes
+ */
+#define SSE2_ROTL(a, b) _mm_or_si128(_mm_slli_epi32(a, b), _mm_srli_epi32(a, 32 - (b)))
+#define SSE2_QR(a, b, c, s) x[a] = _mm_xor_si128(x[a], SSE2_ROTL(_mm_add_epi32(x[b], x[c]), s))
+
+__attribute__((target("sse2")))
+static inline void xor_salsa8_sse2(__m128i B[16], const __m128i Bx[16])
+{
+	__m128i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm_xor_si128(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2)
+		SALSA8_DOUBLE_ROUND(SSE2_QR);
+	for (i = 0; i < 16; i++)
+		B[i] = _mm_add_epi32(B[i], x[i]);
+}
+
+__attribute__((target("sse2")))
+static void scrypt_core_sse2(uint32_t *X, void *scratchpad)
+{
+	__m128i *V = (__m128i *)scratchpad;
+	const uint32_t *V32 = (const uint32_t *)scratchpad;
+	__m128i x[32];
+	uint32_t j[4];
+	int i, k;
+
+	for (k = 0; k < 32; k++)
+		x[k] = _mm_loadu_si128((const __m128i *)&X[4 * k]);
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			_mm_store_si128(&V[i * 32 + k], x[k]);
+		xor_salsa8_sse2(&x[0], &x[16]);
+		xor_salsa8_sse2(&x[16], &x[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		_mm_storeu_si128((__m128i *)j, _mm_slli_epi32(_mm_and_si128(x[16], _mm_set1_epi32(1023)), 7));
+		for (k = 0; k < 32; k++)
+			x[k] = _mm_xor_si128(x[k], _mm_set_epi32(V32[j[3] + 4 * k + 3], V32[j[2] + 4 * k + 2],
+			                                          V32[j[1] + 4 * k + 1], V32[j[0] + 4 * k]));
+		xor_salsa8_sse2(&x[0], &x[16]);
+		xor_salsa8_sse2(&x[16], &x[0]);
+	}
+
+	for (k = 0; k < 32; k++)
+		_mm_storeu_si128((__m128i *)&X[4 * k], x[k]);
+}
+
+/*
+ * AVX2 kernel, eight lanes
+ */
+#define AVX2_ROTL(a, b) _mm256_or_si256(_mm256_slli_epi32(a, b), _mm256_srli_epi32(a, 32 - (b)))
+#define AVX2_QR(a, b, c, s) x[a] = _mm256_xor_si256(x[a], AVX2_ROTL(_mm256_add_epi32(x[b], x[c]), s))
+
+__attribute__((target("avx2")))
+static inline void xor_salsa8_avx2(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm256_xor_si256(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2)
+		SALSA8_DOUBLE_ROUND(AVX2_QR);
+	for (i = 0; i < 16; i++)
+		B[i] = _mm256_add_epi32(B[i], x[i]);
+}
+
+__attribute__((target("avx2")))
+static void scrypt_core_avx2(uint32_t *X, void *scratchpad)
+{
+	__m256i *V = (__m256i *)scratchpad;
+	__m256i x[32];
+	int i, k;
+
+	for (k = 0; k < 32; k++)
+		x[k] = _mm256_loadu_si256((const __m256i *)&X[8 * k]);
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			_mm256_store_si256(&V[i * 32 + k], x[k]);
+		xor_salsa8_avx2(&x[0], &x[16]);
+		xor_salsa8_avx2(&x[16], &x[0]);
+	}
+
+	/* Word index of each lane's row: row * 256 + lane, plus 8 * k per word. */
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	for (i = 0; i < 1024; i++) {
+		__m256i row = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(x[16], _mm256_set1_epi32(1023)), 8), lane);
+		for (k = 0; k < 32; k++)
+			x[k] = _mm256_xor_si256(x[k], _mm256_i32gather_epi32((const int *)V + 8 * k, row, 4));
+		xor_salsa8_avx2(&x[0], &x[16]);
+		xor_salsa8_avx2(&x[16], &x[0]);
+	}
+
+	for (k = 0; k < 32; k++)
+		_mm256_storeu_si256((__m256i *)&X[8 * k], x[k]);
+}
+
+static bool cpu_has_sse2()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+	return edx & (1 << 26);
+}
+
+static bool cpu_has_avx2()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+
+	/* The OS must save the ymm registers (OSXSAVE, AVX and XCR0 bits 1 and 2). */
+	if (!(ecx & (1 << 27)) || !(ecx & (1 << 28))) return false;
+	unsigned int xcr0_lo, xcr0_hi;
+	__asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & 6) != 6) return false;
+
+	if (__get_cpuid_max(0, NULL) < 7) return false;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return ebx & (1 << 5);
+}
+
+#endif /* SCRYPT_X86_KERNELS */
+
+/*
+ * Dispatch
+ */
+static scrypt_kernel_t& current_kernel()
+{
+	static scrypt_kernel_t kernel =
+	    scrypt_kernel_supported(SCRYPT_KERNEL_AVX2) ? SCRYPT_KERNEL_AVX2 :
+	    scrypt_kernel_supported(SCRYPT_KERNEL_SSE2) ? SCRYPT_KERNEL_SSE2 : SCRYPT_KERNEL_GENERIC;
+	return kernel;
+}
+
+const char *scrypt_kernel_name(scrypt_kernel_t kernel)
+{
+	switch (kernel) {
+	case SCRYPT_KERNEL_GENERIC:	return "generic";
+	case SCRYPT_KERNEL_SSE2:	return "sse2";
+	case SCRYPT_KERNEL_AVX2:	return "avx2";
+	default:			return "unknown";
+	}
+}
+
+bool scrypt_kernel_supported(scrypt_kernel_t kernel)
+{
+	switch (kernel) {
+	case SCRYPT_KERNEL_GENERIC:	return true;
+#ifdef SCRYPT_X86_KERNELS
+	case SCRYPT_KERNEL_SSE2:	return cpu_has_sse2();
+	case SCRYPT_KERNEL_AVX2:	return cpu_has_avx2();
+#endif
+	default:			return false;
+	}
+}
+
+scrypt_kernel_t scrypt_get_kernel()
+{
+	return current_kernel();
+}
+
+bool scrypt_set_kernel(scrypt_kernel_t kernel)
+{
+	if (!scrypt_kernel_supported(kernel)) return false;
+	current_kernel() = kernel;
+	return true;
+}
+
+/*
+ * Runs the PBKDF2 steps for each lane around a word-sliced core.
+ */
+static void scrypt_1024_1_1_256_lanes(const char *input, char *output, size_t lanes,
+    void (*core)(uint32_t *X, void *scratchpad), void *scratchpad)
+{
+	uint8_t B[128];
+	uint32_t X[32 * 8];
+	size_t l, k;
+
+	for (l = 0; l < lanes; l++) {
+		PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, (const uint8_t *)input + 80 * l, 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X[k * lanes + l] = le32dec(&B[4 * k]);
+	}
+
+	core(X, scratchpad);
+
+	for (l = 0; l < lanes; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X[k * lanes + l]);
+		PBKDF2_SHA256((const uint8_t *)input + 80 * l, 80, B, 128, 1, (uint8_t *)output + 32 * l, 32);
+	}
+}
+
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t count)
+{
+	if (count == 0) return;
+
+	/* One scratchpad for the widest kernel, 128 KiB per lane. */
+	char *scratchpad = (char *)malloc(8 * 131072 + 63);
+	if (!scratchpad) throw std::bad_alloc();
+	char *aligned = (char *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+#ifdef SCRYPT_X86_KERNELS
+	scrypt_kernel_t kernel = current_kernel();
+	if (kernel == SCRYPT_KERNEL_AVX2) {
+		for (; count >= 8; count -= 8) {
+			scrypt_1024_1_1_256_lanes(input, output, 8, &scrypt_core_avx2, aligned);
+			input += 8 * 80;
+			output += 8 * 32;
+		}
+	}
+	if (kernel == SCRYPT_KERNEL_AVX2 || kernel == SCRYPT_KERNEL_SSE2) {
+		for (; count >= 4; count -= 4) {
+			scrypt_1024_1_1_256_lanes(input, output, 4, &scrypt_core_sse2, aligned);
+			input += 4 * 80;
+			output += 4 * 32;
+		}
+	}
+#endif
+	for (; count > 0; count--) {
+		scrypt_1024_1_1_256_sp_generic(input, output, scratchpad);
+		input += 80;
+		output += 32;
+	}
+
+	free(scratchpad);
+}
@@ -7,6 +7,27 @@ static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 void scrypt_1024_1_1_256_(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
+/*
+ * Hashes count 80 byte inputs stored back to back and writes count 32 byte
+ * digests to output. Lanes of several inputs are run through the SIMD
+ * kernels at once, the remainder goes through the generic code.
+ */
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t count);
+
+enum scrypt_kernel_t
+{
+	SCRYPT_KERNEL_GENERIC,	/* one input at a time */
+	SCRYPT_KERNEL_SSE2,	/* four lanes */
+	SCRYPT_KERNEL_AVX2	/* eight lanes, then four lanes with SSE2 */
+};
+
+const char *scrypt_kernel_name(scrypt_kernel_t kernel);
+bool scrypt_kernel_supported(scrypt_kernel_t kernel);
+scrypt_kernel_t scrypt_get_kernel();
+
+/* Forces a batch kernel, e.g. for benchmarks. Returns false if the CPU does not support it. */
+bool scrypt_set_kernel(scrypt_kernel_t kernel);
+
 #if defined(USE_SSE2)
 extern void scrypt_detect_sse2(unsigned int cpuid_edx);
 void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
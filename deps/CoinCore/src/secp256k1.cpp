@@ -345,7 +345,7 @@ bool CoinCrypto::secp256k1_verify(const secp256k1_key& key, const bytes_t& data,
 
 bytes_t CoinCrypto::secp256k1_rfc6979_k(const secp256k1_key& key, const bytes_t& data)
 {
-    uchar_vector hash = sha256(data);
+    uchar_vector hash = ::sha256(data);
     uchar_vector v("0101010101010101010101010101010101010101010101010101010101010101");
     uchar_vector k("0000000000000000000000000000000000000000000000000000000000000000");
     uchar_vector privkey = key.getPrivKey();
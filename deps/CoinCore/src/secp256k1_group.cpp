@@ -0,0 +1,409 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// secp256k1_group.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "secp256k1_group.h"
+
+#ifdef SECP256K1_GROUP_NATIVE
+
+#include <stdexcept>
+
+using namespace CoinCrypto;
+
+typedef unsigned __int128 uint128_t;
+
+// p = 2^256 - P_COMPLEMENT
+static const uint64_t P[4] = { 0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64_t P_COMPLEMENT = 0x1000003D1ULL;
+
+static const uint64_t GENERATOR_X[4] = { 0x59F2815B16F81798ULL, 0x029BFCDB2DCE28D9ULL, 0x55A06295CE870B07ULL, 0x79BE667EF9DCBBACULL };
+static const uint64_t GENERATOR_Y[4] = { 0x9C47D08FFB10D4B8ULL, 0xFD17B448A6855419ULL, 0x5DA4FBFC0E1108A8ULL, 0x483ADA7726A3C465ULL };
+
+static inline bool geq_p(const uint64_t n[4])
+{
+    // p has all limbs but the lowest set, so n >= p only if the upper limbs are all ones.
+    return (n[3] & n[2] & n[1]) == 0xFFFFFFFFFFFFFFFFULL && n[0] >= P[0];
+}
+
+static inline void sub_p(uint64_t n[4])
+{
+    // n - p = n + P_COMPLEMENT mod 2^256
+    uint128_t acc = (uint128_t)n[0] + P_COMPLEMENT;
+    n[0] = (uint64_t)acc; acc >>= 64;
+    for (int i = 1; i < 4; i++)
+    {
+        acc += n[i];
+        n[i] = (uint64_t)acc; acc >>= 64;
+    }
+}
+
+bool secp256k1_fe::set_bytes(const unsigned char* bytes)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t limb = 0;
+        for (int j = 0; j < 8; j++) { limb = (limb << 8) | bytes[(3 - i) * 8 + j]; }
+        n[i] = limb;
+    }
+    return !geq_p(n);
+}
+
+void secp256k1_fe::get_bytes(unsigned char* bytes) const
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 8; j++) { bytes[(3 - i) * 8 + j] = (unsigned char)(n[i] >> (56 - j * 8)); }
+    }
+}
+
+secp256k1_fe secp256k1_fe::operator+(const secp256k1_fe& rhs) const
+{
+    secp256k1_fe r;
+    uint128_t acc = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        acc += (uint128_t)n[i] + rhs.n[i];
+        r.n[i] = (uint64_t)acc; acc >>= 64;
+    }
+
+    // A carry out means the sum is 2^256 + r, which is congruent to r + P_COMPLEMENT and less than p.
+    if (acc || geq_p(r.n)) { sub_p(r.n); }
+    return r;
+}
+
+secp256k1_fe secp256k1_fe::operator-(const secp256k1_fe& rhs) const
+{
+    secp256k1_fe r;
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint128_t d = (uint128_t)n[i] - rhs.n[i] - borrow;
+        r.n[i] = (uint64_t)d;
+        borrow = (uint64_t)(d >> 64) & 1;
+    }
+
+    if (borrow)
+    {
+        // r = a - b + 2^256, so subtract P_COMPLEMENT to get a - b + p.
+        uint64_t b = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint128_t d = (uint128_t)r.n[i] - (i == 0 ? P_COMPLEMENT : 0) - b;
+            r.n[i] = (uint64_t)d;
+            b = (uint64_t)(d >> 64) & 1;
+        }
+    }
+    return r;
+}
+
+secp256k1_fe secp256k1_fe::operator-() const
+{
+    return secp256k1_fe() - *this;
+}
+
+secp256k1_fe secp256k1_fe::operator*(const secp256k1_fe& rhs) const
+{
+    uint64_t t[8] = { 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        uint128_t acc = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            acc += (uint128_t)n[i] * rhs.n[j] + t[i + j];
+            t[i + j] = (uint64_t)acc; acc >>= 64;
+        }
+        t[i + 4] = (uint64_t)acc;
+    }
+
+    // Fold the high half back in using 2^256 = P_COMPLEMENT mod p.
+    secp256k1_fe r;
+    uint128_t acc = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        acc += (uint128_t)t[i + 4] * P_COMPLEMENT + t[i];
+        r.n[i] = (uint64_t)acc; acc >>= 64;
+    }
+
+    // At most 34 bits remain above 2^256.
+    acc = (uint128_t)(uint64_t)acc * P_COMPLEMENT + r.n[0];
+    r.n[0] = (uint64_t)acc; acc >>= 64;
+    for (int i = 1; i < 4; i++)
+    {
+        acc += r.n[i];
+        r.n[i] = (uint64_t)acc; acc >>= 64;
+    }
+
+    if (acc || geq_p(r.n)) { sub_p(r.n); }
+    return r;
+}
+
+static secp256k1_fe sqr_n(secp256k1_fe a, int n)
+{
+    while (n-- > 0) { a = a.sqr(); }
+    return a;
+}
+
+// a^(2^223 - 1), the common prefix of the addition chains for p - 2 and (p + 1)/4
+static secp256k1_fe pow_x223(const secp256k1_fe& a, secp256k1_fe& x2, secp256k1_fe& x22)
+{
+    x2 = a.sqr() * a;
+    secp256k1_fe x3 = x2.sqr() * a;
+    secp256k1_fe x6 = sqr_n(x3, 3) * x3;
+    secp256k1_fe x9 = sqr_n(x6, 3) * x3;
+    secp256k1_fe x11 = sqr_n(x9, 2) * x2;
+    x22 = sqr_n(x11, 11) * x11;
+    secp256k1_fe x44 = sqr_n(x22, 22) * x22;
+    secp256k1_fe x88 = sqr_n(x44, 44) * x44;
+    secp256k1_fe x176 = sqr_n(x88, 88) * x88;
+    secp256k1_fe x220 = sqr_n(x176, 44) * x44;
+    return sqr_n(x220, 3) * x3;
+}
+
+secp256k1_fe secp256k1_fe::inverse() const
+{
+    // a^(p - 2)
+    secp256k1_fe x2, x22;
+    secp256k1_fe t = sqr_n(pow_x223(*this, x2, x22), 23) * x22;
+    t = sqr_n(t, 5) * *this;
+    t = sqr_n(t, 3) * x2;
+    return sqr_n(t, 2) * *this;
+}
+
+bool secp256k1_fe::sqrt(secp256k1_fe& r) const
+{
+    // a^((p + 1)/4), which is a square root whenever one exists since p = 3 mod 4
+    secp256k1_fe x2, x22;
+    secp256k1_fe t = sqr_n(pow_x223(*this, x2, x22), 23) * x22;
+    t = sqr_n(t, 6) * x2;
+    r = sqr_n(t, 2);
+    return r.sqr() == *this;
+}
+
+static secp256k1_fe curve_rhs(const secp256k1_fe& x)
+{
+    // y^2 = x^3 + 7
+    return x.sqr() * x + secp256k1_fe(7);
+}
+
+
+/*
+ * secp256k1_affine
+*/
+secp256k1_affine::secp256k1_affine(const bytes_t& bytes)
+{
+    if (bytes.size() == 33 && (bytes[0] == 0x02 || bytes[0] == 0x03))
+    {
+        if (!x.set_bytes(&bytes[1])) throw std::runtime_error("secp256k1_affine - invalid x coordinate.");
+        if (!curve_rhs(x).sqrt(y)) throw std::runtime_error("secp256k1_affine - point is not on the curve.");
+        if (y.is_odd() != (bytes[0] == 0x03)) { y = -y; }
+    }
+    else if (bytes.size() == 65 && bytes[0] == 0x04)
+    {
+        if (!x.set_bytes(&bytes[1]) || !y.set_bytes(&bytes[33])) throw std::runtime_error("secp256k1_affine - invalid coordinates.");
+        if (y.sqr() != curve_rhs(x)) throw std::runtime_error("secp256k1_affine - point is not on the curve.");
+    }
+    else
+    {
+        throw std::runtime_error("secp256k1_affine - invalid encoding.");
+    }
+
+    infinity = false;
+}
+
+bytes_t secp256k1_affine::bytes(bool bCompressed) const
+{
+    if (infinity) throw std::runtime_error("secp256k1_affine::bytes() - point at infinity.");
+
+    bytes_t bytes(bCompressed ? 33 : 65);
+    x.get_bytes(&bytes[1]);
+    if (bCompressed)
+    {
+        bytes[0] = y.is_odd() ? 0x03 : 0x02;
+    }
+    else
+    {
+        bytes[0] = 0x04;
+        y.get_bytes(&bytes[33]);
+    }
+    return bytes;
+}
+
+
+/*
+ * secp256k1_jacobian
+*/
+void secp256k1_jacobian::double_point()
+{
+    if (infinity) return;
+    if (y.is_zero()) { infinity = true; return; }
+
+    // dbl-2009-l (a = 0)
+    secp256k1_fe A = x.sqr();
+    secp256k1_fe B = y.sqr();
+    secp256k1_fe C = B.sqr();
+    secp256k1_fe D = (x + B).sqr() - A - C; D = D + D;
+    secp256k1_fe E = A + A + A;
+    secp256k1_fe F = E.sqr();
+    secp256k1_fe C8 = C + C; C8 = C8 + C8; C8 = C8 + C8;
+
+    z = y * z; z = z + z;
+    x = F - D - D;
+    y = E * (D - x) - C8;
+}
+
+secp256k1_jacobian& secp256k1_jacobian::operator+=(const secp256k1_affine& rhs)
+{
+    if (rhs.infinity) return *this;
+    if (infinity)
+    {
+        *this = secp256k1_jacobian(rhs);
+        return *this;
+    }
+
+    // madd-2007-bl
+    secp256k1_fe Z1Z1 = z.sqr();
+    secp256k1_fe U2 = rhs.x * Z1Z1;
+    secp256k1_fe S2 = rhs.y * z * Z1Z1;
+    secp256k1_fe H = U2 - x;
+    secp256k1_fe r = S2 - y; r = r + r;
+
+    if (H.is_zero())
+    {
+        if (r.is_zero()) { double_point(); }
+        else             { infinity = true; }
+        return *this;
+    }
+
+    secp256k1_fe HH = H.sqr();
+    secp256k1_fe I = HH + HH; I = I + I;
+    secp256k1_fe J = H * I;
+    secp256k1_fe V = x * I;
+    secp256k1_fe YJ = y * J;
+
+    x = r.sqr() - J - V - V;
+    y = r * (V - x) - YJ - YJ;
+    z = (z + H).sqr() - Z1Z1 - HH;
+    return *this;
+}
+
+secp256k1_affine secp256k1_jacobian::affine() const
+{
+    if (infinity) return secp256k1_affine();
+
+    secp256k1_fe zinv = z.inverse();
+    secp256k1_fe zinv2 = zinv.sqr();
+    return secp256k1_affine(x * zinv2, y * zinv2 * zinv);
+}
+
+std::vector<secp256k1_affine> CoinCrypto::secp256k1_batch_affine(const std::vector<secp256k1_jacobian>& points)
+{
+    std::vector<secp256k1_affine> result(points.size());
+    if (points.empty()) return result;
+
+    // Montgomery's trick - invert the product of all z and peel the individual inverses off it.
+    std::vector<secp256k1_fe> products(points.size());
+    secp256k1_fe acc(1);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        if (!points[i].infinity) { acc = acc * points[i].z; }
+        products[i] = acc;
+    }
+
+    secp256k1_fe inv = acc.inverse();
+    for (size_t i = points.size(); i-- > 0;)
+    {
+        if (points[i].infinity) continue;
+
+        secp256k1_fe zinv = i > 0 ? inv * products[i - 1] : inv;
+        inv = inv * points[i].z;
+
+        secp256k1_fe zinv2 = zinv.sqr();
+        result[i] = secp256k1_affine(points[i].x * zinv2, points[i].y * zinv2 * zinv);
+    }
+    return result;
+}
+
+
+/*
+ * secp256k1_context
+*/
+const secp256k1_context& secp256k1_context::get()
+{
+    static const secp256k1_context context;
+    return context;
+}
+
+secp256k1_context::secp256k1_context()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        G.x.n[i] = GENERATOR_X[i];
+        G.y.n[i] = GENERATOR_Y[i];
+    }
+    G.infinity = false;
+
+    std::vector<secp256k1_jacobian> points;
+    points.reserve(WINDOWS * WINDOW_POINTS);
+
+    secp256k1_affine base = G;
+    for (unsigned int i = 0; i < WINDOWS; i++)
+    {
+        secp256k1_jacobian multiple;
+        for (unsigned int j = 0; j < WINDOW_POINTS; j++)
+        {
+            multiple += base;
+            points.push_back(multiple);
+        }
+
+        // 16*base = 15*base + base
+        multiple += base;
+        base = multiple.affine();
+    }
+
+    table = secp256k1_batch_affine(points);
+}
+
+secp256k1_jacobian secp256k1_context::generator_mul(const bytes_t& n) const
+{
+    if (n.size() != 32) throw std::runtime_error("secp256k1_context::generator_mul() - scalar must be 32 bytes.");
+
+    secp256k1_jacobian r;
+    for (unsigned int i = 0; i < WINDOWS; i++)
+    {
+        // Window i is the i-th least significant nibble.
+        unsigned char byte = n[31 - i / 2];
+        unsigned int nibble = (i & 1) ? (byte >> 4) : (byte & 0x0f);
+        if (nibble) { r += table[i * WINDOW_POINTS + nibble - 1]; }
+    }
+    return r;
+}
+
+bytes_t secp256k1_context::generator_mul_add(const bytes_t& n, const secp256k1_affine& K) const
+{
+    secp256k1_jacobian r = generator_mul(n);
+    r += K;
+    if (r.infinity) return bytes_t();
+    return r.affine().bytes();
+}
+
+#endif
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// secp256k1_group.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Native secp256k1 group arithmetic for public key operations. Field elements
+// use four 64-bit limbs so this backend is only available on compilers with
+// 128-bit integer support - SECP256K1_GROUP_NATIVE is defined when it is.
+//
+// None of this code runs in constant time. It must only be used with public
+// data such as public keys and public derivation tweaks - private key
+// operations stay with secp256k1_key.
+
+#pragma once
+
+#include "typedefs.h"
+
+#include <stdint.h>
+#include <vector>
+
+#if defined(__SIZEOF_INT128__)
+#define SECP256K1_GROUP_NATIVE
+#endif
+
+#ifdef SECP256K1_GROUP_NATIVE
+
+namespace CoinCrypto
+{
+
+// Element of the field mod p = 2^256 - 2^32 - 977, limbs least significant first and always fully reduced.
+class secp256k1_fe
+{
+public:
+    secp256k1_fe() : n{0, 0, 0, 0} { }
+    explicit secp256k1_fe(uint64_t v) : n{v, 0, 0, 0} { }
+
+    // Big endian, 32 bytes. Returns false if the value is not less than p.
+    bool set_bytes(const unsigned char* bytes);
+    void get_bytes(unsigned char* bytes) const;
+
+    bool is_zero() const { return !(n[0] | n[1] | n[2] | n[3]); }
+    bool is_odd() const { return n[0] & 1; }
+    bool operator==(const secp256k1_fe& rhs) const { return n[0] == rhs.n[0] && n[1] == rhs.n[1] && n[2] == rhs.n[2] && n[3] == rhs.n[3]; }
+    bool operator!=(const secp256k1_fe& rhs) const { return !(*this == rhs); }
+
+    secp256k1_fe operator+(const secp256k1_fe& rhs) const;
+    secp256k1_fe operator-(const secp256k1_fe& rhs) const;
+    secp256k1_fe operator*(const secp256k1_fe& rhs) const;
+    secp256k1_fe operator-() const;
+    secp256k1_fe sqr() const { return *this * *this; }
+    secp256k1_fe inverse() const;
+
+    // Sets r to a square root and returns true if one exists.
+    bool sqrt(secp256k1_fe& r) const;
+
+    uint64_t n[4];
+};
+
+class secp256k1_affine
+{
+public:
+    secp256k1_affine() : infinity(true) { }
+    secp256k1_affine(const secp256k1_fe& x_, const secp256k1_fe& y_) : x(x_), y(y_), infinity(false) { }
+
+    // Accepts compressed and uncompressed encodings. Throws std::runtime_error if the point is not on the curve.
+    explicit secp256k1_affine(const bytes_t& bytes);
+
+    bytes_t bytes(bool bCompressed = true) const;
+
+    secp256k1_fe x;
+    secp256k1_fe y;
+    bool infinity;
+};
+
+// Jacobian coordinates (X, Y, Z) represent the affine point (X/Z^2, Y/Z^3).
+class secp256k1_jacobian
+{
+public:
+    secp256k1_jacobian() : z(1), infinity(true) { }
+    explicit secp256k1_jacobian(const secp256k1_affine& p) : x(p.x), y(p.y), z(1), infinity(p.infinity) { }
+
+    void double_point();
+    secp256k1_jacobian& operator+=(const secp256k1_affine& rhs);
+
+    secp256k1_affine affine() const;
+
+    secp256k1_fe x;
+    secp256k1_fe y;
+    secp256k1_fe z;
+    bool infinity;
+};
+
+// Converts many points at once with a single field inversion.
+std::vector<secp256k1_affine> secp256k1_batch_affine(const std::vector<secp256k1_jacobian>& points);
+
+// Shared immutable curve context holding the fixed-base tables for the generator. The tables are
+// built on first use and never change afterwards, so the context can be used from any thread.
+class secp256k1_context
+{
+public:
+    static const secp256k1_context& get();
+
+    const secp256k1_affine& generator() const { return G; }
+
+    // n*G for a 32 byte big endian scalar
+    secp256k1_jacobian generator_mul(const bytes_t& n) const;
+
+    // n*G + K, compressed. Returns an empty vector if the sum is the point at infinity.
+    bytes_t generator_mul_add(const bytes_t& n, const secp256k1_affine& K) const;
+
+private:
+    secp256k1_context();
+
+    // table[i*15 + j - 1] = j*16^i*G for each of the 64 nibbles of the scalar
+    static const unsigned int WINDOWS = 64;
+    static const unsigned int WINDOW_POINTS = 15;
+
+    secp256k1_affine G;
+    std::vector<secp256k1_affine> table;
+};
+
+}
+
+#endif
@@ -0,0 +1,518 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sha256.h"
+
+#include <openssl/sha.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_X86_KERNELS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace CoinCrypto;
+
+static const uint32_t K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t INIT[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+static inline uint32_t read_be32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void write_be32(unsigned char* p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline uint32_t ror(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// Pads rest, the last len % 64 bytes of a message, into tail and returns the number of tail blocks.
+static size_t pad_rest(unsigned char tail[128], const unsigned char* rest, uint64_t len)
+{
+    size_t rem = len % 64;
+    size_t nblocks = rem < 56 ? 1 : 2;
+    if (rem) { memcpy(tail, rest, rem); }
+    tail[rem] = 0x80;
+    memset(tail + rem + 1, 0, nblocks * 64 - rem - 1 - 8);
+
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) { tail[nblocks * 64 - 1 - i] = (unsigned char)(bits >> (i * 8)); }
+    return nblocks;
+}
+
+// Pads the last len % 64 bytes of a message into tail and returns the number of tail blocks.
+static size_t pad_tail(unsigned char tail[128], const unsigned char* data, size_t len)
+{
+    return pad_rest(tail, data + len - len % 64, len);
+}
+
+typedef void (*transform_t)(uint32_t* s, const unsigned char* chunk, size_t blocks);
+
+static void hash_with(transform_t transform, unsigned char hash[32], const unsigned char* data, size_t len)
+{
+    uint32_t s[8];
+    memcpy(s, INIT, sizeof(s));
+    transform(s, data, len / 64);
+
+    unsigned char tail[128];
+    transform(s, tail, pad_tail(tail, data, len));
+
+    for (int i = 0; i < 8; i++) { write_be32(hash + i * 4, s[i]); }
+}
+
+static void hash2_with(transform_t transform, unsigned char hash[32], const unsigned char* data, size_t len)
+{
+    hash_with(transform, hash, data, len);
+    hash_with(transform, hash, hash, 32);
+}
+
+
+/*
+ * Scalar kernel
+*/
+static void transform_scalar(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--)
+    {
+        uint32_t w[64];
+        for (int t = 0; t < 16; t++) { w[t] = read_be32(chunk + t * 4); }
+        for (int t = 16; t < 64; t++)
+        {
+            uint32_t s0 = ror(w[t - 15], 7) ^ ror(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ror(w[t - 2], 17) ^ ror(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t++)
+        {
+            uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+            uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+        s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+        chunk += 64;
+    }
+}
+
+
+#ifdef SHA256_X86_KERNELS
+
+/*
+ * SHA-NI kernel
+*/
+#define SHANI_QUADROUND(m, k) \
+    do { \
+        __m128i msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)(K + k))); \
+        s1 = _mm_sha256rnds2_epu32(s1, s0, msg); \
+        s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e)); \
+    } while (0)
+
+#define SHANI_SHIFT_A(m0, m1)       m0 = _mm_sha256msg1_epu32(m0, m1)
+#define SHANI_SHIFT_C(m0, m1, m2)   m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1)
+#define SHANI_SHIFT_B(m0, m1, m2)   do { SHANI_SHIFT_C(m0, m1, m2); SHANI_SHIFT_A(m0, m1); } while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void transform_shani(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    // Rearrange the state into the ABEF/CDGH layout the instructions expect.
+    __m128i s0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+
+    while (blocks--)
+    {
+        __m128i so0 = s0;
+        __m128i so1 = s1;
+
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)chunk), mask);
+        SHANI_QUADROUND(m0, 0);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16)), mask);
+        SHANI_QUADROUND(m1, 4);
+        SHANI_SHIFT_A(m0, m1);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 32)), mask);
+        SHANI_QUADROUND(m2, 8);
+        SHANI_SHIFT_A(m1, m2);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 48)), mask);
+        SHANI_QUADROUND(m3, 12);
+        SHANI_SHIFT_B(m2, m3, m0);
+        SHANI_QUADROUND(m0, 16);
+        SHANI_SHIFT_B(m3, m0, m1);
+        SHANI_QUADROUND(m1, 20);
+        SHANI_SHIFT_B(m0, m1, m2);
+        SHANI_QUADROUND(m2, 24);
+        SHANI_SHIFT_B(m1, m2, m3);
+        SHANI_QUADROUND(m3, 28);
+        SHANI_SHIFT_B(m2, m3, m0);
+        SHANI_QUADROUND(m0, 32);
+        SHANI_SHIFT_B(m3, m0, m1);
+        SHANI_QUADROUND(m1, 36);
+        SHANI_SHIFT_B(m0, m1, m2);
+        SHANI_QUADROUND(m2, 40);
+        SHANI_SHIFT_B(m1, m2, m3);
+        SHANI_QUADROUND(m3, 44);
+        SHANI_SHIFT_B(m2, m3, m0);
+        SHANI_QUADROUND(m0, 48);
+        SHANI_SHIFT_B(m3, m0, m1);
+        SHANI_QUADROUND(m1, 52);
+        SHANI_SHIFT_C(m0, m1, m2);
+        SHANI_QUADROUND(m2, 56);
+        SHANI_SHIFT_C(m1, m2, m3);
+        SHANI_QUADROUND(m3, 60);
+
+        s0 = _mm_add_epi32(s0, so0);
+        s1 = _mm_add_epi32(s1, so1);
+        chunk += 64;
+    }
+
+    t1 = _mm_shuffle_epi32(s0, 0x1B);
+    t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+    _mm_storeu_si128((__m128i*)s, s0);
+    _mm_storeu_si128((__m128i*)(s + 4), s1);
+}
+
+
+/*
+ * AVX2 kernel - eight independent messages, one per 32-bit lane
+*/
+#define AVX2_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void transform_avx2_8(__m256i* s, const unsigned char* const* chunks)
+{
+    __m256i w[64];
+    for (int t = 0; t < 16; t++)
+    {
+        w[t] = _mm256_set_epi32(
+            read_be32(chunks[7] + t * 4), read_be32(chunks[6] + t * 4), read_be32(chunks[5] + t * 4), read_be32(chunks[4] + t * 4),
+            read_be32(chunks[3] + t * 4), read_be32(chunks[2] + t * 4), read_be32(chunks[1] + t * 4), read_be32(chunks[0] + t * 4));
+    }
+    for (int t = 16; t < 64; t++)
+    {
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(w[t - 15], 7), AVX2_ROR(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(w[t - 2], 17), AVX2_ROR(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+        w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < 64; t++)
+    {
+        __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(e, 6), AVX2_ROR(e, 11)), AVX2_ROR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, _mm256_set1_epi32(K[t]))), w[t]);
+        __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(a, 2), AVX2_ROR(a, 13)), AVX2_ROR(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = _mm256_add_epi32(S0, maj);
+        h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+        d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+    }
+
+    s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+    s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+    s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+    s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+}
+
+// Double SHA-256 of eight messages of len bytes stored back to back
+__attribute__((target("avx2")))
+static void hash2_avx2_8(unsigned char* hashes, const unsigned char* data, size_t len)
+{
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) { s[i] = _mm256_set1_epi32(INIT[i]); }
+
+    const unsigned char* chunks[8];
+    for (size_t b = 0; b < len / 64; b++)
+    {
+        for (int j = 0; j < 8; j++) { chunks[j] = data + j * len + b * 64; }
+        transform_avx2_8(s, chunks);
+    }
+
+    unsigned char tails[8][128];
+    size_t ntail = 0;
+    for (int j = 0; j < 8; j++) { ntail = pad_tail(tails[j], data + j * len, len); }
+    for (size_t b = 0; b < ntail; b++)
+    {
+        for (int j = 0; j < 8; j++) { chunks[j] = tails[j] + b * 64; }
+        transform_avx2_8(s, chunks);
+    }
+
+    // The second pass hashes each 32 byte digest, which always fits in one padded block.
+    uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) { _mm256_storeu_si256((__m256i*)words[i], s[i]); }
+    for (int j = 0; j < 8; j++)
+    {
+        for (int i = 0; i < 8; i++) { write_be32(tails[j] + i * 4, words[i][j]); }
+        tails[j][32] = 0x80;
+        memset(tails[j] + 33, 0, 31);
+        tails[j][62] = 0x01; // 256 bits
+        chunks[j] = tails[j];
+    }
+
+    for (int i = 0; i < 8; i++) { s[i] = _mm256_set1_epi32(INIT[i]); }
+    transform_avx2_8(s, chunks);
+
+    for (int i = 0; i < 8; i++) { _mm256_storeu_si256((__m256i*)words[i], s[i]); }
+    for (int j = 0; j < 8; j++)
+    {
+        for (int i = 0; i < 8; i++) { write_be32(hashes + j * 32 + i * 4, words[i][j]); }
+    }
+}
+
+
+/*
+ * CPU feature detection
+*/
+static bool cpu_has_avx2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+
+    // The OS must save the ymm registers (OSXSAVE, AVX and XCR0 bits 1 and 2).
+    if (!(ecx & (1 << 27)) || !(ecx & (1 << 28))) return false;
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) return false;
+
+    if (__get_cpuid_max(0, NULL) < 7) return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & (1 << 5);
+}
+
+static bool cpu_has_shani()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+
+    // SSSE3 and SSE4.1 are used for the byte shuffles and blends.
+    if (!(ecx & (1 << 9)) || !(ecx & (1 << 19))) return false;
+
+    if (__get_cpuid_max(0, NULL) < 7) return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & (1 << 29);
+}
+
+#endif // SHA256_X86_KERNELS
+
+
+/*
+ * Dispatch
+*/
+static sha256_kernel_t& current_kernel()
+{
+    static sha256_kernel_t kernel =
+        sha256_kernel_supported(SHA256_KERNEL_SHANI) ? SHA256_KERNEL_SHANI :
+        sha256_kernel_supported(SHA256_KERNEL_AVX2)  ? SHA256_KERNEL_AVX2 : SHA256_KERNEL_SCALAR;
+    return kernel;
+}
+
+static sha256_kernel_t& current_batch_kernel()
+{
+    static sha256_kernel_t kernel = sha256_kernel_supported(SHA256_KERNEL_AVX2) ? SHA256_KERNEL_AVX2 : current_kernel();
+    return kernel;
+}
+
+const char* CoinCrypto::sha256_kernel_name(sha256_kernel_t kernel)
+{
+    switch (kernel)
+    {
+    case SHA256_KERNEL_SCALAR:  return "scalar";
+    case SHA256_KERNEL_AVX2:    return "avx2";
+    case SHA256_KERNEL_SHANI:   return "shani";
+    default:                    return "unknown";
+    }
+}
+
+bool CoinCrypto::sha256_kernel_supported(sha256_kernel_t kernel)
+{
+    switch (kernel)
+    {
+    case SHA256_KERNEL_SCALAR:  return true;
+#ifdef SHA256_X86_KERNELS
+    case SHA256_KERNEL_AVX2:    return cpu_has_avx2();
+    case SHA256_KERNEL_SHANI:   return cpu_has_shani();
+#endif
+    default:                    return false;
+    }
+}
+
+sha256_kernel_t CoinCrypto::sha256_get_kernel()
+{
+    return current_kernel();
+}
+
+sha256_kernel_t CoinCrypto::sha256_get_batch_kernel()
+{
+    return current_batch_kernel();
+}
+
+bool CoinCrypto::sha256_set_kernel(sha256_kernel_t kernel)
+{
+    if (!sha256_kernel_supported(kernel)) return false;
+    current_kernel() = kernel;
+    current_batch_kernel() = kernel;
+    return true;
+}
+
+bool CoinCrypto::sha256_set_batch_kernel(sha256_kernel_t kernel)
+{
+    if (!sha256_kernel_supported(kernel)) return false;
+    current_batch_kernel() = kernel;
+    return true;
+}
+
+void CoinCrypto::sha256(unsigned char hash[32], const unsigned char* data, size_t len)
+{
+#ifdef SHA256_X86_KERNELS
+    if (current_kernel() == SHA256_KERNEL_SHANI)
+    {
+        hash_with(&transform_shani, hash, data, len);
+        return;
+    }
+#endif
+    SHA256(data, len, hash);
+}
+
+void CoinCrypto::sha256d(unsigned char hash[32], const unsigned char* data, size_t len)
+{
+    sha256(hash, data, len);
+    sha256(hash, hash, 32);
+}
+
+void CoinCrypto::sha256d_batch(unsigned char* hashes, const unsigned char* data, size_t len, size_t count)
+{
+    transform_t transform = &transform_scalar;
+
+#ifdef SHA256_X86_KERNELS
+    switch (current_batch_kernel())
+    {
+    case SHA256_KERNEL_SHANI:
+        transform = &transform_shani;
+        break;
+
+    case SHA256_KERNEL_AVX2:
+        for (; count >= 8; count -= 8)
+        {
+            hash2_avx2_8(hashes, data, len);
+            hashes += 8 * 32;
+            data += 8 * len;
+        }
+
+        // Fewer than eight left over, so hash them one at a time.
+        if (current_kernel() == SHA256_KERNEL_SHANI) { transform = &transform_shani; }
+        break;
+
+    default:
+        break;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++)
+    {
+        hash2_with(transform, hashes + i * 32, data + i * len, len);
+    }
+}
+
+
+/*
+ * Incremental hashing
+*/
+void sha256_ctx::init()
+{
+    shani_ = false;
+    len_ = 0;
+#ifdef SHA256_X86_KERNELS
+    if (current_kernel() == SHA256_KERNEL_SHANI)
+    {
+        shani_ = true;
+        memcpy(state_, INIT, sizeof(state_));
+        return;
+    }
+#endif
+    SHA256_Init(&openssl_);
+}
+
+void sha256_ctx::update(const unsigned char* data, size_t len)
+{
+#ifdef SHA256_X86_KERNELS
+    if (shani_)
+    {
+        size_t buffered = len_ % 64;
+        len_ += len;
+        if (buffered)
+        {
+            size_t n = len < 64 - buffered ? len : 64 - buffered;
+            memcpy(buffer_ + buffered, data, n);
+            data += n;
+            len -= n;
+            if (buffered + n < 64) return;
+            transform_shani(state_, buffer_, 1);
+        }
+
+        transform_shani(state_, data, len / 64);
+        if (len % 64) { memcpy(buffer_, data + len - len % 64, len % 64); }
+        return;
+    }
+#endif
+    SHA256_Update(&openssl_, data, len);
+}
+
+void sha256_ctx::final(unsigned char hash[32])
+{
+#ifdef SHA256_X86_KERNELS
+    if (shani_)
+    {
+        unsigned char tail[128];
+        transform_shani(state_, tail, pad_rest(tail, buffer_, len_));
+        for (int i = 0; i < 8; i++) { write_be32(hash + i * 4, state_[i]); }
+        return;
+    }
+#endif
+    SHA256_Final(hash, &openssl_);
+}
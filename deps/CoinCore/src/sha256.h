@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// SHA-256 backend for hash.h. The fastest kernel the CPU supports is picked at
+// runtime:
+//
+//   SHANI  - x86 SHA extensions, one message at a time
+//   AVX2   - eight messages in parallel, batches only
+//   SCALAR - portable C
+//
+// Single messages go through the SHA-NI kernel when it is selected and through
+// OpenSSL otherwise, since OpenSSL has its own tuned code for one buffer.
+// Batches have their own kernel, AVX2 when supported, since eight lanes beat
+// SHA-NI once there are at least eight messages.
+
+#pragma once
+
+#include <openssl/sha.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace CoinCrypto
+{
+
+enum sha256_kernel_t
+{
+    SHA256_KERNEL_SCALAR,
+    SHA256_KERNEL_AVX2,
+    SHA256_KERNEL_SHANI
+};
+
+const char* sha256_kernel_name(sha256_kernel_t kernel);
+bool sha256_kernel_supported(sha256_kernel_t kernel);
+sha256_kernel_t sha256_get_kernel();
+sha256_kernel_t sha256_get_batch_kernel();
+
+// Forces a kernel for single messages and batches, e.g. for benchmarks. Returns false if the CPU does not support it.
+bool sha256_set_kernel(sha256_kernel_t kernel);
+bool sha256_set_batch_kernel(sha256_kernel_t kernel);
+
+void sha256(unsigned char hash[32], const unsigned char* data, size_t len);
+void sha256d(unsigned char hash[32], const unsigned char* data, size_t len);
+
+// Double SHA-256 of count independent messages of len bytes each, stored back to back.
+// Writes count 32 byte digests to hashes. Meant for 80 byte block headers and 64 byte
+// merkle node pairs. hashes may point into data to hash in place, since each digest is
+// written only after its message has been read and never lands past the start of it.
+void sha256d_batch(unsigned char* hashes, const unsigned char* data, size_t len, size_t count);
+
+// Incremental SHA-256 for messages written in pieces, using the same kernel as sha256().
+// The kernel is fixed when the context is initialized. Copying a context saves its midstate.
+class sha256_ctx
+{
+public:
+    sha256_ctx() { init(); }
+
+    void init();
+    void update(const unsigned char* data, size_t len);
+    void final(unsigned char hash[32]); // call init() before reusing the context
+
+private:
+    bool shani_;
+    SHA256_CTX openssl_;
+    uint32_t state_[8];
+    unsigned char buffer_[64];
+    uint64_t len_;
+};
+
+}
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -179,6 +180,82 @@ public:
         return *this;
     }
 
+    base_uint& operator*=(uint32_t b32)
+    {
+        uint64 carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64 n = carry + (uint64)b32 * pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    base_uint& operator/=(const base_uint& b)
+    {
+        // shift and subtract long division
+        base_uint div = b;
+        base_uint num = *this;
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+
+        int num_bits = num.bits();
+        int div_bits = div.bits();
+        if (div_bits == 0)
+            throw std::domain_error("base_uint - division by zero.");
+        if (div_bits > num_bits)
+            return *this;
+
+        int shift = num_bits - div_bits;
+        div <<= shift;
+        while (shift >= 0)
+        {
+            if (num >= div)
+            {
+                num -= div;
+                pn[shift / 32] |= (1U << (shift & 31));
+            }
+            div >>= 1;
+            shift--;
+        }
+        return *this;
+    }
+
+    // Divides in place and returns the remainder.
+    uint32_t DivMod(uint32_t divisor)
+    {
+        if (divisor == 0)
+            throw std::domain_error("base_uint - division by zero.");
+
+        uint64 rem = 0;
+        for (int i = WIDTH-1; i >= 0; i--)
+        {
+            uint64 n = (rem << 32) | pn[i];
+            pn[i] = (uint32_t)(n / divisor);
+            rem = n % divisor;
+        }
+        return (uint32_t)rem;
+    }
+
+    // Position of the highest set bit plus one, zero if the value is zero.
+    unsigned int bits() const
+    {
+        for (int pos = WIDTH-1; pos >= 0; pos--)
+        {
+            if (pn[pos])
+            {
+                for (int nbits = 31; nbits > 0; nbits--)
+                {
+                    if (pn[pos] & (1U << nbits))
+                        return 32*pos + nbits + 1;
+                }
+                return 32*pos + 1;
+            }
+        }
+        return 0;
+    }
+
 
     base_uint& operator++()
     {
@@ -345,6 +422,39 @@ public:
         return (GetHex());
     }
 
+    std::string GetDec() const
+    {
+        base_uint n = *this;
+        std::string dec;
+        do
+        {
+            dec += (char)('0' + n.DivMod(10));
+        } while (!!n);
+        return std::string(dec.rbegin(), dec.rend());
+    }
+
+    void SetDec(const char* psz)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+
+        // skip leading spaces
+        while (isspace(*psz))
+            psz++;
+
+        // decimal string to uint
+        while (*psz >= '0' && *psz <= '9')
+        {
+            *this *= 10;
+            *this += (uint64)(*psz++ - '0');
+        }
+    }
+
+    void SetDec(const std::string& str)
+    {
+        SetDec(str.c_str());
+    }
+
     unsigned char* begin()
     {
         return (unsigned char*)&pn[0];
@@ -588,6 +698,54 @@ public:
         else
             *this = 0;
     }
+
+    // The compact form used for block targets - the byte length in the top 8 bits
+    // followed by a sign bit and a 23 bit mantissa.
+    uint256& SetCompact(uint32_t nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL)
+    {
+        int nSize = nCompact >> 24;
+        uint32_t nWord = nCompact & 0x007fffff;
+        if (nSize <= 3)
+        {
+            nWord >>= 8*(3 - nSize);
+            *this = nWord;
+        }
+        else
+        {
+            *this = nWord;
+            *this <<= 8*(nSize - 3);
+        }
+        if (pfNegative)
+            *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+        if (pfOverflow)
+            *pfOverflow = nWord != 0 && ((nSize > 34) || (nWord > 0xff && nSize > 33) || (nWord > 0xffff && nSize > 32));
+        return *this;
+    }
+
+    uint32_t GetCompact() const
+    {
+        int nSize = (bits() + 7) / 8;
+        uint32_t nCompact;
+        if (nSize <= 3)
+        {
+            nCompact = (uint32_t)Get64() << 8*(3 - nSize);
+        }
+        else
+        {
+            uint256 bn(*this);
+            bn >>= 8*(nSize - 3);
+            nCompact = (uint32_t)bn.Get64();
+        }
+
+        // keep the sign bit clear
+        if (nCompact & 0x00800000)
+        {
+            nCompact >>= 8;
+            nSize++;
+        }
+        nCompact |= nSize << 24;
+        return nCompact;
+    }
 };
 
 inline bool operator==(const uint256& a, uint64 b)                           { return (base_uint256)a == b; }
@@ -596,6 +754,8 @@ inline const uint256 operator<<(const base_uint256& a, unsigned int shift)   { r
 inline const uint256 operator>>(const base_uint256& a, unsigned int shift)   { return uint256(a) >>= shift; }
 inline const uint256 operator<<(const uint256& a, unsigned int shift)        { return uint256(a) <<= shift; }
 inline const uint256 operator>>(const uint256& a, unsigned int shift)        { return uint256(a) >>= shift; }
+inline const uint256 operator*(const uint256& a, uint32_t b)                 { return uint256(a) *= b; }
+inline const uint256 operator/(const uint256& a, const uint256& b)           { return uint256(a) /= b; }
 
 inline const uint256 operator^(const base_uint256& a, const base_uint256& b) { return uint256(a) ^= b; }
 inline const uint256 operator&(const base_uint256& a, const base_uint256& b) { return uint256(a) &= b; }
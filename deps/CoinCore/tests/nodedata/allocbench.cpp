@@ -0,0 +1,236 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// allocbench.cpp
+//
+// Counts heap allocations per processed merkle block. Processing follows what
+// NetworkSync does with a merkle block: hash the header, rebuild the partial
+// merkle tree and check its root, queue the matched tx hashes and then match
+// the incoming transactions against them. The legacy path below reproduces the
+// old code that kept every hash in a uchar_vector.
+//
+// Usage: allocbench [tx count] [matched tx count] [iterations]
+
+#include <CoinNodeData.h>
+#include <MerkleTree.h>
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+using namespace Coin;
+using namespace std;
+
+static size_t g_allocs = 0;
+
+void* operator new(size_t size)
+{
+    g_allocs++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// Legacy processing path
+struct LegacyTree
+{
+    list<uchar_vector> merkleHashes;
+    list<uchar_vector> txHashes;
+    list<bool> bits;
+    uchar_vector root;
+
+    void setCompressed(queue<uchar_vector>& hashQueue, queue<bool>& bitQueue, unsigned int depth)
+    {
+        if (hashQueue.empty() || bitQueue.empty()) throw runtime_error("Invalid compressed partial merkle tree data.");
+
+        bool bit = bitQueue.front();
+        bits.push_back(bit);
+        bitQueue.pop();
+
+        if (depth == 0 || !bit) {
+            root = hashQueue.front();
+            merkleHashes.push_back(hashQueue.front());
+            if (bit) txHashes.push_back(hashQueue.front());
+            hashQueue.pop();
+            return;
+        }
+
+        depth--;
+
+        LegacyTree left;
+        left.setCompressed(hashQueue, bitQueue, depth);
+        merkleHashes.swap(left.merkleHashes);
+        txHashes.swap(left.txHashes);
+        bits.splice(bits.end(), left.bits);
+
+        if (!hashQueue.empty()) {
+            LegacyTree right;
+            right.setCompressed(hashQueue, bitQueue, depth);
+            root = sha256_2(left.root + right.root);
+            merkleHashes.splice(merkleHashes.end(), right.merkleHashes);
+            txHashes.splice(txHashes.end(), right.txHashes);
+            bits.splice(bits.end(), right.bits);
+        }
+        else {
+            root = sha256_2(left.root + left.root);
+        }
+    }
+};
+
+uchar_vector legacyProcess(const MerkleBlock& merkleBlock, const vector<Transaction>& txs)
+{
+    uchar_vector merkleBlockHash = merkleBlock.hash();
+
+    vector<uchar_vector> hashes = merkleBlock.hashes;
+    unsigned int depth = 0;
+    unsigned int n = merkleBlock.nTxs - 1;
+    while (n > 0) { depth++; n >>= 1; }
+
+    queue<uchar_vector> hashQueue;
+    for (auto& hash: hashes) { hashQueue.push(hash); }
+    queue<bool> bitQueue;
+    for (auto& flag: merkleBlock.flags) {
+        for (unsigned int i = 0; i < 8; i++) { bitQueue.push((flag >> i) & 0x01); }
+    }
+
+    LegacyTree tree;
+    tree.setCompressed(hashQueue, bitQueue, depth);
+    if (merkleBlock.merkleRoot() != uchar_vector(tree.root).getReverse()) throw runtime_error("Legacy merkle root mismatch.");
+
+    set<uchar_vector> txHashesSet;
+    for (auto& hash: tree.txHashes) { txHashesSet.insert(hash); }
+    list<unsigned int> txIndices;
+    unsigned int i = 0;
+    for (auto& hash: tree.merkleHashes) { if (txHashesSet.count(hash)) txIndices.push_back(i); i++; }
+
+    set<bytes_t> pendingTxHashes;
+    queue<bytes_t> currentTxHashes;
+    for (auto& reversedTxHash: tree.txHashes)
+    {
+        uchar_vector txHash = reversedTxHash.getReverse();
+        pendingTxHashes.insert(txHash);
+        currentTxHashes.push(txHash);
+    }
+
+    for (auto& tx: txs)
+    {
+        if (!pendingTxHashes.count(tx.hash()) || tx.hash() != currentTxHashes.front()) throw runtime_error("Legacy tx mismatch.");
+        currentTxHashes.pop();
+    }
+    return merkleBlockHash;
+}
+
+// Current processing path
+hash256_t process(const MerkleBlock& merkleBlock, const vector<Transaction>& txs)
+{
+    hash256_t merkleBlockHash = merkleBlock.hash256();
+
+    PartialMerkleTree tree(merkleBlock.merkleTree());
+
+    set<hash256_t> pendingTxHashes;
+    queue<hash256_t> currentTxHashes;
+    for (auto& reversedTxHash: tree.getTxHashes())
+    {
+        hash256_t txHash = reversedTxHash.getReverse();
+        pendingTxHashes.insert(txHash);
+        currentTxHashes.push(txHash);
+    }
+
+    for (auto& tx: txs)
+    {
+        hash256_t txHash = tx.hash256();
+        if (!pendingTxHashes.count(txHash) || txHash != currentTxHashes.front()) throw runtime_error("Tx mismatch.");
+        currentTxHashes.pop();
+    }
+    return merkleBlockHash;
+}
+
+// Test data
+uchar_vector randomBytes(size_t n)
+{
+    uchar_vector bytes(n);
+    for (auto& byte: bytes) { byte = rand() & 0xff; }
+    return bytes;
+}
+
+Transaction randomTx()
+{
+    Transaction tx;
+    tx.addInput(TxIn(OutPoint(randomBytes(32), rand() % 4), randomBytes(106), 0xffffffff));
+    tx.addOutput(TxOut(rand(), uchar_vector("76a914") + randomBytes(20) + uchar_vector("88ac")));
+    return tx;
+}
+
+template<typename Process>
+void run(const string& name, const MerkleBlock& merkleBlock, const vector<Transaction>& txs, unsigned int iterations, Process process)
+{
+    size_t allocs = 0;
+    double seconds = 0;
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        // Fresh copies so no cached hashes carry over between iterations.
+        MerkleBlock block(merkleBlock);
+        vector<Transaction> blockTxs(txs);
+
+        size_t start = g_allocs;
+        auto startTime = chrono::steady_clock::now();
+        process(block, blockTxs);
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+        allocs += g_allocs - start;
+    }
+    cout << "  " << name << ": " << allocs / iterations << " allocations, " << seconds * 1000000 / iterations << " us per merkle block" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int nTxs = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+        unsigned int nMatched = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+        unsigned int iterations = argc > 3 ? strtoul(argv[3], NULL, 0) : 100;
+        if (nTxs == 0 || nMatched > nTxs) throw runtime_error("Invalid tx counts.");
+
+        // Match every (nTxs / nMatched)th transaction.
+        vector<Transaction> matchedTxs;
+        vector<MerkleLeaf> leaves;
+        unsigned int step = nMatched ? nTxs / nMatched : nTxs + 1;
+        for (unsigned int i = 0; i < nTxs; i++)
+        {
+            bool matched = (i % step == 0) && matchedTxs.size() < nMatched;
+            if (matched)
+            {
+                Transaction tx = randomTx();
+                matchedTxs.push_back(tx);
+                leaves.push_back(MerkleLeaf(tx.getHash(), true));
+            }
+            else
+            {
+                leaves.push_back(MerkleLeaf(randomBytes(32), false));
+            }
+        }
+
+        PartialMerkleTree tree(leaves);
+        MerkleBlock merkleBlock(tree, 2, randomBytes(32), 1400000000, 0x1d00ffff, rand());
+
+        // Both paths must accept the block and agree on its hash.
+        uchar_vector legacyHash = legacyProcess(merkleBlock, matchedTxs);
+        hash256_t merkleBlockHash = process(merkleBlock, matchedTxs);
+        if (merkleBlockHash != legacyHash) throw runtime_error("Merkle block hash mismatch.");
+
+        cout << "merkle block " << merkleBlockHash.getHex() << ": " << nTxs << " txs, " << merkleBlock.hashes.size() << " hashes, " << matchedTxs.size() << " matched" << endl;
+        run("legacy", merkleBlock, matchedTxs, iterations, legacyProcess);
+        run("fixed ", merkleBlock, matchedTxs, iterations, process);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
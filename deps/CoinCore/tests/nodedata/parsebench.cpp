@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// parsebench.cpp
+//
+// Measures parsing throughput for block and headers messages. The legacy
+// parser below reproduces the old approach of copying the rest of the buffer
+// for every field so both can be compared on the same data.
+//
+// Usage: parsebench [block file] [iterations]
+//
+// The block file holds a serialized block, either raw or hex encoded. Without
+// one a synthetic block of about 1MB is used.
+
+#include <CoinNodeData.h>
+#include <MerkleTree.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+using namespace Coin;
+using namespace std;
+
+const unsigned int HEADER_COUNT = 2000;
+
+// Legacy parse path
+uint64_t legacyVarInt(const uchar_vector& bytes)
+{
+    VarInt varInt(bytes);
+    return varInt.value;
+}
+
+uint64_t legacyTxIn(const uchar_vector& bytes, TxIn& txIn)
+{
+    if (bytes.size() < MIN_TX_IN_SIZE) throw runtime_error("Invalid data - TxIn too small.");
+    txIn.previousOut.setSerialized(uchar_vector(bytes.begin(), bytes.begin() + 36));
+    uchar_vector rest(bytes.begin() + 36, bytes.end());
+    VarInt scriptLength(rest);
+    uint pos = scriptLength.getSize() + 36;
+    if (bytes.size() < pos + scriptLength.value + 4) throw runtime_error("Invalid data - TxIn script length too small.");
+    txIn.scriptSig.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    pos += scriptLength.value;
+    txIn.sequence = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN);
+    return pos + 4;
+}
+
+uint64_t legacyTxOut(const uchar_vector& bytes, TxOut& txOut)
+{
+    if (bytes.size() < MIN_TX_OUT_SIZE) throw runtime_error("Invalid data - TxOut too small.");
+    txOut.value = vch_to_uint<uint64_t>(bytes, _BIG_ENDIAN);
+    VarInt scriptLength(uchar_vector(bytes.begin() + 8, bytes.end()));
+    uint pos = scriptLength.getSize() + 8;
+    if (bytes.size() < pos + scriptLength.value) throw runtime_error("Invalid data - TxOut script length too small.");
+    txOut.scriptPubKey.assign(bytes.begin() + pos, bytes.begin() + pos + scriptLength.value);
+    return pos + scriptLength.value;
+}
+
+uint64_t legacyTransaction(const uchar_vector& bytes, Transaction& tx)
+{
+    tx.version = vch_to_uint<uint32_t>(uchar_vector(bytes.begin(), bytes.begin() + 4), _BIG_ENDIAN);
+
+    tx.inputs.clear();
+    VarInt count(uchar_vector(bytes.begin() + 4, bytes.end()));
+    uint64_t pos = count.getSize() + 4;
+    for (uint64_t i = 0; i < count.value; i++) {
+        TxIn txIn;
+        pos += legacyTxIn(uchar_vector(bytes.begin() + pos, bytes.end()), txIn);
+        tx.addInput(txIn);
+    }
+
+    tx.outputs.clear();
+    count.setSerialized(uchar_vector(bytes.begin() + pos, bytes.end()));
+    pos += count.getSize();
+    for (uint64_t i = 0; i < count.value; i++) {
+        TxOut txOut;
+        pos += legacyTxOut(uchar_vector(bytes.begin() + pos, bytes.end()), txOut);
+        tx.addOutput(txOut);
+    }
+
+    tx.lockTime = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + 4), _BIG_ENDIAN);
+    return pos + 4;
+}
+
+void legacyBlock(const uchar_vector& bytes, CoinBlock& block)
+{
+    block.blockHeader.setSerialized(uchar_vector(bytes.begin(), bytes.begin() + MIN_COIN_BLOCK_HEADER_SIZE));
+    uint64_t pos = MIN_COIN_BLOCK_HEADER_SIZE;
+
+    MerkleTree txMerkleTree;
+    VarInt count(uchar_vector(bytes.begin() + pos, bytes.end())); pos += count.getSize();
+    block.txs.clear();
+    for (uint64_t i = 0; i < count.value; i++) {
+        Transaction tx;
+        pos += legacyTransaction(uchar_vector(bytes.begin() + pos, bytes.end()), tx);
+        block.txs.push_back(tx);
+        txMerkleTree.addHash(tx.getHash());
+    }
+    if (block.blockHeader.merkleRoot() != txMerkleTree.getRootLittleEndian())
+        throw runtime_error("Invalid data - CoinBlock merkle root mismatch.");
+}
+
+void legacyHeaders(const uchar_vector& bytes, HeadersMessage& headers)
+{
+    VarInt count(bytes);
+    uint64_t pos = count.getSize();
+    headers.clear();
+    for (uint64_t i = 0; i < count.value; i++) {
+        CoinBlockHeader header(uchar_vector(bytes.begin() + pos, bytes.begin() + pos + MIN_COIN_BLOCK_HEADER_SIZE));
+        headers.addHeader(header);
+        pos += MIN_COIN_BLOCK_HEADER_SIZE + 1;
+    }
+}
+
+// Test data
+uchar_vector randomBytes(size_t n)
+{
+    uchar_vector bytes(n);
+    for (auto& byte: bytes) { byte = rand() & 0xff; }
+    return bytes;
+}
+
+CoinBlock syntheticBlock()
+{
+    CoinBlock block(2, 1400000000, 0x1d00ffff, randomBytes(32));
+    while (block.getSize() < 1000000)
+    {
+        Transaction tx;
+        unsigned int nInputs = 1 + rand() % 3;
+        unsigned int nOutputs = 1 + rand() % 3;
+        for (unsigned int i = 0; i < nInputs; i++)  { tx.addInput(TxIn(OutPoint(randomBytes(32), rand() % 4), randomBytes(106), 0xffffffff)); }
+        for (unsigned int i = 0; i < nOutputs; i++) { tx.addOutput(TxOut(rand(), uchar_vector("76a914") + randomBytes(20) + uchar_vector("88ac"))); }
+        block.addTransaction(tx);
+    }
+    block.updateMerkleRoot();
+    return block;
+}
+
+uchar_vector loadBlock(const string& filename)
+{
+    ifstream file(filename, ios::binary);
+    if (!file) throw runtime_error("Could not open " + filename);
+
+    stringstream ss;
+    ss << file.rdbuf();
+    string data = ss.str();
+
+    string hex(data);
+    hex.erase(hex.find_last_not_of(" \r\n\t") + 1);
+    if (!hex.empty() && hex.find_first_not_of("0123456789abcdefABCDEF") == string::npos)
+    {
+        uchar_vector bytes;
+        bytes.setHex(hex);
+        return bytes;
+    }
+    return uchar_vector(data.begin(), data.end());
+}
+
+template<typename Parse>
+double throughput(const uchar_vector& bytes, unsigned int iterations, Parse parse)
+{
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) { parse(); }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)bytes.size() * iterations / seconds / 1000000.0;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+
+        uchar_vector blockBytes = argc > 1 ? loadBlock(argv[1]) : syntheticBlock().getSerialized();
+        CoinBlock block(blockBytes);
+
+        HeadersMessage headersMessage;
+        uchar_vector prevHash = block.blockHeader.prevBlockHash();
+        for (unsigned int i = 0; i < HEADER_COUNT; i++)
+        {
+            CoinBlockHeader header(2, 1400000000 + i * 600, 0x1d00ffff, rand(), prevHash, randomBytes(32));
+            headersMessage.addHeader(header);
+            prevHash = header.getHashLittleEndian();
+        }
+        uchar_vector headersBytes = headersMessage.getSerialized();
+
+        // Both parsers must agree with the original serialization.
+        CoinBlock legacy;
+        legacyBlock(blockBytes, legacy);
+        if (legacy.getSerialized() != blockBytes || block.getSerialized() != blockBytes)
+            throw runtime_error("Block does not round trip.");
+
+        HeadersMessage legacyHeadersMessage;
+        legacyHeaders(headersBytes, legacyHeadersMessage);
+        if (legacyHeadersMessage.getSerialized() != headersBytes || HeadersMessage(headersBytes).getSerialized() != headersBytes)
+            throw runtime_error("Headers message does not round trip.");
+
+        cout << "block: " << blockBytes.size() << " bytes, " << block.txs.size() << " txs" << endl;
+        cout << "  legacy: " << throughput(blockBytes, iterations, [&]() { CoinBlock b; legacyBlock(blockBytes, b); }) << " MB/s" << endl;
+        cout << "  cursor: " << throughput(blockBytes, iterations, [&]() { CoinBlock b(blockBytes); }) << " MB/s" << endl;
+
+        unsigned int headerIterations = iterations * 10;
+        cout << "headers: " << headersBytes.size() << " bytes, " << HEADER_COUNT << " headers" << endl;
+        cout << "  legacy: " << throughput(headersBytes, headerIterations, [&]() { HeadersMessage h; legacyHeaders(headersBytes, h); }) << " MB/s" << endl;
+        cout << "  cursor: " << throughput(headersBytes, headerIterations, [&]() { HeadersMessage h(headersBytes); }) << " MB/s" << endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
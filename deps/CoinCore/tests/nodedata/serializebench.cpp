@@ -0,0 +1,171 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// serializebench.cpp
+//
+// Measures serialization and hashing throughput for a 100 input transaction
+// and a full block. The legacy serializer below reproduces the old approach of
+// appending every nested field's own getSerialized() vector so both can be
+// compared on the same data.
+//
+// Usage: serializebench [iterations]
+
+#include <CoinNodeData.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+using namespace Coin;
+using namespace std;
+
+// Legacy serialize path
+uchar_vector legacyVarInt(uint64_t value)
+{
+    uchar_vector rval;
+    if (value < 0xfd) {
+        rval.push_back(value);
+        return rval;
+    }
+    if (value <= 0xffff) {
+        rval.push_back(0xfd);
+        rval += uint_to_vch<uint16_t>(value, _BIG_ENDIAN);
+        return rval;
+    }
+    if (value <= 0xffffffff) {
+        rval.push_back(0xfe);
+        rval += uint_to_vch<uint32_t>(value, _BIG_ENDIAN);
+        return rval;
+    }
+    rval.push_back(0xff);
+    rval += uint_to_vch<uint64_t>(value, _BIG_ENDIAN);
+    return rval;
+}
+
+uchar_vector legacyTxIn(const TxIn& txIn)
+{
+    uchar_vector rval(txIn.previousOut.hash, 32);
+    rval.reverse();
+    rval += uint_to_vch(txIn.previousOut.index, _BIG_ENDIAN);
+    rval += legacyVarInt(txIn.scriptSig.size());
+    rval += txIn.scriptSig;
+    rval += uint_to_vch(txIn.sequence, _BIG_ENDIAN);
+    return rval;
+}
+
+uchar_vector legacyTxOut(const TxOut& txOut)
+{
+    uchar_vector rval = uint_to_vch(txOut.value, _BIG_ENDIAN);
+    rval += legacyVarInt(txOut.scriptPubKey.size());
+    rval += txOut.scriptPubKey;
+    return rval;
+}
+
+uchar_vector legacyTransaction(const Transaction& tx)
+{
+    uchar_vector rval = uint_to_vch(tx.version, _BIG_ENDIAN);
+    rval += legacyVarInt(tx.inputs.size());
+    for (auto& txIn: tx.inputs) { rval += legacyTxIn(txIn); }
+    rval += legacyVarInt(tx.outputs.size());
+    for (auto& txOut: tx.outputs) { rval += legacyTxOut(txOut); }
+    rval += uint_to_vch(tx.lockTime, _BIG_ENDIAN);
+    return rval;
+}
+
+uchar_vector legacyBlock(const CoinBlock& block)
+{
+    const CoinBlockHeader& header = block.blockHeader;
+    uchar_vector rval = uint_to_vch(header.version(), _BIG_ENDIAN);
+    rval += header.prevBlockHash().getReverse();
+    rval += header.merkleRoot().getReverse();
+    rval += uint_to_vch(header.timestamp(), _BIG_ENDIAN);
+    rval += uint_to_vch(header.bits(), _BIG_ENDIAN);
+    rval += uint_to_vch(header.nonce(), _BIG_ENDIAN);
+    rval += legacyVarInt(block.txs.size());
+    for (auto& tx: block.txs) { rval += legacyTransaction(tx); }
+    return rval;
+}
+
+// Test data
+uchar_vector randomBytes(size_t n)
+{
+    uchar_vector bytes(n);
+    for (auto& byte: bytes) { byte = rand() & 0xff; }
+    return bytes;
+}
+
+Transaction randomTx(unsigned int nInputs, unsigned int nOutputs)
+{
+    Transaction tx;
+    for (unsigned int i = 0; i < nInputs; i++)  { tx.addInput(TxIn(OutPoint(randomBytes(32), rand() % 4), randomBytes(106), 0xffffffff)); }
+    for (unsigned int i = 0; i < nOutputs; i++) { tx.addOutput(TxOut(rand(), uchar_vector("76a914") + randomBytes(20) + uchar_vector("88ac"))); }
+    return tx;
+}
+
+CoinBlock syntheticBlock()
+{
+    CoinBlock block(2, 1400000000, 0x1d00ffff, randomBytes(32));
+    while (block.getSize() < 1000000) { block.addTransaction(randomTx(1 + rand() % 3, 1 + rand() % 3)); }
+    block.updateMerkleRoot();
+    return block;
+}
+
+// Keeps the optimizer from dropping the work.
+volatile unsigned char g_sink = 0;
+
+template<typename Run>
+double throughput(uint64_t size, unsigned int iterations, Run run)
+{
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) { g_sink ^= run(); }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)size * iterations / seconds / 1000000.0;
+}
+
+template<typename T>
+void bench(const string& name, const T& object, uchar_vector (*legacy)(const T&), unsigned int iterations)
+{
+    uchar_vector bytes = object.getSerialized();
+    if (legacy(object) != bytes) throw runtime_error(name + " - serializers disagree.");
+
+    HashWriter hashWriter;
+    object.serialize(hashWriter);
+    if (hashWriter.getHash().bytes() != sha256_2(bytes)) throw runtime_error(name + " - streamed hash does not match.");
+
+    uchar_vector buffer(object.getSize());
+
+    cout << name << ": " << bytes.size() << " bytes" << endl;
+    cout << "  legacy serialize:  " << throughput(bytes.size(), iterations, [&]() { return legacy(object)[0]; }) << " MB/s" << endl;
+    cout << "  getSerialized:     " << throughput(bytes.size(), iterations, [&]() { return object.getSerialized()[0]; }) << " MB/s" << endl;
+    cout << "  caller buffer:     " << throughput(bytes.size(), iterations, [&]()
+    {
+        BufferWriter writer(&buffer[0], buffer.size());
+        object.serialize(writer);
+        return buffer[0];
+    }) << " MB/s" << endl;
+    cout << "  legacy hash:       " << throughput(bytes.size(), iterations, [&]() { return sha256_2(legacy(object))[0]; }) << " MB/s" << endl;
+    cout << "  streamed hash:     " << throughput(bytes.size(), iterations, [&]()
+    {
+        HashWriter writer;
+        object.serialize(writer);
+        return writer.getHash()[0];
+    }) << " MB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 10;
+
+        bench<Transaction>("100 input transaction", randomTx(100, 2), &legacyTransaction, iterations * 1000);
+        bench<CoinBlock>("block", syntheticBlock(), &legacyBlock, iterations);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
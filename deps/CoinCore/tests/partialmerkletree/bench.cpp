@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// bench.cpp
+//
+// Measures merkle tree throughput for a block of transactions: the full tree
+// root, building a partial tree from its leaves, parsing the compressed form
+// received in a merkleblock and merging two partial trees. The legacy code
+// below reproduces the old recursive uchar_vector implementations of the full
+// tree root and of parsing so both can be timed on the same data.
+//
+// Usage: bench [tx count] [matched tx count] [iterations]
+
+#include <MerkleTree.h>
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <list>
+#include <queue>
+
+using namespace Coin;
+using namespace std;
+
+// Legacy full tree root
+uchar_vector legacyRoot(const vector<uchar_vector>& hashes)
+{
+    if (hashes.size() == 1) return hashes[0];
+
+    vector<uchar_vector> parents;
+    for (size_t i = 0; i < hashes.size(); i += 2)
+    {
+        uchar_vector pairedHashes = hashes[i];
+        pairedHashes += (i + 1 < hashes.size()) ? hashes[i + 1] : hashes[i];
+        parents.push_back(sha256_2(pairedHashes));
+    }
+    return legacyRoot(parents);
+}
+
+// Legacy compressed tree parsing
+struct LegacyTree
+{
+    list<uchar_vector> merkleHashes;
+    list<uchar_vector> txHashes;
+    list<bool> bits;
+    uchar_vector root;
+
+    void setCompressed(queue<uchar_vector>& hashQueue, queue<bool>& bitQueue, unsigned int depth)
+    {
+        if (hashQueue.empty() || bitQueue.empty()) throw runtime_error("Invalid compressed partial merkle tree data.");
+
+        bool bit = bitQueue.front();
+        bits.push_back(bit);
+        bitQueue.pop();
+
+        if (depth == 0 || !bit) {
+            root = hashQueue.front();
+            merkleHashes.push_back(hashQueue.front());
+            if (bit) txHashes.push_back(hashQueue.front());
+            hashQueue.pop();
+            return;
+        }
+
+        depth--;
+
+        LegacyTree left;
+        left.setCompressed(hashQueue, bitQueue, depth);
+        merkleHashes.swap(left.merkleHashes);
+        txHashes.swap(left.txHashes);
+        bits.splice(bits.end(), left.bits);
+
+        if (!hashQueue.empty()) {
+            LegacyTree right;
+            right.setCompressed(hashQueue, bitQueue, depth);
+            root = sha256_2(left.root + right.root);
+            merkleHashes.splice(merkleHashes.end(), right.merkleHashes);
+            txHashes.splice(txHashes.end(), right.txHashes);
+            bits.splice(bits.end(), right.bits);
+        }
+        else {
+            root = sha256_2(left.root + left.root);
+        }
+    }
+};
+
+uchar_vector legacyParse(unsigned int nTxs, const vector<uchar_vector>& hashes, const uchar_vector& flags)
+{
+    unsigned int depth = 0;
+    unsigned int n = nTxs - 1;
+    while (n > 0) { depth++; n >>= 1; }
+
+    queue<uchar_vector> hashQueue;
+    for (auto& hash: hashes) { hashQueue.push(hash); }
+    queue<bool> bitQueue;
+    for (auto& flag: flags) {
+        for (unsigned int i = 0; i < 8; i++) { bitQueue.push((flag >> i) & 0x01); }
+    }
+
+    LegacyTree tree;
+    tree.setCompressed(hashQueue, bitQueue, depth);
+
+    // The old code also copied the tx hashes out into a set to find their indices.
+    set<uchar_vector> txHashes(tree.txHashes.begin(), tree.txHashes.end());
+    return tree.root;
+}
+
+// Test data
+uchar_vector randomHash()
+{
+    uchar_vector hash(32);
+    for (auto& byte: hash) { byte = rand() & 0xff; }
+    return hash;
+}
+
+vector<MerkleLeaf> randomLeaves(const vector<uchar_vector>& hashes, unsigned int nMatched)
+{
+    vector<MerkleLeaf> leaves;
+    for (auto& hash: hashes) { leaves.push_back(MerkleLeaf(hash, false)); }
+    for (unsigned int i = 0; i < nMatched; i++) { leaves[rand() % leaves.size()].second = true; }
+    return leaves;
+}
+
+// Keeps the optimizer from dropping the work.
+volatile unsigned char g_sink = 0;
+
+template<typename Run>
+void bench(const string& name, unsigned int iterations, Run run)
+{
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) { g_sink ^= run(); }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  " << name << (double)iterations / seconds << " trees/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int nTxs = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+        unsigned int nMatched = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+        unsigned int iterations = argc > 3 ? strtoul(argv[3], NULL, 0) : 1000;
+        if (nTxs == 0) throw runtime_error("Invalid tx count.");
+
+        vector<uchar_vector> hashes;
+        for (unsigned int i = 0; i < nTxs; i++) { hashes.push_back(randomHash()); }
+        vector<MerkleLeaf> leaves1 = randomLeaves(hashes, nMatched);
+        vector<MerkleLeaf> leaves2 = randomLeaves(hashes, nMatched);
+
+        PartialMerkleTree tree1(leaves1);
+        PartialMerkleTree tree2(leaves2);
+        vector<uchar_vector> merkleHashes = tree1.getMerkleHashesVector();
+        vector<hash256_t> fixedMerkleHashes(tree1.getMerkleHashes().begin(), tree1.getMerkleHashes().end());
+        uchar_vector flags = tree1.getFlags();
+
+        // All paths must agree on the root.
+        uchar_vector root = MerkleTree(hashes).getRoot();
+        if (legacyRoot(hashes) != root || tree1.getRoot() != root || legacyParse(nTxs, merkleHashes, flags) != root)
+            throw runtime_error("Merkle roots do not match.");
+
+        cout << "block: " << nTxs << " txs, " << tree1.getTxHashes().size() << " matched, " << merkleHashes.size() << " hashes in merkleblock" << endl;
+        cout << "full tree root:" << endl;
+        bench("legacy:          ", iterations / 10 + 1, [&]() { return legacyRoot(hashes)[0]; });
+        bench("MerkleTree:      ", iterations / 10 + 1, [&]() { return MerkleTree(hashes).getRoot()[0]; });
+        cout << "partial tree from leaves:" << endl;
+        bench("setUncompressed: ", iterations / 10 + 1, [&]() { return PartialMerkleTree(leaves1).getRootHash()[0]; });
+        cout << "partial tree from merkleblock:" << endl;
+        bench("legacy:          ", iterations, [&]() { return legacyParse(nTxs, merkleHashes, flags)[0]; });
+        bench("setCompressed:   ", iterations, [&]() { return PartialMerkleTree(nTxs, fixedMerkleHashes, flags).getRootHash()[0]; });
+        cout << "merge:" << endl;
+        bench("merge:           ", iterations, [&]()
+        {
+            PartialMerkleTree tree(tree1);
+            tree.merge(tree2);
+            return tree.getRootHash()[0];
+        });
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
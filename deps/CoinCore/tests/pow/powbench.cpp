@@ -0,0 +1,108 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// powbench.cpp
+//
+// Measures proof of work checking in headers per second for each POW hash
+// function in use: double SHA-256 (bitcoin), scrypt (litecoin) and hash9
+// (quarkcoin). Headers are hashed one at a time with getPOWHash() and in one
+// batch with CoinBlockHeader::setPOWHashes(), which runs scrypt through every
+// kernel the CPU supports. Batch results are checked against the single ones.
+//
+// Usage: powbench [header count]
+
+#include <CoinNodeData.h>
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace Coin;
+using namespace std;
+
+uchar_vector randomBytes(size_t n)
+{
+    uchar_vector bytes(n);
+    for (auto& byte: bytes) { byte = rand() & 0xff; }
+    return bytes;
+}
+
+vector<CoinBlockHeader> randomHeaders(size_t count)
+{
+    vector<CoinBlockHeader> headers;
+    for (size_t i = 0; i < count; i++)
+    {
+        headers.push_back(CoinBlockHeader(2, 1400000000 + i, 0x1d00ffff, rand(), randomBytes(32), randomBytes(32)));
+    }
+    return headers;
+}
+
+template<typename Hash>
+double headerRate(size_t count, Hash hash)
+{
+    auto start = chrono::steady_clock::now();
+    hash();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)count / seconds;
+}
+
+void bench(const string& coin, hashfunc_t powhashfunc, size_t count)
+{
+    CoinBlockHeader::setPOWHashFunc(powhashfunc);
+
+    // Fresh copies so no cached POW hashes carry over between runs.
+    const vector<CoinBlockHeader> headers = randomHeaders(count);
+
+    vector<CoinBlockHeader> single(headers);
+    cout << coin << ":" << endl;
+    cout << "  single:         " << headerRate(count, [&]() { for (auto& header: single) { header.getPOWHash(); } }) << " headers/s" << endl;
+
+    vector<scrypt_kernel_t> kernels;
+    if (CoinBlockHeader::isPOWHashFuncScrypt())
+    {
+        kernels.push_back(SCRYPT_KERNEL_GENERIC);
+        kernels.push_back(SCRYPT_KERNEL_SSE2);
+        kernels.push_back(SCRYPT_KERNEL_AVX2);
+    }
+    else
+    {
+        kernels.push_back(scrypt_get_kernel());
+    }
+
+    scrypt_kernel_t defaultKernel = scrypt_get_kernel();
+    for (auto kernel: kernels)
+    {
+        if (!scrypt_set_kernel(kernel)) continue;
+
+        vector<CoinBlockHeader> batch(headers);
+        double rate = headerRate(count, [&]() { CoinBlockHeader::setPOWHashes(batch, 0, batch.size()); });
+        for (size_t i = 0; i < count; i++)
+        {
+            if (batch[i].getPOWHash() != single[i].getPOWHash()) throw runtime_error(coin + " - batch POW hash mismatch.");
+        }
+
+        string name = CoinBlockHeader::isPOWHashFuncScrypt() ? string("batch ") + scrypt_kernel_name(kernel) + ":" : "batch:";
+        cout << "  " << name << string(16 - name.size(), ' ') << rate << " headers/s" << endl;
+    }
+    scrypt_set_kernel(defaultKernel);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+
+        bench("bitcoin (sha256d)", &sha256_2, count * 100);
+        bench("litecoin (scrypt)", &scrypt_1024_1_1_256, count);
+        bench("quarkcoin (hash9)", &hash9, count);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// hashbench.cpp
+//
+// Measures double SHA-256 throughput for each kernel the CPU supports, for
+// batches of 80 byte block headers and 64 byte merkle node pairs and for one
+// message at a time. OpenSSL is timed on the same data as a reference and
+// every kernel's digests, including incremental ones, are checked against it.
+//
+// Usage: hashbench [message count] [iterations]
+
+#include <sha256.h>
+
+#include <openssl/sha.h>
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace CoinCrypto;
+using namespace std;
+
+void openssl_sha256d(unsigned char* hash, const unsigned char* data, size_t len)
+{
+    unsigned char first[SHA256_DIGEST_LENGTH];
+    SHA256(data, len, first);
+    SHA256(first, SHA256_DIGEST_LENGTH, hash);
+}
+
+template<typename Hash>
+double hashrate(size_t count, unsigned int iterations, Hash hash)
+{
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) { hash(); }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)count * iterations / seconds / 1000000.0;
+}
+
+void bench(const char* label, size_t len, size_t count, unsigned int iterations)
+{
+    vector<unsigned char> data(len * count);
+    for (auto& byte: data) { byte = rand(); }
+
+    vector<unsigned char> expected(32 * count);
+    vector<unsigned char> hashes(32 * count);
+    for (size_t i = 0; i < count; i++) { openssl_sha256d(&expected[i * 32], &data[i * len], len); }
+
+    cout << label << ": " << count << " messages of " << len << " bytes" << endl;
+    cout << "  openssl: " << hashrate(count, iterations, [&]() {
+        for (size_t i = 0; i < count; i++) { openssl_sha256d(&hashes[i * 32], &data[i * len], len); }
+    }) << " MH/s" << endl;
+
+    // The default batch kernel may hand a remainder of fewer than eight messages to the single message kernel.
+    sha256d_batch(&hashes[0], &data[0], len, count);
+    if (hashes != expected) throw runtime_error("Default batch digests do not match openssl.");
+    cout << "  default batch: " << hashrate(count, iterations, [&]() {
+        sha256d_batch(&hashes[0], &data[0], len, count);
+    }) << " MH/s" << endl;
+
+    sha256_kernel_t defaultKernel = sha256_get_kernel();
+    sha256_kernel_t defaultBatchKernel = sha256_get_batch_kernel();
+    const sha256_kernel_t kernels[] = { SHA256_KERNEL_SCALAR, SHA256_KERNEL_AVX2, SHA256_KERNEL_SHANI };
+    for (auto kernel: kernels)
+    {
+        if (!sha256_set_kernel(kernel))
+        {
+            cout << "  " << sha256_kernel_name(kernel) << ": not supported" << endl;
+            continue;
+        }
+
+        sha256d_batch(&hashes[0], &data[0], len, count);
+        if (hashes != expected) throw runtime_error(string(sha256_kernel_name(kernel)) + " batch digests do not match openssl.");
+
+        cout << "  " << sha256_kernel_name(kernel) << " batch: " << hashrate(count, iterations, [&]() {
+            sha256d_batch(&hashes[0], &data[0], len, count);
+        }) << " MH/s" << endl;
+
+        cout << "  " << sha256_kernel_name(kernel) << " single: " << hashrate(count, iterations, [&]() {
+            for (size_t i = 0; i < count; i++) { sha256d(&hashes[i * 32], &data[i * len], len); }
+        }) << " MH/s" << endl;
+        if (hashes != expected) throw runtime_error(string(sha256_kernel_name(kernel)) + " digests do not match openssl.");
+
+        // Split each message at a different point so partial and whole buffered blocks are covered.
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char* message = &data[i * len];
+            size_t split = i % (len + 1);
+            sha256_ctx ctx;
+            ctx.update(message, split);
+            ctx.update(message + split, len - split);
+            ctx.final(&hashes[i * 32]);
+            sha256(&hashes[i * 32], &hashes[i * 32], 32);
+        }
+        if (hashes != expected) throw runtime_error(string(sha256_kernel_name(kernel)) + " incremental digests do not match openssl.");
+    }
+
+    sha256_set_kernel(defaultKernel);
+    sha256_set_batch_kernel(defaultBatchKernel);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        size_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+        unsigned int iterations = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+
+        cout << "default kernel: " << sha256_kernel_name(sha256_get_kernel()) << ", batches: " << sha256_kernel_name(sha256_get_batch_kernel()) << endl;
+
+        bench("headers", 80, count, iterations);
+        bench("merkle pairs", 64, count, iterations);
+    }
+    catch (const exception& e)
+    {
+        cout << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// AccountBalances.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#include "AccountBalances.h"
+
+using namespace CoinDB;
+
+balance_contributions_t CoinDB::getBalanceContributions(odb::database& db, const balance_contribution_query_t& query)
+{
+    // Results are collected before any further statements run on the connection.
+    balance_contributions_t contributions;
+    odb::result<BalanceContributionView> r(db.query<BalanceContributionView>(query));
+    for (auto& view: r) { contributions[balance_key_t(view.account_id, view.tx_status, view.height)] += (int64_t)view.balance; }
+    return contributions;
+}
+
+static void addToAccountBalance(odb::database& db, const balance_key_t& key, int64_t amount)
+{
+    typedef odb::query<AccountBalance> query_t;
+    std::shared_ptr<AccountBalance> balance(db.query_one<AccountBalance>(
+        query_t::account == std::get<0>(key) && query_t::tx_status == std::get<1>(key) && query_t::height == std::get<2>(key)));
+
+    if (!balance)
+    {
+        balance = std::make_shared<AccountBalance>(std::get<0>(key), std::get<1>(key), std::get<2>(key), amount);
+        db.persist(balance);
+        return;
+    }
+
+    balance->add(amount);
+    if (balance->balance() == 0)    { db.erase(balance); }
+    else                            { db.update(balance); }
+}
+
+void CoinDB::applyBalanceContributions(odb::database& db, const balance_contribution_query_t& query, int sign)
+{
+    applyBalanceContributions(db, getBalanceContributions(db, query), sign);
+}
+
+void CoinDB::applyBalanceContributions(odb::database& db, const balance_contributions_t& contributions, int sign)
+{
+    for (auto& item: contributions)
+    {
+        if (item.second != 0) { addToAccountBalance(db, item.first, sign * item.second); }
+    }
+}
+
+balance_contributions_t CoinDB::unconfirmedBalanceContributions(const balance_contributions_t& contributions)
+{
+    balance_contributions_t unconfirmed;
+    for (auto& item: contributions)
+    {
+        Tx::status_t status = std::get<1>(item.first);
+        if (status == Tx::CONFIRMED) { status = Tx::PROPAGATED; }
+        unconfirmed[balance_key_t(std::get<0>(item.first), status, 0)] += item.second;
+    }
+    return unconfirmed;
+}
+
+std::vector<AccountBalanceDrift> CoinDB::findAccountBalanceDrift(odb::database& db)
+{
+    balance_contributions_t actual = getBalanceContributions(db, balance_contribution_query_t(true));
+
+    std::map<balance_key_t, int64_t> stored;
+    odb::result<AccountBalance> r(db.query<AccountBalance>());
+    for (auto& balance: r) { stored[balance_key_t(balance.account_id(), balance.tx_status(), balance.height())] = balance.balance(); }
+
+    std::vector<AccountBalanceDrift> drift;
+    auto addDrift = [&](const balance_key_t& key, int64_t stored_balance, int64_t actual_balance)
+    {
+        if (stored_balance == actual_balance) return;
+        AccountBalanceDrift item;
+        item.account_id = std::get<0>(key);
+        item.tx_status = std::get<1>(key);
+        item.height = std::get<2>(key);
+        item.stored = stored_balance;
+        item.actual = actual_balance;
+        drift.push_back(item);
+    };
+
+    for (auto& item: stored)
+    {
+        auto it = actual.find(item.first);
+        addDrift(item.first, item.second, it == actual.end() ? 0 : it->second);
+    }
+    for (auto& item: actual)
+    {
+        if (!stored.count(item.first)) { addDrift(item.first, 0, item.second); }
+    }
+
+    for (auto& item: drift)
+    {
+        std::shared_ptr<Account> account(db.find<Account>(item.account_id));
+        if (account) { item.account_name = account->name(); }
+    }
+
+    return drift;
+}
+
+void CoinDB::rebuildAccountBalances(odb::database& db)
+{
+    db.erase_query<AccountBalance>();
+    for (auto& item: getBalanceContributions(db, balance_contribution_query_t(true)))
+    {
+        if (item.second == 0) continue;
+        AccountBalance balance(std::get<0>(item.first), std::get<1>(item.first), std::get<2>(item.first), item.second);
+        db.persist(balance);
+    }
+}
+
+/*
+ * Callbacks
+ */
+static void updateBalancesForEvent(odb::callback_event event, odb::database& db, const balance_contribution_query_t& query)
+{
+    switch (event)
+    {
+    case odb::callback_event::pre_update:
+    case odb::callback_event::pre_erase:
+        applyBalanceContributions(db, query, -1);
+        break;
+
+    case odb::callback_event::post_persist:
+    case odb::callback_event::post_update:
+        applyBalanceContributions(db, query, 1);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void TxOut::updateAccountBalances(odb::callback_event event, odb::database& db) const
+{
+    updateBalancesForEvent(event, db, balance_contribution_query_t::TxOut::id == id_);
+}
+
+void Tx::updateAccountBalances(odb::callback_event event, odb::database& db) const
+{
+    updateBalancesForEvent(event, db, balance_contribution_query_t::Tx::id == id_);
+}
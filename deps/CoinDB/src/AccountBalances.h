@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// AccountBalances.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Maintenance of the AccountBalance table. Tx and TxOut callbacks subtract
+// the contribution of the affected outputs before each write and add it back
+// afterwards, both computed from the database, so every write path keeps the
+// table exact without having to know what it changed.
+//
+
+#pragma once
+
+#include "Schema.h"
+
+#if defined(DATABASE_MYSQL)
+    #include "../odb/Schema-odb-mysql.hxx"
+#elif defined(DATABASE_SQLITE)
+    #include "../odb/Schema-odb-sqlite.hxx"
+#else
+    #error "No database engine selected."
+#endif
+
+#include <vector>
+#include <map>
+#include <tuple>
+
+namespace CoinDB
+{
+
+typedef odb::query<BalanceContributionView> balance_contribution_query_t;
+
+// Amounts keyed by account id, tx status and height, as stored in AccountBalance.
+typedef std::tuple<unsigned long, Tx::status_t, uint32_t> balance_key_t;
+typedef std::map<balance_key_t, int64_t> balance_contributions_t;
+
+balance_contributions_t getBalanceContributions(odb::database& db, const balance_contribution_query_t& query);
+
+// Adds (sign = 1) or subtracts (sign = -1) the contribution of the outputs matching query.
+// Writes that bypass the callbacks, such as bulk UPDATE statements, must call this before and after.
+void applyBalanceContributions(odb::database& db, const balance_contribution_query_t& query, int sign);
+void applyBalanceContributions(odb::database& db, const balance_contributions_t& contributions, int sign);
+
+// The same contributions once their transactions lose their block, as Tx::blockheader(nullptr) does.
+balance_contributions_t unconfirmedBalanceContributions(const balance_contributions_t& contributions);
+
+// Recomputes every row from the outputs and reports the ones that differ.
+std::vector<AccountBalanceDrift> findAccountBalanceDrift(odb::database& db);
+
+// Replaces the whole table with balances recomputed from the outputs.
+void rebuildAccountBalances(odb::database& db);
+
+}
@@ -0,0 +1,386 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinSelection.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#include "CoinSelection.h"
+
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+
+using namespace CoinDB;
+
+static uint32_t pushDataSize(uint32_t size)
+{
+    if (size < 0x4c)    return 1;
+    if (size <= 0xff)   return 2;
+    if (size <= 0xffff) return 3;
+    return 5;
+}
+
+static uint32_t varIntSize(uint64_t n)
+{
+    if (n < 0xfd)           return 1;
+    if (n <= 0xffff)        return 3;
+    if (n <= 0xffffffff)    return 5;
+    return 9;
+}
+
+uint32_t CoinDB::estimateMultiSigTxInSize(unsigned int minsigs, unsigned int pubkeys, bool compressed_keys)
+{
+    // OP_m <pubkeys> OP_n OP_CHECKMULTISIG
+    uint32_t redeemscript_size = 1 + pubkeys * (1 + (compressed_keys ? 33 : 65)) + 1 + 1;
+
+    // OP_0 <sigs> <redeemscript>, with signatures counted at 72 bytes including the hash type
+    uint32_t txinscript_size = 1 + minsigs * (1 + 72) + pushDataSize(redeemscript_size) + redeemscript_size;
+
+    // outpoint, script, sequence
+    return 32 + 4 + varIntSize(txinscript_size) + txinscript_size + 4;
+}
+
+uint64_t CoinSelectionPolicy::cost_of_change() const
+{
+    // Without a fee rate change costs nothing, so any excess is returned rather than given to the miner.
+    if (fee_rate == 0) return 0;
+
+    return fee(change_txout_size) + std::max(min_change, long_term_fee(change_txin_size));
+}
+
+CoinSelection::CoinSelection(const coin_candidates_t& coins_, uint64_t target, const CoinSelectionPolicy& policy)
+    : coins(coins_), value(0), input_fee(0), excess(0), change(0), waste(0)
+{
+    for (auto& coin: coins)
+    {
+        value += coin.value;
+        input_fee += policy.fee(coin.txin_size);
+        waste += (int64_t)policy.fee(coin.txin_size) - (int64_t)policy.long_term_fee(coin.txin_size);
+    }
+
+    if (value >= input_fee + target) { excess = value - input_fee - target; }
+
+    if (excess > 0 && excess >= policy.cost_of_change())
+    {
+        change = excess - policy.fee(policy.change_txout_size);
+        waste += policy.fee(policy.change_txout_size) + policy.long_term_fee(policy.change_txin_size);
+    }
+    else
+    {
+        waste += excess;
+    }
+}
+
+bool CoinDB::selectCoinsBranchAndBound(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection)
+{
+    const unsigned int MAX_TRIES = 100000;
+
+    // Candidates that cost more to spend than they are worth never help. The
+    // rest are explored largest first so the lookahead bound prunes early.
+    coin_candidates_t pool;
+    for (auto& candidate: candidates)
+    {
+        if (policy.effective_value(candidate) > 0) { pool.push_back(candidate); }
+    }
+    std::sort(pool.begin(), pool.end(), [&](const CoinCandidate& a, const CoinCandidate& b) { return policy.effective_value(a) > policy.effective_value(b); });
+
+    std::vector<int64_t> values;
+    std::vector<int64_t> input_waste;
+    int64_t available = 0;
+    for (auto& coin: pool)
+    {
+        values.push_back(policy.effective_value(coin));
+        input_waste.push_back((int64_t)policy.fee(coin.txin_size) - (int64_t)policy.long_term_fee(coin.txin_size));
+        available += values.back();
+    }
+
+    int64_t goal = (int64_t)target;
+    if (available < goal) return false;
+
+    // Selections reaching upper would produce change.
+    int64_t upper = goal + (int64_t)std::max(policy.cost_of_change(), (uint64_t)1);
+
+    // While fees are above the long term rate every extra input adds waste, so a branch already
+    // worse than the best selection cannot improve.
+    bool prune_on_waste = policy.fee_rate > policy.long_term_fee_rate;
+
+    std::vector<size_t> current;
+    std::vector<size_t> best;
+    int64_t current_value = 0;
+    int64_t current_waste = 0;
+    int64_t best_waste = std::numeric_limits<int64_t>::max();
+
+    size_t i = 0;
+    for (unsigned int tries = 0; tries < MAX_TRIES; tries++, i++)
+    {
+        bool backtrack = false;
+        if (current_value + available < goal || current_value >= upper || (prune_on_waste && current_waste > best_waste))
+        {
+            backtrack = true;
+        }
+        else if (current_value >= goal)
+        {
+            int64_t waste = current_waste + current_value - goal;
+            if (waste < best_waste || (waste == best_waste && current.size() < best.size()))
+            {
+                best = current;
+                best_waste = waste;
+            }
+            backtrack = true;
+        }
+
+        if (backtrack)
+        {
+            if (current.empty()) break;
+
+            // Return the coins skipped since the last inclusion to the lookahead, then exclude that coin.
+            for (--i; i > current.back(); --i) { available += values[i]; }
+            current_value -= values[i];
+            current_waste -= input_waste[i];
+            current.pop_back();
+        }
+        else
+        {
+            available -= values[i];
+
+            // Including a coin equal to the one just excluded would repeat a branch already searched.
+            bool previous_excluded = i > 0 && (current.empty() || current.back() != i - 1);
+            if (!previous_excluded || values[i] != values[i - 1] || input_waste[i] != input_waste[i - 1])
+            {
+                current.push_back(i);
+                current_value += values[i];
+                current_waste += input_waste[i];
+            }
+        }
+    }
+
+    if (best.empty()) return false;
+
+    coin_candidates_t coins;
+    for (auto index: best) { coins.push_back(pool[index]); }
+    selection = CoinSelection(coins, target, policy);
+    return true;
+}
+
+bool CoinDB::selectCoinsFewestInputs(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection)
+{
+    int64_t goal = (int64_t)target;
+
+    // One pass finds the smallest coin that covers the target on its own, the usual case.
+    coin_candidates_t pool;
+    const CoinCandidate* lowest_larger = nullptr;
+    for (auto& candidate: candidates)
+    {
+        int64_t value = policy.effective_value(candidate);
+        if (value <= 0) continue;
+
+        if (value >= goal)
+        {
+            if (!lowest_larger || value < policy.effective_value(*lowest_larger)) { lowest_larger = &candidate; }
+        }
+        else
+        {
+            pool.push_back(candidate);
+        }
+    }
+
+    if (lowest_larger)
+    {
+        selection = CoinSelection(coin_candidates_t(1, *lowest_larger), target, policy);
+        return true;
+    }
+
+    std::sort(pool.begin(), pool.end(), [&](const CoinCandidate& a, const CoinCandidate& b) { return policy.effective_value(a) > policy.effective_value(b); });
+
+    // The k largest coins are worth more than any other k, so taking them in order reaches the target soonest.
+    coin_candidates_t coins;
+    int64_t value = 0;
+    for (auto& coin: pool)
+    {
+        coins.push_back(coin);
+        value += policy.effective_value(coin);
+        if (value >= goal) break;
+    }
+    if (value < goal) return false;
+
+    // The last coin only has to make up the rest, so swap in the smallest coin that still does.
+    int64_t rest = goal - (value - policy.effective_value(coins.back()));
+    size_t last = coins.size() - 1;
+    for (size_t i = pool.size(); i-- > last;)
+    {
+        if (policy.effective_value(pool[i]) >= rest)
+        {
+            coins.back() = pool[i];
+            break;
+        }
+    }
+
+    selection = CoinSelection(coins, target, policy);
+    return true;
+}
+
+// Stochastic search for the subset of values with the smallest sum not less than target.
+static void approximateBestSubset(const std::vector<int64_t>& values, int64_t total, int64_t target, std::vector<bool>& best, int64_t& best_value, unsigned int iterations)
+{
+    best.assign(values.size(), true);
+    best_value = total;
+
+    std::vector<bool> included;
+    for (unsigned int rep = 0; rep < iterations && best_value != target; rep++)
+    {
+        included.assign(values.size(), false);
+        int64_t value = 0;
+        bool reached_target = false;
+        for (int pass = 0; pass < 2 && !reached_target; pass++)
+        {
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                // The first pass takes coins at random, the second adds the ones it left out.
+                if (pass == 0 ? (std::rand() & 1) : !included[i])
+                {
+                    value += values[i];
+                    included[i] = true;
+                    if (value >= target)
+                    {
+                        reached_target = true;
+                        if (value < best_value)
+                        {
+                            best_value = value;
+                            best = included;
+                        }
+                        value -= values[i];
+                        included[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
+
+const size_t KNAPSACK_MAX_ITERATIONS = 1000;
+const size_t KNAPSACK_MIN_ITERATIONS = 10;
+const size_t KNAPSACK_WORK_LIMIT = 500000;
+
+bool CoinDB::selectCoinsKnapsack(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection)
+{
+    // Without a fee rate a smaller sum saves nothing, while every extra input still makes the transaction larger.
+    if (policy.fee_rate == 0) return selectCoinsFewestInputs(candidates, target, policy, selection);
+
+    int64_t goal = (int64_t)target;
+    int64_t cost_of_change = (int64_t)policy.cost_of_change();
+
+    // Coins smaller than the target plus the cost of change are combined. Of the larger ones only the smallest matters.
+    coin_candidates_t lower;
+    int64_t lower_total = 0;
+    const CoinCandidate* lowest_larger = nullptr;
+    for (auto& candidate: candidates)
+    {
+        int64_t value = policy.effective_value(candidate);
+        if (value <= 0) continue;
+
+        if (value == goal)
+        {
+            selection = CoinSelection(coin_candidates_t(1, candidate), target, policy);
+            return true;
+        }
+        else if (value < goal + cost_of_change)
+        {
+            lower.push_back(candidate);
+            lower_total += value;
+        }
+        else if (!lowest_larger || value < policy.effective_value(*lowest_larger))
+        {
+            lowest_larger = &candidate;
+        }
+    }
+
+    if (lower_total == goal)
+    {
+        selection = CoinSelection(lower, target, policy);
+        return true;
+    }
+
+    if (lower_total < goal)
+    {
+        if (!lowest_larger) return false;
+        selection = CoinSelection(coin_candidates_t(1, *lowest_larger), target, policy);
+        return true;
+    }
+
+    std::sort(lower.begin(), lower.end(), [&](const CoinCandidate& a, const CoinCandidate& b) { return policy.effective_value(a) > policy.effective_value(b); });
+    std::vector<int64_t> values;
+    for (auto& coin: lower) { values.push_back(policy.effective_value(coin)); }
+
+    // Each iteration visits every coin, so large sets get fewer iterations.
+    unsigned int iterations = (unsigned int)std::min<size_t>(KNAPSACK_MAX_ITERATIONS, std::max<size_t>(KNAPSACK_MIN_ITERATIONS, KNAPSACK_WORK_LIMIT / values.size()));
+
+    // Look for an exact match first, then for one leaving enough for a change output.
+    std::vector<bool> best;
+    int64_t best_value;
+    approximateBestSubset(values, lower_total, goal, best, best_value, iterations);
+    if (best_value != goal && lower_total >= goal + cost_of_change)
+    {
+        approximateBestSubset(values, lower_total, goal + cost_of_change, best, best_value, iterations);
+    }
+
+    if (lowest_larger && ((best_value != goal && best_value < goal + cost_of_change) || policy.effective_value(*lowest_larger) <= best_value))
+    {
+        selection = CoinSelection(coin_candidates_t(1, *lowest_larger), target, policy);
+        return true;
+    }
+
+    coin_candidates_t coins;
+    for (size_t i = 0; i < lower.size(); i++)
+    {
+        if (best[i]) { coins.push_back(lower[i]); }
+    }
+    selection = CoinSelection(coins, target, policy);
+    return true;
+}
+
+bool CoinDB::selectCoinsRandom(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection)
+{
+    coin_candidates_t pool;
+    for (auto& candidate: candidates)
+    {
+        if (policy.effective_value(candidate) > 0) { pool.push_back(candidate); }
+    }
+    std::random_shuffle(pool.begin(), pool.end(), [](int i) { return std::rand() % i; });
+
+    coin_candidates_t coins;
+    int64_t value = 0;
+    for (auto& coin: pool)
+    {
+        coins.push_back(coin);
+        value += policy.effective_value(coin);
+        if (value >= (int64_t)target)
+        {
+            selection = CoinSelection(coins, target, policy);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CoinDB::selectCoins(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection)
+{
+    // Avoiding change or matching the target closely can take more inputs than it saves, so the selection that
+    // wastes least is kept. Waste does not count inputs that cost nothing to spend, so ties go to fewer inputs.
+    auto better = [](const CoinSelection& a, const CoinSelection& b)
+    {
+        return a.waste < b.waste || (a.waste == b.waste && a.coins.size() < b.coins.size());
+    };
+
+    if (!selectCoinsFewestInputs(candidates, target, policy, selection)) return false;
+
+    CoinSelection other;
+    if (policy.fee_rate > 0)
+    {
+        if (selectCoinsKnapsack(candidates, target, policy, other) && better(other, selection)) { selection = other; }
+        if (selectCoinsBranchAndBound(candidates, target, policy, other) && !better(selection, other)) { selection = other; }
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinSelection.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Chooses which unspent outputs fund a transaction. Selectors only see output
+// ids, values and estimated input sizes, so they can be run and benchmarked
+// without a database.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+namespace CoinDB
+{
+
+// Serialized size of a fully signed input spending a pay-to-script-hash m of n multisig output.
+uint32_t estimateMultiSigTxInSize(unsigned int minsigs, unsigned int pubkeys, bool compressed_keys = true);
+
+// Serialized size of a pay-to-script-hash output.
+const uint32_t P2SH_TXOUT_SIZE = 32;
+
+// Change smaller than this is left to the fee rather than creating a dust output. Only applies while a fee rate is set.
+const uint64_t DEFAULT_MIN_CHANGE = 5460;
+
+struct CoinCandidate
+{
+    CoinCandidate() : id(0), value(0), txin_size(0) { }
+    CoinCandidate(unsigned long id_, uint64_t value_, uint32_t txin_size_) : id(id_), value(value_), txin_size(txin_size_) { }
+
+    unsigned long id;       // TxOut id
+    uint64_t value;
+    uint32_t txin_size;     // estimated size of the signed input that spends it
+};
+
+typedef std::vector<CoinCandidate> coin_candidates_t;
+
+// Fee rates are in satoshis per 1000 bytes. The default policy charges
+// nothing per input and makes change of any excess, so the fee passed to
+// Vault::createTx is the whole fee.
+struct CoinSelectionPolicy
+{
+    CoinSelectionPolicy() :
+        fee_rate(0),
+        long_term_fee_rate(0),
+        change_txout_size(P2SH_TXOUT_SIZE),
+        change_txin_size(0),
+        min_change(DEFAULT_MIN_CHANGE) { }
+
+    uint64_t fee_rate;              // paid for each selected input and for the change output
+    uint64_t long_term_fee_rate;    // expected rate when the change is eventually spent
+    uint32_t change_txout_size;
+    uint32_t change_txin_size;      // size of the input that will spend the change
+    uint64_t min_change;            // ignored while fee_rate is 0
+
+    uint64_t fee(uint32_t size) const { return fee_rate * size / 1000; }
+    uint64_t long_term_fee(uint32_t size) const { return long_term_fee_rate * size / 1000; }
+
+    // Value a candidate adds once the fee for spending it is paid.
+    int64_t effective_value(const CoinCandidate& coin) const { return (int64_t)coin.value - (int64_t)fee(coin.txin_size); }
+
+    // A change output is only created when the excess is at least this much. 0 while fee_rate is 0.
+    uint64_t cost_of_change() const;
+};
+
+// The chosen coins and what spending them leaves over. excess is what
+// remains after the target and the input fees, and becomes change only when
+// it covers the cost of change. Otherwise it is added to the fee.
+struct CoinSelection
+{
+    CoinSelection() : value(0), input_fee(0), excess(0), change(0), waste(0) { }
+    CoinSelection(const coin_candidates_t& coins, uint64_t target, const CoinSelectionPolicy& policy);
+
+    coin_candidates_t coins;
+    uint64_t value;
+    uint64_t input_fee;
+    uint64_t excess;
+    uint64_t change;
+    int64_t waste;          // cost of this selection compared to spending the same coins at the long term fee rate with no excess
+};
+
+// Selectors return false if the candidates cannot cover the target. target
+// includes the outputs and the fixed part of the fee, but not the input fees.
+typedef std::function<bool(const coin_candidates_t& /*candidates*/, uint64_t /*target*/, const CoinSelectionPolicy& /*policy*/, CoinSelection& /*selection*/)> coin_selector_t;
+
+// Depth first search for the lowest waste subset whose excess is below the
+// cost of change, so no change output is needed. Ties go to the subset with
+// fewer inputs. Fails if there is none within the iteration limit.
+bool selectCoinsBranchAndBound(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection);
+
+// The single smallest coin that covers the target, or else the largest
+// coins until the target is covered, which takes the fewest inputs.
+bool selectCoinsFewestInputs(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection);
+
+// Randomized approximation of the smallest subset that covers the target
+// plus the cost of change, or the single smallest coin that does. While
+// fee_rate is 0 inputs cost nothing, so it selects the fewest inputs instead.
+bool selectCoinsKnapsack(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection);
+
+// Adds coins in random order until the target is covered.
+bool selectCoinsRandom(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection);
+
+// Whichever of branch and bound, knapsack and fewest inputs wastes less. On a
+// tie, which is common while fee_rate is 0 and inputs cost nothing, whichever
+// has fewer inputs. Branch and bound is skipped while fee_rate is 0 since
+// avoiding change saves nothing then.
+bool selectCoins(const coin_candidates_t& candidates, uint64_t target, const CoinSelectionPolicy& policy, CoinSelection& selection);
+
+}
@@ -15,11 +15,14 @@
 
 #include <string>
 #include <memory>   // std::unique_ptr
+#include <utility>  // std::move
 #include <cstdlib>  // std::exit
 #include <iostream>
 
 #include <odb/database.hxx>
 
+#include "StorageProfile.h"
+
 #if defined(DATABASE_MYSQL)
 #  include <odb/connection.hxx>
 #  include <odb/transaction.hxx>
@@ -30,6 +33,10 @@
 #  include <odb/transaction.hxx>
 #  include <odb/schema-catalog.hxx>
 #  include <odb/sqlite/database.hxx>
+#  include <odb/sqlite/connection.hxx>
+#  include <odb/sqlite/connection-factory.hxx>
+#  include <sstream>
+#  include <stdexcept>
 #elif defined(DATABASE_PGSQL)
 #  include <odb/pgsql/database.hxx>
 #elif defined(DATABASE_ORACLE)
@@ -43,8 +50,64 @@
 namespace CoinDB
 {
 
+#if defined(DATABASE_SQLITE)
+inline void sqlite_exec(sqlite3* handle, const std::string& sql)
+{
+    char* errmsg = nullptr;
+    if (sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, &errmsg) != SQLITE_OK)
+    {
+        std::string error(errmsg ? errmsg : "unknown error");
+        sqlite3_free(errmsg);
+        throw std::runtime_error(sql + " - " + error);
+    }
+}
+
+inline void apply_storage_profile(sqlite3* handle, const StorageProfile& profile)
+{
+    static const char* synchronous[] = { "OFF", "NORMAL", "FULL" };
+
+    std::stringstream pragmas;
+    if (profile.wal) { pragmas << "PRAGMA journal_mode=WAL;"; }
+    pragmas << "PRAGMA synchronous=" << synchronous[profile.synchronous] << ";"
+            << "PRAGMA mmap_size=" << profile.mmap_size << ";"
+            << "PRAGMA cache_size=" << profile.cache_size << ";"
+            << "PRAGMA temp_store=" << (profile.temp_store_memory ? "MEMORY" : "DEFAULT") << ";";
+
+    // Checkpoints run on our own thread so commits never stall on one.
+    if (profile.wal && profile.checkpoint_interval) { pragmas << "PRAGMA wal_autocheckpoint=0;"; }
+
+    sqlite_exec(handle, pragmas.str());
+}
+
+// Pooled connections keep their prepared statement caches for the lifetime
+// of the pool, so the profile only needs to be applied when one is created.
+class ProfiledConnectionFactory : public odb::sqlite::connection_pool_factory
+{
+public:
+    explicit ProfiledConnectionFactory(const StorageProfile& profile) : profile_(profile) { }
+
+protected:
+    virtual pooled_connection_ptr create()
+    {
+        pooled_connection_ptr connection(connection_pool_factory::create());
+        apply_storage_profile(connection->handle(), profile_);
+        return connection;
+    }
+
+private:
+    StorageProfile profile_;
+};
+
+// Copies WAL pages back into the database file without blocking readers or writers.
+inline void checkpoint_database(odb::database& db)
+{
+    odb::sqlite::connection_ptr c(static_cast<odb::sqlite::database&>(db).connection());
+    sqlite_exec(c->handle(), "PRAGMA wal_checkpoint(PASSIVE)");
+}
+#endif
+
 inline std::unique_ptr<odb::database>
-open_database (int& argc, char* argv[], bool create = false)
+open_database (int& argc, char* argv[], bool create = false, const StorageProfile& profile = StorageProfile())
 {
   using namespace std;
   using namespace odb::core;
@@ -72,9 +135,10 @@ open_database (int& argc, char* argv[], bool create = false)
 #if defined(DATABASE_MYSQL)
   unique_ptr<database> db (new odb::mysql::database (argc, argv));
 #elif defined(DATABASE_SQLITE)
+  unique_ptr<odb::sqlite::connection_factory> factory (new ProfiledConnectionFactory (profile));
   unique_ptr<database> db (
     new odb::sqlite::database (
-      argc, argv, false, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
+      argc, argv, false, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, true, "", std::move (factory)));
 
   // Create the database schema. Due to bugs in SQLite foreign key
   // support for DDL statements, we need to temporarily disable
@@ -103,7 +167,7 @@ open_database (int& argc, char* argv[], bool create = false)
 }
 
 inline std::unique_ptr<odb::database>
-openDatabase(const std::string& user, const std::string& passwd, const std::string& dbname, bool create = false)
+openDatabase(const std::string& user, const std::string& passwd, const std::string& dbname, bool create = false, const StorageProfile& profile = StorageProfile())
 {
     using namespace odb::core;
 
@@ -112,7 +176,8 @@ openDatabase(const std::string& user, const std::string& passwd, const std::stri
 #elif defined(DATABASE_SQLITE)
     int flags = SQLITE_OPEN_READWRITE;
     if (create) flags |= SQLITE_OPEN_CREATE;
-    std::unique_ptr<database> db(new odb::sqlite::database(dbname, flags, false));
+    std::unique_ptr<odb::sqlite::connection_factory> factory(new ProfiledConnectionFactory(profile));
+    std::unique_ptr<database> db(new odb::sqlite::database(dbname, flags, false, "", std::move(factory)));
 #endif
 
   // Create the database schema. Due to bugs in SQLite foreign key
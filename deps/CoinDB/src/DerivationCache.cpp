@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// DerivationCache.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#include "DerivationCache.h"
+
+using namespace CoinDB;
+
+DerivationCache::DerivationCache(std::size_t capacity, bool wipe_nodes)
+    : capacity_(capacity), wipe_nodes_(wipe_nodes), hits_(0), misses_(0)
+{
+}
+
+DerivationCache& DerivationCache::publicNodes()
+{
+    static DerivationCache cache(DEFAULT_PUBLIC_CAPACITY, false);
+    return cache;
+}
+
+DerivationCache& DerivationCache::privateNodes()
+{
+    static DerivationCache cache(DEFAULT_PRIVATE_CAPACITY, true);
+    return cache;
+}
+
+bool DerivationCache::get(const bytes_t& keychain_hash, const std::vector<uint32_t>& path, Coin::HDKeychain& node)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    auto it = entries_.find(key_t(keychain_hash, path));
+    if (it == entries_.end())
+    {
+        misses_++;
+        return false;
+    }
+
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+    node = it->second.node;
+    return true;
+}
+
+void DerivationCache::put(const bytes_t& keychain_hash, const std::vector<uint32_t>& path, const Coin::HDKeychain& node)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (capacity_ == 0) return;
+
+    key_t key(keychain_hash, path);
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+        return;
+    }
+
+    while (entries_.size() >= capacity_) { evict(entries_.find(lru_.back())); }
+
+    lru_.push_front(key);
+    Entry& entry = entries_[key];
+    entry.node = node;
+    entry.lru_it = lru_.begin();
+}
+
+void DerivationCache::erase(const bytes_t& keychain_hash)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    auto it = entries_.lower_bound(key_t(keychain_hash, std::vector<uint32_t>()));
+    while (it != entries_.end() && it->first.first == keychain_hash) { evict(it++); }
+}
+
+void DerivationCache::clear()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    while (!entries_.empty()) { evict(entries_.begin()); }
+}
+
+void DerivationCache::setCapacity(std::size_t capacity)
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    capacity_ = capacity;
+    while (entries_.size() > capacity_) { evict(entries_.find(lru_.back())); }
+}
+
+DerivationCache::Stats DerivationCache::getStats() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.size = entries_.size();
+    stats.capacity = capacity_;
+    return stats;
+}
+
+void DerivationCache::resetStats()
+{
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    hits_ = 0;
+    misses_ = 0;
+}
+
+void DerivationCache::evict(map_t::iterator it)
+{
+    if (wipe_nodes_) { it->second.node.wipe(); }
+    lru_.erase(it->second.lru_it);
+    entries_.erase(it);
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// DerivationCache.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Bounded caches of derived HD nodes, keyed by the hash of the keychain they
+// were derived from and the derivation path below it. Signing keys are
+// derived from these nodes with a single getChild() call, so issuing,
+// refilling and signing many scripts of the same account bin does not repeat
+// the derivation of the bin node.
+//
+// Public and private nodes live in separate caches. Private nodes are wiped
+// when they are evicted, when their keychain is locked and when the vault
+// locks any keychain.
+
+#pragma once
+
+#include <CoinCore/hdkeys.h>
+#include <CoinCore/typedefs.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <list>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+namespace CoinDB
+{
+
+class DerivationCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        std::size_t size;
+        std::size_t capacity;
+    };
+
+    static const std::size_t DEFAULT_PUBLIC_CAPACITY = 4096;
+    static const std::size_t DEFAULT_PRIVATE_CAPACITY = 256;
+
+    DerivationCache(std::size_t capacity, bool wipe_nodes);
+    ~DerivationCache() { clear(); }
+
+    // Process-wide caches used by Keychain.
+    static DerivationCache& publicNodes();
+    static DerivationCache& privateNodes();
+
+    // Returns false and leaves node untouched on a miss.
+    bool get(const bytes_t& keychain_hash, const std::vector<uint32_t>& path, Coin::HDKeychain& node);
+    void put(const bytes_t& keychain_hash, const std::vector<uint32_t>& path, const Coin::HDKeychain& node);
+
+    void erase(const bytes_t& keychain_hash);
+    void clear();
+
+    void setCapacity(std::size_t capacity);
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    DerivationCache(const DerivationCache&);
+    DerivationCache& operator=(const DerivationCache&);
+
+    typedef std::pair<bytes_t, std::vector<uint32_t>> key_t;
+    typedef std::list<key_t> lru_t;
+    struct Entry
+    {
+        Coin::HDKeychain node;
+        lru_t::iterator lru_it;
+    };
+    typedef std::map<key_t, Entry> map_t;
+
+    mutable boost::mutex mutex_;
+    std::size_t capacity_;
+    bool wipe_nodes_;
+    map_t entries_;
+    lru_t lru_; // most recently used first
+    uint64_t hits_;
+    uint64_t misses_;
+
+    void evict(map_t::iterator it);
+};
+
+}
@@ -8,6 +8,7 @@
 //
 
 #include "Schema.h"
+#include "DerivationCache.h"
 
 #include <stdutils/stringutils.h>
 
@@ -146,6 +147,7 @@ std::shared_ptr<Keychain> Keychain::child(uint32_t i, bool get_private, const se
 void Keychain::lock() const
 {
     privkey_.clear();
+    DerivationCache::privateNodes().erase(hash_);
 }
 
 void Keychain::unlock(const secure_bytes_t& lock_key) const
@@ -191,15 +193,29 @@ secure_bytes_t Keychain::getSigningPrivateKey(uint32_t i, const std::vector<uint
 
     // Remove initial zero from privkey if necessary
     secure_bytes_t stripped_privkey = (privkey_.size() > 32) ? secure_bytes_t(privkey_.begin() + 1, privkey_.end()) : privkey_;
-    Coin::HDKeychain hdkeychain(stripped_privkey, chain_code_, child_num_, parent_fp_, depth_);
-    for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
-    return hdkeychain.getPrivateSigningKey(i);
+    Coin::HDKeychain hdkeychain;
+    DerivationCache& cache = DerivationCache::privateNodes();
+    if (!cache.get(hash_, derivation_path, hdkeychain))
+    {
+        hdkeychain = Coin::HDKeychain(stripped_privkey, chain_code_, child_num_, parent_fp_, depth_);
+        for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
+        cache.put(hash_, derivation_path, hdkeychain);
+    }
+    secure_bytes_t signingkey = hdkeychain.getPrivateSigningKey(i);
+    hdkeychain.wipe();
+    return signingkey;
 }
 
 bytes_t Keychain::getSigningPublicKey(uint32_t i, bool get_compressed, const std::vector<uint32_t>& derivation_path) const
 {
-    Coin::HDKeychain hdkeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
-    for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
+    Coin::HDKeychain hdkeychain;
+    DerivationCache& cache = DerivationCache::publicNodes();
+    if (!cache.get(hash_, derivation_path, hdkeychain))
+    {
+        hdkeychain = Coin::HDKeychain(pubkey_, chain_code_, child_num_, parent_fp_, depth_);
+        for (auto k: derivation_path) { hdkeychain = hdkeychain.getChild(k); }
+        cache.put(hash_, derivation_path, hdkeychain);
+    }
     return hdkeychain.getPublicSigningKey(i, get_compressed);
 }
 
@@ -273,6 +289,7 @@ void Keychain::clearPrivateKey()
     privkey_.clear();
     privkey_ciphertext_.clear();
     privkey_salt_ = 0;
+    DerivationCache::privateNodes().erase(hash_);
 }
 
 
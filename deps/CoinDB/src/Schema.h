@@ -18,6 +18,7 @@
 #include <CoinQ/CoinQ_script.h>
 
 #include <odb/core.hxx>
+#include <odb/callback.hxx>
 #include <odb/nullable.hxx>
 #include <odb/database.hxx>
 
@@ -55,7 +56,7 @@ typedef odb::nullable<unsigned long> null_id_t;
 ////////////////////
 
 #define SCHEMA_BASE_VERSION 12
-#define SCHEMA_VERSION      14
+#define SCHEMA_VERSION      16
 
 #ifdef ODB_COMPILER
 #pragma db model version(SCHEMA_BASE_VERSION, SCHEMA_VERSION, open)
@@ -778,6 +779,13 @@ private:
     KeyVector keys_;
 
     std::shared_ptr<Contact> contact_;
+
+    // Every incoming transaction output is matched against this column.
+#if defined(DATABASE_MYSQL)
+    #pragma db index("SigningScript_txoutscript_i") member(txoutscript_, "(64)")
+#else
+    #pragma db index("SigningScript_txoutscript_i") member(txoutscript_)
+#endif
 };
 
 
@@ -908,7 +916,7 @@ private:
     #pragma db id auto
     unsigned long id_;
 
-    #pragma db not_null
+    #pragma db not_null index
     std::shared_ptr<BlockHeader> blockheader_;
 
     uint32_t txcount_;
@@ -1004,7 +1012,7 @@ private:
     bytes_t script_;
     uint32_t sequence_;
 
-    #pragma db not_null
+    #pragma db not_null index
     std::weak_ptr<Tx> tx_;
 
     uint32_t txindex_;
@@ -1012,6 +1020,9 @@ private:
     #pragma db null
     std::weak_ptr<TxOut> outpoint_;
 
+    // Outpoint lookups when connecting inputs to the outputs they spend.
+    #pragma db index("TxIn_outhash_outindex_i") members(outhash_, outindex_)
+
     friend class boost::serialization::access;
     template<class Archive>
     void serialize(Archive& ar, const unsigned int /*version*/)
@@ -1026,7 +1037,7 @@ private:
 typedef std::vector<std::shared_ptr<TxIn>> txins_t;
 
 
-#pragma db object pointer(std::shared_ptr)
+#pragma db object pointer(std::shared_ptr) callback(updateAccountBalances)
 class TxOut
 {
 public:
@@ -1103,17 +1114,21 @@ public:
 private:
     friend class odb::access;
 
+    // Keeps AccountBalance in step with every write. Defined in AccountBalances.cpp.
+    void updateAccountBalances(odb::callback_event event, odb::database& db) const;
+
     #pragma db id auto
     unsigned long id_;
 
     uint64_t value_;
+    #pragma db index
     bytes_t script_;
 
-    #pragma db not_null
+    #pragma db not_null index
     std::weak_ptr<Tx> tx_;
     uint32_t txindex_;
 
-    #pragma db null
+    #pragma db null index
     std::shared_ptr<TxIn> spent_;
 
     #pragma db null
@@ -1135,6 +1150,9 @@ private:
     // Redundant but convenient for view queries.
     status_t status_;
 
+    // Balance and unspent output views filter on both.
+    #pragma db index("TxOut_receiving_account_status_i") members(receiving_account_, status_)
+
     friend class boost::serialization::access;
     template<class Archive>
     void serialize(Archive& ar, const unsigned int /*version*/)
@@ -1149,7 +1167,7 @@ private:
 typedef std::vector<std::shared_ptr<TxOut>> txouts_t;
 
 
-#pragma db object pointer(std::shared_ptr)
+#pragma db object pointer(std::shared_ptr) callback(updateAccountBalances)
 class Tx : public std::enable_shared_from_this<Tx>
 {
 public:
@@ -1238,12 +1256,16 @@ public:
 private:
     friend class odb::access;
 
+    // Keeps AccountBalance in step with every write. Defined in AccountBalances.cpp.
+    void updateAccountBalances(odb::callback_event event, odb::database& db) const;
+
     void fromCoinCore(const Coin::Transaction& coin_tx);
 
     #pragma db id auto
     unsigned long id_;
 
     // hash stays empty until transaction is fully signed.
+    #pragma db index
     bytes_t hash_;
 
     // We'll use the unsigned hash as a unique identifier to avoid malleability issues.
@@ -1274,7 +1296,7 @@ private:
     uint64_t txin_total_;
     uint64_t txout_total_;
 
-    #pragma db null
+    #pragma db null index
     std::shared_ptr<BlockHeader> blockheader_;
 
     #pragma db null
@@ -1358,6 +1380,52 @@ private:
     BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
 
+
+// Unspent outputs received by an account, summed per transaction status and block height. Height 0 holds
+// unconfirmed transactions. Rows are kept in step with TxOut and Tx by their callbacks so balance queries
+// read a few rows per account instead of joining every output.
+#pragma db object pointer(std::shared_ptr)
+class AccountBalance
+{
+public:
+    AccountBalance(unsigned long account_id, Tx::status_t tx_status, uint32_t height, int64_t balance = 0)
+        : account_(account_id), tx_status_(tx_status), height_(height), balance_(balance) { }
+
+    unsigned long id() const { return id_; }
+    unsigned long account_id() const { return account_; }
+    Tx::status_t tx_status() const { return tx_status_; }
+    uint32_t height() const { return height_; }
+
+    void add(int64_t amount) { balance_ += amount; }
+    int64_t balance() const { return balance_; }
+
+private:
+    friend class odb::access;
+    AccountBalance() { }
+
+    #pragma db id auto
+    unsigned long id_;
+
+    // Account id rather than a pointer so erasing an account does not depend on this table.
+    unsigned long account_;
+    Tx::status_t tx_status_;
+    uint32_t height_;
+    int64_t balance_;
+
+    #pragma db index("AccountBalance_bucket_i") unique members(account_, tx_status_, height_)
+};
+
+// An AccountBalance row that does not match its outputs, as reported by Vault::checkAccountBalances().
+struct AccountBalanceDrift
+{
+    unsigned long account_id;
+    std::string account_name; // empty if the account no longer exists
+    Tx::status_t tx_status;
+    uint32_t height;
+    int64_t stored;
+    int64_t actual;
+};
+
 typedef std::vector<std::shared_ptr<Tx>> txs_t;
 
 
@@ -1704,6 +1772,20 @@ struct TxOutView
     uint32_t height;
 };
 
+// Just what coin selection needs, so spendable outputs can be listed without loading their scripts.
+#pragma db view \
+    object(TxOut) \
+    object(Tx inner: TxOut::tx_) \
+    object(BlockHeader: Tx::blockheader_)
+struct CoinCandidateView
+{
+    #pragma db column(TxOut::id_)
+    unsigned long id;
+
+    #pragma db column(TxOut::value_)
+    uint64_t value;
+};
+
 #pragma db view \
     object(TxOut) \
     object(Tx: TxOut::tx_) \
@@ -1717,6 +1799,34 @@ struct BalanceView
     uint64_t balance;
 };
 
+// What a set of outputs adds to each AccountBalance row, computed from the outputs themselves.
+#pragma db view \
+    object(TxOut) \
+    object(Tx inner: TxOut::tx_) \
+    object(BlockHeader: Tx::blockheader_) \
+    object(Account inner: TxOut::receiving_account_) \
+    query((TxOut::status_ == TxOut::UNSPENT && (?)) + "GROUP BY" + Account::id_ + "," + Tx::status_ + "," + BlockHeader::height_)
+struct BalanceContributionView
+{
+    #pragma db column(Account::id_)
+    unsigned long account_id;
+    #pragma db column(Tx::status_)
+    Tx::status_t tx_status;
+    #pragma db column("coalesce(" + BlockHeader::height_ + ", 0)")
+    uint32_t height;
+    #pragma db column("sum(" + TxOut::value_ + ")")
+    uint64_t balance;
+};
+
+#pragma db view \
+    object(AccountBalance) \
+    object(Account inner: AccountBalance::account_ == Account::id_)
+struct AccountBalanceView
+{
+    #pragma db column("coalesce(sum(" + AccountBalance::balance_ + "), 0)")
+    int64_t balance;
+};
+
 #pragma db view \
 	object(MerkleBlock) \
     object(BlockHeader: MerkleBlock::blockheader_) \
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// StorageProfile.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace CoinDB
+{
+
+// Storage settings applied to every connection when a database is opened.
+// Only SQLite uses them. The defaults are what SQLite itself uses, so a
+// default constructed profile leaves behavior unchanged.
+struct StorageProfile
+{
+    enum Synchronous { SYNCHRONOUS_OFF = 0, SYNCHRONOUS_NORMAL = 1, SYNCHRONOUS_FULL = 2 };
+
+    StorageProfile() :
+        wal(false),
+        synchronous(SYNCHRONOUS_FULL),
+        mmap_size(0),
+        cache_size(-2000),
+        temp_store_memory(false),
+        checkpoint_interval(0) { }
+
+    bool wal;                           // write-ahead log instead of rollback journal
+    Synchronous synchronous;
+    int64_t mmap_size;                  // bytes of the database file to memory map, 0 to disable
+    int cache_size;                     // page cache, in pages if positive or in KiB if negative
+    bool temp_store_memory;             // keep temporary tables and indices in memory
+    unsigned int checkpoint_interval;   // seconds between background WAL checkpoints, 0 to disable
+
+    // SQLite defaults: rollback journal, fsync on every commit.
+    static StorageProfile legacy() { return StorageProfile(); }
+
+    // WAL with a synchronous commit. A commit needs one fsync of the log and
+    // survives power loss.
+    static StorageProfile durable()
+    {
+        StorageProfile profile;
+        profile.wal = true;
+        profile.synchronous = SYNCHRONOUS_FULL;
+        profile.mmap_size = 256 * 1024 * 1024;
+        profile.cache_size = -16 * 1024;
+        profile.temp_store_memory = true;
+        profile.checkpoint_interval = 60;
+        return profile;
+    }
+
+    // WAL that only fsyncs on checkpoints. The database stays consistent but
+    // a power loss can drop the last commits, which are refetched on the next
+    // sync unless they were local changes.
+    static StorageProfile fast()
+    {
+        StorageProfile profile = durable();
+        profile.synchronous = SYNCHRONOUS_NORMAL;
+        return profile;
+    }
+};
+
+}
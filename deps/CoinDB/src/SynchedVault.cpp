@@ -36,19 +36,25 @@ const std::string SynchedVault::getStatusString(status_t status)
 // Constructor
 SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
     m_vault(nullptr),
+    m_storageProfile(StorageProfile::durable()),
     m_status(STOPPED),
     m_bestHeight(0),
     m_syncHeight(0),
     m_filterFalsePositiveRate(0.001),
     m_filterTweak(0),
     m_filterFlags(0),
+    m_bBloomFilterLoaded(false),
     m_networkSync(coinParams),
     m_bBlockTreeLoaded(false),
     m_bConnected(false),
     m_bSynching(false),
     m_bBlockTreeSynched(false),
     m_bGotMempool(false),
-    m_bInsertMerkleBlocks(false)
+    m_bInsertMerkleBlocks(false),
+    m_blockBatchSize(DEFAULT_BLOCK_BATCH_SIZE),
+    m_blockBatchLatency(DEFAULT_BLOCK_BATCH_LATENCY),
+    m_completedMerkleBlocks(0),
+    m_merkleBlockFlushTimer(m_networkSync.getIOService())
 {
     LOGGER(trace) << "SynchedVault::SynchedVault()" << std::endl;
 
@@ -149,6 +155,12 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
     {
         LOGGER(trace) << "SynchedVault - Block sync complete." << std::endl;
 
+        if (m_vault)
+        {
+            std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
+            if (m_vault) { flushMerkleBlocks(); }
+        }
+
         if (m_networkSync.connected())
         {
             updateStatus(SYNCHED);
@@ -185,12 +197,14 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         LOGGER(trace) << "SynchedVault - Received new transaction " << cointx.hash().getHex() << std::endl;
 
         if (!m_vault) return;
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
         try
         {
+            flushMerkleBlocks();
             m_vault->insertNewTx(cointx);
+            if (m_bBloomFilterLoaded) { refreshBloomFilter(); }
         }
         catch (const VaultException& e)
         {
@@ -209,12 +223,12 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         LOGGER(trace) << "SynchedVault - Received merkle transaction " << cointx.hash().getHex() << " in block " << chainmerkleblock.hash().getHex() << std::endl;
 
         if (!m_vault) return;
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
         try
         {
-            m_vault->insertMerkleTx(chainmerkleblock, cointx, txindex, txcount);
+            queueMerkleTx(chainmerkleblock, MerkleTxUpdate(cointx, txindex, txcount));
         }
         catch (const VaultException& e)
         {
@@ -234,12 +248,12 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
         LOGGER(trace) << "SynchedVault - Received transaction confirmation " << uchar_vector(txhash).getHex() << " in block " << chainmerkleblock.hash().getHex() << std::endl;
 
         if (!m_vault) return;
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
         try
         {
-            m_vault->confirmMerkleTx(chainmerkleblock, txhash, txindex, txcount);
+            queueMerkleTx(chainmerkleblock, MerkleTxUpdate(txhash, txindex, txcount));
         }
         catch (const VaultException& e)
         {
@@ -259,15 +273,13 @@ SynchedVault::SynchedVault(const CoinQ::CoinParams& coinParams) :
 
         if (!m_vault) return;
         if (!m_bInsertMerkleBlocks) return;
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         if (!m_vault) return;
         if (!m_bInsertMerkleBlocks) return;
 
         try
         {
-            std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(chainMerkleBlock));
-	    merkleblock->txsinserted(true);
-            m_vault->insertMerkleBlock(merkleblock);
+            queueMerkleBlock(chainMerkleBlock);
         }
         catch (const VaultException& e)
         {
@@ -320,10 +332,12 @@ void SynchedVault::openVault(const std::string& dbuser, const std::string& dbpas
     LOGGER(trace) << "SynchedVault::openVault(" << dbuser << ", ..., " << dbname << ", " << (bCreate ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
 
     {
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         m_notifyVaultClosed();
         if (m_vault) delete m_vault;
         m_vault = new Vault;
+        m_vault->setStorageProfile(m_storageProfile);
+        m_bBloomFilterLoaded = false;
         try
         {
             m_vault->open(dbuser, dbpasswd, dbname, bCreate, version, network, migrate);
@@ -356,6 +370,7 @@ void SynchedVault::openVault(const std::string& dbuser, const std::string& dbpas
         m_vault->subscribeTxInsertionError([this](std::shared_ptr<Tx> tx, std::string description) { m_notifyTxInsertionError(tx, description); });
         m_vault->subscribeMerkleBlockInsertionError([this](std::shared_ptr<MerkleBlock> merkleblock, std::string description) { m_notifyMerkleBlockInsertionError(merkleblock, description); });
         m_vault->subscribeTxConfirmationError([this](std::shared_ptr<MerkleBlock> merkleblock, bytes_t txhash) { m_notifyTxConfirmationError(merkleblock, txhash); });
+        m_vault->subscribeReorg([this](uint32_t forkHeight, ids_t txIds) { m_notifyReorg(forkHeight, txIds); });
     }
 
     m_notifyVaultOpened(m_vault);
@@ -368,13 +383,15 @@ void SynchedVault::closeVault()
 
     {
         if (!m_vault) return;
-        std::lock_guard<std::mutex> lock(m_vaultMutex);
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
         if (!m_vault) return;
 
         m_bInsertMerkleBlocks = false;
         m_networkSync.stopSynchingBlocks();
+        flushMerkleBlocks();
         delete m_vault;
         m_vault = nullptr;
+        m_bBloomFilterLoaded = false;
     }
 
     m_notifyVaultClosed();
@@ -402,6 +419,10 @@ void SynchedVault::stopSync()
 {
     LOGGER(trace) << "SynchedVault::stopSync()" << std::endl;
     m_networkSync.stop();
+
+    if (!m_vault) return;
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
+    if (m_vault) { flushMerkleBlocks(); }
 }
 
 //TODO: get rid of m_bInsertMerkleBlocks
@@ -411,8 +432,9 @@ void SynchedVault::suspendBlockUpdates()
 
     if (!m_vault) return;
     if (!m_bInsertMerkleBlocks) return;
-    std::lock_guard<std::mutex> lock(m_vaultMutex);
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
     m_bInsertMerkleBlocks = false;
+    if (m_vault) { flushMerkleBlocks(); }
 }
 
 void SynchedVault::syncBlocks()
@@ -422,9 +444,10 @@ void SynchedVault::syncBlocks()
     if (!m_bConnected) throw std::runtime_error("Not connected.");
 
     if (!m_vault) throw std::runtime_error("No vault is open.");
-    std::lock_guard<std::mutex> lock(m_vaultMutex);
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
+    flushMerkleBlocks();
     uint32_t startTime = m_vault->getMaxFirstBlockTimestamp();
     if (startTime == 0)
     {
@@ -432,7 +455,8 @@ void SynchedVault::syncBlocks()
         return;
     }
 
-    m_networkSync.setBloomFilter(m_vault->getBloomFilter(0.001, 0, 0));
+    // The peer's filter is cleared whenever block sync stops so it must be loaded again.
+    if (!refreshBloomFilter()) { m_networkSync.setBloomFilter(m_networkSync.getBloomFilter()); }
 
     std::vector<bytes_t> locatorHashes = m_vault->getLocatorHashes();
     m_bGotMempool = false;
@@ -447,15 +471,41 @@ void SynchedVault::setFilterParams(double falsePositiveRate, uint32_t nTweak, ui
     m_filterFlags = nFlags;
 }
 
-void SynchedVault::updateBloomFilter()
+void SynchedVault::updateBloomFilter(bool bRebuild)
 {
-    LOGGER(trace) << "SynchedVault::updateBloomFilter()" << std::endl;
+    LOGGER(trace) << "SynchedVault::updateBloomFilter(" << (bRebuild ? "true" : "false") << ")" << std::endl;
 
     if (!m_vault) throw std::runtime_error("No vault is open.");
-    std::lock_guard<std::mutex> lock(m_vaultMutex);
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
-    m_networkSync.setBloomFilter(m_vault->getBloomFilter(0.001, 0, 0));
+    flushMerkleBlocks();
+    refreshBloomFilter(bRebuild);
+}
+
+// Must be called with m_vaultMutex locked.
+bool SynchedVault::refreshBloomFilter(bool bRebuild)
+{
+    const Coin::BloomFilter& filter = m_networkSync.getBloomFilter();
+    std::vector<bytes_t> elements = m_vault->getNewBloomFilterElements();
+
+    // Scripts issued since the filter was built are sent with filteradd, or with a reload of the filter if an element
+    // is too large for filteradd, unless that would push the false positive rate over target. A filter already at
+    // maximum size can't do better when rebuilt.
+    if (!bRebuild && m_bBloomFilterLoaded && filter.isSet())
+    {
+        if (elements.empty()) return false;
+        if (filter.isMaxSize() || filter.getFalsePositiveRate(elements.size()) <= m_filterFalsePositiveRate)
+        {
+            m_networkSync.addToBloomFilter(elements);
+            return false;
+        }
+    }
+
+    LOGGER(trace) << "SynchedVault::refreshBloomFilter() - rebuilding bloom filter." << std::endl;
+    m_networkSync.setBloomFilter(m_vault->getBloomFilter(m_filterFalsePositiveRate, m_filterTweak, m_filterFlags));
+    m_bBloomFilterLoaded = true;
+    return true;
 }
 
 std::shared_ptr<Tx> SynchedVault::sendTx(const bytes_t& hash)
@@ -464,7 +514,7 @@ std::shared_ptr<Tx> SynchedVault::sendTx(const bytes_t& hash)
     if (!m_bConnected) throw std::runtime_error("Not connected.");
 
     if (!m_vault) throw std::runtime_error("No vault is open.");
-    std::lock_guard<std::mutex> lock(m_vaultMutex);
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
     std::shared_ptr<Tx> tx = m_vault->getTx(hash);
@@ -485,7 +535,7 @@ std::shared_ptr<Tx> SynchedVault::sendTx(unsigned long tx_id)
     if (!m_bConnected) throw std::runtime_error("Not connected.");
 
     if (!m_vault) throw std::runtime_error("No vault is open.");
-    std::lock_guard<std::mutex> lock(m_vaultMutex);
+    std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
     std::shared_ptr<Tx> tx = m_vault->getTx(tx_id);
@@ -514,9 +564,10 @@ void SynchedVault::sendTx(Coin::Transaction& coin_tx)
 void SynchedVault::insertFakeMerkleBlock(unsigned int nExtraLeaves)
 {
     if (!m_vault) throw std::runtime_error("No vault is open.");
-    std::unique_lock<std::mutex> lock(m_vaultMutex);
+    std::unique_lock<std::recursive_mutex> lock(m_vaultMutex);
     if (!m_vault) throw std::runtime_error("No vault is open.");
 
+    flushMerkleBlocks();
     txs_t txs = m_vault->getTxs(Tx::PROPAGATED);
     std::vector<Coin::Transaction> cointxs;
     std::vector<uchar_vector> txhashes;
@@ -532,6 +583,9 @@ void SynchedVault::insertFakeMerkleBlock(unsigned int nExtraLeaves)
 
     lock.unlock();
     m_networkSync.insertMerkleBlock(coinmerkleblock, cointxs);
+
+    lock.lock();
+    if (m_vault) { flushMerkleBlocks(); }
 }
 
 
@@ -555,9 +609,122 @@ void SynchedVault::clearAllSlots()
     m_notifyMerkleBlockInserted.clear();
     m_notifyTxInsertionError.clear();
     m_notifyMerkleBlockInsertionError.clear();
+    m_notifyReorg.clear();
     m_notifyProtocolError.clear();
 }
 
+// Must be called with m_vaultMutex locked.
+void SynchedVault::startMerkleBlockBatch()
+{
+    m_merkleBlockBatchStart = std::chrono::steady_clock::now();
+
+    // Otherwise the latency limit would only be checked when the next block arrives.
+    m_merkleBlockFlushTimer.expires_from_now(std::chrono::milliseconds(m_blockBatchLatency));
+    m_merkleBlockFlushTimer.async_wait([this](const boost::system::error_code& ec)
+    {
+        if (ec || !m_vault) return;
+        std::lock_guard<std::recursive_mutex> lock(m_vaultMutex);
+        if (m_vault) { flushMerkleBlocks(false); }
+    });
+}
+
+// Must be called with m_vaultMutex locked.
+void SynchedVault::queueMerkleBlock(const ChainMerkleBlock& merkleblock)
+{
+    if (m_merkleBlockUpdates.empty()) { startMerkleBlockBatch(); }
+
+    m_merkleBlockUpdates.push_back(MerkleBlockUpdate(merkleblock));
+    m_completedMerkleBlocks++;
+    flushMerkleBlocks(false);
+}
+
+// Must be called with m_vaultMutex locked.
+void SynchedVault::queueMerkleTx(const ChainMerkleBlock& merkleblock, const MerkleTxUpdate& tx)
+{
+    if (m_merkleBlockUpdates.empty()) { startMerkleBlockBatch(); }
+
+    if (m_merkleBlockUpdates.empty() || m_merkleBlockUpdates.back().merkleblock.hash() != merkleblock.hash())
+    {
+        m_merkleBlockUpdates.push_back(MerkleBlockUpdate(merkleblock));
+    }
+
+    m_merkleBlockUpdates.back().txs.push_back(tx);
+    if (tx.txindex + 1 == tx.txcount) { m_completedMerkleBlocks++; }
+    flushMerkleBlocks(false);
+}
+
+// Must be called with m_vaultMutex locked.
+void SynchedVault::flushMerkleBlocks(bool bForce)
+{
+    if (m_merkleBlockUpdates.empty()) return;
+
+    if (!bForce && m_completedMerkleBlocks < m_blockBatchSize &&
+        std::chrono::steady_clock::now() - m_merkleBlockBatchStart < std::chrono::milliseconds(m_blockBatchLatency)) return;
+
+    MerkleBlockUpdates updates;
+    updates.swap(m_merkleBlockUpdates);
+    m_completedMerkleBlocks = 0;
+
+    boost::system::error_code ec;
+    m_merkleBlockFlushTimer.cancel(ec);
+
+    try
+    {
+        m_vault->insertMerkleBlocks(updates);
+        if (m_bBloomFilterLoaded) { refreshBloomFilter(); }
+        return;
+    }
+    catch (const std::exception& e)
+    {
+        LOGGER(debug) << "SynchedVault::flushMerkleBlocks() - batch of " << updates.size() << " merkle block(s) failed, inserting one at a time: " << e.what() << std::endl;
+    }
+
+    // The batch was rolled back. Replay it one operation per transaction so a bad block or transaction only affects itself.
+    auto apply = [this](std::function<void()> op)
+    {
+        try
+        {
+            op();
+        }
+        catch (const VaultException& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), e.code());
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << e.what() << std::endl;
+            m_notifyVaultError(e.what(), -1);
+        }
+    };
+
+    for (auto& update: updates)
+    {
+        const ChainMerkleBlock& chainmerkleblock = update.merkleblock;
+        if (update.txs.empty())
+        {
+            apply([&]()
+            {
+                std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(chainmerkleblock));
+                merkleblock->txsinserted(true);
+                m_vault->insertMerkleBlock(merkleblock);
+            });
+            continue;
+        }
+
+        for (auto& tx: update.txs)
+        {
+            apply([&]()
+            {
+                if (tx.confirmonly) { m_vault->confirmMerkleTx(chainmerkleblock, tx.txhash, tx.txindex, tx.txcount); }
+                else                { m_vault->insertMerkleTx(chainmerkleblock, tx.cointx, tx.txindex, tx.txcount); }
+            });
+        }
+    }
+
+    if (m_bBloomFilterLoaded) { apply([this]() { refreshBloomFilter(); }); }
+}
+
 void SynchedVault::updateStatus(status_t newStatus)
 {
     if (m_status != newStatus)
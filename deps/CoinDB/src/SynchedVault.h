@@ -15,7 +15,10 @@
 
 #include <CoinQ/CoinQ_netsync.h>
 
+#include <boost/asio/steady_timer.hpp>
+
 #include <mutex>
+#include <chrono>
 
 namespace CoinDB
 {
@@ -42,6 +45,10 @@ public:
     void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = false, CoinQBlockTreeMem::callback_t callback = nullptr);
     bool areHeadersLoaded() const { return m_bBlockTreeLoaded; }
 
+    // Applies to vaults opened after the call.
+    void setStorageProfile(const StorageProfile& profile) { m_storageProfile = profile; }
+    const StorageProfile& getStorageProfile() const { return m_storageProfile; }
+
     void openVault(const std::string& dbname, bool bCreate = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     void openVault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool bCreate = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     void closeVault();
@@ -56,7 +63,23 @@ public:
     void syncBlocks();
 
     void setFilterParams(double falsePositiveRate, uint32_t nTweak, uint8_t nFlags);
-    void updateBloomFilter();
+    // Sends scripts issued since the last update to the peer, rebuilding the filter only when
+    // it would exceed the target false positive rate or when bRebuild is set (e.g. after deletions).
+    void updateBloomFilter(bool bRebuild = false);
+
+    // Number of filtered blocks kept in flight while catching up
+    void setBlockSyncWindow(unsigned int blockSyncWindow) { m_networkSync.setBlockSyncWindow(blockSyncWindow); }
+    unsigned int getBlockSyncWindow() const { return m_networkSync.getBlockSyncWindow(); }
+
+    // Merkle blocks and their transactions are written to the vault in batches, one database transaction per batch.
+    // A batch is committed once it holds blockBatchSize complete blocks, once its first block is older than
+    // blockBatchLatency milliseconds, or as soon as block sync catches up with the tip.
+    static const unsigned int DEFAULT_BLOCK_BATCH_SIZE = 100;
+    static const unsigned int DEFAULT_BLOCK_BATCH_LATENCY = 1000;
+    void setBlockBatchSize(unsigned int blockBatchSize) { m_blockBatchSize = blockBatchSize ? blockBatchSize : 1; }
+    unsigned int getBlockBatchSize() const { return m_blockBatchSize; }
+    void setBlockBatchLatency(unsigned int blockBatchLatency) { m_blockBatchLatency = blockBatchLatency; }
+    unsigned int getBlockBatchLatency() const { return m_blockBatchLatency; }
 
     status_t getStatus() const { return m_status; }
     uint32_t getBestHeight() const { return m_bestHeight; }
@@ -100,6 +123,7 @@ public:
     Signals::Connection subscribeTxInsertionError(TxErrorSignal::Slot slot) { return m_notifyTxInsertionError.connect(slot); }
     Signals::Connection subscribeMerkleBlockInsertionError(MerkleBlockErrorSignal::Slot slot) { return m_notifyMerkleBlockInsertionError.connect(slot); }
     Signals::Connection subscribeTxConfirmationError(TxConfirmationErrorSignal::Slot slot) { return m_notifyTxConfirmationError.connect(slot); }
+    Signals::Connection subscribeReorg(ReorgSignal::Slot slot) { return m_notifyReorg.connect(slot); }
     Signals::Connection subscribeProtocolError(ErrorSignal::Slot slot) { return m_notifyProtocolError.connect(slot); }
 
     void clearAllSlots();
@@ -107,8 +131,9 @@ public:
 private:
     friend class VaultLock;
 
-    mutable std::mutex          m_vaultMutex;
+    mutable std::recursive_mutex m_vaultMutex; // recursive since block sync events can fire from within locked calls
     Vault*                      m_vault;
+    StorageProfile              m_storageProfile;
 
     status_t                    m_status;
     void                        updateStatus(status_t newStatus);
@@ -127,6 +152,8 @@ private:
     double                      m_filterFalsePositiveRate;
     uint32_t                    m_filterTweak;
     uint8_t                     m_filterFlags;
+    bool                        m_bBloomFilterLoaded; // network filter was built from the open vault
+    bool                        refreshBloomFilter(bool bRebuild = false); // returns true if the filter was rebuilt
 
     CoinQ::Network::NetworkSync m_networkSync;
     std::string                 m_blockTreeFile;
@@ -138,6 +165,18 @@ private:
 
     bool                        m_bInsertMerkleBlocks;
 
+    // Merkle block batching - must be accessed with m_vaultMutex locked
+    unsigned int                m_blockBatchSize;
+    unsigned int                m_blockBatchLatency;
+    MerkleBlockUpdates          m_merkleBlockUpdates;
+    unsigned int                m_completedMerkleBlocks;
+    std::chrono::steady_clock::time_point m_merkleBlockBatchStart;
+    boost::asio::steady_timer   m_merkleBlockFlushTimer; // commits a batch whose peer has stalled
+    void                        startMerkleBlockBatch();
+    void                        queueMerkleBlock(const ChainMerkleBlock& merkleblock);
+    void                        queueMerkleTx(const ChainMerkleBlock& merkleblock, const MerkleTxUpdate& tx);
+    void                        flushMerkleBlocks(bool bForce = true);
+
     // Vault state events
     VaultSignal                 m_notifyVaultOpened;
     VoidSignal                  m_notifyVaultClosed;
@@ -160,6 +199,7 @@ private:
     TxErrorSignal               m_notifyTxInsertionError;
     MerkleBlockErrorSignal      m_notifyMerkleBlockInsertionError;
     TxConfirmationErrorSignal   m_notifyTxConfirmationError;
+    ReorgSignal                 m_notifyReorg;
     ErrorSignal                 m_notifyProtocolError;
 };
 
@@ -169,7 +209,7 @@ public:
     explicit VaultLock(const SynchedVault& synchedVault) : m_lock(synchedVault.m_vaultMutex) { }
 
 private:
-    std::lock_guard<std::mutex> m_lock;
+    std::lock_guard<std::recursive_mutex> m_lock;
 };
 
 }
@@ -11,6 +11,8 @@
 
 #include "Vault.h"
 #include "Database.h"
+#include "DerivationCache.h"
+#include "AccountBalances.h"
 
 #include <CoinQ/CoinQ_script.h>
 #include <CoinQ/CoinQ_blocks.h>
@@ -66,7 +68,13 @@ static const migration_entry<14> migrate_compressed_keys_entry(&migrate_compress
 /*
  * class Vault implementation
 */
-Vault::Vault(int argc, char** argv, bool create, uint32_t version, const std::string& network, bool migrate)
+Vault::Vault(int argc, char** argv, bool create, uint32_t version, const std::string& network, bool migrate) :
+    storageProfile_(StorageProfile::durable()),
+    coinSelector_(&selectCoins),
+    bloomFilterTracking_(false),
+    txFilterLoaded_(false),
+    txFilterHits_(0),
+    txFilterMisses_(0)
 {
     LOGGER(trace) << "Vault::Vault(..., " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
 
@@ -75,7 +83,13 @@ Vault::Vault(int argc, char** argv, bool create, uint32_t version, const std::st
 //    if (create) setSchemaVersion(version);
 }
 
-Vault::Vault(const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate)
+Vault::Vault(const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate) :
+    storageProfile_(StorageProfile::durable()),
+    coinSelector_(&selectCoins),
+    bloomFilterTracking_(false),
+    txFilterLoaded_(false),
+    txFilterHits_(0),
+    txFilterMisses_(0)
 {
     LOGGER(trace) << "Vault::Vault(" << dbname << ", " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
 
@@ -84,7 +98,13 @@ Vault::Vault(const std::string& dbname, bool create, uint32_t version, const std
 //    if (create) setSchemaVersion(version);
 }
 
-Vault::Vault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate)
+Vault::Vault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate) :
+    storageProfile_(StorageProfile::durable()),
+    coinSelector_(&selectCoins),
+    bloomFilterTracking_(false),
+    txFilterLoaded_(false),
+    txFilterHits_(0),
+    txFilterMisses_(0)
 {
     LOGGER(trace) << "Vault::Vault(" << dbuser << ", ..., " << dbname << ", " << (create ? "true" : "false") << ", " << version << ", " << network << ", " << (migrate ? "true" : "false") << ")" << std::endl;
 
@@ -151,11 +171,16 @@ void Vault::open(int argc, char** argv, bool create, uint32_t version, const std
 
     if (argc >= 2) name_ = argv[1];
 
+    stopCheckpointThread();
     boost::lock_guard<boost::mutex> lock(mutex);
+    clearTxFilter_unwrapped();
+    bloomFilterTracking_ = false;
+    newBloomFilterElements_.clear();
+    pendingBloomFilterElements_.clear();
 
     try
     {
-        db_ = open_database(argc, argv, create);
+        db_ = open_database(argc, argv, create, storageProfile_);
     }
     catch (const std::exception& e)
     {
@@ -205,7 +230,7 @@ void Vault::open(int argc, char** argv, bool create, uint32_t version, const std
             if (!migrate) throw VaultNeedsSchemaMigrationException(name_, v, cv);
 
             LOGGER(info) << "Migrating database from schema " << v << " to schema " << cv << "." << std::endl;
-            odb::schema_catalog::migrate(*db_);
+            migrateSchema_unwrapped(v, cv);
             setSchemaVersion_unwrapped(version);
 
             if (v < 14 && cv >= 14)
@@ -218,10 +243,18 @@ void Vault::open(int argc, char** argv, bool create, uint32_t version, const std
                     db_->update(account);
                 }
             }
+
+            if (v < 16 && cv >= 16)
+            {
+                LOGGER(info) << "Computing account balances..." << std::endl;
+                CoinDB::rebuildAccountBalances(*db_);
+            }
                 
             t.commit();
         }
     }
+
+    startCheckpointThread();
 }
 
 void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create, uint32_t version, const std::string& network, bool migrate)
@@ -230,11 +263,16 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
 
     name_ = dbname;
 
+    stopCheckpointThread();
     boost::lock_guard<boost::mutex> lock(mutex);
+    clearTxFilter_unwrapped();
+    bloomFilterTracking_ = false;
+    newBloomFilterElements_.clear();
+    pendingBloomFilterElements_.clear();
 
     try
     {
-        db_ = openDatabase(dbuser, dbpasswd, dbname, create);
+        db_ = openDatabase(dbuser, dbpasswd, dbname, create, storageProfile_);
     }
     catch (const std::exception& e)
     {
@@ -284,7 +322,7 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
             if (!migrate) throw VaultNeedsSchemaMigrationException(name_, v, cv);
 
             LOGGER(info) << "Migrating database from schema " << v << " to schema " << cv << "." << std::endl;
-            odb::schema_catalog::migrate(*db_);
+            migrateSchema_unwrapped(v, cv);
             setSchemaVersion_unwrapped(version);
 
             if (v < 14 && cv >= 14)
@@ -298,10 +336,30 @@ void Vault::open(const std::string& dbuser, const std::string& dbpasswd, const s
                 }
             }
 
+            if (v < 16 && cv >= 16)
+            {
+                LOGGER(info) << "Computing account balances..." << std::endl;
+                CoinDB::rebuildAccountBalances(*db_);
+            }
+
             t.commit();
         }
 
     }
+
+    startCheckpointThread();
+}
+
+// Steps through each schema version so progress can be reported. Version 15 only adds indexes, which
+// can take a while on vaults with a long history.
+void Vault::migrateSchema_unwrapped(uint32_t from_version, uint32_t to_version)
+{
+    for (uint32_t version = from_version + 1; version <= to_version; version++)
+    {
+        LOGGER(info) << "Migrating database to schema " << version << (version == 15 ? " - building indexes" : "") << "..." << std::endl;
+        notifySchemaMigration(version, to_version);
+        odb::schema_catalog::migrate(*db_, version);
+    }
 }
 
 void Vault::close()
@@ -309,10 +367,64 @@ void Vault::close()
     LOGGER(trace) << "Vault::close()" << std::endl;
 
     if (!db_) return;
+    stopCheckpointThread();
     boost::lock_guard<boost::mutex> lock(mutex);
+    clearTxFilter_unwrapped();
+    bloomFilterTracking_ = false;
+    newBloomFilterElements_.clear();
+    pendingBloomFilterElements_.clear();
     db_.reset();
 }
 
+void Vault::setStorageProfile(const StorageProfile& profile)
+{
+    LOGGER(trace) << "Vault::setStorageProfile(...)" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    storageProfile_ = profile;
+}
+
+StorageProfile Vault::getStorageProfile() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return storageProfile_;
+}
+
+void Vault::startCheckpointThread()
+{
+#if defined(DATABASE_SQLITE)
+    if (!storageProfile_.wal || !storageProfile_.checkpoint_interval) return;
+
+    boost::chrono::seconds interval(storageProfile_.checkpoint_interval);
+    checkpointThread_ = boost::thread([this, interval]()
+    {
+        try
+        {
+            while (true)
+            {
+                boost::this_thread::sleep_for(interval);
+                boost::lock_guard<boost::mutex> lock(mutex);
+                checkpoint_database(*db_);
+            }
+        }
+        catch (const boost::thread_interrupted&)
+        {
+        }
+        catch (const std::exception& e)
+        {
+            LOGGER(error) << "Vault checkpoint thread - " << e.what() << std::endl;
+        }
+    });
+#endif
+}
+
+void Vault::stopCheckpointThread()
+{
+    if (!checkpointThread_.joinable()) return;
+    checkpointThread_.interrupt();
+    checkpointThread_.join();
+}
+
 uint32_t Vault::getSchemaVersion() const
 {
     LOGGER(trace) << "Vault::getSchemaVersion()" << std::endl;
@@ -491,7 +603,7 @@ std::vector<bytes_t> Vault::getLocatorHashes_unwrapped() const
     return hashes;
 }
 
-Coin::BloomFilter Vault::getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const
+Coin::BloomFilter Vault::getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags)
 {
     LOGGER(trace) << "Vault::getBloomFilter(" << falsePositiveRate << ", " << nTweak << ", " << nFlags << ")" << std::endl;
 
@@ -502,25 +614,52 @@ Coin::BloomFilter Vault::getBloomFilter(double falsePositiveRate, uint32_t nTwea
     return getBloomFilter_unwrapped(falsePositiveRate, nTweak, nFlags);
 }
 
-Coin::BloomFilter Vault::getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const
+static void addBloomFilterElements(std::vector<bytes_t>& elements, const bytes_t& txinscript, const bytes_t& txoutscript)
 {
     using namespace CoinQ::Script;
 
+    Script script(txinscript);
+    elements.push_back(script.txinscript(Script::SIGN));            // Add input script element
+    elements.push_back(getScriptPubKeyPayee(txoutscript).second);   // Add output script element
+}
+
+Coin::BloomFilter Vault::getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags)
+{
+    bloomFilterTracking_ = true;
+    newBloomFilterElements_.clear();
+
     std::vector<bytes_t> elements;
     odb::result<SigningScriptView> r(db_->query<SigningScriptView>());
-    for (auto& view: r)
-    {
-        Script script(view.txinscript);
-        elements.push_back(script.txinscript(Script::SIGN));                // Add input script element
-        elements.push_back(getScriptPubKeyPayee(view.txoutscript).second);  // Add output script element
-    }
+    for (auto& view: r) { addBloomFilterElements(elements, view.txinscript, view.txoutscript); }
     if (elements.empty()) return Coin::BloomFilter();
 
-    Coin::BloomFilter filter(elements.size(), falsePositiveRate, nTweak, nFlags);
+    // Leave room for scripts issued later so they can be added without rebuilding the filter.
+    uint32_t capacity = elements.size() + elements.size() * BLOOM_FILTER_HEADROOM_PERCENT / 100;
+    Coin::BloomFilter filter(capacity, falsePositiveRate, nTweak, nFlags);
     for (auto& element: elements) { filter.insert(element); }
     return filter;
 }
 
+std::vector<bytes_t> Vault::getNewBloomFilterElements()
+{
+    LOGGER(trace) << "Vault::getNewBloomFilterElements()" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    std::vector<bytes_t> elements;
+    elements.swap(newBloomFilterElements_);
+    return elements;
+}
+
+void Vault::onBloomFilterTransactionEnd(unsigned short event, void* key, unsigned long long /*data*/)
+{
+    Vault* vault = static_cast<Vault*>(key);
+    if (event == odb::transaction::event_commit && vault->bloomFilterTracking_)
+    {
+        vault->newBloomFilterElements_.insert(vault->newBloomFilterElements_.end(), vault->pendingBloomFilterElements_.begin(), vault->pendingBloomFilterElements_.end());
+    }
+    vault->pendingBloomFilterElements_.clear();
+}
+
 hashvector_t Vault::getIncompleteBlockHashes() const
 {
     LOGGER(trace) << "Vault::getIncompleteBlockHashes()" << std::endl;
@@ -541,6 +680,123 @@ hashvector_t Vault::getIncompleteBlockHashes_unwrapped() const
     return hashes;
 }
 
+uint64_t Vault::getTxFilterHits() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return txFilterHits_;
+}
+
+uint64_t Vault::getTxFilterMisses() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return txFilterMisses_;
+}
+
+void Vault::resetTxFilterCounters()
+{
+    LOGGER(trace) << "Vault::resetTxFilterCounters()" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    txFilterHits_ = 0;
+    txFilterMisses_ = 0;
+}
+
+void Vault::loadTxFilter_unwrapped()
+{
+    clearTxFilter_unwrapped();
+
+    odb::result<SigningScriptView> script_r(db_->query<SigningScriptView>());
+    for (auto& script_view: script_r)
+    {
+        txFilterTxInScripts_.insert(script_view.txinscript);
+        txFilterTxOutScripts_.insert(script_view.txoutscript);
+    }
+
+    odb::result<TxView> tx_r(db_->query<TxView>());
+    for (auto& tx_view: tx_r) { txFilterUnsignedHashes_.insert(tx_view.unsigned_hash); }
+
+    txFilterLoaded_ = true;
+    LOGGER(debug) << "Vault::loadTxFilter_unwrapped() - loaded " << txFilterTxOutScripts_.size() << " scripts and " << txFilterUnsignedHashes_.size() << " transactions." << std::endl;
+}
+
+void Vault::clearTxFilter_unwrapped()
+{
+    txFilterLoaded_ = false;
+    txFilterTxInScripts_.clear();
+    txFilterTxOutScripts_.clear();
+    txFilterUnsignedHashes_.clear();
+}
+
+void Vault::indexSigningScript_unwrapped(std::shared_ptr<SigningScript> script)
+{
+    // Scripts created after the last bloom filter was built are queued so they can be added to it. A rolled back
+    // transaction drops its elements.
+    if (bloomFilterTracking_)
+    {
+        if (pendingBloomFilterElements_.empty()) { odb::transaction::current().callback_register(&Vault::onBloomFilterTransactionEnd, this); }
+        addBloomFilterElements(pendingBloomFilterElements_, script->txinscript(), script->txoutscript());
+    }
+
+    // Nothing to do until the tx filter is loaded - the script will be read from the database then.
+    if (!txFilterLoaded_) return;
+
+    txFilterTxInScripts_.insert(script->txinscript());
+    txFilterTxOutScripts_.insert(script->txoutscript());
+}
+
+bool Vault::matchTxFilter_unwrapped(std::shared_ptr<Tx> tx)
+{
+    if (!txFilterLoaded_) loadTxFilter_unwrapped();
+
+    bool match = txFilterUnsignedHashes_.count(tx->unsigned_hash()) > 0;
+
+    // Outputs paying to one of our scripts
+    if (!match)
+    {
+        for (auto& txout: tx->txouts())
+        {
+            if (txFilterTxOutScripts_.count(txout->script()))
+            {
+                match = true;
+                break;
+            }
+        }
+    }
+
+    // Inputs spending one of our scripts. Spending reveals the redeem script so no outpoint lookup is needed.
+    if (!match)
+    {
+        using namespace CoinQ::Script;
+        for (auto& txin: tx->txins())
+        {
+            try
+            {
+                Script script(txin->script());
+                if (script.type() == Script::PAY_TO_MULTISIG_SCRIPT_HASH && txFilterTxOutScripts_.count(script.txoutscript()))
+                {
+                    match = true;
+                    break;
+                }
+
+                script.clearSigs();
+                if (txFilterTxInScripts_.count(script.txinscript(Script::EDIT)))
+                {
+                    match = true;
+                    break;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                // Unrecognized input scripts cannot belong to our accounts
+            }
+        }
+    }
+
+    if (match)  { txFilterHits_++;      }
+    else        { txFilterMisses_++;    }
+    return match;
+}
+
 void Vault::exportVault(const std::string& filepath, bool exportprivkeys) const
 {
     LOGGER(trace) << "Vault::exportVault(" << filepath << ", " << (exportprivkeys ? "true" : "false") << std::endl;
@@ -1109,6 +1365,7 @@ void Vault::lockAllKeychains()
 
     boost::lock_guard<boost::mutex> lock(mutex);
     mapPrivateKeyUnlock.clear();
+    DerivationCache::privateNodes().clear();
     for (auto& item: mapPrivateKeyUnlock)
     {
         notifyKeychainLocked(item.first);
@@ -1121,6 +1378,9 @@ void Vault::lockKeychain(const std::string& keychain_name)
 
     boost::lock_guard<boost::mutex> lock(mutex);
     mapPrivateKeyUnlock.erase(keychain_name);
+
+    // Cached nodes are keyed by keychain hash, not name, so drop all private nodes.
+    DerivationCache::privateNodes().clear();
     notifyKeychainLocked(keychain_name);
 }
 
@@ -1350,6 +1610,7 @@ std::shared_ptr<Account> Vault::importAccount_unwrapped(boost::archive::text_iar
         {
             for (auto& key: script->keys()) { db_->persist(key); }
             db_->persist(script);
+            indexSigningScript_unwrapped(script);
         }
 
         db_->update(bin);
@@ -1454,10 +1715,12 @@ void Vault::newAccount(const std::string& account_name, unsigned int minsigs, co
         std::shared_ptr<SigningScript> changeSigningScript = changeAccountBin->newSigningScript();
         for (auto& key: changeSigningScript->keys()) { db_->persist(key); } 
         db_->persist(changeSigningScript);
+        indexSigningScript_unwrapped(changeSigningScript);
 
         std::shared_ptr<SigningScript> defaultSigningScript = defaultAccountBin->newSigningScript();
         for (auto& key: defaultSigningScript->keys()) { db_->persist(key); }
         db_->persist(defaultSigningScript);
+        indexSigningScript_unwrapped(defaultSigningScript);
     }
     db_->update(changeAccountBin);
     db_->update(defaultAccountBin);
@@ -1579,16 +1842,39 @@ uint64_t Vault::getAccountBalance(const std::string& account_name, unsigned int
     boost::lock_guard<boost::mutex> lock(mutex);
 #endif
     odb::core::transaction t(db_->begin());
-    typedef odb::query<BalanceView> query_t;
-    query_t query(query_t::Account::name == account_name && query_t::TxOut::status == TxOut::UNSPENT && query_t::Tx::status.in_range(tx_statuses.begin(), tx_statuses.end()));
+    typedef odb::query<AccountBalanceView> query_t;
+    query_t query(query_t::Account::name == account_name && query_t::AccountBalance::tx_status.in_range(tx_statuses.begin(), tx_statuses.end()));
     if (min_confirmations > 0)
     {
         uint32_t best_height = getBestHeight_unwrapped();
         if (min_confirmations > best_height) return 0;
-        query = (query && query_t::BlockHeader::height <= best_height + 1 - min_confirmations);
+        query = (query && query_t::AccountBalance::height != 0 && query_t::AccountBalance::height <= best_height + 1 - min_confirmations);
     }
-    odb::result<BalanceView> r(db_->query<BalanceView>(query));
-    return r.empty() ? 0 : r.begin()->balance;
+    odb::result<AccountBalanceView> r(db_->query<AccountBalanceView>(query));
+    return r.empty() ? 0 : (uint64_t)r.begin()->balance;
+}
+
+std::vector<AccountBalanceDrift> Vault::checkAccountBalances() const
+{
+    LOGGER(trace) << "Vault::checkAccountBalances()" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    return findAccountBalanceDrift(*db_);
+}
+
+void Vault::rebuildAccountBalances()
+{
+    LOGGER(trace) << "Vault::rebuildAccountBalances()" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    CoinDB::rebuildAccountBalances(*db_);
+    t.commit();
 }
 
 std::shared_ptr<AccountBin> Vault::addAccountBin(const std::string& account_name, const std::string& bin_name)
@@ -1625,6 +1911,7 @@ std::shared_ptr<AccountBin> Vault::addAccountBin(const std::string& account_name
         std::shared_ptr<SigningScript> script = bin->newSigningScript();
         for (auto& key: script->keys()) { db_->persist(key); }
         db_->persist(script);
+        indexSigningScript_unwrapped(script);
     }
     db_->update(bin);
     db_->update(account);
@@ -1729,7 +2016,8 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
             std::shared_ptr<SigningScript> script = bin->newSigningScript();
             script->status(SigningScript::ISSUED);
             for (auto& key: script->keys()) { db_->persist(key); }
-            db_->persist(script); 
+            db_->persist(script);
+            indexSigningScript_unwrapped(script);
         }
     }
 
@@ -1742,7 +2030,8 @@ void Vault::refillAccountBinPool_unwrapped(std::shared_ptr<AccountBin> bin, uint
     {
         std::shared_ptr<SigningScript> script = bin->newSigningScript();
         for (auto& key: script->keys()) { db_->persist(key); }
-        db_->persist(script); 
+        db_->persist(script);
+        indexSigningScript_unwrapped(script);
     } 
     db_->update(bin);
 }
@@ -1771,46 +2060,128 @@ std::vector<SigningScriptView> Vault::getSigningScriptViews(const std::string& a
     return views;
 }
 
+// Keyset condition selecting the rows after cursor in history order. Unconfirmed transactions have no block header
+// and sort as height 0. No index serves the order, so SQLite sorts the rows past the cursor and keeps the first limit.
+template<typename Query, typename IdColumn>
+static Query afterHistoryCursor(const HistoryCursor& cursor, const IdColumn& id)
+{
+    if (cursor.id == 0) return Query(true);
+
+    Query height("coalesce(" + Query::BlockHeader::height + ", 0)");
+    return Query((height + "<" + Query::_val(cursor.height)) ||
+        ((height + "=" + Query::_val(cursor.height)) && (Query::Tx::timestamp < cursor.timestamp || (Query::Tx::timestamp == cursor.timestamp && id < cursor.id))));
+}
+
+template<typename Query, typename IdColumn>
+static void appendHistoryOrder(Query& query, const IdColumn& id, unsigned int limit)
+{
+    query += "ORDER BY coalesce(" + Query::BlockHeader::height + ", 0) DESC," + Query::Tx::timestamp + "DESC," + id + "DESC";
+    if (limit)
+    {
+        std::stringstream ss;
+        ss << "LIMIT " << limit;
+        query = query + ss.str().c_str();
+    }
+}
+
 std::vector<TxOutView> Vault::getTxOutViews(const std::string& account_name, const std::string& bin_name, int role_flags, int txout_status_flags, int tx_status_flags, bool hide_change) const
 {
     LOGGER(trace) << "Vault::getTxOutViews(" << account_name << ", " << bin_name << ", " << TxOut::getRoleString(role_flags) << ", " << TxOut::getStatusString(txout_status_flags) << ", " << ", " << Tx::getStatusString(tx_status_flags) << ")" << std::endl;
 
+    HistoryFilter filter;
+    filter.account_name = account_name;
+    filter.bin_name = bin_name;
+    filter.role_flags = role_flags;
+    filter.txout_status_flags = txout_status_flags;
+    filter.tx_status_flags = tx_status_flags;
+    filter.hide_change = hide_change;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    std::vector<TxOutView> views;
+    HistoryCursor cursor;
+    queryTxOutViews_unwrapped(filter, cursor, 0, [&](const TxOutView& view) -> bool { views.push_back(view); return true; });
+    return views;
+}
+
+std::vector<TxOutView> Vault::getTxOutViewPage(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int count) const
+{
+    LOGGER(trace) << "Vault::getTxOutViewPage(" << filter.account_name << ", " << cursor.height << ":" << cursor.timestamp << ":" << cursor.id << ", " << count << ")" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    std::vector<TxOutView> views;
+    queryTxOutViews_unwrapped(filter, cursor, count, [&](const TxOutView& view) -> bool { views.push_back(view); return true; });
+    return views;
+}
+
+void Vault::streamTxOutViews(const HistoryFilter& filter, txout_view_callback_t callback, const HistoryCursor& cursor) const
+{
+    LOGGER(trace) << "Vault::streamTxOutViews(" << filter.account_name << ", " << cursor.height << ":" << cursor.timestamp << ":" << cursor.id << ")" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    HistoryCursor position(cursor);
+    queryTxOutViews_unwrapped(filter, position, 0, callback);
+}
+
+unsigned int Vault::queryTxOutViews_unwrapped(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int limit, txout_view_callback_t callback) const
+{
     typedef odb::query<TxOutView> query_t;
     query_t query(query_t::receiving_account::id != 0 || query_t::sending_account::id != 0);
-    if (!account_name.empty())
+    if (!filter.account_name.empty())
     {
-        query_t role_query(1 == 1);
-        if (role_flags & TxOut::ROLE_SENDER)    role_query = (role_query && (query_t::sending_account::name == account_name));
-        if (role_flags & TxOut::ROLE_RECEIVER)  role_query = (role_query || (query_t::receiving_account::name == account_name));
+        query_t role_query(false);
+        if (filter.role_flags & TxOut::ROLE_SENDER)     role_query = (role_query || (query_t::sending_account::name == filter.account_name));
+        if (filter.role_flags & TxOut::ROLE_RECEIVER)   role_query = (role_query || (query_t::receiving_account::name == filter.account_name));
         query = query && role_query;
     }
-    if (!bin_name.empty())                      query = (query && query_t::AccountBin::name == bin_name);
-    if (hide_change)                            query = (query && (query_t::TxOut::account_bin.is_null() || query_t::AccountBin::name != CHANGE_BIN_NAME));
+    if (!filter.bin_name.empty())                       query = (query && query_t::AccountBin::name == filter.bin_name);
+    if (filter.hide_change)                             query = (query && (query_t::TxOut::account_bin.is_null() || query_t::AccountBin::name != CHANGE_BIN_NAME));
 
-    std::vector<TxOut::status_t> txout_statuses = TxOut::getStatusFlags(txout_status_flags);
+    std::vector<TxOut::status_t> txout_statuses = TxOut::getStatusFlags(filter.txout_status_flags);
     query = (query && query_t::TxOut::status.in_range(txout_statuses.begin(), txout_statuses.end()));
 
-    if (tx_status_flags != Tx::ALL)
+    if (filter.tx_status_flags != Tx::ALL)
     {
-        std::vector<Tx::status_t> tx_statuses = Tx::getStatusFlags(tx_status_flags);
+        std::vector<Tx::status_t> tx_statuses = Tx::getStatusFlags(filter.tx_status_flags);
         query = (query && query_t::Tx::status.in_range(tx_statuses.begin(), tx_statuses.end()));
     }
 
-    query += "ORDER BY" + query_t::BlockHeader::height + "DESC," + query_t::Tx::timestamp + "DESC," + query_t::Tx::id + "DESC";
+    if (filter.start_time)                              query = (query && query_t::Tx::timestamp >= filter.start_time);
+    if (filter.end_time)                                query = (query && query_t::Tx::timestamp < filter.end_time);
+    if (filter.min_height)                              query = (query && query_t::BlockHeader::height >= filter.min_height);
 
-#if defined(LOCK_ALL_CALLS)
-    boost::lock_guard<boost::mutex> lock(mutex);
-#endif
-    odb::core::transaction t(db_->begin());
-    std::vector<TxOutView> views;
+    query = (query && afterHistoryCursor<query_t>(cursor, query_t::TxOut::id));
+    appendHistoryOrder(query, query_t::TxOut::id, limit);
+
+    unsigned int rows = 0;
+    bool stopped = false;
     odb::result<TxOutView> r(db_->query<TxOutView>(query));
     for (auto& view: r)
     {
-        view.updateRole(role_flags);
-        std::vector<TxOutView> split_views = view.getSplitRoles(TxOut::ROLE_RECEIVER, account_name);
-        for (auto& split_view: split_views) { views.push_back(split_view); }
+        rows++;
+        cursor.height = view.height;
+        cursor.timestamp = view.tx_timestamp;
+        cursor.id = view.id;
+
+        view.updateRole(filter.role_flags);
+        std::vector<TxOutView> split_views = view.getSplitRoles(TxOut::ROLE_RECEIVER, filter.account_name);
+        for (auto& split_view: split_views)
+        {
+            if (!callback(split_view)) { stopped = true; break; }
+        }
+        if (stopped) break;
     }
-    return views;
+
+    cursor.end = !stopped && (limit == 0 || rows < limit);
+    return rows;
 }
 
 
@@ -1961,12 +2332,14 @@ std::shared_ptr<AccountBin> Vault::importAccountBin_unwrapped(const std::string&
         script->status(SigningScript::ISSUED);
         for (auto& key: script->keys()) { db_->persist(key); }
         db_->persist(script);
+        indexSigningScript_unwrapped(script);
     }
     for (unsigned int i = 0; i < DEFAULT_UNUSED_POOL_SIZE; i++)
     {
         std::shared_ptr<SigningScript> script = bin->newSigningScript();
         for (auto& key: script->keys()) { db_->persist(key); }
         db_->persist(script);
+        indexSigningScript_unwrapped(script);
     }
     db_->update(bin);
     
@@ -2169,6 +2542,74 @@ std::vector<TxView> Vault::getTxViews(int tx_status_flags, unsigned long start,
     return views; 
 }
 
+std::vector<TxView> Vault::getTxViewPage(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int count) const
+{
+    LOGGER(trace) << "Vault::getTxViewPage(" << filter.account_name << ", " << cursor.height << ":" << cursor.timestamp << ":" << cursor.id << ", " << count << ")" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    std::vector<TxView> views;
+    queryTxViews_unwrapped(filter, cursor, count, [&](const TxView& view) -> bool { views.push_back(view); return true; });
+    return views;
+}
+
+void Vault::streamTxViews(const HistoryFilter& filter, tx_view_callback_t callback, const HistoryCursor& cursor) const
+{
+    LOGGER(trace) << "Vault::streamTxViews(" << filter.account_name << ", " << cursor.height << ":" << cursor.timestamp << ":" << cursor.id << ")" << std::endl;
+
+#if defined(LOCK_ALL_CALLS)
+    boost::lock_guard<boost::mutex> lock(mutex);
+#endif
+    odb::core::transaction t(db_->begin());
+    HistoryCursor position(cursor);
+    queryTxViews_unwrapped(filter, position, 0, callback);
+}
+
+unsigned int Vault::queryTxViews_unwrapped(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int limit, tx_view_callback_t callback) const
+{
+    typedef odb::query<TxView> query_t;
+    query_t query(afterHistoryCursor<query_t>(cursor, query_t::Tx::id));
+    if (!filter.account_name.empty())
+    {
+        // TxView has a row per transaction, so outputs are matched with a subquery rather than a join.
+        unsigned long account_id = getAccount_unwrapped(filter.account_name)->id();
+        query_t txout_query(query_t("EXISTS (SELECT 1 FROM TxOut WHERE TxOut.tx =") + query_t::Tx::id + "AND (0 = 1");
+        if (filter.role_flags & TxOut::ROLE_SENDER)     txout_query = txout_query + "OR TxOut.sending_account =" + query_t::_val(account_id);
+        if (filter.role_flags & TxOut::ROLE_RECEIVER)   txout_query = txout_query + "OR TxOut.receiving_account =" + query_t::_val(account_id);
+        txout_query = txout_query + "))";
+        query = (query && txout_query);
+    }
+
+    if (filter.tx_status_flags != Tx::ALL)
+    {
+        std::vector<Tx::status_t> tx_statuses = Tx::getStatusFlags(filter.tx_status_flags);
+        query = (query && query_t::Tx::status.in_range(tx_statuses.begin(), tx_statuses.end()));
+    }
+
+    if (filter.start_time)                              query = (query && query_t::Tx::timestamp >= filter.start_time);
+    if (filter.end_time)                                query = (query && query_t::Tx::timestamp < filter.end_time);
+    if (filter.min_height)                              query = (query && query_t::BlockHeader::height >= filter.min_height);
+
+    appendHistoryOrder(query, query_t::Tx::id, limit);
+
+    unsigned int rows = 0;
+    bool stopped = false;
+    odb::result<TxView> r(db_->query<TxView>(query));
+    for (auto& view: r)
+    {
+        rows++;
+        cursor.height = view.height;
+        cursor.timestamp = view.timestamp;
+        cursor.id = view.id;
+        if (!callback(view)) { stopped = true; break; }
+    }
+
+    cursor.end = !stopped && (limit == 0 || rows < limit);
+    return rows;
+}
+
 std::shared_ptr<Tx> Vault::insertTx(std::shared_ptr<Tx> tx, bool replace_labels)
 {
     LOGGER(trace) << "Vault::insertTx(...) - hash: " << uchar_vector(tx->hash()).getHex() << ", unsigned hash: " << uchar_vector(tx->unsigned_hash()).getHex() << ", replace_labels: " << (replace_labels ? "true" : "false") << std::endl;
@@ -2191,6 +2632,13 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
     {
         // TODO: Validate signatures
         tx->updateStatus();
+
+        if (!matchTxFilter_unwrapped(tx))
+        {
+            LOGGER(trace) << "Vault::insertTx_unwrapped(...) - transaction does not affect vault. hash: " << uchar_vector(tx->hash()).getHex() << std::endl;
+            return nullptr;
+        }
+
         std::string hashstr = uchar_vector(tx->hash()).getHex();
         std::string unsignedhashstr = uchar_vector(tx->unsigned_hash()).getHex();
         LOGGER(trace) << "Vault::insertTx_unwrapped(...) - hash: " << hashstr << ", unsigned hash: " << unsignedhashstr << std::endl;
@@ -2491,6 +2939,7 @@ std::shared_ptr<Tx> Vault::insertTx_unwrapped(std::shared_ptr<Tx> tx, bool repla
             db_->persist(*tx);
             for (auto& txin:        tx->txins())    { db_->persist(txin);       }
             for (auto& txout:       tx->txouts())   { db_->persist(txout);      }
+            txFilterUnsignedHashes_.insert(tx->unsigned_hash());
 
             // Update other affected objects
             for (auto& txin:        updated_txins)  { db_->update(txin);        }
@@ -2549,6 +2998,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
 
         std::shared_ptr<Tx> tx(new Tx());
         tx->set(cointx, blockheader ? blockheader->timestamp() : time(NULL), Tx::PROPAGATED);
+        if (!matchTxFilter_unwrapped(tx)) return nullptr;
 
         // If we already have it but it is unsent update to propagated and update confirmations.
         odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::hash == tx->hash() || odb::query<Tx>::unsigned_hash == tx->unsigned_hash()));
@@ -2672,6 +3122,7 @@ std::shared_ptr<Tx> Vault::insertNewTx_unwrapped(const Coin::Transaction& cointx
             tx->updateTotals(); db_->persist(tx);
             for (auto& txin:    tx->txins())            { db_->persist(txin);                   }
             for (auto& txout:   tx->txouts())           { db_->persist(txout);                  }
+            txFilterUnsignedHashes_.insert(tx->unsigned_hash());
 
             for (auto& txin:    updated_txins)          { db_->update(txin);                    }
             for (auto& txout:   updated_txouts)         { db_->update(txout);                   }
@@ -2739,32 +3190,8 @@ std::shared_ptr<Tx> Vault::insertMerkleTx_unwrapped(const ChainMerkleBlock& chai
                         throw MerkleTxInvalidHeightException(blockhash, chainmerkleblock.height, txhash, txindex, txcount);
                 }
 
-                {
-                    // Unconfirm any transactions with equal or larger height
-                    odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::blockheader->height >= (unsigned int)chainmerkleblock.height));
-                    for (odb::result<Tx>::iterator it = r.begin(); it != r.end(); ++it)
-                    {
-                        std::shared_ptr<Tx> tx(it.load());
-                        tx->blockheader(nullptr);
-                        db_->update(tx);
-                        signalQueue.push(notifyTxUpdated.bind(tx));
-                    }
-                }
-
-                {
-                    // Delete any merkleblocks with equal or larger height
-                    odb::result<MerkleBlock> r(db_->query<MerkleBlock>(odb::query<MerkleBlock>::blockheader->height >= (unsigned int)chainmerkleblock.height));
-                    for (auto& merkleblock: r) { db_->erase(merkleblock); }
-                }
-
-                {
-                    // Delete any blockheaders with equal or larger height
-                    odb::result<BlockHeader> r(db_->query<BlockHeader>(odb::query<BlockHeader>::height >= (unsigned int)chainmerkleblock.height));
-                    for (auto& blockheader: r) { db_->erase(blockheader); }
-                }
-
-                // TODO: test and use the following instead of the above three code blocks
-                //deleteMerkleBlock_unwrapped((uint32_t)chainmerkleblock.height);
+                // Unconfirm transactions and delete merkle blocks with equal or larger height
+                deleteMerkleBlock_unwrapped((uint32_t)chainmerkleblock.height);
 
                 // Instantiate the new merkle block and store
                 merkleblock = std::make_shared<MerkleBlock>(chainmerkleblock);
@@ -2905,12 +3332,16 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
                 }
 
                 {
-                    // Unconfirm any transactions with equal or larger height
+                    // Unconfirm any transactions with equal or larger height. They are loaded first since the updates
+                    // below take them out of the query.
+                    std::vector<std::shared_ptr<Tx>> txs;
                     odb::result<Tx> r(db_->query<Tx>(odb::query<Tx>::blockheader->height >= (unsigned int)chainmerkleblock.height));
-                    for (odb::result<Tx>::iterator it = r.begin(); it != r.end(); ++it)
+                    for (odb::result<Tx>::iterator it = r.begin(); it != r.end(); ++it) { txs.push_back(it.load()); }
+
+                    for (auto& tx: txs)
                     {
-                        std::shared_ptr<Tx> tx(it.load());
-                        tx->status(Tx::PROPAGATED);
+                        // Clearing the blockheader also moves the tx to PROPAGATED, so its balances are filed as unconfirmed.
+                        tx->blockheader(nullptr);
                         db_->update(tx);
                         signalQueue.push(notifyTxUpdated.bind(tx));
                     }
@@ -2967,6 +3398,28 @@ std::shared_ptr<Tx> Vault::confirmMerkleTx_unwrapped(const ChainMerkleBlock& cha
     }
 }
 
+void Vault::setCoinSelectionPolicy(const CoinSelectionPolicy& policy)
+{
+    LOGGER(trace) << "Vault::setCoinSelectionPolicy(...)" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    coinSelectionPolicy_ = policy;
+}
+
+CoinSelectionPolicy Vault::getCoinSelectionPolicy() const
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    return coinSelectionPolicy_;
+}
+
+void Vault::setCoinSelector(coin_selector_t selector)
+{
+    LOGGER(trace) << "Vault::setCoinSelector(...)" << std::endl;
+
+    boost::lock_guard<boost::mutex> lock(mutex);
+    coinSelector_ = selector;
+}
+
 std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int maxchangeouts, bool insert)
 {
     LOGGER(trace) << "Vault::createTx(" << account_name << ", " << tx_version << ", " << tx_locktime << ", " << txouts.size() << " txout(s), " << fee << ", " << maxchangeouts << ", " << (insert ? "insert" : "no insert") << ")" << std::endl;
@@ -2990,53 +3443,7 @@ std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx
 
 std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int /*maxchangeouts*/)
 {
-    // TODO: Better rng seeding
-    std::srand(std::time(0));
-
-    // TODO: Better fee calculation heuristics
-    uint64_t desired_total = fee;
-    for (auto& txout: txouts) { desired_total += txout->value(); }
-
-    std::shared_ptr<Account> account = getAccount_unwrapped(account_name);
-
-    // TODO: Better coin selection
-    typedef odb::query<TxOutView> query_t;
-    odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(query_t::Tx::status > Tx::UNSIGNED && query_t::TxOut::status == TxOut::UNSPENT && query_t::receiving_account::id == account->id()));
-    std::vector<TxOutView> utxoviews;
-    for (auto& utxoview: utxoview_r) { utxoviews.push_back(utxoview); }
-   
-    std::random_shuffle(utxoviews.begin(), utxoviews.end(), [](int i) { return std::rand() % i; });
-
-    txins_t txins;
-    int i = 0;
-    uint64_t total = 0;
-    for (auto& utxoview: utxoviews)
-    {
-        total += utxoview.value;
-        std::shared_ptr<TxIn> txin(new TxIn(utxoview.tx_hash, utxoview.tx_index, utxoview.signingscript_txinscript, 0xffffffff));
-        txins.push_back(txin);
-        i++;
-        if (total >= desired_total) break;
-    }
-    if (total < desired_total) throw AccountInsufficientFundsException(account_name); 
-
-    utxoviews.resize(i);
-    uint64_t change = total - desired_total;
-
-    if (change > 0)
-    {
-        std::shared_ptr<AccountBin> bin = getAccountBin_unwrapped(account_name, CHANGE_BIN_NAME);
-        std::shared_ptr<SigningScript> changescript = issueAccountBinSigningScript_unwrapped(bin);
-
-        // TODO: Allow adding multiple change outputs
-        std::shared_ptr<TxOut> txout(new TxOut(change, changescript));
-        txouts.push_back(txout);
-    }
-    std::random_shuffle(txouts.begin(), txouts.end(), [](int i) { return std::rand() % i; });
-
-    std::shared_ptr<Tx> tx(new Tx());
-    tx->set(tx_version, txins, txouts, tx_locktime, time(NULL), Tx::UNSIGNED);
-    return tx;
+    return createTx_unwrapped(account_name, tx_version, tx_locktime, ids_t(), txouts, fee, 0);
 }
 
 std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations, bool insert)
@@ -3062,15 +3469,21 @@ std::shared_ptr<Tx> Vault::createTx(const std::string& account_name, uint32_t tx
 
 std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations)
 {
+    // TODO: Better rng seeding
+    std::srand(std::time(0));
+
     std::shared_ptr<Account> account = getAccount_unwrapped(account_name);
 
-    // TODO: Better fee calculation heuristics
-    uint64_t input_total = 0;
     uint64_t desired_total = fee;
     for (auto& txout: txouts) { desired_total += txout->value(); }
 
-    typedef odb::query<TxOutView> query_t;
-    query_t base_query(query_t::Tx::status > Tx::UNSIGNED && query_t::TxOut::status == TxOut::UNSPENT && query_t::receiving_account::id == account->id());
+    // All of the account's scripts share its m of n policy.
+    uint32_t txin_size = estimateMultiSigTxInSize(account->minsigs(), account->keychains().size(), account->compressed_keys());
+    CoinSelectionPolicy policy(coinSelectionPolicy_);
+    policy.change_txin_size = txin_size;
+
+    typedef odb::query<CoinCandidateView> query_t;
+    query_t base_query(query_t::Tx::status > Tx::UNSIGNED && query_t::TxOut::status == TxOut::UNSPENT && query_t::TxOut::receiving_account == account->id());
 
     if (min_confirmations > 0)
     {
@@ -3079,38 +3492,50 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
         base_query = (base_query && query_t::BlockHeader::height <= best_height + 1 - min_confirmations);
     }
 
-    txins_t txins;
+    coin_candidates_t coins;
+    int64_t supplied_total = 0;
     if (!coin_ids.empty())
     {
-        odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(base_query && query_t::TxOut::id.in_range(coin_ids.begin(), coin_ids.end())));
-        for (auto& utxoview: utxoview_r)
+        odb::result<CoinCandidateView> candidate_r(db_->query<CoinCandidateView>(base_query && query_t::TxOut::id.in_range(coin_ids.begin(), coin_ids.end())));
+        for (auto& candidate: candidate_r)
         {
-            std::shared_ptr<TxIn> txin(new TxIn(utxoview.tx_hash, utxoview.tx_index, utxoview.signingscript_txinscript, 0xffffffff));
-            txins.push_back(txin);
-            input_total += utxoview.value;
+            coins.push_back(CoinCandidate(candidate.id, candidate.value, txin_size));
+            supplied_total += policy.effective_value(coins.back());
         }
-        if (txins.size() < coin_ids.size()) throw TxInvalidInputsException();
+        if (coins.size() < coin_ids.size()) throw TxInvalidInputsException();
     }
 
-    // If the supplied inputs are insufficient, automatically add more
-    // TODO; Better coin selection heuristics
-    if (input_total < desired_total)
+    // If the supplied inputs are insufficient, select more
+    if (supplied_total < (int64_t)desired_total)
     {
         query_t query(base_query);
         if (!coin_ids.empty()) { query = (query && !query_t::TxOut::id.in_range(coin_ids.begin(), coin_ids.end())); }
-        odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(query));
-        std::vector<TxOutView> utxoviews;
-        for (auto& utxoview: utxoview_r) { utxoviews.push_back(utxoview); }
-        std::random_shuffle(utxoviews.begin(), utxoviews.end(), [](int i) { return std::rand() % i; });
 
-        for (auto& utxoview: utxoviews)
+        coin_candidates_t candidates;
+        odb::result<CoinCandidateView> candidate_r(db_->query<CoinCandidateView>(query));
+        for (auto& candidate: candidate_r) { candidates.push_back(CoinCandidate(candidate.id, candidate.value, txin_size)); }
+
+        CoinSelection selection;
+        if (!coinSelector_(candidates, (uint64_t)((int64_t)desired_total - supplied_total), policy, selection)) throw AccountInsufficientFundsException(account_name);
+        coins.insert(coins.end(), selection.coins.begin(), selection.coins.end());
+    }
+
+    CoinSelection selection(coins, desired_total, policy);
+    LOGGER(debug) << "Vault::createTx_unwrapped() - selected " << coins.size() << " input(s) totaling " << selection.value << ", input fee: " << selection.input_fee << ", change: " << selection.change << ", waste: " << selection.waste << std::endl;
+
+    ids_t selected_ids;
+    for (auto& coin: coins) { selected_ids.push_back(coin.id); }
+
+    txins_t txins;
+    if (!selected_ids.empty())
+    {
+        typedef odb::query<TxOutView> view_query_t;
+        odb::result<TxOutView> utxoview_r(db_->query<TxOutView>(view_query_t::TxOut::id.in_range(selected_ids.begin(), selected_ids.end())));
+        for (auto& utxoview: utxoview_r)
         {
             std::shared_ptr<TxIn> txin(new TxIn(utxoview.tx_hash, utxoview.tx_index, utxoview.signingscript_txinscript, 0xffffffff));
             txins.push_back(txin);
-            input_total += utxoview.value;
-            if (input_total >= desired_total) break;
         }
-        if (input_total < desired_total) throw AccountInsufficientFundsException(account_name);
     }
  
     // Use supplied outputs first
@@ -3125,8 +3550,9 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
         }
     }
 
-    // If supplied change amounts are insufficient, add another change output
-    uint64_t change = input_total - desired_total;
+    // If supplied change amounts are insufficient, add another change output. Excess too small to be worth
+    // an output goes to the fee.
+    uint64_t change = selection.change;
     if (change > 0)
     {
         if (!change_bin) { change_bin = getAccountBin_unwrapped(account_name, CHANGE_BIN_NAME); }
@@ -3135,8 +3561,6 @@ std::shared_ptr<Tx> Vault::createTx_unwrapped(const std::string& account_name, u
         std::shared_ptr<TxOut> txout(new TxOut(change, changescript));
         txouts.push_back(txout);
     }
-    // TODO: Better rng seeding
-    std::srand(std::time(0));
     std::random_shuffle(txins.begin(), txins.end(), [](int i) { return std::rand() % i; });
     std::random_shuffle(txouts.begin(), txouts.end(), [](int i) { return std::rand() % i; });
 
@@ -3216,6 +3640,7 @@ void Vault::deleteTx_unwrapped(std::shared_ptr<Tx> tx)
 
         // delete tx
         db_->erase(tx);
+        txFilterUnsignedHashes_.erase(tx->unsigned_hash());
         signalQueue.push(notifyTxDeleted.bind(tx));
     }
     catch (...)
@@ -3418,6 +3843,9 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
 
     KeychainSet keychains_signed;
 
+    // Serialized once on the first input we have keys for
+    std::unique_ptr<Coin::SigHashCache> sighashcache;
+
     unsigned int sigsadded = 0;
     for (auto& txin: tx->txins())
     {
@@ -3431,17 +3859,9 @@ unsigned int Vault::signTx_unwrapped(std::shared_ptr<Tx> tx, std::vector<std::st
         odb::result<Key> key_r(db_->query<Key>(privkey_query && odb::query<Key>::pubkey.in_range(pubkeys.begin(), pubkeys.end())));
         if (key_r.empty()) continue;
 
-        // Prepare the inputs for hashing
-        Coin::Transaction coin_tx = tx->toCoinCore();
-        unsigned int i = 0;
-        for (auto& coin_input: coin_tx.inputs)
-        {
-            if (i++ == txin->txindex()) { coin_input.scriptSig = script.txinscript(Script::SIGN); }
-            else                        { coin_input.scriptSig.clear(); }
-        }
-
         // Compute hash to sign
-        bytes_t signingHash = coin_tx.getHashWithAppendedCode(SIGHASH_ALL);
+        if (!sighashcache) { sighashcache.reset(new Coin::SigHashCache(tx->toCoinCore())); }
+        bytes_t signingHash = sighashcache->getHash(txin->txindex(), script.txinscript(Script::SIGN), SIGHASH_ALL);
         LOGGER(debug) << "Vault::signTx_unwrapped - computed signing hash " << uchar_vector(signingHash).getHex() << " for input " << txin->txindex() << std::endl;
 
         for (auto& key: key_r)
@@ -3969,6 +4389,43 @@ std::shared_ptr<MerkleBlock> Vault::insertMerkleBlock_unwrapped(std::shared_ptr<
     }
 }
 
+void Vault::insertMerkleBlocks(const MerkleBlockUpdates& updates)
+{
+    LOGGER(trace) << "Vault::insertMerkleBlocks(" << updates.size() << " merkle block(s))" << std::endl;
+
+    if (updates.empty()) return;
+
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        odb::core::session s;
+        odb::core::transaction t(db_->begin());
+        insertMerkleBlocks_unwrapped(updates);
+        t.commit();
+    }
+
+    signalQueue.flush();
+}
+
+void Vault::insertMerkleBlocks_unwrapped(const MerkleBlockUpdates& updates)
+{
+    for (auto& update: updates)
+    {
+        if (update.txs.empty())
+        {
+            std::shared_ptr<MerkleBlock> merkleblock(new MerkleBlock(update.merkleblock));
+            merkleblock->txsinserted(true);
+            insertMerkleBlock_unwrapped(merkleblock);
+            continue;
+        }
+
+        for (auto& tx: update.txs)
+        {
+            if (tx.confirmonly) { confirmMerkleTx_unwrapped(update.merkleblock, tx.txhash, tx.txindex, tx.txcount); }
+            else                { insertMerkleTx_unwrapped(update.merkleblock, tx.cointx, tx.txindex, tx.txcount); }
+        }
+    }
+}
+
 unsigned int Vault::deleteMerkleBlock(const bytes_t& hash)
 {
     return 0;
@@ -3995,63 +4452,62 @@ unsigned int Vault::deleteMerkleBlock_unwrapped(uint32_t height)
 {
     try
     {
+        // Usual case when extending the chain - nothing at or above this height.
+        if (getBestHeight_unwrapped() < height) return 0;
 
-    /*
-        unsigned int count = 0;
+        // Unconfirm all affected transactions with a single statement.
+        ids_t tx_ids;
+        typedef odb::query<TxView> tx_query_t;
+        odb::result<TxView> tx_r(db_->query<TxView>(tx_query_t::BlockHeader::height >= height));
+        for (auto& tx_view: tx_r) { tx_ids.push_back(tx_view.id); }
 
-        typedef odb::query<ConfirmedTxView> query_t;
-        odb::result<ConfirmedTxView> r(db_->query<ConfirmedTxView>((query_t::BlockHeader::height >= height) + "ORDER BY" + query_t::BlockHeader::height));
-        for (auto& view: r)
+        if (!tx_ids.empty())
         {
-            std::shared_ptr<Tx> tx(db_->find<Tx>(view.tx_id));
-            if (tx)
-            {
-                tx->blockheader(nullptr);
-                db_->update(tx);
-                signalQueue.push(notifyTxUpdated.bind(tx));
-            }
-
-            std::shared_ptr<MerkleBlock> merkleblock(db_->find<MerkleBlock>(view.merkleblock_id));
-            if (merkleblock) { db_->erase(merkleblock); }
-
-            std::shared_ptr<BlockHeader> blockheader(db_->find<BlockHeader>(view.blockheader_id));
-            if (blockheader)
+            // The bulk update skips the Tx callbacks, so the balances are moved to unconfirmed here. Once the
+            // blockheader is cleared these outputs can no longer be found by height, so they are read first.
+            balance_contribution_query_t balance_query(balance_contribution_query_t::Tx::blockheader + "IN (SELECT id FROM BlockHeader WHERE height >=" + balance_contribution_query_t::_val(height) + ")");
+            balance_contributions_t balances = getBalanceContributions(*db_, balance_query);
+            applyBalanceContributions(*db_, balances, -1);
+
+            // Same transition as Tx::blockheader(nullptr), which patches the session objects below.
+            std::stringstream sql;
+            sql << "UPDATE Tx SET blockheader = NULL, status = CASE WHEN status = " << Tx::CONFIRMED << " THEN " << Tx::PROPAGATED << " ELSE status END"
+                << " WHERE blockheader IN (SELECT id FROM BlockHeader WHERE height >= " << height << ")";
+            db_->execute(sql.str());
+
+            applyBalanceContributions(*db_, unconfirmedBalanceContributions(balances), 1);
+
+            // Transactions already loaded in this session must agree with the database.
+            if (odb::core::session::has_current())
             {
-                db_->erase(blockheader);
-                count++;
+                odb::core::session& s = odb::core::session::current();
+                for (auto& tx_id: tx_ids)
+                {
+                    std::shared_ptr<Tx> tx(s.cache_find<Tx>(*db_, tx_id));
+                    if (tx) { tx->blockheader(nullptr); }
+                }
             }
         }
 
-        return count;
-    */
+        // Delete merkle blocks and block headers. Objects are erased individually so they also leave the session cache.
+        odb::result<MerkleBlock> merkleblock_r(db_->query<MerkleBlock>(odb::query<MerkleBlock>::blockheader->height >= height));
+        for (auto& merkleblock: merkleblock_r) { db_->erase(merkleblock); }
 
-        typedef odb::query<BlockHeader> query_t;
-        odb::result<BlockHeader> r(db_->query<BlockHeader>((query_t::height >= height) + "ORDER BY" + query_t::height + "DESC"));
         unsigned int count = 0;
-        for (auto& blockheader: r)
+        odb::result<BlockHeader> blockheader_r(db_->query<BlockHeader>(odb::query<BlockHeader>::height >= height));
+        for (auto& blockheader: blockheader_r)
         {
             LOGGER(debug) << "Vault::deleteMerkleBlock_unwrapped - deleting block. hash: " << uchar_vector(blockheader.hash()).getHex() << ", height: " << blockheader.height() << std::endl;
-
-            // Remove tx confirmations
-            odb::result<Tx> tx_r(db_->query<Tx>(odb::query<Tx>::blockheader == blockheader.id()));
-            for (auto& tx: tx_r)
-            {
-    //            LOGGER(debug) << "Vault::deleteMerkleBlock_unwrapped - unconfirming transaction. hash: " << uchar_vector(tx.hash()).getHex() << std::endl;
-                tx.blockheader(nullptr);
-                db_->update(tx);
-                signalQueue.push(notifyTxUpdated.bind(std::make_shared<Tx>(tx)));
-                //notifyTxUpdated(std::make_shared<Tx>(tx));
-            }
-
-            // Delete merkle block
-            db_->erase_query<MerkleBlock>(odb::query<MerkleBlock>::blockheader == blockheader.id());
-
-            // Delete block header
             db_->erase(blockheader);
-
             count++;
         }
 
+        if (count > 0)
+        {
+            LOGGER(debug) << "Vault::deleteMerkleBlock_unwrapped - " << count << " block(s) deleted, " << tx_ids.size() << " transaction(s) unconfirmed. fork height: " << height << std::endl;
+            signalQueue.push(notifyReorg.bind(height, tx_ids));
+        }
+
         return count;
     }
     catch (...)
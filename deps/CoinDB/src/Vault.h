@@ -13,6 +13,8 @@
 #include "VaultExceptions.h"
 #include "SigningRequest.h"
 #include "SignatureInfo.h"
+#include "StorageProfile.h"
+#include "CoinSelection.h"
 
 #include <Signals/Signals.h>
 #include <Signals/SignalQueue.h>
@@ -41,10 +43,78 @@ typedef Signals::Signal<std::shared_ptr<MerkleBlock>, const std::string& /*descr
 
 typedef Signals::Signal<std::shared_ptr<MerkleBlock>, bytes_t> TxConfirmationErrorSignal;
 
+typedef Signals::Signal<uint32_t /*fork_height*/, ids_t /*unconfirmed_tx_ids*/> ReorgSignal;
+
+typedef Signals::Signal<uint32_t /*version*/, uint32_t /*target_version*/> SchemaMigrationSignal;
+
+// Matched transaction of a merkle block for batched insertion. Transactions we already have only need to be confirmed
+// so just their hashes are given.
+struct MerkleTxUpdate
+{
+    MerkleTxUpdate(const Coin::Transaction& cointx_, unsigned int txindex_, unsigned int txcount_) :
+        confirmonly(false), txhash(cointx_.hash()), cointx(cointx_), txindex(txindex_), txcount(txcount_) { }
+    MerkleTxUpdate(const bytes_t& txhash_, unsigned int txindex_, unsigned int txcount_) :
+        confirmonly(true), txhash(txhash_), txindex(txindex_), txcount(txcount_) { }
+
+    bool                confirmonly;
+    bytes_t             txhash;
+    Coin::Transaction   cointx;
+    unsigned int        txindex;
+    unsigned int        txcount;
+};
+
+// A merkle block and its matched transactions in merkle tree order. A block without transactions is inserted as is.
+struct MerkleBlockUpdate
+{
+    explicit MerkleBlockUpdate(const ChainMerkleBlock& merkleblock_) : merkleblock(merkleblock_) { }
+
+    ChainMerkleBlock                merkleblock;
+    std::vector<MerkleTxUpdate>     txs;
+};
+
+typedef std::vector<MerkleBlockUpdate> MerkleBlockUpdates;
+
+// Which transactions or outputs a history query returns. Empty names and zero times or heights do not filter.
+struct HistoryFilter
+{
+    HistoryFilter() :
+        role_flags(TxOut::ROLE_BOTH), txout_status_flags(TxOut::BOTH), tx_status_flags(Tx::ALL), hide_change(true),
+        start_time(0), end_time(0), min_height(0) { }
+
+    std::string         account_name;       // transactions sending from or receiving to the account, in the roles given by role_flags
+    std::string         bin_name;           // outputs only
+    int                 role_flags;
+    int                 txout_status_flags; // outputs only
+    int                 tx_status_flags;
+    bool                hide_change;        // outputs only
+    uint32_t            start_time;         // tx timestamp, inclusive
+    uint32_t            end_time;           // tx timestamp, exclusive
+    uint32_t            min_height;
+};
+
+// Position in history order: block height descending with unconfirmed last, then tx timestamp descending, then
+// id descending. The id is the tx id for transactions and the txout id for outputs. A default constructed cursor
+// starts at the newest row, and end is set once a page comes back short. No index serves this order since it spans
+// BlockHeader and Tx, so each page reads and sorts every matching row past the cursor. Pages get cheaper toward the
+// end of the history rather than dearer as they would with an offset.
+struct HistoryCursor
+{
+    HistoryCursor() : height(0), timestamp(0), id(0), end(false) { }
+
+    uint32_t            height;
+    uint32_t            timestamp;
+    unsigned long       id;
+    bool                end;
+};
+
+// Return false to stop the query.
+typedef std::function<bool(const TxView&)> tx_view_callback_t;
+typedef std::function<bool(const TxOutView&)> txout_view_callback_t;
+
 class Vault
 {
 public:
-    Vault() : db_(nullptr) { }
+    Vault() : db_(nullptr), storageProfile_(StorageProfile::durable()), coinSelector_(&selectCoins), bloomFilterTracking_(false), txFilterLoaded_(false), txFilterHits_(0), txFilterMisses_(0) { }
     Vault(int argc, char** argv, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     Vault(const std::string& dbname, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     Vault(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
@@ -66,6 +136,10 @@ public:
     void                                    open(const std::string& dbuser, const std::string& dbpasswd, const std::string& dbname, bool create = false, uint32_t version = SCHEMA_VERSION, const std::string& network = "", bool migrate = false);
     void                                    close();
 
+    // Used by databases opened after the call. Defaults to StorageProfile::durable().
+    void                                    setStorageProfile(const StorageProfile& profile);
+    StorageProfile                          getStorageProfile() const;
+
     const std::string&                      getName() const { return name_; }
     uint32_t                                getSchemaVersion() const;
     void                                    setSchemaVersion(uint32_t version);
@@ -77,9 +151,17 @@ public:
     uint32_t                                getMaxFirstBlockTimestamp() const; // convenience method. getHorizonTimestamp() - MIN_HORIZON_TIMESTAMP_OFFSET
     uint32_t                                getHorizonHeight() const;
     std::vector<bytes_t>                    getLocatorHashes() const;
-    Coin::BloomFilter                       getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const;
+    static const uint32_t                   BLOOM_FILTER_HEADROOM_PERCENT = 50; // extra capacity in new bloom filters for scripts issued later
+    Coin::BloomFilter                       getBloomFilter(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags);
+    std::vector<bytes_t>                    getNewBloomFilterElements(); // elements for scripts created since the last getBloomFilter or getNewBloomFilterElements call
     hashvector_t                            getIncompleteBlockHashes() const;
 
+    // Incoming transactions are first checked against an in-memory index of vault scripts and transaction hashes.
+    // A hit means the transaction might affect the vault and was looked up in the database, a miss means it was rejected without a query.
+    uint64_t                                getTxFilterHits() const;
+    uint64_t                                getTxFilterMisses() const;
+    void                                    resetTxFilterCounters();
+
     void                                    exportVault(const std::string& filepath, bool exportprivkeys = true) const;
 
     void                                    importVault(const std::string& filepath, bool importprivkeys = true);
@@ -136,6 +218,10 @@ public:
     AccountInfo                             getAccountInfo(const std::string& account_name) const;
     std::vector<AccountInfo>                getAllAccountInfo() const;
     uint64_t                                getAccountBalance(const std::string& account_name, unsigned int min_confirmations = 1, int tx_flags = Tx::ALL) const;
+
+    // Balances are read from the AccountBalance table. These recompute it from the outputs to find or repair drift.
+    std::vector<AccountBalanceDrift>        checkAccountBalances() const;
+    void                                    rebuildAccountBalances();
     std::shared_ptr<AccountBin>             addAccountBin(const std::string& account_name, const std::string& bin_name);
     std::shared_ptr<SigningScript>          issueSigningScript(const std::string& account_name, const std::string& bin_name = DEFAULT_BIN_NAME, const std::string& label = "", uint32_t index = 0, const std::string& username = std::string());
     void                                    refillAccountPool(const std::string& account_name);
@@ -143,6 +229,14 @@ public:
     // empty account_name or bin_name means do not filter on those fields
     std::vector<SigningScriptView>          getSigningScriptViews(const std::string& account_name = "", const std::string& bin_name = "", int flags = SigningScript::ALL) const;
     std::vector<TxOutView>                  getTxOutViews(const std::string& account_name = "", const std::string& bin_name = "", int role_flags = TxOut::ROLE_BOTH, int txout_status_flags = TxOut::BOTH, int tx_status_flags = Tx::ALL, bool hide_change = true) const;
+
+    // Pages return up to count rows after the cursor and move it past them. An output where the account is both
+    // sender and receiver is one row but yields a view for each role.
+    std::vector<TxOutView>                  getTxOutViewPage(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int count) const;
+
+    // Calls back for each output as it is read, in history order. The vault is locked meanwhile, so the callback must
+    // not call into it.
+    void                                    streamTxOutViews(const HistoryFilter& filter, txout_view_callback_t callback, const HistoryCursor& cursor = HistoryCursor()) const;
     std::vector<TxOutView>                  getUnspentTxOutViews(const std::string& account_name, uint32_t min_confirmations = 0) const;
 
     ////////////////////////////
@@ -163,11 +257,18 @@ public:
     uint32_t                                getTxConfirmations(unsigned long tx_id) const;
     uint32_t                                getTxConfirmations(std::shared_ptr<Tx> tx) const;
     std::vector<TxView>                     getTxViews(int tx_status_flags = Tx::ALL, unsigned long start = 0, int count = -1, uint32_t minheight = 0) const; // count = -1 means display all
+    std::vector<TxView>                     getTxViewPage(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int count) const; // See getTxOutViewPage.
+    void                                    streamTxViews(const HistoryFilter& filter, tx_view_callback_t callback, const HistoryCursor& cursor = HistoryCursor()) const; // See streamTxOutViews.
     std::vector<std::string>                getSerializedUnsignedTxs(const std::string& account_name) const;
     std::shared_ptr<Tx>                     insertTx(std::shared_ptr<Tx> tx, bool replace_labels = false); // Inserts transaction only if it affects one of our accounts. Returns transaction in vault if change occured. Otherwise returns nullptr.
     std::shared_ptr<Tx>                     insertNewTx(const Coin::Transaction& cointx, std::shared_ptr<BlockHeader> blockheader = nullptr, bool verifysigs = false, bool isCoinbase = false);
     std::shared_ptr<Tx>                     insertMerkleTx(const ChainMerkleBlock& chainmerkleblock, const Coin::Transaction& cointx, unsigned int txindex, unsigned int txcount, bool verifysigs = false, bool isCoinbase = false);
     std::shared_ptr<Tx>                     confirmMerkleTx(const ChainMerkleBlock& chainmerkleblock, const bytes_t& txhash, unsigned int txindex, unsigned int txcount);
+    // Inputs are chosen by the coin selector under the coin selection policy. fee is the fixed part of the fee,
+    // inputs and change add to it at the policy's fee rate.
+    void                                    setCoinSelectionPolicy(const CoinSelectionPolicy& policy);
+    CoinSelectionPolicy                     getCoinSelectionPolicy() const;
+    void                                    setCoinSelector(coin_selector_t selector); // Defaults to selectCoins.
     std::shared_ptr<Tx>                     createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int maxchangeouts = 1, bool insert = false);
     std::shared_ptr<Tx>                     createTx(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations, bool insert = false); // Pass empty output scripts to generate change outputs.
     void                                    deleteTx(const bytes_t& tx_hash); // Tries both signed and unsigned hashes. Throws TxNotFoundException.
@@ -208,6 +309,7 @@ public:
     std::shared_ptr<BlockHeader>            getBlockHeader(uint32_t height) const;
     std::shared_ptr<BlockHeader>            getBestBlockHeader() const;
     std::shared_ptr<MerkleBlock>            insertMerkleBlock(std::shared_ptr<MerkleBlock> merkleblock);
+    void                                    insertMerkleBlocks(const MerkleBlockUpdates& updates); // Single database transaction and signal flush. Nothing is stored if any update throws.
     unsigned int                            deleteMerkleBlock(const bytes_t& hash);
     unsigned int                            deleteMerkleBlock(uint32_t height);
     void                                    exportMerkleBlocks(const std::string& filepath) const;
@@ -229,6 +331,12 @@ public:
 
     Signals::Connection subscribeTxConfirmationError(TxConfirmationErrorSignal::Slot slot) { return notifyTxConfirmationError.connect(slot); }
 
+    // Emitted once per reorganization with the lowest height removed and the transactions that lost their confirmations.
+    Signals::Connection subscribeReorg(ReorgSignal::Slot slot) { return notifyReorg.connect(slot); }
+
+    // Emitted from open() before each schema migration step, with the vault locked.
+    Signals::Connection subscribeSchemaMigration(SchemaMigrationSignal::Slot slot) { return notifySchemaMigration.connect(slot); }
+
     void clearAllSlots()
     {
         notifyKeychainUnlocked.clear();
@@ -243,6 +351,9 @@ public:
         notifyMerkleBlockInsertionError.clear();
 
         notifyTxConfirmationError.clear();
+
+        notifyReorg.clear();
+        notifySchemaMigration.clear();
     }
 
 protected:
@@ -259,9 +370,14 @@ protected:
     uint32_t                                getMaxFirstBlockTimestamp_unwrapped() const;
     uint32_t                                getHorizonHeight_unwrapped() const;
     std::vector<bytes_t>                    getLocatorHashes_unwrapped() const;
-    Coin::BloomFilter                       getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags) const;
+    Coin::BloomFilter                       getBloomFilter_unwrapped(double falsePositiveRate, uint32_t nTweak, uint32_t nFlags);
     hashvector_t                            getIncompleteBlockHashes_unwrapped() const;
 
+    void                                    loadTxFilter_unwrapped();
+    void                                    clearTxFilter_unwrapped();
+    void                                    indexSigningScript_unwrapped(std::shared_ptr<SigningScript> script);
+    bool                                    matchTxFilter_unwrapped(std::shared_ptr<Tx> tx); // Returns false only if the transaction cannot affect the vault.
+
     ////////////////////////
     // CONTACT OPERATIONS //
     ////////////////////////
@@ -328,6 +444,8 @@ protected:
     std::shared_ptr<Tx>                     insertNewTx_unwrapped(const Coin::Transaction& cointx, std::shared_ptr<BlockHeader> blockheader = nullptr, bool verifysigs = false, bool isCoinbase = false);
     std::shared_ptr<Tx>                     insertMerkleTx_unwrapped(const ChainMerkleBlock& chainmerkleblock, const Coin::Transaction& cointx, unsigned int txindex, unsigned int txcount, bool verifysigs = false, bool isCoinbase = false);
     std::shared_ptr<Tx>                     confirmMerkleTx_unwrapped(const ChainMerkleBlock& chainmerkleblock, const bytes_t& txhash, unsigned int txindex, unsigned int txcount);
+    unsigned int                            queryTxOutViews_unwrapped(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int limit, txout_view_callback_t callback) const; // limit = 0 means no limit. Returns rows read.
+    unsigned int                            queryTxViews_unwrapped(const HistoryFilter& filter, HistoryCursor& cursor, unsigned int limit, tx_view_callback_t callback) const; // limit = 0 means no limit. Returns rows read.
     std::shared_ptr<Tx>                     createTx_unwrapped(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, txouts_t txouts, uint64_t fee, unsigned int maxchangeouts = 1);
     std::shared_ptr<Tx>                     createTx_unwrapped(const std::string& account_name, uint32_t tx_version, uint32_t tx_locktime, ids_t coin_ids, txouts_t txouts, uint64_t fee, uint32_t min_confirmations);
     void                                    deleteTx_unwrapped(std::shared_ptr<Tx> tx);
@@ -356,6 +474,7 @@ protected:
     std::shared_ptr<BlockHeader>            getBlockHeader_unwrapped(uint32_t height) const;
     std::shared_ptr<BlockHeader>            getBestBlockHeader_unwrapped() const;
     std::shared_ptr<MerkleBlock>            insertMerkleBlock_unwrapped(std::shared_ptr<MerkleBlock> merkleblock);
+    void                                    insertMerkleBlocks_unwrapped(const MerkleBlockUpdates& updates);
     unsigned int                            deleteMerkleBlock_unwrapped(std::shared_ptr<MerkleBlock> merkleblock);
     unsigned int                            deleteMerkleBlock_unwrapped(uint32_t height);
     unsigned int                            updateConfirmations_unwrapped(std::shared_ptr<Tx> tx = nullptr); // If parameter is null, updates all unconfirmed transactions.
@@ -382,12 +501,42 @@ protected:
 
     TxConfirmationErrorSignal               notifyTxConfirmationError;
 
+    ReorgSignal                             notifyReorg;
+
+    SchemaMigrationSignal                   notifySchemaMigration;
+
 private:
     mutable boost::mutex mutex;
     std::shared_ptr<odb::core::database> db_;
     std::string name_;
 
+    StorageProfile storageProfile_;
+
+    CoinSelectionPolicy coinSelectionPolicy_;
+    coin_selector_t coinSelector_;
+    boost::thread checkpointThread_;
+    void startCheckpointThread();
+    void stopCheckpointThread();
+
+    void migrateSchema_unwrapped(uint32_t from_version, uint32_t to_version);
+
     mutable std::map<std::string, secure_bytes_t> mapPrivateKeyUnlock;
+
+    // Bloom filter elements for signing scripts created since the last bloom filter was built. Elements wait in
+    // pendingBloomFilterElements_ until the transaction that created their scripts commits.
+    bool bloomFilterTracking_;
+    std::vector<bytes_t> newBloomFilterElements_;
+    std::vector<bytes_t> pendingBloomFilterElements_;
+    static void onBloomFilterTransactionEnd(unsigned short event, void* key, unsigned long long data);
+
+    // In-memory transaction filter. Loaded from the database on first use and kept in sync with every persisted
+    // signing script and transaction. It may contain entries that are no longer in the database but never misses any.
+    bool txFilterLoaded_;
+    std::set<bytes_t> txFilterTxInScripts_;
+    std::set<bytes_t> txFilterTxOutScripts_;
+    std::set<bytes_t> txFilterUnsignedHashes_;
+    uint64_t txFilterHits_;
+    uint64_t txFilterMisses_;
 };
 
 }
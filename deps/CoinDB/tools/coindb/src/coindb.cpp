@@ -82,6 +82,32 @@ cli::result_t cmd_migrate(const cli::params_t& params)
     return "Schema is already current.";
 }
 
+cli::result_t cmd_checkbalances(const cli::params_t& params)
+{
+    Vault vault(g_dbuser, g_dbpasswd, params[0], false);
+    bool repair = params.size() > 1 && params[1] == "true";
+
+    vector<AccountBalanceDrift> drift = vault.checkAccountBalances();
+    if (drift.empty()) return "Account balances are consistent.";
+
+    stringstream ss;
+    ss << formattedAccountBalanceDriftHeader();
+    for (auto& item: drift)
+        ss << endl << formattedAccountBalanceDrift(item);
+    ss << endl;
+
+    if (repair)
+    {
+        vault.rebuildAccountBalances();
+        ss << "Account balances rebuilt.";
+    }
+    else
+    {
+        ss << drift.size() << " balance bucket(s) drifted.";
+    }
+    return ss.str();
+}
+
 cli::result_t cmd_exportvault(const cli::params_t& params)
 {
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
@@ -589,23 +615,58 @@ cli::result_t cmd_listscripts(const cli::params_t& params)
     return ss.str();
 }
 
+// Cursors are passed between calls as height:timestamp:id
+static HistoryCursor parseHistoryCursor(const std::string& cursor_str)
+{
+    HistoryCursor cursor;
+    std::vector<std::string> fields;
+    boost::split(fields, cursor_str, boost::is_any_of(":"));
+    if (fields.size() != 3) throw std::runtime_error("Invalid cursor.");
+
+    cursor.height = strtoul(fields[0].c_str(), NULL, 0);
+    cursor.timestamp = strtoul(fields[1].c_str(), NULL, 0);
+    cursor.id = strtoul(fields[2].c_str(), NULL, 0);
+    return cursor;
+}
+
+static std::string formattedHistoryCursor(const HistoryCursor& cursor)
+{
+    if (cursor.end) return "end of history";
+
+    stringstream ss;
+    ss << "next cursor: " << cursor.height << ":" << cursor.timestamp << ":" << cursor.id;
+    return ss.str();
+}
+
 cli::result_t cmd_history(const cli::params_t& params)
 {
-    std::string account_name = params.size() > 1 ? params[1] : std::string("@all");
-    if (account_name == "@all") account_name = "";
+    HistoryFilter filter;
+    filter.account_name = params.size() > 1 ? params[1] : std::string("@all");
+    if (filter.account_name == "@all") filter.account_name = "";
 
-    std::string bin_name = params.size() > 2 ? params[2] : std::string("@all");
-    if (bin_name == "@all") bin_name = "";
+    filter.bin_name = params.size() > 2 ? params[2] : std::string("@all");
+    if (filter.bin_name == "@all") filter.bin_name = "";
+
+    filter.hide_change = params.size() > 3 ? params[3] == "true" : true;
+
+    unsigned int page_size = params.size() > 4 ? strtoul(params[4].c_str(), NULL, 0) : 0;
+    HistoryCursor cursor = params.size() > 5 ? parseHistoryCursor(params[5]) : HistoryCursor();
 
-    bool hide_change = params.size() > 3 ? params[3] == "true" : true;
-    
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
     uint32_t best_height = vault.getBestHeight();
-    vector<TxOutView> txOutViews = vault.getTxOutViews(account_name, bin_name, TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, hide_change);
     stringstream ss;
     ss << formattedTxOutViewHeader();
-    for (auto& txOutView: txOutViews)
-        ss << endl << formattedTxOutView(txOutView, best_height);
+    if (page_size == 0)
+    {
+        vault.streamTxOutViews(filter, [&](const TxOutView& txOutView) -> bool { ss << endl << formattedTxOutView(txOutView, best_height); return true; }, cursor);
+    }
+    else
+    {
+        vector<TxOutView> txOutViews = vault.getTxOutViewPage(filter, cursor, page_size);
+        for (auto& txOutView: txOutViews)
+            ss << endl << formattedTxOutView(txOutView, best_height);
+        ss << endl << formattedHistoryCursor(cursor);
+    }
     return ss.str();
 }
 
@@ -685,15 +746,28 @@ cli::result_t cmd_importbin(const cli::params_t& params)
 // Tx operations
 cli::result_t cmd_listtxs(const cli::params_t& params)
 {
-    int tx_status_flags = params.size() > 1 && params[1] == "unsigned" ? Tx::UNSIGNED : Tx::ALL;
-    uint32_t minheight = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+    HistoryFilter filter;
+    filter.tx_status_flags = params.size() > 1 && params[1] == "unsigned" ? Tx::UNSIGNED : Tx::ALL;
+    filter.min_height = params.size() > 2 ? strtoul(params[2].c_str(), NULL, 0) : 0;
+
+    unsigned int page_size = params.size() > 3 ? strtoul(params[3].c_str(), NULL, 0) : 0;
+    HistoryCursor cursor = params.size() > 4 ? parseHistoryCursor(params[4]) : HistoryCursor();
+
     Vault vault(g_dbuser, g_dbpasswd, params[0], false);
     uint32_t best_height = vault.getBestHeight();
-    std::vector<TxView> txViews = vault.getTxViews(tx_status_flags, 0, -1, minheight);
     stringstream ss;
     ss << formattedTxViewHeader();
-    for (auto& txView: txViews)
-        ss << endl << formattedTxView(txView, best_height);
+    if (page_size == 0)
+    {
+        vault.streamTxViews(filter, [&](const TxView& txView) -> bool { ss << endl << formattedTxView(txView, best_height); return true; }, cursor);
+    }
+    else
+    {
+        std::vector<TxView> txViews = vault.getTxViewPage(filter, cursor, page_size);
+        for (auto& txView: txViews)
+            ss << endl << formattedTxView(txView, best_height);
+        ss << endl << formattedHistoryCursor(cursor);
+    }
     return ss.str();
 }
 
@@ -1191,6 +1265,12 @@ int main(int argc, char* argv[])
         "migrate",
         "migrate schema version",
         command::params(1, "db file")));
+    shell.add(command(
+        &cmd_checkbalances,
+        "checkbalances",
+        "compare stored account balances with the outputs they summarize",
+        command::params(1, "db file"),
+        command::params(1, "repair = false")));
     shell.add(command(
         &cmd_exportvault,
         "exportvault",
@@ -1366,7 +1446,7 @@ int main(int argc, char* argv[])
         "history",
         "display transaction history",
         command::params(1, "db file"),
-        command::params(3, "account name = @all", "bin name = @all", "hide change = true")));
+        command::params(5, "account name = @all", "bin name = @all", "hide change = true", "page size = 0 (all)", "cursor")));
     shell.add(command(
         &cmd_unspent,
         "unspent",
@@ -1409,7 +1489,7 @@ int main(int argc, char* argv[])
         "listtxs",
         "list transactions",
         command::params(1, "db file"),
-        command::params(2, "all | unsigned (default: all)", "minheight (default:0)")));
+        command::params(4, "all | unsigned (default: all)", "minheight (default:0)", "page size (default: 0 = all)", "cursor")));
     shell.add(command(
         &cmd_txinfo,
         "txinfo",
@@ -430,6 +430,44 @@ inline std::string formattedAccount(const CoinDB::AccountInfo& info)
     return ss.str();
 }
 
+// Account balance drift
+inline std::string formattedAccountBalanceDriftHeader()
+{
+    using namespace std;
+
+    stringstream ss;
+    ss << " ";
+    ss << left  << setw(15) << "account name" << " | "
+       << right << setw(10) << "account id" << " | "
+       << left  << setw(12) << "tx status" << " | "
+       << right << setw(8)  << "height" << " | "
+       << right << setw(20) << "stored" << " | "
+       << right << setw(20) << "actual";
+    ss << " ";
+
+    size_t header_length = ss.str().size();
+    ss << endl;
+    for (size_t i = 0; i < header_length; i++) { ss << "="; }
+    return ss.str();
+}
+
+inline std::string formattedAccountBalanceDrift(const CoinDB::AccountBalanceDrift& drift)
+{
+    using namespace std;
+    using namespace CoinDB;
+
+    stringstream ss;
+    ss << " ";
+    ss << left  << setw(15) << drift.account_name << " | "
+       << right << setw(10) << drift.account_id << " | "
+       << left  << setw(12) << Tx::getStatusString(drift.tx_status, true) << " | "
+       << right << setw(8)  << drift.height << " | "
+       << right << setw(20) << drift.stored << " | "
+       << right << setw(20) << drift.actual;
+    ss << " ";
+    return ss.str();
+}
+
 // Account bins
 inline std::string formattedAccountBinViewHeader()
 {
@@ -0,0 +1,144 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// coinselectbench.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Runs each coin selector on synthetic sets of unspent 2 of 3 multisig
+// outputs and reports selection time, input count, waste and how often no
+// change output was needed. Times cover the selection only, not loading the
+// candidates from a vault.
+//
+// Usage: coinselectbench [payments per set] [fee rate] [long term fee rate] [seed]
+
+#include <CoinSelection.h>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace CoinDB;
+using namespace std;
+
+// Values are log-uniform between 0.0001 and 10 BTC, like a wallet receiving many payments of varied size.
+static uint64_t randomValue(mt19937_64& rng, double min_value, double max_value)
+{
+    uniform_real_distribution<double> exponent(log(min_value), log(max_value));
+    return (uint64_t)exp(exponent(rng));
+}
+
+static coin_candidates_t makeCandidates(mt19937_64& rng, size_t count, uint32_t txin_size)
+{
+    coin_candidates_t candidates;
+    for (size_t i = 0; i < count; i++) { candidates.push_back(CoinCandidate(i + 1, randomValue(rng, 1e4, 1e9), txin_size)); }
+    return candidates;
+}
+
+struct BenchResult
+{
+    BenchResult() : runs(0), failures(0), micros(0), inputs(0), waste(0), changeless(0) { }
+
+    unsigned int runs;
+    unsigned int failures;
+    double micros;
+    uint64_t inputs;
+    int64_t waste;
+    unsigned int changeless;
+};
+
+static void bench(const coin_selector_t& selector, const coin_candidates_t& candidates, const vector<uint64_t>& targets, const CoinSelectionPolicy& policy, BenchResult& result)
+{
+    for (auto target: targets)
+    {
+        CoinSelection selection;
+        auto start = chrono::steady_clock::now();
+        bool selected = selector(candidates, target, policy, selection);
+        auto end = chrono::steady_clock::now();
+
+        result.runs++;
+        result.micros += chrono::duration<double, micro>(end - start).count();
+        if (!selected)
+        {
+            result.failures++;
+            continue;
+        }
+
+        if (selection.value < selection.input_fee + target) throw runtime_error("Selection does not cover its target.");
+        result.inputs += selection.coins.size();
+        result.waste += selection.waste;
+        if (selection.change == 0) result.changeless++;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int nPayments = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+
+        CoinSelectionPolicy policy;
+        policy.fee_rate = argc > 2 ? strtoull(argv[2], NULL, 0) : 20000;
+        policy.long_term_fee_rate = argc > 3 ? strtoull(argv[3], NULL, 0) : 10000;
+        unsigned int seed = argc > 4 ? strtoul(argv[4], NULL, 0) : 1;
+
+        uint32_t txin_size = estimateMultiSigTxInSize(2, 3);
+        policy.change_txin_size = txin_size;
+
+        struct { const char* name; coin_selector_t selector; } selectors[] =
+        {
+            { "random (legacy)", &selectCoinsRandom },
+            { "fewest inputs", &selectCoinsFewestInputs },
+            { "knapsack", &selectCoinsKnapsack },
+            { "selectCoins (default)", &selectCoins }
+        };
+
+        cout << "fee rate: " << policy.fee_rate << " sat/kB, long term fee rate: " << policy.long_term_fee_rate << " sat/kB, "
+             << "input size: " << txin_size << " bytes, cost of change: " << policy.cost_of_change() << endl << endl;
+
+        cout << left  << setw(8)  << "utxos" << " | "
+             << left  << setw(28) << "selector" << " | "
+             << right << setw(12) << "avg us" << " | "
+             << right << setw(10) << "avg inputs" << " | "
+             << right << setw(12) << "avg waste" << " | "
+             << right << setw(10) << "changeless" << " | "
+             << right << setw(8)  << "failures" << endl;
+
+        const size_t set_sizes[] = { 100, 1000, 10000, 50000 };
+        for (auto set_size: set_sizes)
+        {
+            mt19937_64 rng(seed);
+            coin_candidates_t candidates = makeCandidates(rng, set_size, txin_size);
+            vector<uint64_t> targets;
+            for (unsigned int i = 0; i < nPayments; i++) { targets.push_back(randomValue(rng, 1e5, 1e8)); }
+
+            for (auto& s: selectors)
+            {
+                srand(seed);
+                BenchResult result;
+                bench(s.selector, candidates, targets, policy, result);
+
+                unsigned int succeeded = result.runs - result.failures;
+                cout << left  << setw(8)  << set_size << " | "
+                     << left  << setw(28) << s.name << " | "
+                     << right << setw(12) << fixed << setprecision(1) << result.micros / result.runs << " | "
+                     << right << setw(10) << setprecision(2) << (succeeded ? (double)result.inputs / succeeded : 0.0) << " | "
+                     << right << setw(12) << setprecision(0) << (succeeded ? (double)result.waste / succeeded : 0.0) << " | "
+                     << right << setw(9)  << setprecision(0) << (succeeded ? 100.0 * result.changeless / succeeded : 0.0) << "%" << " | "
+                     << right << setw(8)  << result.failures << endl;
+            }
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
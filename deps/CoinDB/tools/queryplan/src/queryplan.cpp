@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// queryplan.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Query plan regression check for SQLite vaults. Runs EXPLAIN QUERY PLAN on
+// the SQL ODB generates for the queries made on every transaction and block
+// insertion and fails if any of them scans a table or has SQLite build a
+// temporary index. History pages read every matching row past the cursor, so
+// their driving table may be scanned, but nothing joined to it may be.
+//
+// Usage: queryplan [vault file]
+//
+// Without a vault file a new vault with the current schema is created in a
+// temporary file and checked.
+
+#include <Vault.h>
+
+#include <sqlite3.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace CoinDB;
+using namespace std;
+
+struct HotQuery
+{
+    const char* name;
+    const char* sql;
+};
+
+// Column and join layout follows the statements ODB generates for the queries in Vault.cpp.
+static const HotQuery HOT_QUERIES[] =
+{
+    { "signing script by txoutscript",
+      "SELECT \"SigningScript\".\"id\" FROM \"SigningScript\" WHERE \"SigningScript\".\"txoutscript\" = ?" },
+    { "tx by hash",
+      "SELECT \"Tx\".\"id\" FROM \"Tx\" WHERE \"Tx\".\"hash\" = ?" },
+    { "tx by unsigned hash",
+      "SELECT \"Tx\".\"id\" FROM \"Tx\" WHERE \"Tx\".\"unsigned_hash\" = ?" },
+    { "tx inputs",
+      "SELECT \"TxIn\".\"id\" FROM \"TxIn\" WHERE \"TxIn\".\"tx\" = ?" },
+    { "tx outputs",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" WHERE \"TxOut\".\"tx\" = ?" },
+    { "txin by outpoint",
+      "SELECT \"TxIn\".\"id\" FROM \"TxIn\" WHERE \"TxIn\".\"outhash\" = ? AND \"TxIn\".\"outindex\" = ?" },
+    { "txout by outpoint",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" LEFT JOIN \"Tx\" AS \"tx\" ON \"tx\".\"id\" = \"TxOut\".\"tx\" WHERE \"tx\".\"hash\" = ? AND \"TxOut\".\"txindex\" = ?" },
+    { "txout by spending input",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" WHERE \"TxOut\".\"spent\" = ?" },
+    { "txout by script",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" WHERE \"TxOut\".\"script\" = ?" },
+    { "merkle block by hash",
+      "SELECT \"MerkleBlock\".\"id\" FROM \"MerkleBlock\" LEFT JOIN \"BlockHeader\" AS \"blockheader\" ON \"blockheader\".\"id\" = \"MerkleBlock\".\"blockheader\" WHERE \"MerkleBlock\".\"blockheader\" IS NOT NULL AND \"blockheader\".\"hash\" = ?" },
+    { "merkle blocks above height",
+      "SELECT \"MerkleBlock\".\"id\" FROM \"MerkleBlock\" LEFT JOIN \"BlockHeader\" AS \"blockheader\" ON \"blockheader\".\"id\" = \"MerkleBlock\".\"blockheader\" WHERE \"blockheader\".\"height\" >= ?" },
+    { "txs above height",
+      "SELECT \"Tx\".\"id\" FROM \"Tx\" LEFT JOIN \"BlockHeader\" AS \"blockheader\" ON \"blockheader\".\"id\" = \"Tx\".\"blockheader\" WHERE \"blockheader\".\"height\" >= ?" },
+    { "block header by height",
+      "SELECT \"BlockHeader\".\"id\" FROM \"BlockHeader\" WHERE \"BlockHeader\".\"height\" = ?" },
+    { "account balance",
+      "SELECT coalesce(sum(\"AccountBalance\".\"balance\"), 0) FROM \"AccountBalance\" INNER JOIN \"Account\" ON \"AccountBalance\".\"account\" = \"Account\".\"id\" WHERE \"Account\".\"name\" = ? AND \"AccountBalance\".\"tx_status\" IN (?, ?) AND \"AccountBalance\".\"height\" != ? AND \"AccountBalance\".\"height\" <= ?" },
+    { "account balance bucket",
+      "SELECT \"AccountBalance\".\"id\" FROM \"AccountBalance\" WHERE \"AccountBalance\".\"account\" = ? AND \"AccountBalance\".\"tx_status\" = ? AND \"AccountBalance\".\"height\" = ?" },
+    { "balance contribution of output",
+      "SELECT \"Account\".\"id\", \"Tx\".\"status\", coalesce(\"BlockHeader\".\"height\", 0), sum(\"TxOut\".\"value\") FROM \"TxOut\" INNER JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" INNER JOIN \"Account\" ON \"TxOut\".\"receiving_account\" = \"Account\".\"id\" WHERE (\"TxOut\".\"status\" = ? AND (\"TxOut\".\"id\" = ?)) GROUP BY \"Account\".\"id\", \"Tx\".\"status\", \"BlockHeader\".\"height\"" },
+    { "balance contribution of tx",
+      "SELECT \"Account\".\"id\", \"Tx\".\"status\", coalesce(\"BlockHeader\".\"height\", 0), sum(\"TxOut\".\"value\") FROM \"TxOut\" INNER JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" INNER JOIN \"Account\" ON \"TxOut\".\"receiving_account\" = \"Account\".\"id\" WHERE (\"TxOut\".\"status\" = ? AND (\"Tx\".\"id\" = ?)) GROUP BY \"Account\".\"id\", \"Tx\".\"status\", \"BlockHeader\".\"height\"" },
+    { "balance contribution above height",
+      "SELECT \"Account\".\"id\", \"Tx\".\"status\", coalesce(\"BlockHeader\".\"height\", 0), sum(\"TxOut\".\"value\") FROM \"TxOut\" INNER JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" INNER JOIN \"Account\" ON \"TxOut\".\"receiving_account\" = \"Account\".\"id\" WHERE (\"TxOut\".\"status\" = ? AND (\"Tx\".\"blockheader\" IN (SELECT id FROM BlockHeader WHERE height >= ?))) GROUP BY \"Account\".\"id\", \"Tx\".\"status\", \"BlockHeader\".\"height\"" },
+    { "coin candidates",
+      "SELECT \"TxOut\".\"id\", \"TxOut\".\"value\" FROM \"TxOut\" INNER JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" WHERE \"Tx\".\"status\" > ? AND \"TxOut\".\"status\" = ? AND \"TxOut\".\"receiving_account\" = ?" },
+    { "unspent outputs",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" LEFT JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"Account\" AS \"receiving_account\" ON \"TxOut\".\"receiving_account\" = \"receiving_account\".\"id\" WHERE \"Tx\".\"status\" > ? AND \"TxOut\".\"status\" = ? AND \"receiving_account\".\"id\" = ? ORDER BY \"TxOut\".\"value\" DESC" }
+};
+
+// Pages of account history in the order afterHistoryCursor and appendHistoryOrder give them in Vault.cpp.
+static const HotQuery HISTORY_QUERIES[] =
+{
+    { "tx history page",
+      "SELECT \"Tx\".\"id\" FROM \"Tx\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" WHERE EXISTS (SELECT 1 FROM TxOut WHERE TxOut.tx = \"Tx\".\"id\" AND (0 = 1 OR TxOut.sending_account = ? OR TxOut.receiving_account = ?)) AND ((coalesce(\"BlockHeader\".\"height\", 0) < ?) OR ((coalesce(\"BlockHeader\".\"height\", 0) = ?) AND (\"Tx\".\"timestamp\" < ? OR (\"Tx\".\"timestamp\" = ? AND \"Tx\".\"id\" < ?)))) ORDER BY coalesce(\"BlockHeader\".\"height\", 0) DESC, \"Tx\".\"timestamp\" DESC, \"Tx\".\"id\" DESC LIMIT ?" },
+    { "txout history page",
+      "SELECT \"TxOut\".\"id\" FROM \"TxOut\" LEFT JOIN \"Tx\" ON \"TxOut\".\"tx\" = \"Tx\".\"id\" LEFT JOIN \"BlockHeader\" ON \"Tx\".\"blockheader\" = \"BlockHeader\".\"id\" LEFT JOIN \"Account\" AS \"sending_account\" ON \"TxOut\".\"sending_account\" = \"sending_account\".\"id\" LEFT JOIN \"Account\" AS \"receiving_account\" ON \"TxOut\".\"receiving_account\" = \"receiving_account\".\"id\" LEFT JOIN \"AccountBin\" ON \"TxOut\".\"account_bin\" = \"AccountBin\".\"id\" LEFT JOIN \"SigningScript\" ON \"TxOut\".\"signingscript\" = \"SigningScript\".\"id\" WHERE (\"receiving_account\".\"id\" != ? OR \"sending_account\".\"id\" != ?) AND (\"sending_account\".\"name\" = ? OR \"receiving_account\".\"name\" = ?) AND (\"TxOut\".\"account_bin\" IS NULL OR \"AccountBin\".\"name\" != ?) AND \"TxOut\".\"status\" IN (?, ?) AND \"Tx\".\"status\" IN (?) AND ((coalesce(\"BlockHeader\".\"height\", 0) < ?) OR ((coalesce(\"BlockHeader\".\"height\", 0) = ?) AND (\"Tx\".\"timestamp\" < ? OR (\"Tx\".\"timestamp\" = ? AND \"TxOut\".\"id\" < ?)))) ORDER BY coalesce(\"BlockHeader\".\"height\", 0) DESC, \"Tx\".\"timestamp\" DESC, \"TxOut\".\"id\" DESC LIMIT ?" }
+};
+
+static vector<string> getQueryPlan(sqlite3* db, const string& sql)
+{
+    sqlite3_stmt* stmt;
+    string explain = "EXPLAIN QUERY PLAN " + sql;
+    if (sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, nullptr) != SQLITE_OK) throw runtime_error(sqlite3_errmsg(db));
+
+    vector<string> steps;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        // The last column holds the step description for all SQLite versions.
+        int column = sqlite3_column_count(stmt) - 1;
+        steps.push_back((const char*)sqlite3_column_text(stmt, column));
+    }
+    sqlite3_finalize(stmt);
+    return steps;
+}
+
+static bool usesIndexes(const vector<string>& steps, bool scansDrivingTable = false)
+{
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        if (steps[i].compare(0, 5, "SCAN ") == 0 && !(scansDrivingTable && i == 0)) return false;
+        if (steps[i].find("AUTOMATIC") != string::npos) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+#if !defined(DATABASE_SQLITE)
+    cerr << "queryplan only supports SQLite vaults." << endl;
+    return 1;
+#else
+    string filename;
+    bool temporary = argc < 2;
+    if (temporary)
+    {
+        filename = "queryplan.db";
+        remove(filename.c_str());
+    }
+    else
+    {
+        filename = argv[1];
+    }
+
+    int failed = 0;
+    try
+    {
+        {
+            // Creates a new vault or checks an existing one is at the current schema version.
+            Vault vault(filename, temporary);
+        }
+
+        sqlite3* db;
+        if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) throw runtime_error("Failed to open " + filename + ".");
+
+        auto check = [&](const HotQuery& query, bool scansDrivingTable)
+        {
+            vector<string> steps = getQueryPlan(db, query.sql);
+            bool ok = usesIndexes(steps, scansDrivingTable);
+            if (!ok) failed++;
+
+            cout << (ok ? "ok     " : "FAILED ") << query.name << endl;
+            for (auto& step: steps) { cout << "         " << step << endl; }
+        };
+
+        for (auto& query: HOT_QUERIES)      { check(query, false); }
+        for (auto& query: HISTORY_QUERIES)  { check(query, true); }
+
+        sqlite3_close(db);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Exception: " << e.what() << endl;
+        failed = -1;
+    }
+
+    if (temporary)
+    {
+        remove(filename.c_str());
+        remove((filename + "-wal").c_str());
+        remove((filename + "-shm").c_str());
+    }
+
+    if (failed < 0) return 1;
+    cout << (failed ? to_string(failed) + " queries do not use an index." : string("All queries use indexes.")) << endl;
+    return failed ? 1 : 0;
+#endif
+}
@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// storagebench.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+//
+// Ingests a synthetic transaction history into a fresh vault under each
+// storage profile and reports transactions per second and fsync counts. Every
+// insertTx call commits its own transaction, as it does during a sync.
+//
+// Usage: storagebench [tx count] [directory]
+
+#include <Vault.h>
+
+#include <CoinCore/random.h>
+#include <CoinCore/CoinNodeData.h>
+
+#include <sqlite3.h>
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace CoinDB;
+using namespace std;
+
+// SQLite VFS that forwards everything to the default VFS and counts syncs.
+static sqlite3_vfs* g_defaultVfs = nullptr;
+static sqlite3_io_methods g_countingMethods;
+static uint64_t g_syncs = 0;
+
+struct CountingFile
+{
+    sqlite3_file base;
+    sqlite3_file* real;
+};
+
+static sqlite3_file* realFile(sqlite3_file* file) { return ((CountingFile*)file)->real; }
+
+static int countingClose(sqlite3_file* file)
+{
+    sqlite3_file* real = realFile(file);
+    int rc = real->pMethods ? real->pMethods->xClose(real) : SQLITE_OK;
+    sqlite3_free(real);
+    return rc;
+}
+
+static int countingRead(sqlite3_file* f, void* buf, int n, sqlite3_int64 offset)         { return realFile(f)->pMethods->xRead(realFile(f), buf, n, offset); }
+static int countingWrite(sqlite3_file* f, const void* buf, int n, sqlite3_int64 offset)  { return realFile(f)->pMethods->xWrite(realFile(f), buf, n, offset); }
+static int countingTruncate(sqlite3_file* f, sqlite3_int64 size)                         { return realFile(f)->pMethods->xTruncate(realFile(f), size); }
+static int countingSync(sqlite3_file* f, int flags)                                      { g_syncs++; return realFile(f)->pMethods->xSync(realFile(f), flags); }
+static int countingFileSize(sqlite3_file* f, sqlite3_int64* size)                        { return realFile(f)->pMethods->xFileSize(realFile(f), size); }
+static int countingLock(sqlite3_file* f, int lock)                                       { return realFile(f)->pMethods->xLock(realFile(f), lock); }
+static int countingUnlock(sqlite3_file* f, int lock)                                     { return realFile(f)->pMethods->xUnlock(realFile(f), lock); }
+static int countingCheckReservedLock(sqlite3_file* f, int* out)                          { return realFile(f)->pMethods->xCheckReservedLock(realFile(f), out); }
+static int countingFileControl(sqlite3_file* f, int op, void* arg)                       { return realFile(f)->pMethods->xFileControl(realFile(f), op, arg); }
+static int countingSectorSize(sqlite3_file* f)                                           { return realFile(f)->pMethods->xSectorSize(realFile(f)); }
+static int countingDeviceCharacteristics(sqlite3_file* f)                                { return realFile(f)->pMethods->xDeviceCharacteristics(realFile(f)); }
+static int countingShmMap(sqlite3_file* f, int page, int size, int extend, void volatile** p) { return realFile(f)->pMethods->xShmMap(realFile(f), page, size, extend, p); }
+static int countingShmLock(sqlite3_file* f, int offset, int n, int flags)                { return realFile(f)->pMethods->xShmLock(realFile(f), offset, n, flags); }
+static void countingShmBarrier(sqlite3_file* f)                                          { realFile(f)->pMethods->xShmBarrier(realFile(f)); }
+static int countingShmUnmap(sqlite3_file* f, int deleteFlag)                             { return realFile(f)->pMethods->xShmUnmap(realFile(f), deleteFlag); }
+static int countingFetch(sqlite3_file* f, sqlite3_int64 offset, int n, void** p)         { return realFile(f)->pMethods->xFetch(realFile(f), offset, n, p); }
+static int countingUnfetch(sqlite3_file* f, sqlite3_int64 offset, void* p)               { return realFile(f)->pMethods->xUnfetch(realFile(f), offset, p); }
+
+static int countingOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags)
+{
+    CountingFile* countingFile = (CountingFile*)file;
+    countingFile->base.pMethods = nullptr;
+    countingFile->real = (sqlite3_file*)sqlite3_malloc(g_defaultVfs->szOsFile);
+    if (!countingFile->real) return SQLITE_NOMEM;
+    memset(countingFile->real, 0, g_defaultVfs->szOsFile);
+
+    int rc = g_defaultVfs->xOpen(g_defaultVfs, name, countingFile->real, flags, outFlags);
+    if (rc != SQLITE_OK)
+    {
+        sqlite3_free(countingFile->real);
+        return rc;
+    }
+
+    // Match the real file's interface version so SQLite only uses what it provides.
+    g_countingMethods.iVersion = countingFile->real->pMethods->iVersion;
+    countingFile->base.pMethods = &g_countingMethods;
+    return SQLITE_OK;
+}
+
+static void registerCountingVfs()
+{
+    g_defaultVfs = sqlite3_vfs_find(nullptr);
+    if (!g_defaultVfs) throw runtime_error("No default SQLite VFS.");
+
+    g_countingMethods = {
+        3, countingClose, countingRead, countingWrite, countingTruncate, countingSync, countingFileSize,
+        countingLock, countingUnlock, countingCheckReservedLock, countingFileControl, countingSectorSize,
+        countingDeviceCharacteristics, countingShmMap, countingShmLock, countingShmBarrier, countingShmUnmap,
+        countingFetch, countingUnfetch
+    };
+
+    static sqlite3_vfs countingVfs = *g_defaultVfs;
+    countingVfs.zName = "counting";
+    countingVfs.szOsFile = sizeof(CountingFile);
+    countingVfs.xOpen = countingOpen;
+    countingVfs.pNext = nullptr;
+    if (sqlite3_vfs_register(&countingVfs, 1) != SQLITE_OK) throw runtime_error("Failed to register SQLite VFS.");
+}
+
+// Test data
+static uchar_vector randomBytes(size_t n)
+{
+    uchar_vector bytes(n);
+    for (auto& byte: bytes) { byte = rand() & 0xff; }
+    return bytes;
+}
+
+static void removeDatabase(const string& filename)
+{
+    remove(filename.c_str());
+    remove((filename + "-journal").c_str());
+    remove((filename + "-wal").c_str());
+    remove((filename + "-shm").c_str());
+}
+
+static void bench(const string& name, const StorageProfile& profile, const string& filename, unsigned int nTxs)
+{
+    removeDatabase(filename);
+
+    Vault vault;
+    vault.setStorageProfile(profile);
+    vault.open("", "", filename, true);
+
+    vault.newKeychain("keychain", secure_random_bytes(32));
+    vault.newAccount("account", 1, vector<string>(1, "keychain"), 100);
+
+    vector<bytes_t> txoutscripts;
+    for (unsigned int i = 0; i < 100; i++) { txoutscripts.push_back(vault.issueSigningScript("account")->txoutscript()); }
+
+    uint64_t syncs = g_syncs;
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < nTxs; i++)
+    {
+        Coin::Transaction cointx;
+        cointx.addInput(Coin::TxIn(Coin::OutPoint(randomBytes(32), rand() % 4), randomBytes(106), 0xffffffff));
+        cointx.addOutput(Coin::TxOut(100000 + rand(), txoutscripts[i % txoutscripts.size()]));
+        cointx.addOutput(Coin::TxOut(100000 + rand(), uchar_vector("76a914") + randomBytes(20) + uchar_vector("88ac")));
+
+        std::shared_ptr<Tx> tx(new Tx());
+        tx->set(cointx);
+        if (!vault.insertTx(tx)) throw runtime_error("Transaction was not inserted.");
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    syncs = g_syncs - syncs;
+
+    cout << name << ": " << nTxs / seconds << " tx/s, " << syncs << " fsyncs (" << (double)syncs / nTxs << " per tx)" << endl;
+
+    vault.close();
+    removeDatabase(filename);
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        unsigned int nTxs = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000;
+        string dir = argc > 2 ? argv[2] : ".";
+        string filename = dir + "/storagebench.db";
+
+        registerCountingVfs();
+
+        bench("legacy ", StorageProfile::legacy(), filename, nTxs);
+        bench("durable", StorageProfile::durable(), filename, nTxs);
+        bench("fast   ", StorageProfile::fast(), filename, nTxs);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Exception: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
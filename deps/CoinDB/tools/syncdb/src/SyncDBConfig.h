@@ -16,6 +16,7 @@
 const double DEFAULT_FILTER_FALSE_POSITIVE_RATE = 0.001;
 const uint32_t DEFAULT_FILTER_TWEAK = 0;
 const uint8_t DEFAULT_FILTER_FLAGS = 0;
+const unsigned int DEFAULT_BLOCK_SYNC_WINDOW = 16;
 
 class SyncDBConfig : public CoinDBConfig
 {
@@ -27,11 +28,13 @@ public:
     double getFilterFalsePositiveRate() const { return m_filterFalsePositiveRate; }
     uint32_t getFilterTweak() const { return m_filterTweak; }
     uint8_t getFilterFlags() const { return m_filterFlags; }
+    unsigned int getBlockSyncWindow() const { return m_blockSyncWindow; }
 
 protected:
     double m_filterFalsePositiveRate;
     uint32_t m_filterTweak;
     uint8_t m_filterFlags;
+    unsigned int m_blockSyncWindow;
 };
 
 inline SyncDBConfig::SyncDBConfig() : CoinDBConfig()
@@ -42,6 +45,7 @@ inline SyncDBConfig::SyncDBConfig() : CoinDBConfig()
         ("filterfpr", po::value<double>(&m_filterFalsePositiveRate), "filter false positive rate")
         ("filtertweak", po::value<uint32_t>(&m_filterTweak), "filter tweak")
         ("filterflags", po::value<uint8_t>(&m_filterFlags), "filter flags")
+        ("blocksyncwindow", po::value<unsigned int>(&m_blockSyncWindow), "number of filtered blocks to request ahead while synching")
     ;
 }
 
@@ -52,6 +56,7 @@ inline bool SyncDBConfig::parseParams(int argc, char* argv[])
     if (!m_vm.count("filterfpr"))   { m_filterFalsePositiveRate = DEFAULT_FILTER_FALSE_POSITIVE_RATE; }
     if (!m_vm.count("filtertweak")) { m_filterTweak = DEFAULT_FILTER_TWEAK; }
     if (!m_vm.count("filterflags")) { m_filterFlags = DEFAULT_FILTER_FLAGS; }
+    if (!m_vm.count("blocksyncwindow")) { m_blockSyncWindow = DEFAULT_BLOCK_SYNC_WINDOW; }
 
     return true;
 }
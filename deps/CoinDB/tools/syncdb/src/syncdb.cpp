@@ -72,6 +72,14 @@ void subscribeHandlers(SynchedVault& synchedVault)
         cout << ss.str() << endl;
     });
 
+    synchedVault.subscribeReorg([](uint32_t forkHeight, ids_t txIds)
+    {
+        stringstream ss;
+        ss << "Reorganization at height: " << forkHeight << " Transactions unconfirmed: " << txIds.size();
+        LOGGER(info) << ss.str() << endl;
+        cout << ss.str() << endl;
+    });
+
     synchedVault.subscribeTxInsertionError([](std::shared_ptr<Tx> tx, const std::string& description)
     {
         stringstream ss;
@@ -177,6 +185,7 @@ int main(int argc, char* argv[])
     SynchedVault synchedVault(coinParams);
     LOGGER(trace) << "bar" << endl;
     subscribeHandlers(synchedVault);
+    synchedVault.setBlockSyncWindow(config.getBlockSyncWindow());
 
     try
     {
@@ -207,7 +216,8 @@ int main(int argc, char* argv[])
            << "  host:             " << host << endl
            << "  port:             " << port << endl
            << "  magic bytes:      " << hex << coinParams.magic_bytes() << endl
-           << "  protocol version: " << dec << coinParams.protocol_version() << endl;
+           << "  protocol version: " << dec << coinParams.protocol_version() << endl
+           << "  sync window:      " << config.getBlockSyncWindow() << endl;
 
         LOGGER(info) << ss.str() << endl;
         cout << ss.str() << endl;
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// block tree load benchmark
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include <CoinQ_blocks.h>
+
+#include <CoinCore/hash.h>
+#include <CoinCore/numericdata.h>
+
+#include <logger/logger.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+const unsigned int DEFAULT_HEADER_COUNT = 1000000;
+
+// Regtest difficulty so every header can be mined in a couple of tries
+const uint32_t SYNTHETIC_BITS = 0x207fffff;
+
+void writeSyntheticHeaders(const string& filename, unsigned int count)
+{
+    ofstream fs(filename, ios::binary | ios::trunc);
+    if (!fs.good()) throw runtime_error("Failed to open file for write.");
+
+    uchar_vector prevHash = g_zero32bytes;
+    uint32_t timestamp = 1296688602;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        Coin::CoinBlockHeader header(2, timestamp + i * 600, SYNTHETIC_BITS, 0, prevHash, sha256_2(uint_to_vch(i, _BIG_ENDIAN)));
+        while (!header.hasValidPOW()) { header.incrementNonce(); }
+
+        uchar_vector headerBytes = header.getSerialized();
+        prevHash = header.hash();
+        fs.write((const char*)&headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
+        fs.write((const char*)&prevHash[0], 4);
+        if (fs.bad()) throw runtime_error("Failed to write file.");
+    }
+}
+
+void loadHeaders(const string& filename, bool bCheckProofOfWork)
+{
+    CoinQBlockTreeMem blockTree;
+    auto start = chrono::steady_clock::now();
+    blockTree.loadFromFile(filename, bCheckProofOfWork);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    unsigned int count = blockTree.getBestHeight() + 1;
+    cout << "  proof of work:    " << (bCheckProofOfWork ? "checked" : "unchecked") << endl
+         << "  headers:          " << count << endl
+         << "  seconds:          " << seconds << endl
+         << "  headers/sec:      " << (unsigned long)(count / seconds) << endl << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "# Usage: " << argv[0] << " <headers file> [header count = " << DEFAULT_HEADER_COUNT << "]" << endl
+             << "# A synthetic chain is generated if the file does not exist." << endl;
+        return -1;
+    }
+
+    try
+    {
+        INIT_LOGGER("blocktreeload.log");
+
+        string filename = argv[1];
+        unsigned int count = (argc > 2) ? strtoul(argv[2], NULL, 0) : DEFAULT_HEADER_COUNT;
+
+        if (!boost::filesystem::exists(filename))
+        {
+            cout << "Generating " << count << " synthetic headers..." << endl;
+            writeSyntheticHeaders(filename, count);
+        }
+
+        cout << endl << "Loading " << filename << endl
+             << "-------------------------------------------" << endl;
+
+        loadHeaders(filename, false);
+        loadHeaders(filename, true);
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// block tree memory and lookup benchmark
+//
+// main.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include <CoinQ_blocks.h>
+
+#include <CoinCore/hash.h>
+#include <CoinCore/numericdata.h>
+
+#include <logger/logger.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+const unsigned int DEFAULT_HEADER_COUNT = 500000;
+const unsigned int LOOKUP_COUNT = 1000000;
+
+// Keeps lookups from being optimized away
+volatile int g_heightSum = 0;
+
+// The map based storage CoinQBlockTreeMem used before the header arena
+class MapBlockTree
+{
+public:
+    void insertHeader(const Coin::CoinBlockHeader& header)
+    {
+        const uchar_vector& hash = header.hash();
+        ChainHeader& chainHeader = mHeaderHashMap[hash] = header;
+        auto it = mHeaderHashMap.find(header.prevBlockHash());
+        if (it == mHeaderHashMap.end())
+        {
+            chainHeader.height = 0;
+            chainHeader.chainWork = chainHeader.getWork();
+        }
+        else
+        {
+            chainHeader.height = it->second.height + 1;
+            chainHeader.chainWork = it->second.chainWork + chainHeader.getWork();
+            it->second.childHashes.insert(hash);
+        }
+        chainHeader.inBestChain = true;
+        mHeaderHeightMap[chainHeader.height] = &chainHeader;
+    }
+
+    const ChainHeader& getHeader(const uchar_vector& hash) const { return mHeaderHashMap.at(hash); }
+
+private:
+    std::map<uchar_vector, ChainHeader> mHeaderHashMap;
+    std::map<unsigned int, ChainHeader*> mHeaderHeightMap;
+};
+
+// Heap bytes currently allocated
+size_t getAllocatedMemory()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+vector<Coin::CoinBlockHeader> makeHeaders(unsigned int count)
+{
+    vector<Coin::CoinBlockHeader> headers;
+    headers.reserve(count);
+
+    uchar_vector prevHash = g_zero32bytes;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        // Use a real looking difficulty so hashes have leading zeros like mainnet headers.
+        headers.push_back(Coin::CoinBlockHeader(2, 1296688602 + i * 600, 0x1d00ffff, i, prevHash, sha256_2(uint_to_vch(i, _BIG_ENDIAN))));
+        prevHash = headers.back().hash();
+    }
+    return headers;
+}
+
+// Memory is measured again after the lookups so anything they leave behind is counted.
+template<typename Tree>
+void lookupHeaders(const Tree& tree, const vector<uchar_vector>& hashes, size_t startMemory, unsigned int count)
+{
+    auto start = chrono::steady_clock::now();
+    for (auto& hash: hashes) { g_heightSum += tree.getHeader(hash).height; }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  lookups:          " << hashes.size() << endl
+         << "  ns/lookup:        " << (unsigned long)(seconds * 1e9 / hashes.size()) << endl
+         << "  bytes/header:     " << (getAllocatedMemory() - startMemory) / count << " after lookups" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        INIT_LOGGER("blocktreemem.log");
+
+        unsigned int count = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_HEADER_COUNT;
+        if (count == 0) throw runtime_error("Header count must be positive.");
+
+        cout << "Generating " << count << " headers..." << endl;
+        vector<Coin::CoinBlockHeader> headers = makeHeaders(count);
+
+        mt19937 rng(0);
+        uniform_int_distribution<unsigned int> dist(0, count - 1);
+        vector<uchar_vector> lookupHashes;
+        lookupHashes.reserve(LOOKUP_COUNT);
+        for (unsigned int i = 0; i < LOOKUP_COUNT; i++) { lookupHashes.push_back(headers[dist(rng)].hash()); }
+
+        {
+            cout << endl << "CoinQBlockTreeMem" << endl
+                 << "-------------------------------------------" << endl;
+            size_t startMemory = getAllocatedMemory();
+            auto start = chrono::steady_clock::now();
+            CoinQBlockTreeMem tree;
+            tree.setGenesisBlock(headers[0]);
+            for (unsigned int i = 1; i < count; i++) { tree.insertHeader(headers[i], false); }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "  bytes/header:     " << (getAllocatedMemory() - startMemory) / count << endl
+                 << "  inserts/sec:      " << (unsigned long)(count / seconds) << endl;
+
+            // getHeader builds a ChainHeader for each lookup so time hasHeader separately.
+            start = chrono::steady_clock::now();
+            unsigned int found = 0;
+            for (auto& hash: lookupHashes) { if (tree.hasHeader(hash)) found++; }
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (found != lookupHashes.size()) throw runtime_error("Header missing from tree.");
+            cout << "  ns/hasHeader:     " << (unsigned long)(seconds * 1e9 / lookupHashes.size()) << endl;
+            lookupHeaders(tree, lookupHashes, startMemory, count);
+        }
+
+        {
+            cout << endl << "std::map storage" << endl
+                 << "-------------------------------------------" << endl;
+            size_t startMemory = getAllocatedMemory();
+            auto start = chrono::steady_clock::now();
+            MapBlockTree tree;
+            for (auto& header: headers) { tree.insertHeader(header); }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "  bytes/header:     " << (getAllocatedMemory() - startMemory) / count << endl
+                 << "  inserts/sec:      " << (unsigned long)(count / seconds) << endl;
+            lookupHeaders(tree, lookupHashes, startMemory, count);
+        }
+    }
+    catch (const exception& e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return -2;
+    }
+
+    return 0;
+}
@@ -68,7 +68,7 @@ int main(int argc, char* argv[])
 
         Network::NetworkSync networkSync(coinParams);
         networkSync.loadHeaders("blocktree.dat", false, [&](const CoinQBlockTreeMem& blocktree) {
-            cout << "Best height: " << blocktree.getBestHeight() << " Total work: " << blocktree.getTotalWork().getDec() << endl;
+            cout << "Best height: " << blocktree.getBestHeight() << " Total work: " << blocktree.getTotalWork().GetDec() << endl;
             return !g_bShutdown;
         });
 
@@ -75,7 +75,7 @@ bool initBlockTree(CoinQBlockTreeMem& blockTree, const CoinBlockHeader& genesisB
             blockTree.loadFromFile(filename);
             std::cout << "Done. "
                       << " mBestHeight: " << blockTree.getBestHeight()
-                      << " mTotalWork: " << blockTree.getTotalWork().getDec() << std::endl;
+                      << " mTotalWork: " << blockTree.getTotalWork().GetDec() << std::endl;
             return true;
         }
         catch (const std::exception& e) {
@@ -101,7 +101,7 @@ void onDoneSync(CoinQ::Peer& peer, ICoinQBlockTree& blockTree, ICoinQTxStore& tx
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Added to best chain:     " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
 
         txStore.setBestHeight(header.height);
         wsServer.setBestHeader(header);
@@ -327,7 +327,7 @@ int main(int argc, char** argv)
 
                 cout << "Processed " << headers.headers.size() << " headers."
                      << " mBestHeight: " << blockTree.getBestHeight()
-                     << " mTotalWork: " << blockTree.getTotalWork().getDec()
+                     << " mTotalWork: " << blockTree.getTotalWork().GetDec()
                      << " Attempting to fetch more headers..." << endl;
                 peer.getHeaders(blockTree.getLocatorHashes(1));
             }
@@ -367,7 +367,7 @@ int main(int argc, char** argv)
     CoinQBestChainBlockFilter blockFilter(&blockTree);
     blockFilter.connect([&](const ChainBlock& block) {
         uchar_vector blockHash = block.blockHeader.getHashLittleEndian();
-        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.getDec() << endl;
+        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.GetDec() << endl;
         for (unsigned int i = 0; i < block.txs.size(); i++) {
             ChainTransaction tx(block.txs[i], block.getHeader(), i);
             txFilter.push(tx);
@@ -387,7 +387,7 @@ int main(int argc, char** argv)
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Removed from best chain: " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
         if (txStore.isOpen()) {
             txStore.unconfirm(hash);
         }
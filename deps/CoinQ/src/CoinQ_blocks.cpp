@@ -8,118 +8,316 @@
 
 #include "CoinQ_blocks.h"
 
+#include <CoinCore/sha256.h>
+
 #include <logger/logger.h>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
 using namespace CoinQ;
 
-bool CoinQBlockTreeMem::setBestChain(ChainHeader& header)
+// Block hashes start with zeros so index by the other end.
+inline std::size_t hashIndexSlot(const unsigned char* hash, std::size_t mask)
+{
+    uint64_t n;
+    memcpy(&n, hash + 24, sizeof(n));
+    return (std::size_t)n & mask;
+}
+
+inline uint32_t headerTimestamp(const unsigned char* header)
+{
+    const unsigned char* p = header + 68;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+const uint256& CoinQBlockTreeMem::getWork(const Coin::CoinBlockHeader& header)
 {
-    if (header.inBestChain) return false;
+    if (header.bits() != mLastWorkBits)
+    {
+        mLastWork = header.getWork();
+        mLastWorkBits = header.bits();
+    }
+    return mLastWork;
+}
+
+uint32_t CoinQBlockTreeMem::findRecord(const uchar_vector& hash) const
+{
+    if (hash.size() != 32 || mHashIndex.empty()) return NO_RECORD;
+
+    std::size_t mask = mHashIndex.size() - 1;
+    for (std::size_t slot = hashIndexSlot(&hash[0], mask);; slot = (slot + 1) & mask)
+    {
+        uint32_t i = mHashIndex[slot];
+        if (i == NO_RECORD) return NO_RECORD;
+        if (!memcmp(mRecords[i].hash, &hash[0], 32)) return i;
+    }
+}
+
+void CoinQBlockTreeMem::indexRecord(uint32_t i)
+{
+    if ((mHashIndexCount + 1) * 2 > mHashIndex.size()) growHashIndex();
+
+    std::size_t mask = mHashIndex.size() - 1;
+    std::size_t slot = hashIndexSlot(mRecords[i].hash, mask);
+    while (mHashIndex[slot] != NO_RECORD) { slot = (slot + 1) & mask; }
+    mHashIndex[slot] = i;
+    mHashIndexCount++;
+}
+
+void CoinQBlockTreeMem::unindexRecord(uint32_t i)
+{
+    std::size_t mask = mHashIndex.size() - 1;
+    std::size_t slot = hashIndexSlot(mRecords[i].hash, mask);
+    while (mHashIndex[slot] != i) { slot = (slot + 1) & mask; }
+    mHashIndex[slot] = NO_RECORD;
+    mHashIndexCount--;
+
+    // Shift back any following entries that can no longer be reached past the empty slot.
+    for (std::size_t next = (slot + 1) & mask; mHashIndex[next] != NO_RECORD; next = (next + 1) & mask)
+    {
+        std::size_t home = hashIndexSlot(mRecords[mHashIndex[next]].hash, mask);
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            mHashIndex[slot] = mHashIndex[next];
+            mHashIndex[next] = NO_RECORD;
+            slot = next;
+        }
+    }
+}
+
+void CoinQBlockTreeMem::growHashIndex()
+{
+    std::size_t size = mHashIndex.empty() ? 1024 : mHashIndex.size() * 2;
+    mHashIndex.assign(size, NO_RECORD);
+    mHashIndexCount = 0;
+    for (uint32_t i = 0; i < mRecords.size(); i++)
+    {
+        if (mRecords[i].inUse) indexRecord(i);
+    }
+}
+
+void CoinQBlockTreeMem::reserve(std::size_t size)
+{
+    mRecords.reserve(size);
+    mBestChain.reserve(size);
+    while (mHashIndex.size() < size * 2) { growHashIndex(); }
+}
+
+uint32_t CoinQBlockTreeMem::newRecord(const Coin::CoinBlockHeader& header, const uchar_vector& hash)
+{
+    uint32_t i;
+    if (mFreeRecords.empty())
+    {
+        if (mRecords.size() >= NO_RECORD) throw std::runtime_error("Tree is full.");
+        i = mRecords.size();
+        mRecords.push_back(HeaderRecord());
+    }
+    else
+    {
+        i = mFreeRecords.back();
+        mFreeRecords.pop_back();
+    }
+
+    HeaderRecord& record = mRecords[i];
+    uchar_vector headerBytes = header.getSerialized();
+    memcpy(record.header, &headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
+    memcpy(record.hash, &hash[0], 32);
+    record.chainWork = 0;
+    record.height = -1;
+    record.parent = NO_RECORD;
+    record.child = NO_RECORD;
+    record.inBestChain = false;
+    record.inUse = true;
+    indexRecord(i);
+    return i;
+}
+
+void CoinQBlockTreeMem::freeRecord(uint32_t i)
+{
+    unindexRecord(i);
+    mRecords[i].inUse = false;
+    mForkChildren.erase(i);
+    mFreeRecords.push_back(i);
+}
+
+std::vector<uint32_t> CoinQBlockTreeMem::getChildren(uint32_t i) const
+{
+    std::vector<uint32_t> children;
+    if (mRecords[i].child == NO_RECORD) return children;
+
+    children.push_back(mRecords[i].child);
+    fork_children_map_t::const_iterator it = mForkChildren.find(i);
+    if (it != mForkChildren.end()) { children.insert(children.end(), it->second.begin(), it->second.end()); }
+    return children;
+}
+
+void CoinQBlockTreeMem::addChild(uint32_t i, uint32_t child)
+{
+    if (mRecords[i].child == NO_RECORD)
+    {
+        mRecords[i].child = child;
+    }
+    else
+    {
+        mForkChildren[i].push_back(child);
+    }
+}
+
+void CoinQBlockTreeMem::removeChild(uint32_t i, uint32_t child)
+{
+    fork_children_map_t::iterator itFork = mForkChildren.find(i);
+    if (mRecords[i].child == child)
+    {
+        if (itFork == mForkChildren.end())
+        {
+            mRecords[i].child = NO_RECORD;
+        }
+        else
+        {
+            mRecords[i].child = itFork->second.back();
+            itFork->second.pop_back();
+        }
+    }
+    else if (itFork != mForkChildren.end())
+    {
+        itFork->second.erase(std::remove(itFork->second.begin(), itFork->second.end(), child), itFork->second.end());
+    }
+    if (itFork != mForkChildren.end() && itFork->second.empty()) { mForkChildren.erase(itFork); }
+}
+
+ChainHeader CoinQBlockTreeMem::getChainHeader(uint32_t i) const
+{
+    const HeaderRecord& record = mRecords[i];
+    Coin::CoinBlockHeader header;
+    header.setSerialized(uchar_vector(record.header, record.header + MIN_COIN_BLOCK_HEADER_SIZE));
+
+    ChainHeader chainHeader(header, record.inBestChain, record.height, record.chainWork);
+    for (auto child: getChildren(i)) { chainHeader.childHashes.insert(uchar_vector(mRecords[child].hash, mRecords[child].hash + 32)); }
+    return chainHeader;
+}
+
+void CoinQBlockTreeMem::notify(CoinQSignal<const ChainHeader&>& signal, uint32_t i)
+{
+    if (signal.empty()) return;
+
+    signal(getChainHeader(i));
+}
+
+bool CoinQBlockTreeMem::setBestChain(uint32_t i)
+{
+    if (mRecords[i].inBestChain) return false;
 
     // Retrace back to earliest best block
-    std::stack<ChainHeader*> newBestChain;
-    ChainHeader* pParent = &header;
-    while (!pParent->inBestChain)
+    std::stack<uint32_t> newBestChain;
+    uint32_t parent = i;
+    while (!mRecords[parent].inBestChain)
     {
-        newBestChain.push(pParent);
-        pParent = &mHeaderHashMap.at(pParent->prevBlockHash());
+        newBestChain.push(parent);
+        parent = mRecords[parent].parent;
+        if (parent == NO_RECORD) throw std::runtime_error("Parent not found.");
     }
 
-    for (auto it = pParent->childHashes.begin(); it != pParent->childHashes.end(); ++it)
+    for (auto child: getChildren(parent))
     {
-        ChainHeader& child = mHeaderHashMap.at(*it);
-        if (child.inBestChain)
+        if (mRecords[child].inBestChain)
         {
             unsetBestChain(child);
             break;
         }
     }
 
+    setDirty(mRecords[parent].height + 1);
+
     // First set these so we have the most current info.
-    mBestHeight = header.height;
-    mTotalWork = header.chainWork;
+    mBestHeight = mRecords[i].height;
+    mTotalWork = mRecords[i].chainWork;
+    mBestChain.resize(mBestHeight + 1, NO_RECORD);
 
     // Pop back up stack and make this the best chain
     int count = 0;
     while (!newBestChain.empty())
     {
-        ChainHeader* pChild = newBestChain.top();
-        pChild->inBestChain = true;
-        mHeaderHeightMap[pChild->height] = pChild;
-        if (count == 0) notifyReorg(*pChild);
-        notifyAddBestChain(*pChild);
+        uint32_t child = newBestChain.top();
+        mRecords[child].inBestChain = true;
+        mBestChain[mRecords[child].height] = child;
+        if (count == 0) notify(notifyReorg, child);
+        notify(notifyAddBestChain, child);
         newBestChain.pop();
         count++;
     }
 
-    pHead = &header;
+    mHead = i;
 
     return true;
 }
 
-bool CoinQBlockTreeMem::unsetBestChain(ChainHeader& header)
+bool CoinQBlockTreeMem::unsetBestChain(uint32_t i)
 {
-    if (!header.inBestChain) return false;
+    if (!mRecords[i].inBestChain) return false;
 
-    if (header.height == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
+    int height = mRecords[i].height;
+    if (height == 0) throw std::runtime_error("Cannot remove genesis block from best chain.");
 
-    ChainHeader* pParent = &mHeaderHashMap.at(header.prevBlockHash());
-    if (pParent->inBestChain)
+    uint32_t parent = mRecords[i].parent;
+    if (mRecords[parent].inBestChain)
     {
-        mBestHeight = pParent->height;
-        mTotalWork = pParent->chainWork;
+        mBestHeight = mRecords[parent].height;
+        mTotalWork = mRecords[parent].chainWork;
     }
-    header.inBestChain = false;
-    notifyRemoveBestChain(header);
+    mRecords[i].inBestChain = false;
+    setDirty(height);
+    notify(notifyRemoveBestChain, i);
 
-    pParent = &header;
-    while (pParent->childHashes.size() != 0)
+    // Everything above it in the best chain descends from it.
+    for (std::size_t h = height + 1; h < mBestChain.size(); h++)
     {
-        for (auto it = pParent->childHashes.begin(); it != pParent->childHashes.end(); ++it)
-        {
-            ChainHeader* pChild = &mHeaderHashMap.at(*it);
-            if (pChild->inBestChain)
-            {
-                pParent = pChild;
-                mHeaderHeightMap.erase(pChild->height);
-                pChild->inBestChain = false;
-                notifyRemoveBestChain(*pChild);
-                break;
-            }
-        }
+        uint32_t child = mBestChain[h];
+        mRecords[child].inBestChain = false;
+        notify(notifyRemoveBestChain, child);
     }
+    mBestChain.resize(height);
     return true;
 }
 
 void CoinQBlockTreeMem::setGenesisBlock(const Coin::CoinBlockHeader& header)
 {
-    if (mHeaderHashMap.size() != 0) throw std::runtime_error("Tree is not empty.");
+    if (mHashIndexCount != 0) throw std::runtime_error("Tree is not empty.");
 
     bFlushed = false;
-    uchar_vector hash = header.hash();
-    ChainHeader& genesisHeader = mHeaderHashMap[hash] = header;
-    mHeaderHeightMap[0] = &genesisHeader;
-    genesisHeader.height = 0;
-    genesisHeader.inBestChain = true;
-    genesisHeader.chainWork = genesisHeader.getWork();
+    setDirty(0);
+    uint32_t i = newRecord(header, header.hash());
+    HeaderRecord& genesisRecord = mRecords[i];
+    genesisRecord.height = 0;
+    genesisRecord.inBestChain = true;
+    genesisRecord.chainWork = getWork(header);
+    mBestChain.assign(1, i);
     mBestHeight = 0;
-    mTotalWork = genesisHeader.chainWork;
-    pHead = &genesisHeader;
-    notifyInsert(header);
-    notifyAddBestChain(header);
+    mTotalWork = genesisRecord.chainWork;
+    mHead = i;
+    notify(notifyInsert, i);
+    notify(notifyAddBestChain, i);
 }
 
 bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork, bool bReplaceTip)
 {
-    if (mHeaderHashMap.size() == 0) throw std::runtime_error("No genesis block.");
-
-    uchar_vector headerHash = header.hash();
-    if (hasHeader(headerHash)) return false;
+    if (mHashIndexCount == 0) throw std::runtime_error("No genesis block.");
 
-    header_hash_map_t::iterator it = mHeaderHashMap.find(header.prevBlockHash());
-    if (it == mHeaderHashMap.end()) throw std::runtime_error("Parent not found.");
+    const uchar_vector& headerHash = header.hash();
+    if (findRecord(headerHash) != NO_RECORD) return false;
 
-    ChainHeader& parent = it->second;
+    uint32_t parent = findRecord(header.prevBlockHash());
+    if (parent == NO_RECORD) throw std::runtime_error("Parent not found.");
 
     // TODO: Check version, compute work required.
 
@@ -129,17 +327,22 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
     }*/
 
     // Check proof of work
-    if (bCheckProofOfWork && BigInt(header.getPOWHashLittleEndian()) > header.getTarget()) throw std::runtime_error("Header hash is too big.");
+    if (bCheckProofOfWork && !header.hasValidPOW()) throw std::runtime_error("Header hash is too big.");
 
-    ChainHeader& chainHeader = mHeaderHashMap[headerHash] = header;
-    chainHeader.height = parent.height + 1;
-    chainHeader.chainWork = parent.chainWork + chainHeader.getWork();
-    parent.childHashes.insert(headerHash);
-    notifyInsert(chainHeader);
+    uint256 chainWork = mRecords[parent].chainWork + getWork(header);
+    int height = mRecords[parent].height + 1;
 
-    if ((bReplaceTip && chainHeader.chainWork >= mTotalWork) || chainHeader.chainWork > mTotalWork)
+    uint32_t i = newRecord(header, headerHash);
+    HeaderRecord& record = mRecords[i];
+    record.height = height;
+    record.chainWork = chainWork;
+    record.parent = parent;
+    addChild(parent, i);
+    notify(notifyInsert, i);
+
+    if ((bReplaceTip && chainWork >= mTotalWork) || chainWork > mTotalWork)
     {
-        setBestChain(chainHeader);
+        setBestChain(i);
     }
 
     bFlushed = false;
@@ -148,83 +351,86 @@ bool CoinQBlockTreeMem::insertHeader(const Coin::CoinBlockHeader& header, bool b
 
 bool CoinQBlockTreeMem::deleteHeader(const uchar_vector& hash)
 {
-    header_hash_map_t::iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end()) return false;
+    uint32_t i = findRecord(hash);
+    if (i == NO_RECORD) return false;
 
-    ChainHeader& header = it->second;
-    unsetBestChain(header);
-    header_hash_map_t::iterator itParent = mHeaderHashMap.find(header.hash());
-    if (itParent == mHeaderHashMap.end()) throw std::runtime_error("Critical error: parent for block not found.");
+    unsetBestChain(i);
+    uint32_t parent = mRecords[i].parent;
+    if (parent == NO_RECORD) throw std::runtime_error("Critical error: parent for block not found.");
 
     // Recurse through children
-    for (auto itChild = header.childHashes.begin(); itChild != header.childHashes.end(); ++itChild) { deleteHeader(*itChild); }
+    for (auto child: getChildren(i)) { deleteHeader(uchar_vector(mRecords[child].hash, mRecords[child].hash + 32)); }
 
     // TODO: Find new best chain if this header was in best chain.
 
     // Remove header
-    ChainHeader& parent = itParent->second;
-    unsigned int nErased = parent.childHashes.erase(hash);
-    assert(nErased == 1);
-    notifyDelete(header);
-    mHeaderHashMap.erase(hash);
+    removeChild(parent, i);
+    notify(notifyDelete, i);
+    freeRecord(i);
+    if (mHead == i) { mHead = mBestChain.back(); }
     bFlushed = false;
     return true;
 }
 
 bool CoinQBlockTreeMem::hasHeader(const uchar_vector& hash) const
 {
-    return (mHeaderHashMap.find(hash) != mHeaderHashMap.end());
+    return (findRecord(hash) != NO_RECORD);
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeader(const uchar_vector& hash) const
+ChainHeader CoinQBlockTreeMem::getHeader(const uchar_vector& hash) const
 {
-    header_hash_map_t::const_iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end()) throw std::runtime_error("Not found.");
+    uint32_t i = findRecord(hash);
+    if (i == NO_RECORD) throw std::runtime_error("Not found.");
 
-    return it->second;
+    return getChainHeader(i);
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeader(int height) const
+ChainHeader CoinQBlockTreeMem::getHeader(int height) const
 {
-    if (mHeaderHeightMap.size() > 0)
-    {
-        if (height < 0) height += mBestHeight + 1;
-        if (height >= 0)
-        {
-            header_height_map_t::const_iterator it = mHeaderHeightMap.find((unsigned int)height);
-            if (it != mHeaderHeightMap.end()) return *it->second;
-        }
-    }
+    if (height < 0) height += mBestHeight + 1;
+    if (height >= 0 && height < (int)mBestChain.size()) return getChainHeader(mBestChain[height]);
 
     throw std::runtime_error("Not found.");
 }
 
-const ChainHeader& CoinQBlockTreeMem::getTip() const
+ChainHeader CoinQBlockTreeMem::getTip() const
 {
-    if (!pHead) throw std::runtime_error("Tree is empty.");
+    if (mHead == NO_RECORD) throw std::runtime_error("Tree is empty.");
 
-    return *pHead;
+    return getChainHeader(mHead);
+}
+
+uchar_vector CoinQBlockTreeMem::getBestHash() const
+{
+    if (mBestHeight == -1) throw std::runtime_error("Not found.");
+
+    const HeaderRecord& record = mRecords[mBestChain[mBestHeight]];
+    return uchar_vector(record.hash, record.hash + 32);
 }
 
 int CoinQBlockTreeMem::getTipHeight() const
 {
-    if (!pHead) throw std::runtime_error("Tree is empty.");
+    if (mHead == NO_RECORD) throw std::runtime_error("Tree is empty.");
 
-    return pHead->height;
+    return mRecords[mHead].height;
 }
 
-const ChainHeader& CoinQBlockTreeMem::getHeaderBefore(uint32_t timestamp) const
+ChainHeader CoinQBlockTreeMem::getHeaderBefore(uint32_t timestamp) const
 {
     if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
 
     int i;
     for (i = 1; i <= mBestHeight; i++)
     {
-        ChainHeader* header = mHeaderHeightMap.at(i);
-        if (header->timestamp() > timestamp) break; 
+        if (headerTimestamp(mRecords[mBestChain[i]].header) > timestamp) break; 
     }
 
-    return *mHeaderHeightMap.at(i - 1);
+    return getChainHeader(mBestChain[i - 1]);
+}
+
+uint256 CoinQBlockTreeMem::getTotalWork() const
+{
+    return mTotalWork;
 }
 
 std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1) const
@@ -244,7 +450,8 @@ std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1)
     int step = 1;
     while ((i >= 0) && (n < maxSize))
     {
-        locatorHashes.push_back(mHeaderHeightMap.at(i)->hash());
+        const HeaderRecord& record = mRecords[mBestChain[i]];
+        locatorHashes.push_back(uchar_vector(record.hash, record.hash + 32));
         i -= step;
         n++;
         if (n > 10) step *= 2;
@@ -254,10 +461,84 @@ std::vector<uchar_vector> CoinQBlockTreeMem::getLocatorHashes(int maxSize = -1)
 
 int CoinQBlockTreeMem::getConfirmations(const uchar_vector& hash) const
 {
-    header_hash_map_t::const_iterator it = mHeaderHashMap.find(hash);
-    if (it == mHeaderHashMap.end() || !it->second.inBestChain) return 0;
+    uint32_t i = findRecord(hash);
+    if (i == NO_RECORD || !mRecords[i].inBestChain) return 0;
+
+    return mBestHeight - mRecords[i].height + 1;
+}
+
+void CoinQBlockTreeMem::clear()
+{
+    mRecords.clear();
+    mFreeRecords.clear();
+    mHashIndex.clear();
+    mHashIndexCount = 0;
+    mBestChain.clear();
+    mForkChildren.clear();
+    mBestHeight = -1;
+    mTotalWork = 0;
+    mHead = NO_RECORD;
+    resetFlushState();
+}
+
+const uint32_t CoinQBlockTreeMem::NO_RECORD;
+const std::size_t CoinQBlockTreeMem::LOAD_BATCH_SIZE;
+
+void CoinQBlockTreeMem::loadRecords(const unsigned char* data, std::size_t offset, std::size_t begin, std::size_t end, std::vector<Coin::CoinBlockHeader>& headers, bool bCheckProofOfWork, std::size_t& checksumError, std::size_t& powError)
+{
+    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+
+    checksumError = headers.size();
+    powError = headers.size();
+
+    // With double SHA-256 headers the whole range is hashed in one batch up front.
+    std::vector<unsigned char> digests;
+    if (end > begin && Coin::CoinBlockHeader::isHashFuncSha256d())
+    {
+        std::vector<unsigned char> rawHeaders((end - begin) * MIN_COIN_BLOCK_HEADER_SIZE);
+        for (std::size_t i = begin; i < end; i++)
+        {
+            const unsigned char* record = data + (offset + i) * RECORD_SIZE;
+            memcpy(&rawHeaders[(i - begin) * MIN_COIN_BLOCK_HEADER_SIZE], record, MIN_COIN_BLOCK_HEADER_SIZE);
+        }
+        digests.resize((end - begin) * 32);
+        CoinCrypto::sha256d_batch(&digests[0], &rawHeaders[0], MIN_COIN_BLOCK_HEADER_SIZE, end - begin);
+    }
+
+    uchar_vector headerBytes;
+    for (std::size_t i = begin; i < end; i++)
+    {
+        const unsigned char* record = data + (offset + i) * RECORD_SIZE;
+        headerBytes.assign(record, record + MIN_COIN_BLOCK_HEADER_SIZE);
 
-    return mBestHeight - it->second.height + 1;
+        Coin::CoinBlockHeader& header = headers[i];
+        header.setSerialized(headerBytes);
+        if (!digests.empty())
+        {
+            const unsigned char* digest = &digests[(i - begin) * 32];
+            header.setHash(uchar_vector(digest, digest + 32));
+        }
+        if (memcmp(record + MIN_COIN_BLOCK_HEADER_SIZE, &header.hash()[0], 4))
+        {
+            checksumError = i;
+            end = i;
+            break;
+        }
+    }
+
+    if (!bCheckProofOfWork) return;
+
+    // The proofs of work are computed together so scrypt can run several headers at once.
+    Coin::CoinBlockHeader::setPOWHashes(headers, begin, end);
+    for (std::size_t i = begin; i < end; i++)
+    {
+        // The genesis block is never checked.
+        if (offset + i > 0 && !headers[i].hasValidPOW())
+        {
+            powError = i;
+            return;
+        }
+    }
 }
 
 void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckProofOfWork, CoinQBlockTreeMem::callback_t callback)
@@ -268,70 +549,117 @@ void CoinQBlockTreeMem::loadFromFile(const std::string& filename, bool bCheckPro
     if (!boost::filesystem::is_regular_file(p)) throw BlockTreeInvalidFileTypeException();
 
     const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
-    if (boost::filesystem::file_size(p) % RECORD_SIZE != 0) throw BlockTreeInvalidFileLengthException();
-
-#ifndef _WIN32
-    std::ifstream fs(p.native(), std::ios::binary);
-#else
-    std::ifstream fs(filename, std::ios::binary);
-#endif
-    if (!fs.good()) throw BlockTreeFailedToOpenFileForReadException();
+    uintmax_t fileSize = boost::filesystem::file_size(p);
+    if (fileSize % RECORD_SIZE != 0)
+    {
+        // An interrupted flush can leave a partial record at the end of the file.
+        LOGGER(error) << "CoinQBlockTreeMem::loadFromFile() - truncating partial record at end of file " << filename << std::endl;
+        fileSize -= fileSize % RECORD_SIZE;
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(p, fileSize, ec);
+        if (!!ec) throw BlockTreeInvalidFileLengthException();
+    }
 
     clear();
-    uchar_vector headerBytes;
-    uchar_vector hash;
-    Coin::CoinBlockHeader header;
+    reserve(fileSize / RECORD_SIZE);
+
+    // Records are hashed and checked in parallel one batch at a time, then linked into the tree in order.
+    // The callback gets called after each batch so loading can still be interrupted.
+    const std::size_t nRecords = fileSize / RECORD_SIZE;
+    const unsigned int nThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+    std::vector<Coin::CoinBlockHeader> headers;
+    std::vector<std::size_t> checksumErrors(nThreads);
+    std::vector<std::size_t> powErrors(nThreads);
 
-    unsigned int count = 0;
+    std::size_t count = 0;
+    bool bTornTail = false;
 
-    char buf[RECORD_SIZE * 64];
-    while (fs)
+    if (nRecords > 0)
     {
-        fs.read(buf, RECORD_SIZE * 64);
-        if (fs.bad()) throw BlockTreeFileReadFailureException();
+        boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only, 0, fileSize);
+        const unsigned char* data = (const unsigned char*)region.get_address();
 
-        unsigned int nbytesread = fs.gcount();
-        unsigned int pos = 0;
-        for (; pos <= nbytesread - RECORD_SIZE; pos += RECORD_SIZE)
+        while (count < nRecords && !bTornTail)
         {
-            headerBytes.assign((unsigned char*)&buf[pos], (unsigned char*)&buf[pos + MIN_COIN_BLOCK_HEADER_SIZE]);
-            header.setSerialized(headerBytes);
-            hash = header.hash();
-            if (memcmp(&buf[pos + MIN_COIN_BLOCK_HEADER_SIZE], &hash[0], 4)) throw BlockTreeChecksumErrorException();
+            std::size_t batchSize = std::min(nRecords - count, LOAD_BATCH_SIZE);
+            headers.resize(batchSize);
+
+            std::size_t chunkSize = (batchSize + nThreads - 1) / nThreads;
+            boost::thread_group threads;
+            for (unsigned int t = 0; t < nThreads; t++)
+            {
+                std::size_t begin = std::min(t * chunkSize, batchSize);
+                std::size_t end = std::min(begin + chunkSize, batchSize);
+                threads.create_thread([&, t, begin, end]() {
+                    loadRecords(data, count, begin, end, headers, bCheckProofOfWork, checksumErrors[t], powErrors[t]);
+                });
+            }
+            threads.join_all();
 
-            try
+            std::size_t validSize = *std::min_element(checksumErrors.begin(), checksumErrors.end());
+            std::size_t powError = *std::min_element(powErrors.begin(), powErrors.end());
+
+            for (std::size_t i = 0; i < validSize; i++)
             {
-                if (mBestHeight >= 0)
+                const Coin::CoinBlockHeader& header = headers[i];
+                try
                 {
-                    insertHeader(header, bCheckProofOfWork);
-                    if (count % 10000 == 0)
+                    if (i == powError) throw std::runtime_error("Header hash is too big.");
+
+                    if (mBestHeight >= 0)
+                    {
+                        // Hash and proof of work were already checked above.
+                        insertHeader(header, false);
+                    }
+                    else
                     {
-                        if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
-                        LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - header hash: " << header.hash().getHex() << " height: " << count << std::endl;
+                        setGenesisBlock(header);
+                        LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - genesis hash: " << header.hash().getHex() << std::endl;
                     }
                     count++;
                 }
-                else
-                { 
-                    setGenesisBlock(header);
-                    if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
-                    LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - genesis hash: " << header.hash().getHex() << std::endl;
-                    count++;
+                catch (const BlockTreeException& e)
+                {
+                    throw e;
+                }
+                catch (const std::exception& e)
+                {
+                    throw std::runtime_error(std::string("Block ") + header.hash().getHex() + ": " + e.what());
                 }
             }
-            catch (const BlockTreeException& e)
+
+            if (validSize < batchSize)
             {
-                throw e;
+                // Records past this point were never completely written. Keep everything before it.
+                if (count == 0) throw BlockTreeChecksumErrorException();
+                bTornTail = true;
             }
-            catch (const std::exception& e)
+
+            if (count > 0)
             {
-                throw std::runtime_error(std::string("Block ") + hash.getHex() + ": " + e.what());
+                if (callback && !callback(*this)) throw BlockTreeLoadInterruptedException();
+                LOGGER(debug) << "CoinQBlockTreeMem::loadFromFile() - header hash: " << getBestHash().getHex() << " height: " << mBestHeight << std::endl;
             }
         }
+    }
 
-        if (pos != nbytesread) throw BlockTreeUnexpectedEndOfFileException();
+    if (bTornTail)
+    {
+        LOGGER(error) << "CoinQBlockTreeMem::loadFromFile() - checksum error in record " << count << ", truncating file " << filename << std::endl;
+        fileSize = (uintmax_t)count * RECORD_SIZE;
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(p, fileSize, ec);
+        if (!!ec) throw BlockTreeChecksumErrorException();
     }
 
+    // The file only holds the best chain in height order if every record made it into the best chain.
+    // Otherwise leave it unflushed so the next flush rewrites it.
+    mFlushedFile = filename;
+    mFlushedHeight = mBestHeight;
+    mDirtyHeight = -1;
+    bFlushed = (fileSize == (uintmax_t)(mBestHeight + 1) * RECORD_SIZE);
+
     if (callback) callback(*this); // No need to interrupt since we're done.
 }
 
@@ -339,6 +667,70 @@ void CoinQBlockTreeMem::flushToFile(const std::string& filename)
 {
     if (mBestHeight == -1) throw std::runtime_error("Tree is empty.");
 
+    // Only append if the file still matches what we last wrote to it.
+    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+    boost::system::error_code ec;
+    uintmax_t fileSize = boost::filesystem::file_size(boost::filesystem::path(filename), ec);
+
+    int startHeight = mFlushedHeight + 1;
+    if (mDirtyHeight != -1 && mDirtyHeight < startHeight) { startHeight = mDirtyHeight; }
+
+    if (filename == mFlushedFile && mFlushedHeight >= 0 && !ec && fileSize == (uintmax_t)(mFlushedHeight + 1) * RECORD_SIZE && startHeight > 0)
+    {
+        appendToFile(filename, startHeight);
+    }
+    else
+    {
+        rewriteFile(filename);
+    }
+
+    mFlushedFile = filename;
+    mFlushedHeight = mBestHeight;
+    mDirtyHeight = -1;
+    bFlushed = true;
+}
+
+void CoinQBlockTreeMem::appendToFile(const std::string& filename, int startHeight)
+{
+    const unsigned int RECORD_SIZE = MIN_COIN_BLOCK_HEADER_SIZE + 4;
+
+    if (startHeight <= mFlushedHeight)
+    {
+        // Reorg - drop the records that are no longer in the best chain.
+        boost::system::error_code ec;
+        boost::filesystem::resize_file(boost::filesystem::path(filename), (uintmax_t)startHeight * RECORD_SIZE, ec);
+        if (!!ec) throw std::runtime_error(ec.message());
+    }
+
+    if (startHeight > mBestHeight) return;
+
+    // Write all new records with a single call and sync once for the whole batch.
+    uchar_vector buffer;
+    buffer.reserve((mBestHeight - startHeight + 1) * RECORD_SIZE);
+
+    for (int i = startHeight; i <= mBestHeight; i++)
+    {
+        const HeaderRecord& record = mRecords[mBestChain[i]];
+        buffer.insert(buffer.end(), record.header, record.header + MIN_COIN_BLOCK_HEADER_SIZE);
+        buffer.insert(buffer.end(), record.hash, record.hash + 4);
+    }
+
+    FILE* fp = fopen(filename.c_str(), "r+b");
+    if (!fp) throw BlockTreeFailedToOpenFileForWriteException();
+
+    bool bSuccess = (fseek(fp, 0, SEEK_END) == 0) && (fwrite(&buffer[0], 1, buffer.size(), fp) == buffer.size()) && (fflush(fp) == 0);
+#ifndef _WIN32
+    bSuccess = bSuccess && (fsync(fileno(fp)) == 0);
+#else
+    bSuccess = bSuccess && (_commit(_fileno(fp)) == 0);
+#endif
+    fclose(fp);
+
+    if (!bSuccess) throw BlockTreeFileWriteFailureException();
+}
+
+void CoinQBlockTreeMem::rewriteFile(const std::string& filename)
+{
     boost::filesystem::path swapfile(filename + ".swp");
     //if (boost::filesystem::exists(swapfile)) throw BlockTreeSwapfileAlreadyExistsException();
 
@@ -349,19 +741,14 @@ void CoinQBlockTreeMem::flushToFile(const std::string& filename)
         std::ofstream fs(filename + ".swp", std::ios::binary | std::ios::trunc);
 #endif
 
-        uchar_vector headerBytes, hash;
-
         for (int i = 0; i <= mBestHeight; i++)
         {
-            ChainHeader* pHeader = mHeaderHeightMap.at(i);
+            const HeaderRecord& record = mRecords[mBestChain[i]];
 
-            headerBytes = pHeader->getSerialized();
-            hash = pHeader->hash();
-
-            fs.write((const char*)&headerBytes[0], MIN_COIN_BLOCK_HEADER_SIZE);
+            fs.write((const char*)record.header, MIN_COIN_BLOCK_HEADER_SIZE);
             if (fs.bad()) throw BlockTreeFileWriteFailureException();
 
-            fs.write((const char*)&hash[0], 4);
+            fs.write((const char*)record.hash, 4);
             if (fs.bad()) throw BlockTreeFileWriteFailureException();
         }
     }
@@ -370,7 +757,5 @@ void CoinQBlockTreeMem::flushToFile(const std::string& filename)
     boost::filesystem::path p(filename);
     boost::filesystem::rename(swapfile, p, ec);
     if (!!ec) throw std::runtime_error(ec.message());
-
-    bFlushed = true;
 }
 
@@ -13,10 +13,13 @@
 #include "CoinQ_slots.h"
 
 #include <CoinCore/CoinNodeData.h>
+#include <CoinCore/uint256.h>
 
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <stack>
+#include <vector>
 #include <stdexcept>
 #include <fstream>
 
@@ -30,12 +33,12 @@ class ChainHeader : public Coin::CoinBlockHeader
 public:
     bool inBestChain;
     int height;
-    BigInt chainWork; // total work for the chain with this header as its leaf
+    uint256 chainWork; // total work for the chain with this header as its leaf
     std::set<uchar_vector> childHashes;
 
     ChainHeader() : Coin::CoinBlockHeader(), inBestChain(false), height(-1), chainWork(0) { }
-    ChainHeader(const Coin::CoinBlockHeader& header, bool _inBestChain = false, int _height = -1, const BigInt& _chainWork = 0) : Coin::CoinBlockHeader(header), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
-    ChainHeader(uint32_t _version, uint32_t _timestamp, uint32_t _bits, uint32_t _nonce = 0, const uchar_vector& _prevBlockHash = g_zero32bytes, const uchar_vector& _merkleRoot = g_zero32bytes, bool _inBestChain = false, int _height = -1, const BigInt& _chainWork = 0) : Coin::CoinBlockHeader(_version, _timestamp, _bits, _nonce, _prevBlockHash, _merkleRoot), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
+    ChainHeader(const Coin::CoinBlockHeader& header, bool _inBestChain = false, int _height = -1, const uint256& _chainWork = 0) : Coin::CoinBlockHeader(header), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
+    ChainHeader(uint32_t _version, uint32_t _timestamp, uint32_t _bits, uint32_t _nonce = 0, const uchar_vector& _prevBlockHash = g_zero32bytes, const uchar_vector& _merkleRoot = g_zero32bytes, bool _inBestChain = false, int _height = -1, const uint256& _chainWork = 0) : Coin::CoinBlockHeader(_version, _timestamp, _bits, _nonce, _prevBlockHash, _merkleRoot), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
 
     // TODO: add these operators for CoinClasses and compare directly instead of using hashes.
     bool operator==(const ChainHeader& rhs) const { return ((getHash() == rhs.getHash()) && (inBestChain == rhs.inBestChain) && (height == rhs.height) && (chainWork == rhs.chainWork)); }
@@ -51,10 +54,10 @@ class ChainBlock : public Coin::CoinBlock
 public:
     bool inBestChain;
     int height;
-    BigInt chainWork;
+    uint256 chainWork;
 
     ChainBlock() : Coin::CoinBlock(), inBestChain(false), height(-1), chainWork(0) { }
-    ChainBlock(const Coin::CoinBlock& block, bool _inBestChain = false, int _height = -1, const BigInt& _chainWork = 0) : Coin::CoinBlock(block), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
+    ChainBlock(const Coin::CoinBlock& block, bool _inBestChain = false, int _height = -1, const uint256& _chainWork = 0) : Coin::CoinBlock(block), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
 
     ChainHeader getHeader() const { return ChainHeader(blockHeader, inBestChain, height, chainWork); }
 };
@@ -64,10 +67,10 @@ class ChainMerkleBlock : public Coin::MerkleBlock
 public:
     bool inBestChain;
     int height;
-    BigInt chainWork;
+    uint256 chainWork;
 
     ChainMerkleBlock() : Coin::MerkleBlock(), inBestChain(false), height(-1), chainWork(0) { }
-    ChainMerkleBlock(const Coin::MerkleBlock& merkleBlock, bool _inBestChain = false, int _height = -1, const BigInt& _chainWork = 0) : Coin::MerkleBlock(merkleBlock), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
+    ChainMerkleBlock(const Coin::MerkleBlock& merkleBlock, bool _inBestChain = false, int _height = -1, const uint256& _chainWork = 0) : Coin::MerkleBlock(merkleBlock), inBestChain(_inBestChain), height(_height), chainWork(_chainWork) { }
 
     ChainHeader getHeader() const { return ChainHeader(blockHeader, inBestChain, height, chainWork); }
 };
@@ -106,15 +109,15 @@ public:
     virtual bool deleteHeader(const uchar_vector& hash) = 0;
  
     virtual bool hasHeader(const uchar_vector& hash) const = 0;
-    virtual const ChainHeader& getHeader(const uchar_vector& hash) const = 0;
-    virtual const ChainHeader& getHeader(int height) const = 0; // Use -1 to get top block
-    virtual const ChainHeader& getTip() const = 0;
+    virtual ChainHeader getHeader(const uchar_vector& hash) const = 0;
+    virtual ChainHeader getHeader(int height) const = 0; // Use -1 to get top block
+    virtual ChainHeader getTip() const = 0;
     virtual int getTipHeight() const = 0;
-    virtual const ChainHeader& getHeaderBefore(uint32_t timestamp) const = 0;
+    virtual ChainHeader getHeaderBefore(uint32_t timestamp) const = 0;
 
-    virtual const uchar_vector& getBestHash() const = 0;
+    virtual uchar_vector getBestHash() const = 0;
     virtual int getBestHeight() const = 0;
-    virtual BigInt getTotalWork() const = 0;
+    virtual uint256 getTotalWork() const = 0;
 
     virtual std::vector<uchar_vector> getLocatorHashes(int maxSize) const = 0;
 
@@ -127,16 +130,72 @@ class CoinQBlockTreeMem : public ICoinQBlockTree
 private:
     bool bFlushed;
 
-    typedef std::map<uchar_vector, ChainHeader> header_hash_map_t;
-    header_hash_map_t mHeaderHashMap;
-
-    typedef std::map<unsigned int, ChainHeader*> header_height_map_t;
-    header_height_map_t mHeaderHeightMap;
+    // The header file is an append-only log of the best chain. These track what is already on disk
+    // so a flush only needs to truncate back to the lowest changed height and append from there.
+    std::string mFlushedFile;
+    int mFlushedHeight;
+    int mDirtyHeight; // lowest best chain height changed since last flush, -1 if none
+    void setDirty(int height) { if (mDirtyHeight == -1 || height < mDirtyHeight) mDirtyHeight = height; }
+    void resetFlushState() { mFlushedFile.clear(); mFlushedHeight = -1; mDirtyHeight = -1; }
+    void rewriteFile(const std::string& filename);
+    void appendToFile(const std::string& filename, int startHeight);
+
+    // Number of header file records hashed in parallel between load callbacks
+    static const std::size_t LOAD_BATCH_SIZE = 10000;
+    static void loadRecords(const unsigned char* data, std::size_t offset, std::size_t begin, std::size_t end, std::vector<Coin::CoinBlockHeader>& headers, bool bCheckProofOfWork, std::size_t& checksumError, std::size_t& powError);
+
+    // Headers are kept as fixed-size records in a contiguous arena, found by hash through an open addressing index.
+    // Most headers have a single child, so additional children of fork points go in a side table.
+    // ChainHeader objects are built on request and returned by value, so lookups neither allocate per
+    // record nor write to the tree.
+    static const uint32_t NO_RECORD = 0xffffffff;
+
+    struct HeaderRecord
+    {
+        unsigned char header[MIN_COIN_BLOCK_HEADER_SIZE];
+        unsigned char hash[32]; // same byte order as CoinBlockHeader::hash()
+        uint256 chainWork;
+        int height;
+        uint32_t parent;
+        uint32_t child; // first child
+        bool inBestChain;
+        bool inUse;
+    };
+
+    std::vector<HeaderRecord> mRecords;
+    std::vector<uint32_t> mFreeRecords;
+
+    std::vector<uint32_t> mHashIndex; // NO_RECORD for empty slots, size is always a power of two
+    std::size_t mHashIndexCount;
+
+    std::vector<uint32_t> mBestChain; // record by height
+
+    typedef std::unordered_map<uint32_t, std::vector<uint32_t>> fork_children_map_t;
+    fork_children_map_t mForkChildren;
+
+    // Work only changes at difficulty adjustments so remember the last one computed.
+    uint32_t mLastWorkBits;
+    uint256 mLastWork;
+    const uint256& getWork(const Coin::CoinBlockHeader& header);
+
+    uint32_t findRecord(const uchar_vector& hash) const;
+    void indexRecord(uint32_t i);
+    void unindexRecord(uint32_t i);
+    void growHashIndex();
+    uint32_t newRecord(const Coin::CoinBlockHeader& header, const uchar_vector& hash);
+    void freeRecord(uint32_t i);
+
+    std::vector<uint32_t> getChildren(uint32_t i) const;
+    void addChild(uint32_t i, uint32_t child);
+    void removeChild(uint32_t i, uint32_t child);
+
+    ChainHeader getChainHeader(uint32_t i) const;
+    void notify(CoinQSignal<const ChainHeader&>& signal, uint32_t i);
 
     int mBestHeight;
-    BigInt mTotalWork;
+    uint256 mTotalWork;
 
-    ChainHeader* pHead;    
+    uint32_t mHead;
 
     bool bCheckTimestamp;
     bool bCheckProofOfWork;
@@ -148,14 +207,14 @@ private:
     CoinQSignal<const ChainHeader&> notifyReorg;
 
 protected:
-    bool setBestChain(ChainHeader& header);
-    bool unsetBestChain(ChainHeader& header);
+    bool setBestChain(uint32_t i);
+    bool unsetBestChain(uint32_t i);
 
 public:
     CoinQBlockTreeMem(bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { }
+        : bFlushed(true), mFlushedHeight(-1), mDirtyHeight(-1), mHashIndexCount(0), mLastWorkBits(0), mBestHeight(-1), mTotalWork(0), mHead(NO_RECORD), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { }
     CoinQBlockTreeMem(const Coin::CoinBlockHeader& header, bool _bCheckTimestamp = true, bool _bCheckProofOfWork = true)
-        : bFlushed(true), mBestHeight(-1), mTotalWork(0), pHead(NULL), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { setGenesisBlock(header); }
+        : bFlushed(true), mFlushedHeight(-1), mDirtyHeight(-1), mHashIndexCount(0), mLastWorkBits(0), mBestHeight(-1), mTotalWork(0), mHead(NO_RECORD), bCheckTimestamp(_bCheckTimestamp), bCheckProofOfWork(_bCheckProofOfWork) { setGenesisBlock(header); }
 
     void subscribeAddBestChain(chain_header_slot_t slot) { notifyAddBestChain.connect(slot); }
     void subscribeRemoveBestChain(chain_header_slot_t slot) { notifyRemoveBestChain.connect(slot); }
@@ -170,29 +229,34 @@ public:
     void clearReorg() { notifyReorg.clear();; }
 
     void setGenesisBlock(const Coin::CoinBlockHeader& header);
-    bool isEmpty() const { return pHead == nullptr; }
+    bool isEmpty() const { return mHead == NO_RECORD; }
     bool insertHeader(const Coin::CoinBlockHeader& header, bool bCheckProofOfWork = true, bool bReplaceTip = false);
     bool deleteHeader(const uchar_vector& hash);
 
     bool hasHeader(const uchar_vector& hash) const;
-    const ChainHeader& getHeader(const uchar_vector& hash) const;
-    const ChainHeader& getHeader(int height) const;
-    const ChainHeader& getTip() const;
+    ChainHeader getHeader(const uchar_vector& hash) const;
+    ChainHeader getHeader(int height) const;
+    ChainHeader getTip() const;
     int getTipHeight() const;
-    const ChainHeader& getHeaderBefore(uint32_t timestamp) const;
+    ChainHeader getHeaderBefore(uint32_t timestamp) const;
 
-    const uchar_vector& getBestHash() const { return getHeader(-1).hash(); }
+    uchar_vector getBestHash() const;
     int getBestHeight() const { return mBestHeight; }
-    BigInt getTotalWork() const { return mTotalWork; }
+    uint256 getTotalWork() const;
 
     std::vector<uchar_vector> getLocatorHashes(int maxSize) const;
 
     int getConfirmations(const uchar_vector& hash) const;
-    void clear() { mHeaderHashMap.clear(); mHeaderHeightMap.clear(); mBestHeight = -1; mTotalWork = 0; pHead = NULL; }
+    void clear();
+
+    // Reserves space for the given number of headers
+    void reserve(std::size_t size);
 
+    // A torn or corrupted tail left behind by an interrupted flush is truncated away on load.
     typedef std::function<bool(const CoinQBlockTreeMem&)> callback_t;
     void loadFromFile(const std::string& filename, bool bCheckProofOfWork = true, callback_t callback = nullptr); 
 
+    // Only writes best chain headers that changed since the last flush to the same file.
     void flushToFile(const std::string& filename);
 
     bool flushed() const { return bFlushed; }
@@ -84,7 +84,7 @@ json_spirit::Object getChainHeaderJsonObject(const ChainHeader& header)
     json_spirit::Object obj = getHeaderJsonObject(header);
     obj.push_back(json_spirit::Pair("inbestchain", header.inBestChain));
     obj.push_back(json_spirit::Pair("height", header.height));
-    obj.push_back(json_spirit::Pair("chainwork", header.chainWork.getDec()));
+    obj.push_back(json_spirit::Pair("chainwork", header.chainWork.GetDec()));
     return obj;
 }
 
@@ -93,7 +93,7 @@ json_spirit::Object getChainBlockJsonObject(const ChainBlock& block, bool allFie
     json_spirit::Object obj = getBlockJsonObject(block, allFields);
     obj.push_back(json_spirit::Pair("inbestchain", block.inBestChain));
     obj.push_back(json_spirit::Pair("height", block.height));
-    obj.push_back(json_spirit::Pair("chainwork", block.chainWork.getDec()));
+    obj.push_back(json_spirit::Pair("chainwork", block.chainWork.GetDec()));
     return obj;
 }
 
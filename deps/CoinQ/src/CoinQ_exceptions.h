@@ -30,7 +30,8 @@ enum ErrorCodes
     BLOCKTREE_CHECKSUM_ERROR,
     BLOCKTREE_LOAD_INTERRUPTED,
     BLOCKTREE_UNEXPECTED_END_OF_FILE,
-    BLOCKTREE_SWAPFILE_ALREADY_EXISTS
+    BLOCKTREE_SWAPFILE_ALREADY_EXISTS,
+    BLOCKTREE_FAILED_TO_OPEN_FILE_FOR_WRITE
 };
 
 // NETWORK SELECTOR EXCEPTIONS
@@ -130,5 +131,11 @@ public:
     explicit BlockTreeSwapfileAlreadyExistsException() : BlockTreeException("Blocktree swapfile already exists.", BLOCKTREE_SWAPFILE_ALREADY_EXISTS) { }
 };
 
+class BlockTreeFailedToOpenFileForWriteException : public BlockTreeException
+{
+public:
+    explicit BlockTreeFailedToOpenFileForWriteException() : BlockTreeException("Blocktree failed to open file for write.", BLOCKTREE_FAILED_TO_OPEN_FILE_FOR_WRITE) { }
+};
+
 }
 
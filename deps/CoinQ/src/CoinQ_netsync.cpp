@@ -16,6 +16,7 @@
 
 #include <logger/logger.h>
 
+#include <algorithm>
 #include <thread>
 #include <chrono>
 
@@ -32,7 +33,9 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
     m_peer(m_ioService),
     m_bFlushingToFile(false),
     m_bHeadersSynched(false),
-    m_bMissingTxs(false)
+    m_bMissingTxs(false),
+    m_blockSyncWindow(1),
+    m_nextRequestHeight(-1)
 {
     // Select hash functions
     Coin::CoinBlockHeader::setHashFunc(m_coinParams.block_header_hash_function());
@@ -52,7 +55,7 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
         notifyAddBestChain(header);
         uchar_vector hash = header.hash();
         std::stringstream status;
-        status << "Added to best chain: " << hash.getHex() << " Height: " << header.height << " ChainWork: " << header.chainWork.getDec();
+        status << "Added to best chain: " << hash.getHex() << " Height: " << header.height << " ChainWork: " << header.chainWork.GetDec();
         notifyStatus(status.str());
     });
 */
@@ -130,14 +133,21 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
     m_peer.subscribeTx([&](CoinQ::Peer& /*peer*/, const Coin::Transaction& tx)
     {
-        LOGGER(trace) << "Received transaction: " << tx.hash().getHex() << endl;
+        hash256_t txHash = tx.hash256();
+        LOGGER(trace) << "Received transaction: " << txHash.getHex() << endl;
 
         boost::unique_lock<boost::mutex> syncLock(m_syncMutex);
-        if (m_currentMerkleTxHashes.empty())
+        if (m_pendingMerkleTxHashes.count(txHash))
+        {
+            // It belongs to a merkle block we received ahead of the one we're synching - hold it until we get there.
+            LOGGER(trace) << "Holding transaction for pending merkle block: " << txHash.getHex() << endl;
+            m_pendingMerkleTxs[txHash] = tx;
+        }
+        else if (m_currentMerkleTxHashes.empty())
         {
             {
                 boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.insert(tx.hash());
+                m_mempoolTxs.insert(txHash);
             }
 
             syncLock.unlock();
@@ -160,6 +170,15 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             if (headersMessage.headers.size() > 0)
             {
                 notifySynchingHeaders();
+
+                // Compute the proofs of work of the new headers in one batch before inserting them.
+                {
+                    boost::unique_lock<boost::mutex> fileFlushLock(m_fileFlushMutex);
+                    std::size_t firstNew = 0;
+                    while (firstNew < headersMessage.headers.size() && m_blockTree.hasHeader(headersMessage.headers[firstNew].hash())) { firstNew++; }
+                    Coin::CoinBlockHeader::setPOWHashes(headersMessage.headers, firstNew, headersMessage.headers.size());
+                }
+
                 for (auto& item: headersMessage.headers)
                 {
                     try
@@ -180,12 +199,12 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
                 LOGGER(trace)   << "Processed " << headersMessage.headers.size() << " headers."
                                 << " mBestHeight: " << m_blockTree.getBestHeight()
-                                << " mTotalWork: " << m_blockTree.getTotalWork().getDec()
+                                << " mTotalWork: " << m_blockTree.getTotalWork().GetDec()
                                 << " Attempting to fetch more headers..." << std::endl;
 
                 notifyBlockTreeChanged();
                 std::stringstream status;
-                status << "Best Height: " << m_blockTree.getBestHeight() << " / " << "Total Work: " << m_blockTree.getTotalWork().getDec();
+                status << "Best Height: " << m_blockTree.getBestHeight() << " / " << "Total Work: " << m_blockTree.getTotalWork().GetDec();
                 notifyStatus(status.str());
 
                 vector<uchar_vector> locatorHashes = m_blockTree.getLocatorHashes(1);
@@ -238,16 +257,17 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
             {
                 if (m_currentMerkleTxHashes.empty()) break; // We got all our transactions.
 
-                if (tx.hash() == m_currentMerkleTxHashes.front())
+                hash256_t txHash = tx.hash256();
+                if (txHash == m_currentMerkleTxHashes.front())
                 {
-                    LOGGER(trace) << "New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << tx.hash().getHex() << endl;
+                    LOGGER(trace) << "New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
 
                     notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
                     m_currentMerkleTxHashes.pop();
 
                     {
                         boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                        m_mempoolTxs.erase(tx.hash());
+                        m_mempoolTxs.erase(txHash);
                     }
                 }
             }
@@ -260,33 +280,12 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
             m_bMissingTxs = false;
 
-            // Once the queue is empty, if we're at the tip signal completion of block sync.
-            uchar_vector currentMerkleBlockHash = m_currentMerkleBlock.hash();
-            const ChainHeader& chainTip = m_blockTree.getTip();
-            if (chainTip.hash() == currentMerkleBlockHash)
+            // Once the queue is empty, if we're at the tip signal completion of block sync. Otherwise move on to the next block.
+            if (syncNextMerkleBlocks(m_currentMerkleBlock.height, m_currentMerkleBlock.hash()))
             {
                 LOGGER(trace) << "Block sync detected from block handler." << endl;
-                m_lastRequestedMerkleBlockHash.clear();
-                m_lastSynchedMerkleBlockHash = currentMerkleBlockHash;
                 syncLock.unlock();
                 notifyBlocksSynched();
-                return;
-            }
-
-            // Ask for the next block
-            const ChainHeader& nextHeader = m_blockTree.getHeader(m_currentMerkleBlock.height + 1);
-            m_lastRequestedMerkleBlockHash = nextHeader.hash();
-            LOGGER(trace) << "Asking for filtered block from block handler: " << m_lastRequestedMerkleBlockHash.getHex() << std::endl;
-            
-            try
-            {
-                m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
-            }
-            catch (const exception& e)
-            {
-                // TODO: Propagate code
-                syncLock.unlock();
-                notifyConnectionError(e.what(), -1);
             }
         }
         catch (const exception& e)
@@ -340,28 +339,32 @@ NetworkSync::NetworkSync(const CoinQ::CoinParams& coinParams, bool bCheckProofOf
 
                 if (!m_currentMerkleTxHashes.empty()) return; // We need to wait for some transactions
 
-                if (merkleBlockHash == chainTipHash)
+                if (syncNextMerkleBlocks(merkleHeader.height, merkleBlockHash))
                 {
                     // We're at the tip
                     LOGGER(trace) << "Block sync detected from merkle block handler." << endl;
-                    m_lastRequestedMerkleBlockHash.clear();
-                    m_lastSynchedMerkleBlockHash = chainTipHash;
                     syncLock.unlock();
                     notifyBlocksSynched();
                 }
-                else
+            }
+            else if (bufferMerkleBlock(merkleBlock, merkleTree))
+            {
+                // It's a block we requested ahead of the current one - it gets synched once we reach its height.
+                // The peer sends the transactions for each merkle block before the next merkle block, so if we're
+                // still missing transactions for the current block they are not coming and we need the full block.
+                if (!m_currentMerkleTxHashes.empty() && !m_bMissingTxs && m_lastRequestedBlockHash != m_lastRequestedMerkleBlockHash)
                 {
-                    // Ask for the next block
-                    const ChainHeader& nextHeader = m_blockTree.getHeader(merkleHeader.height + 1);
-                    m_lastRequestedMerkleBlockHash = nextHeader.hash();
-                    LOGGER(trace) << "Asking for filtered block (2) " << m_lastRequestedMerkleBlockHash.getHex() << endl;
-    
+                    m_bMissingTxs = true;
+                    m_lastRequestedBlockHash = m_lastRequestedMerkleBlockHash;
+                    LOGGER(trace) << "We are missing some transactions in the mempool - perhaps due to reorg." << endl;
+                    LOGGER(trace) << "Asking for block " << m_lastRequestedBlockHash.getHex() << endl;
                     try
                     {
-                        m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
+                        m_peer.getBlock(m_lastRequestedBlockHash);
                     }
                     catch (const exception& e)
                     {
+                        m_lastRequestedBlockHash.clear();
                         syncLock.unlock();
                         // TODO: propagate code
                         notifyConnectionError(e.what(), -1);
@@ -450,7 +453,7 @@ void NetworkSync::loadHeaders(const std::string& blockTreeFile, bool bCheckProof
         m_blockTree.loadFromFile(blockTreeFile, bCheckProofOfWork, callback);
 
         std::stringstream status;
-        status << "Best Height: " << m_blockTree.getBestHeight() << " / " << "Total Work: " << m_blockTree.getTotalWork().getDec();
+        status << "Best Height: " << m_blockTree.getBestHeight() << " / " << "Total Work: " << m_blockTree.getTotalWork().GetDec();
         notifyStatus(status.str());
         notifyAddBestChain(m_blockTree.getHeader(-1));
         return;
@@ -473,7 +476,7 @@ int NetworkSync::getBestHeight() const
     return m_blockTree.getBestHeight();
 }
 
-const bytes_t& NetworkSync::getBestHash() const
+bytes_t NetworkSync::getBestHash() const
 {
     return m_blockTree.getBestHash();
 }
@@ -488,14 +491,18 @@ void NetworkSync::syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t
 
     boost::lock_guard<boost::mutex> syncLock(m_syncMutex);
 
-    const ChainHeader* pMostRecentHeader = nullptr;
+    ChainHeader mostRecentHeader;
+    bool bFoundMostRecentHeader = false;
     for (auto& hash: locatorHashes)
     {
         try
         {
-            pMostRecentHeader = &m_blockTree.getHeader(hash);
-            if (pMostRecentHeader && pMostRecentHeader->inBestChain) break;
-            pMostRecentHeader = nullptr;
+            mostRecentHeader = m_blockTree.getHeader(hash);
+            if (mostRecentHeader.inBestChain)
+            {
+                bFoundMostRecentHeader = true;
+                break;
+            }
         }
         catch (const std::exception& e)
         {
@@ -506,17 +513,17 @@ void NetworkSync::syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t
     }
 
 
-    if (pMostRecentHeader)
+    if (bFoundMostRecentHeader)
     {
-        if (m_blockTree.getTipHeight() == pMostRecentHeader->height)
+        if (m_blockTree.getTipHeight() == mostRecentHeader.height)
         {
-            m_lastSynchedMerkleBlockHash = pMostRecentHeader->hash();
+            m_lastSynchedMerkleBlockHash = mostRecentHeader.hash();
             notifyBlocksSynched();
             return;
         } 
         else
         {
-            startHeight = pMostRecentHeader->height + 1;
+            startHeight = mostRecentHeader.height + 1;
         }
     }
     else
@@ -536,13 +543,13 @@ void NetworkSync::syncBlocks(int startHeight)
 void NetworkSync::do_syncBlocks(int startHeight)
 {
     m_lastSynchedMerkleBlockHash.clear();
+    clearPendingMerkleBlocks();
     m_lastRequestedMerkleBlockHash = m_blockTree.getHeader(startHeight).hash();
 
     LOGGER(trace) "Resynching blocks " << startHeight << " - " << m_blockTree.getTipHeight() << endl;
     notifySynchingBlocks();
 
-    LOGGER(trace) << "Asking for filtered block (3) " << m_lastRequestedMerkleBlockHash.getHex() << endl;
-    m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
+    requestMerkleBlocks(startHeight);
 }
 
 void NetworkSync::stopSynchingBlocks(bool bClearFilter)
@@ -550,20 +557,29 @@ void NetworkSync::stopSynchingBlocks(bool bClearFilter)
     boost::lock_guard<boost::mutex> lock(m_syncMutex);
     m_lastRequestedMerkleBlockHash.clear();
     m_lastSynchedMerkleBlockHash.clear();
+    clearPendingMerkleBlocks();
     if (bClearFilter) { clearBloomFilter(); }
 }
 
+void NetworkSync::setBlockSyncWindow(unsigned int blockSyncWindow)
+{
+    if (blockSyncWindow == 0) throw std::runtime_error("NetworkSync::setBlockSyncWindow() - window size must be at least 1.");
+
+    boost::lock_guard<boost::mutex> lock(m_syncMutex);
+    m_blockSyncWindow = blockSyncWindow;
+}
+
 void NetworkSync::addToMempool(const uchar_vector& txHash)
 {
     boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-    m_mempoolTxs.insert(txHash);
+    m_mempoolTxs.insert(hash256_t(txHash));
 }
 
 void NetworkSync::insertTx(const Coin::Transaction& tx)
 {
     {
         boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-        m_mempoolTxs.insert(tx.hash());
+        m_mempoolTxs.insert(tx.hash256());
     }
 
     notifyNewTx(tx);
@@ -599,7 +615,7 @@ void NetworkSync::insertMerkleBlock(const Coin::MerkleBlock& merkleBlock, const
 
             {
                 boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
-                m_mempoolTxs.erase(tx.hash());
+                m_mempoolTxs.erase(tx.hash256());
             }
         }
     }
@@ -652,6 +668,7 @@ void NetworkSync::stop()
         m_bHeadersSynched = false;
         m_lastRequestedMerkleBlockHash.clear();
         while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
+        clearPendingMerkleBlocks();
     }
 
     notifyStopped();
@@ -693,6 +710,34 @@ void NetworkSync::setBloomFilter(const Coin::BloomFilter& bloomFilter)
     m_peer.send(filterLoad);
 }
 
+void NetworkSync::addToBloomFilter(const std::vector<bytes_t>& elements)
+{
+    if (!m_bloomFilter.isSet() || elements.empty()) return;
+
+    // Keep our copy in step with the peer's so a reconnect loads the same filter.
+    for (auto& element: elements) { m_bloomFilter.insert(element); }
+
+    // Peers reject and penalize filteradd messages with oversized elements, as large m of n input scripts can be.
+    for (auto& element: elements)
+    {
+        if (element.size() > Coin::MAX_FILTERADD_DATA_SIZE)
+        {
+            LOGGER(trace) << "Bloom filter element of " << element.size() << " bytes is too large for filteradd. Reloading filter." << endl;
+            Coin::FilterLoadMessage filterLoad(m_bloomFilter.getNHashFuncs(), m_bloomFilter.getNTweak(), m_bloomFilter.getNFlags(), m_bloomFilter.getFilter());
+            m_peer.send(filterLoad);
+            return;
+        }
+    }
+
+    LOGGER(trace) << "Adding " << elements.size() << " elements to bloom filter." << endl;
+    for (auto& element: elements)
+    {
+        Coin::FilterAddMessage filterAdd;
+        filterAdd.data = element;
+        m_peer.send(filterAdd);
+    }
+}
+
 void NetworkSync::clearBloomFilter()
 {
     LOGGER(trace) << "Clearing bloom filter." << endl;
@@ -790,6 +835,108 @@ void NetworkSync::fileFlushLoop()
     }
 }
 
+// Must be called with m_syncMutex locked.
+// Requests filtered blocks for all heights in the window starting at nextHeight that have not yet been requested.
+void NetworkSync::requestMerkleBlocks(int nextHeight)
+{
+    if (m_nextRequestHeight < nextHeight) { m_nextRequestHeight = nextHeight; }
+
+    int maxHeight = std::min(m_blockTree.getBestHeight(), nextHeight + (int)m_blockSyncWindow - 1);
+    if (m_nextRequestHeight > maxHeight) return;
+
+    int firstHeight = m_nextRequestHeight;
+    hashvector_t hashes;
+    for (; m_nextRequestHeight <= maxHeight; m_nextRequestHeight++) { hashes.push_back(m_blockTree.getHeader(m_nextRequestHeight).hash()); }
+
+    LOGGER(trace) << "Asking for filtered blocks " << firstHeight << " - " << maxHeight << endl;
+    m_peer.getFilteredBlocks(hashes);
+}
+
+// Must be called with m_syncMutex locked.
+// Holds on to a requested merkle block that arrived ahead of the block currently being synched.
+// Returns false if the block is not one we're waiting for.
+bool NetworkSync::bufferMerkleBlock(const Coin::MerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree)
+{
+    if (m_lastRequestedMerkleBlockHash.empty() || !m_blockTree.hasHeader(m_lastRequestedMerkleBlockHash)) return false;
+
+    uchar_vector merkleBlockHash = merkleBlock.hash();
+    if (!m_blockTree.hasHeader(merkleBlockHash)) return false;
+
+    const ChainHeader& merkleHeader = m_blockTree.getHeader(merkleBlockHash);
+    const ChainHeader& currentHeader = m_blockTree.getHeader(m_lastRequestedMerkleBlockHash);
+    if (!merkleHeader.inBestChain || merkleHeader.height <= currentHeader.height || merkleHeader.height >= m_nextRequestHeight) return false;
+
+    if (m_pendingMerkleBlocks.count(merkleHeader.height)) return true; // We already have it
+
+    LOGGER(trace) << "Buffering merkle block: " << merkleBlockHash.getHex() << " height: " << merkleHeader.height << endl;
+    ChainMerkleBlock chainMerkleBlock(merkleBlock, true, merkleHeader.height, merkleHeader.chainWork);
+    m_pendingMerkleBlocks[merkleHeader.height] = std::make_pair(chainMerkleBlock, merkleTree);
+    for (auto& reversedTxHash: merkleTree.getTxHashes()) { m_pendingMerkleTxHashes.insert(reversedTxHash.getReverse()); }
+    return true;
+}
+
+// Must be called with m_syncMutex locked once the block at syncedHeight has been fully processed.
+// Syncs any buffered merkle blocks that follow it in chain order and tops up the request window.
+// Returns true if we've reached the tip.
+bool NetworkSync::syncNextMerkleBlocks(int syncedHeight, const bytes_t& syncedHash)
+{
+    int height = syncedHeight;
+    uchar_vector hash = syncedHash;
+    while (true)
+    {
+        if (m_blockTree.getTip().hash() == hash)
+        {
+            m_lastRequestedMerkleBlockHash.clear();
+            m_lastSynchedMerkleBlockHash = hash;
+            clearPendingMerkleBlocks();
+            return true;
+        }
+
+        const ChainHeader& nextHeader = m_blockTree.getHeader(height + 1);
+        m_lastRequestedMerkleBlockHash = nextHeader.hash();
+
+        auto it = m_pendingMerkleBlocks.find(nextHeader.height);
+        if (it != m_pendingMerkleBlocks.end() && it->second.first.hash() != m_lastRequestedMerkleBlockHash)
+        {
+            // The best chain changed under us - discard what we have buffered and request again.
+            LOGGER(trace) << "Discarding " << m_pendingMerkleBlocks.size() << " buffered merkle blocks after reorg." << endl;
+            clearPendingMerkleBlocks();
+            it = m_pendingMerkleBlocks.end();
+        }
+
+        if (it == m_pendingMerkleBlocks.end())
+        {
+            requestMerkleBlocks(nextHeader.height);
+            return false;
+        }
+
+        pending_merkle_block_t pendingMerkleBlock = it->second;
+        m_pendingMerkleBlocks.erase(it);
+        for (auto& reversedTxHash: pendingMerkleBlock.second.getTxHashes()) { m_pendingMerkleTxHashes.erase(reversedTxHash.getReverse()); }
+
+        syncMerkleBlock(pendingMerkleBlock.first, pendingMerkleBlock.second);
+        processPendingMerkleTxs();
+        if (!m_currentMerkleTxHashes.empty())
+        {
+            // We need to wait for some transactions
+            requestMerkleBlocks(nextHeader.height);
+            return false;
+        }
+
+        height = nextHeader.height;
+        hash = m_lastRequestedMerkleBlockHash;
+    }
+}
+
+// Must be called with m_syncMutex locked.
+void NetworkSync::clearPendingMerkleBlocks()
+{
+    m_nextRequestHeight = -1;
+    m_pendingMerkleBlocks.clear();
+    m_pendingMerkleTxHashes.clear();
+    m_pendingMerkleTxs.clear();
+}
+
 void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree)
 {
     LOGGER(trace) << "Synchronizing merkle block: " << merkleBlock.hash().getHex() << " height: " << merkleBlock.height << endl;
@@ -797,7 +944,7 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
     while (!m_currentMerkleTxHashes.empty()) { m_currentMerkleTxHashes.pop(); }
 
     // The byte order of the tx hashes must be reversed when moving between merkle trees and the block chain
-    const std::list<uchar_vector>& reversedTxHashes = merkleTree.getTxHashes();
+    const std::vector<hash256_t>& reversedTxHashes = merkleTree.getTxHashes();
 
     if (reversedTxHashes.empty())
     {
@@ -809,7 +956,7 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
     int i = 0;
     for (auto& reversedTxHash: merkleTree.getTxHashes())
     {
-        uchar_vector txHash = reversedTxHash.getReverse();
+        hash256_t txHash = reversedTxHash.getReverse();
         m_currentMerkleTxHashes.push(txHash);
         LOGGER(trace) << "  Added tx to queue (" << ++i << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
     }
@@ -824,7 +971,8 @@ void NetworkSync::syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coi
 
 void NetworkSync::processBlockTx(const Coin::Transaction& tx)
 {
-    string txHashHex = tx.hash().getHex();
+    hash256_t txHash = tx.hash256();
+    string txHashHex = txHash.getHex();
     LOGGER(trace) << "NetworkSync::processBlockTx(" << txHashHex << ")" << endl;
     try
     {
@@ -834,7 +982,7 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
         processMempoolConfirmations();
         if (!m_currentMerkleTxHashes.empty())
         {
-            if (tx.hash() == m_currentMerkleTxHashes.front())
+            if (txHash == m_currentMerkleTxHashes.front())
             {
                 LOGGER(trace) << "NetworkSync::processBlockTx - New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHashHex << endl;
                 notifyMerkleTx(m_currentMerkleBlock, tx, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
@@ -865,33 +1013,12 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
 
         if (!m_currentMerkleTxHashes.empty()) return; // we're still missing transactions
 
-        // Once the queue is empty, if we're at the tip signal completion of block sync.
-        uchar_vector currentMerkleBlockHash = m_currentMerkleBlock.hash();
-        const ChainHeader& chainTip = m_blockTree.getTip();
-        if (chainTip.hash() == currentMerkleBlockHash)
+        // Once the queue is empty, if we're at the tip signal completion of block sync. Otherwise move on to the next block.
+        if (syncNextMerkleBlocks(m_currentMerkleBlock.height, m_currentMerkleBlock.hash()))
         {
             LOGGER(trace) << "Block sync detected from tx handler." << endl;
-            m_lastRequestedMerkleBlockHash.clear();
-            m_lastSynchedMerkleBlockHash = currentMerkleBlockHash;
             syncLock.unlock();
             notifyBlocksSynched();
-            return;
-        }
-
-        // Ask for the next block
-        const ChainHeader& nextHeader = m_blockTree.getHeader(m_currentMerkleBlock.height + 1);
-        m_lastRequestedMerkleBlockHash = nextHeader.hash();
-        LOGGER(trace) << "Asking for filtered block (1) " << m_lastRequestedMerkleBlockHash.getHex() << std::endl;
-        
-        try
-        {
-            m_peer.getFilteredBlock(m_lastRequestedMerkleBlockHash);
-        }
-        catch (const exception& e)
-        {
-            // TODO: Propagate code
-            syncLock.unlock();
-            notifyConnectionError(e.what(), -1);
         }
     }
     catch (const exception& e)
@@ -902,16 +1029,39 @@ void NetworkSync::processBlockTx(const Coin::Transaction& tx)
     }
 }
 
+// Must be called with m_syncMutex locked.
+// Feeds transactions that arrived ahead of their merkle block to the current merkle block in order.
+void NetworkSync::processPendingMerkleTxs()
+{
+    while (!m_currentMerkleTxHashes.empty())
+    {
+        auto it = m_pendingMerkleTxs.find(m_currentMerkleTxHashes.front());
+        if (it == m_pendingMerkleTxs.end()) break;
+
+        LOGGER(trace) << "NetworkSync::processPendingMerkleTxs - New merkle transaction (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << it->first.getHex() << endl;
+        notifyMerkleTx(m_currentMerkleBlock, it->second, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
+        m_currentMerkleTxHashes.pop();
+
+        {
+            boost::lock_guard<boost::mutex> mempoolLock(m_mempoolMutex);
+            m_mempoolTxs.erase(it->first);
+        }
+
+        m_pendingMerkleTxs.erase(it);
+        processMempoolConfirmations();
+    }
+}
+
 void NetworkSync::processMempoolConfirmations()
 {
     boost::unique_lock<boost::mutex> mempoolLock(m_mempoolMutex);
     LOGGER(trace) << "Confirming " << m_currentMerkleTxHashes.size() << " merkle block transactions from " << m_mempoolTxs.size() << " mempool transactions..." << endl;
     while (!m_currentMerkleTxHashes.empty() && m_mempoolTxs.count(m_currentMerkleTxHashes.front()))
     {
-        const uchar_vector& txHash = m_currentMerkleTxHashes.front();
+        hash256_t txHash = m_currentMerkleTxHashes.front();
         LOGGER(trace) << "  Confirming tx (" << (m_currentMerkleTxIndex + 1) << " of " << m_currentMerkleTxCount << "): " << txHash.getHex() << endl;
         mempoolLock.unlock();
-        notifyTxConfirmed(m_currentMerkleBlock, txHash, m_currentMerkleTxIndex++, m_currentMerkleTxCount);
+        notifyTxConfirmed(m_currentMerkleBlock, txHash.bytes(), m_currentMerkleTxIndex++, m_currentMerkleTxCount);
 
         mempoolLock.lock();
         m_mempoolTxs.erase(txHash);
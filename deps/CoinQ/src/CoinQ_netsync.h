@@ -25,20 +25,18 @@
 #include "CoinQ_coinparams.h"
 
 #include <CoinCore/typedefs.h>
+#include <CoinCore/hashtypes.h>
 #include <CoinCore/BloomFilter.h>
+#include <CoinCore/MerkleTree.h>
 
 #include <queue>
+#include <map>
 
 typedef Coin::Transaction coin_tx_t;
 typedef ChainHeader chain_header_t;
 typedef ChainBlock chain_block_t;
 typedef ChainMerkleBlock chain_merkle_block_t;
 
-namespace Coin
-{
-    class PartialMerkleTree;
-}
-
 namespace CoinQ
 {
     namespace Network
@@ -58,14 +56,17 @@ public:
 
     void enableCheckProofOfWork(bool bCheckProofOfWork = true) { m_bCheckProofOfWork = bCheckProofOfWork; }
 
+    // Handlers posted here run on the same thread as the network event notifications.
+    CoinQ::io_service_t& getIOService() { return m_ioService; }
+
     void loadHeaders(const std::string& blockTreeFile, bool bCheckProofOfWork = true, CoinQBlockTreeMem::callback_t callback = nullptr);
     bool headersSynched() const { return m_bHeadersSynched; }
     int getBestHeight() const;
-    const bytes_t& getBestHash() const;
-    const ChainHeader& getBestHeader() const { return m_blockTree.getHeader(-1); }
-    const ChainHeader& getHeader(const bytes_t& hash) const { return m_blockTree.getHeader(hash); }
-    const ChainHeader& getHeader(int height) const { return m_blockTree.getHeader(height); }
-    const ChainHeader& getHeaderBefore(uint32_t timestamp) const { return m_blockTree.getHeaderBefore(timestamp); }
+    bytes_t getBestHash() const;
+    ChainHeader getBestHeader() const { return m_blockTree.getHeader(-1); }
+    ChainHeader getHeader(const bytes_t& hash) const { return m_blockTree.getHeader(hash); }
+    ChainHeader getHeader(int height) const { return m_blockTree.getHeader(height); }
+    ChainHeader getHeaderBefore(uint32_t timestamp) const { return m_blockTree.getHeaderBefore(timestamp); }
 
 /*
     void start();
@@ -78,12 +79,19 @@ public:
     bool connected() const { return m_bConnected; }
 
     void setBloomFilter(const Coin::BloomFilter& bloomFilter);
+    void addToBloomFilter(const std::vector<bytes_t>& elements); // inserts elements into the current filter and sends them to the peer, reloading the whole filter if any is too large for filteradd
     void clearBloomFilter();
+    const Coin::BloomFilter& getBloomFilter() const { return m_bloomFilter; }
 
     void syncBlocks(const std::vector<bytes_t>& locatorHashes, uint32_t startTime);
     void syncBlocks(int startHeight);
     void stopSynchingBlocks(bool bClearFilter = true);
 
+    // Maximum number of filtered blocks requested ahead of the block currently being synched.
+    // A window of 1 requests one block at a time.
+    void setBlockSyncWindow(unsigned int blockSyncWindow);
+    unsigned int getBlockSyncWindow() const { return m_blockSyncWindow; }
+
     // TRANSACTIONS PUSHED OFF CHAIN MUST BE ADDED BACK TO MEMPOOL
     void addToMempool(const uchar_vector& txHash);
 
@@ -172,15 +180,30 @@ private:
 
     // Merkle block state
     mutable boost::mutex m_mempoolMutex;
-    std::set<bytes_t> m_mempoolTxs;
+    std::set<hash256_t> m_mempoolTxs;
     ChainMerkleBlock m_currentMerkleBlock;
-    std::queue<bytes_t> m_currentMerkleTxHashes;
+    std::queue<hash256_t> m_currentMerkleTxHashes;
     unsigned int m_currentMerkleTxIndex;
     unsigned int m_currentMerkleTxCount;
     bool m_bMissingTxs;
 
+    // Block sync pipeline state - merkle blocks that arrive ahead of the current one are buffered
+    // by height along with their transactions and are only processed in chain order.
+    unsigned int m_blockSyncWindow;
+    int m_nextRequestHeight;
+    typedef std::pair<ChainMerkleBlock, Coin::PartialMerkleTree> pending_merkle_block_t;
+    std::map<int, pending_merkle_block_t> m_pendingMerkleBlocks;
+    std::set<hash256_t> m_pendingMerkleTxHashes;
+    std::map<hash256_t, Coin::Transaction> m_pendingMerkleTxs;
+
+    void requestMerkleBlocks(int nextHeight);
+    bool bufferMerkleBlock(const Coin::MerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree);
+    bool syncNextMerkleBlocks(int syncedHeight, const bytes_t& syncedHash);
+    void clearPendingMerkleBlocks();
+
     void syncMerkleBlock(const ChainMerkleBlock& merkleBlock, const Coin::PartialMerkleTree& merkleTree);
     void processBlockTx(const Coin::Transaction& tx);
+    void processPendingMerkleTxs();
     void processMempoolConfirmations();
 
     // Sync signals
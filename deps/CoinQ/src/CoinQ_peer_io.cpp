@@ -8,9 +8,12 @@
 
 #include "CoinQ_peer_io.h"
 
+#include <CoinCore/sha256.h>
+
 #include <logger/logger.h>
 
 #include <sstream>
+#include <cstring>
 
 using namespace CoinQ;
 using namespace std;
@@ -47,11 +50,66 @@ void Peer::do_handshake()
     });
 }
 
+// Commands are 12 bytes, NUL padded. They are mapped to a key once so the handler can switch on it.
+enum command_key_t
+{
+    CMD_UNKNOWN,
+    CMD_VERSION,
+    CMD_VERACK,
+    CMD_INV,
+    CMD_TX,
+    CMD_BLOCK,
+    CMD_MERKLEBLOCK,
+    CMD_ADDR,
+    CMD_HEADERS,
+    CMD_PING
+};
+
+static command_key_t getCommandKey(const unsigned char* command)
+{
+    static const struct { char name[12]; command_key_t key; } commands[] =
+    {
+        { "version",        CMD_VERSION },
+        { "verack",         CMD_VERACK },
+        { "inv",            CMD_INV },
+        { "tx",             CMD_TX },
+        { "block",          CMD_BLOCK },
+        { "merkleblock",    CMD_MERKLEBLOCK },
+        { "addr",           CMD_ADDR },
+        { "headers",        CMD_HEADERS },
+        { "ping",           CMD_PING }
+    };
+
+    for (auto& entry: commands)
+    {
+        if (memcmp(command, entry.name, 12) == 0) return entry.key;
+    }
+    return CMD_UNKNOWN;
+}
+
+static bool isChecksumValid(const unsigned char* payload, std::size_t size, const unsigned char* checksum)
+{
+    unsigned char hash[32];
+    CoinCrypto::sha256d(hash, payload, size);
+    return memcmp(hash, checksum, 4) == 0;
+}
+
 void Peer::do_read()
 {
+    if (read_buffer.size() - read_end < min_read_bytes)
+    {
+        std::size_t unread = read_end - read_begin;
+        if (read_begin > 0)
+        {
+            memmove(&read_buffer[0], &read_buffer[read_begin], unread);
+            read_begin = 0;
+            read_end = unread;
+        }
+        if (read_buffer.size() - read_end < min_read_bytes) { read_buffer.resize(read_end + min_read_bytes); }
+    }
+
     LOGGER(trace) << "Peer::do_read() - waiting for " << min_read_bytes << " bytes..." << endl;
-    boost::asio::async_read(socket_, boost::asio::buffer(read_buffer, READ_BUFFER_SIZE),
-        //boost::asio::transfer_at_least(MIN_MESSAGE_HEADER_SIZE),
+    boost::asio::async_read(socket_, boost::asio::buffer(&read_buffer[read_end], read_buffer.size() - read_end),
         boost::asio::transfer_at_least(min_read_bytes),
     strand_.wrap([this](const boost::system::error_code& ec, std::size_t bytes_read) {
         if (!bRunning) return;
@@ -60,7 +118,7 @@ void Peer::do_read()
         {
             if (ec == boost::asio::error::operation_aborted) return;
 
-            read_message.clear();
+            read_begin = read_end = 0;
             do_stop();
 
             stringstream err;
@@ -70,157 +128,192 @@ void Peer::do_read()
             return;
         }
 
-        read_message += uchar_vector(read_buffer, bytes_read);
+        read_end += bytes_read;
+        while (bRunning && do_readFrame()) { }
 
-        while (true)
+        if (read_begin == read_end)
         {
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE)
+            read_begin = read_end = 0;
+            if (read_buffer.size() > READ_BUFFER_SIZE)
             {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE - read_message.size();
-                break;
+                read_buffer.resize(READ_BUFFER_SIZE);
+                read_buffer.shrink_to_fit();
             }
+        }
+        LOGGER(debug) << "Peer read handler - remaining message bytes: " << (read_end - read_begin) << endl;
 
-            // Find the first occurrence of the magic bytes, discard anything before it.
-            // If magic bytes are not found, read new buffer. 
-            // TODO: detect misbehaving node and disconnect.
-            uchar_vector::iterator it = std::search(read_message.begin(), read_message.end(), magic_bytes_vector_.begin(), magic_bytes_vector_.end());
-            if (it == read_message.end())
-            {
-                read_message.clear();
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
-                break;
-            }
+        do_read();
+    }));
+}
 
-            read_message.assign(it, read_message.end());
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE)
-            {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE - read_message.size();
-                break;
-            }
+bool Peer::do_readFrame()
+{
+    std::size_t available = read_end - read_begin;
+    if (available < MIN_MESSAGE_HEADER_SIZE)
+    {
+        min_read_bytes = MIN_MESSAGE_HEADER_SIZE - available;
+        return false;
+    }
 
-            // Get command
-            unsigned char command[13];
-            command[12] = 0;
-            uchar_vector(read_message.begin() + 4, read_message.begin() + 16).copyToArray(command);
-            LOGGER(debug) << "Peer read handler - command: " << command << endl;
+    // Find the first occurrence of the magic bytes, discard anything before it.
+    // If magic bytes are not found keep only a possible partial match at the end.
+    // TODO: detect misbehaving node and disconnect.
+    const unsigned char* data = &read_buffer[read_begin];
+    const unsigned char* magic = std::search(data, data + available, magic_bytes_vector_.begin(), magic_bytes_vector_.end());
+    if (magic == data + available)
+    {
+        std::size_t keep = std::min(available, magic_bytes_vector_.size() - 1);
+        read_begin = read_end - keep;
+        min_read_bytes = MIN_MESSAGE_HEADER_SIZE - keep;
+        return false;
+    }
+
+    read_begin += magic - data;
+    available = read_end - read_begin;
+    if (available < MIN_MESSAGE_HEADER_SIZE)
+    {
+        min_read_bytes = MIN_MESSAGE_HEADER_SIZE - available;
+        return false;
+    }
 
-            // Get payload size
-            unsigned int payloadSize = vch_to_uint<uint32_t>(uchar_vector(read_message.begin() + 16, read_message.begin() + 20), _BIG_ENDIAN);
-            LOGGER(debug) << "Peer read handler - payload size: " << payloadSize << endl;
-            LOGGER(debug) << "Peer read handler - read_message size: " << read_message.size() << endl;
+    // Header fields: magic (4), command (12), payload size (4), checksum (4)
+    const unsigned char* header = &read_buffer[read_begin];
+    const unsigned char* command = header + 4;
+    uint32_t payloadSize = header[16] | (header[17] << 8) | (header[18] << 16) | ((uint32_t)header[19] << 24);
+    LOGGER(debug) << "Peer read handler - command: " << std::string((const char*)command, strnlen((const char*)command, 12)) << endl;
+    LOGGER(debug) << "Peer read handler - payload size: " << payloadSize << endl;
+    LOGGER(debug) << "Peer read handler - buffered bytes: " << available << endl;
 
-            if (read_message.size() < MIN_MESSAGE_HEADER_SIZE  + payloadSize)
-            {
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE + payloadSize - read_message.size();
-                break;
-            }
+    if (payloadSize > MAX_MESSAGE_PAYLOAD_SIZE)
+    {
+        std::stringstream err;
+        err << "Message decode error: payload size " << payloadSize << " too large.";
+        LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
+        notifyProtocolError(*this, err.str(), -1);
+        read_begin += magic_bytes_vector_.size();
+        return true;
+    }
 
-            try
-            {
-                Coin::CoinNodeMessage peerMessage(read_message);
-
-                if (!peerMessage.isChecksumValid()) throw std::runtime_error("Invalid checksum.");
-
-                std::string command = peerMessage.getCommand();
-                if (command == "verack") {
-                    LOGGER(trace) << "Peer read handler - VERACK" << std::endl;
-
-                    // Signal completion of handshake
-                    if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
-                    boost::unique_lock<boost::mutex> lock(handshakeMutex);
-                    if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
-                    timer_.cancel();
-                    bHandshakeComplete = true;
-                    lock.unlock();
-                    bWriteReady = true;
-                    notifyOpen(*this);
-                }
-                else if (command == "version")
-                {
-                    LOGGER(trace) << "Peer read handler - VERSION" << std::endl;
-
-                    // TODO: Check version information
-                    Coin::VerackMessage verackMessage;
-                    Coin::CoinNodeMessage msg(magic_bytes_, &verackMessage);
-                    do_send(msg);
-                }
-                else if (command == "inv")
-                {
-                    LOGGER(trace) << "Peer read handler - INV" << std::endl;
-
-                    Coin::Inventory* pInventory = static_cast<Coin::Inventory*>(peerMessage.getPayload());
-                    notifyInv(*this, *pInventory);
-                }
-                else if (command == "tx")
-                {
-                    LOGGER(trace) << "Peer read handler - TX" << std::endl;
-
-                    Coin::Transaction* pTx = static_cast<Coin::Transaction*>(peerMessage.getPayload());
-                    notifyTx(*this, *pTx);
-                }
-                else if (command == "block")
-                {
-                    LOGGER(trace) << "Peer read handler - BLOCK" << std::endl;
-
-                    Coin::CoinBlock* pBlock = static_cast<Coin::CoinBlock*>(peerMessage.getPayload());
-                    notifyBlock(*this, *pBlock);
-                }
-                else if (command == "merkleblock")
-                {
-                    LOGGER(trace) << "Peer read handler - MERKLEBLOCK" << std::endl;
-
-                    Coin::MerkleBlock* pMerkleBlock = static_cast<Coin::MerkleBlock*>(peerMessage.getPayload());
-                    notifyMerkleBlock(*this, *pMerkleBlock);
-                }
-                else if (command == "addr")
-                {
-                    LOGGER(trace) << "Peer read handler - ADDR" << std::endl;
-
-                    Coin::AddrMessage* pAddr = static_cast<Coin::AddrMessage*>(peerMessage.getPayload());
-                    notifyAddr(*this, *pAddr);
-                }
-                else if (command == "headers")
-                {
-                    LOGGER(trace) << "Peer read handler - HEADERS" << std::endl;
-
-                    Coin::HeadersMessage* pHeaders = static_cast<Coin::HeadersMessage*>(peerMessage.getPayload());
-                    notifyHeaders(*this, *pHeaders);
-                }
-                else if (command == "ping")
-                {
-                    LOGGER(trace) << "Peer read handler - PING" << std::endl;
-
-                    Coin::PingMessage* pPing = static_cast<Coin::PingMessage*>(peerMessage.getPayload());
-                    Coin::PongMessage pongMessage(pPing->nonce);
-                    Coin::CoinNodeMessage msg(magic_bytes_, &pongMessage);
-                    do_send(msg);
-                }
-                else
-                {
-                    LOGGER(error) << "Peer read handler - command not implemented: " << command << std::endl;
-
-                    std::stringstream err;
-                    err << "Command type not implemented: " << command;
-                    notifyProtocolError(*this, err.str(), -1);
-                }
-
-                notifyMessage(*this, peerMessage);
-            }
-            catch (const std::exception& e)
-            {
-                std::stringstream err;
-                err << "Message decode error: " << e.what();
-                LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
-                notifyProtocolError(*this, err.str(), -1);
-                min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
-            }
+    if (available < MIN_MESSAGE_HEADER_SIZE + payloadSize)
+    {
+        min_read_bytes = MIN_MESSAGE_HEADER_SIZE + payloadSize - available;
+        return false;
+    }
+
+    try
+    {
+        if (!isChecksumValid(header + MIN_MESSAGE_HEADER_SIZE, payloadSize, header + 20)) throw std::runtime_error("Invalid checksum.");
 
-            read_message.assign(read_message.begin() + MIN_MESSAGE_HEADER_SIZE + payloadSize, read_message.end());
-            LOGGER(debug) << "Peer read handler - remaining message bytes: " << read_message.size() << endl;
+        Coin::DataCursor cursor(header, MIN_MESSAGE_HEADER_SIZE + payloadSize);
+        Coin::CoinNodeMessage peerMessage(cursor);
+
+        switch (getCommandKey(command))
+        {
+        case CMD_VERACK:
+        {
+            LOGGER(trace) << "Peer read handler - VERACK" << std::endl;
+
+            // Signal completion of handshake
+            if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
+            boost::unique_lock<boost::mutex> lock(handshakeMutex);
+            if (bHandshakeComplete) throw std::runtime_error("Second verack received.");
+            timer_.cancel();
+            bHandshakeComplete = true;
+            lock.unlock();
+            bWriteReady = true;
+            notifyOpen(*this);
+            break;
         }
+        case CMD_VERSION:
+        {
+            LOGGER(trace) << "Peer read handler - VERSION" << std::endl;
 
-        do_read();
-    }));
+            // TODO: Check version information
+            Coin::VerackMessage verackMessage;
+            Coin::CoinNodeMessage msg(magic_bytes_, &verackMessage);
+            do_send(msg);
+            break;
+        }
+        case CMD_INV:
+        {
+            LOGGER(trace) << "Peer read handler - INV" << std::endl;
+
+            Coin::Inventory* pInventory = static_cast<Coin::Inventory*>(peerMessage.getPayload());
+            notifyInv(*this, *pInventory);
+            break;
+        }
+        case CMD_TX:
+        {
+            LOGGER(trace) << "Peer read handler - TX" << std::endl;
+
+            Coin::Transaction* pTx = static_cast<Coin::Transaction*>(peerMessage.getPayload());
+            notifyTx(*this, *pTx);
+            break;
+        }
+        case CMD_BLOCK:
+        {
+            LOGGER(trace) << "Peer read handler - BLOCK" << std::endl;
+
+            Coin::CoinBlock* pBlock = static_cast<Coin::CoinBlock*>(peerMessage.getPayload());
+            notifyBlock(*this, *pBlock);
+            break;
+        }
+        case CMD_MERKLEBLOCK:
+        {
+            LOGGER(trace) << "Peer read handler - MERKLEBLOCK" << std::endl;
+
+            Coin::MerkleBlock* pMerkleBlock = static_cast<Coin::MerkleBlock*>(peerMessage.getPayload());
+            notifyMerkleBlock(*this, *pMerkleBlock);
+            break;
+        }
+        case CMD_ADDR:
+        {
+            LOGGER(trace) << "Peer read handler - ADDR" << std::endl;
+
+            Coin::AddrMessage* pAddr = static_cast<Coin::AddrMessage*>(peerMessage.getPayload());
+            notifyAddr(*this, *pAddr);
+            break;
+        }
+        case CMD_HEADERS:
+        {
+            LOGGER(trace) << "Peer read handler - HEADERS" << std::endl;
+
+            Coin::HeadersMessage* pHeaders = static_cast<Coin::HeadersMessage*>(peerMessage.getPayload());
+            notifyHeaders(*this, *pHeaders);
+            break;
+        }
+        case CMD_PING:
+        {
+            LOGGER(trace) << "Peer read handler - PING" << std::endl;
+
+            Coin::PingMessage* pPing = static_cast<Coin::PingMessage*>(peerMessage.getPayload());
+            Coin::PongMessage pongMessage(pPing->nonce);
+            Coin::CoinNodeMessage msg(magic_bytes_, &pongMessage);
+            do_send(msg);
+            break;
+        }
+        default:
+        {
+            LOGGER(error) << "Peer read handler - command not implemented: " << peerMessage.getCommand() << std::endl;
+
+            std::stringstream err;
+            err << "Command type not implemented: " << peerMessage.getCommand();
+            notifyProtocolError(*this, err.str(), -1);
+        }
+        }
+
+        notifyMessage(*this, peerMessage);
+    }
+    catch (const std::exception& e)
+    {
+        std::stringstream err;
+        err << "Message decode error: " << e.what();
+        LOGGER(error) << "Peer read handler error: " << err.str() << std::endl;
+        notifyProtocolError(*this, err.str(), -1);
+    }
+
+    read_begin += MIN_MESSAGE_HEADER_SIZE + payloadSize;
+    return true;
 }
 
 void Peer::do_write(boost::shared_ptr<uchar_vector> data)
@@ -313,7 +406,7 @@ void Peer::start()
     bRunning = true;
     bHandshakeComplete = false;
     bWriteReady = false;
-    read_message.clear();
+    read_begin = read_end = 0;
     min_read_bytes = MIN_MESSAGE_HEADER_SIZE;
 
     tcp::resolver::query query(host_, port_);
@@ -69,7 +69,10 @@ public:
         user_agent_(user_agent),
         start_height_(start_height),
         relay_(relay),
-        bRunning(false)
+        bRunning(false),
+        read_buffer(READ_BUFFER_SIZE),
+        read_begin(0),
+        read_end(0)
     {
         magic_bytes_vector_ = uint_to_vch(magic_bytes_, _BIG_ENDIAN);
     }
@@ -157,6 +160,17 @@ public:
         send(getData);
     }
 
+    void getFilteredBlocks(const hashvector_t& blockhashes)
+    {
+        using namespace Coin;
+
+        if (blockhashes.empty()) return;
+        Inventory inv;
+        for (auto& hash: blockhashes) { inv.addItem(InventoryItem(MSG_FILTERED_BLOCK, hash)); }
+        GetDataMessage getData(inv);
+        send(getData);
+    }
+
     void getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop = g_zero32bytes)
     {
         Coin::GetHeadersMessage getHeaders(protocol_version_, locatorHashes, hashStop);
@@ -244,17 +258,23 @@ private:
 
     CoinQSignal<Peer&>                                  notifyTimeout;
 
+    // Bytes are read straight into read_buffer and frames are decoded in place. Consumed bytes are skipped
+    // by advancing read_begin and are only moved to the front when the space left after read_end is too
+    // small for the next read. The buffer grows only for messages larger than READ_BUFFER_SIZE.
     static const unsigned int READ_BUFFER_SIZE = 262144;
-    unsigned char read_buffer[READ_BUFFER_SIZE];
+    static const unsigned int MAX_MESSAGE_PAYLOAD_SIZE = 0x02000000;
+    std::vector<unsigned char> read_buffer;
+    std::size_t read_begin;
+    std::size_t read_end;
     std::size_t min_read_bytes;
 
-    uchar_vector read_message;
     uchar_vector write_message;
     std::queue<boost::shared_ptr<uchar_vector>> sendQueue;
     boost::mutex sendMutex;
 
     void do_connect(tcp::resolver::iterator iter);
     void do_read();
+    bool do_readFrame(); // decodes the next frame in read_buffer. returns false if more bytes are needed.
     void do_write(boost::shared_ptr<uchar_vector> data);
     void do_send(const Coin::CoinNodeMessage& message); // calls do_write from the strand thread 
     void do_handshake();
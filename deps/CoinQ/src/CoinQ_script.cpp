@@ -11,6 +11,8 @@
 #include <CoinCore/Base58Check.h>
 #include <CoinCore/secp256k1.h>
 
+#include <map>
+
 using namespace CoinCrypto;
 
 namespace CoinQ {
@@ -209,6 +211,11 @@ Script::Script(type_t type, unsigned int minsigs, const std::vector<bytes_t>& pu
 }
 
 Script::Script(const bytes_t& txinscript, const bytes_t& signinghash, bool clearinvalidsigs)
+    : Script(txinscript, signinghash, clearinvalidsigs, [](const SigCheck& check) { return SigVerifier::getDefault().verify(check); })
+{
+}
+
+Script::Script(const bytes_t& txinscript, const bytes_t& signinghash, bool clearinvalidsigs, const sigchecker_t& sigchecker)
 {
     std::vector<bytes_t> objects;
     unsigned int pos = 0;
@@ -304,9 +311,7 @@ Script::Script(const bytes_t& txinscript, const bytes_t& signinghash, bool clear
                     bytes_t signature(sigs[iSig].begin(), sigs[iSig].end() - 1);
 
                     // Verify signature.
-                    secp256k1_key key;
-                    key.setPubKey(pubkey);
-                    if (secp256k1_verify(key, signinghash, signature))
+                    if (sigchecker(SigCheck(pubkey, signinghash, signature)))
                     {
                         // Signature is valid. Keep it.
                         sigs_.push_back(sigs[iSig]);
@@ -459,6 +464,32 @@ void Script::clearSigs()
     for (unsigned int i = 0; i < pubkeys_.size(); i++) { sigs_.push_back(bytes_t()); }
 }
 
+std::vector<SigCheck> Script::sigchecks(const bytes_t& signinghash) const
+{
+    std::vector<SigCheck> checks;
+    if (type_ != PAY_TO_MULTISIG_SCRIPT_HASH) return checks;
+
+    // Same walk as the constructor with every check succeeding.
+    unsigned int iSig = 0;
+    unsigned int nValidSigs = 0;
+    for (auto& pubkey: pubkeys_)
+    {
+        if (nValidSigs == minsigs_ || iSig >= sigs_.size() || sigs_[iSig].empty())
+        {
+            iSig++;
+            continue;
+        }
+
+        // The constructor rejects other hash types.
+        if (sigs_[iSig].back() != SIGHASH_ALL) break;
+
+        checks.push_back(SigCheck(pubkey, signinghash, bytes_t(sigs_[iSig].begin(), sigs_[iSig].end() - 1)));
+        iSig++;
+        nValidSigs++;
+    }
+    return checks;
+}
+
 unsigned int Script::mergesigs(const Script& other)
 {
     if (type_ != other.type_) throw std::runtime_error("Script::mergesigs(...) - cannot merge two different script types.");
@@ -483,26 +514,40 @@ void Signer::setTx(const Coin::Transaction& tx, bool clearinvalidsigs)
     tx_ = tx;
     tx_.clearScriptSigs();
 
-    Coin::Transaction txCopy = tx_;
+    Coin::SigHashCache sighashcache(tx_);
 
-    scripts_.clear();
+    // Collect the checks each input needs if its signatures are valid, the usual case, and verify them all in one
+    // batch. An input whose checks all pass comes out exactly as in a serial pass. For any other input the serial
+    // pass below verifies what the batch did not cover.
+    std::vector<bytes_t> signinghashes;
+    std::vector<SigCheck> checks;
     unsigned int i = 0;
     for (auto& txin: tx.inputs)
     {
-        bytes_t signinghash;
-        {
-            Script script(txin.scriptSig);
-            txCopy.inputs[i].scriptSig = script.txinscript(Script::SIGN);
-            signinghash = txCopy.getHashWithAppendedCode(SIGHASH_ALL);
-            txCopy.inputs[i].scriptSig.clear();
-        }
-        {
-            Script script(txin.scriptSig, signinghash, clearinvalidsigs);
-            tx_.inputs[i].scriptSig = script.txinscript((script.sigsneeded() == 0) ? Script::BROADCAST : Script::EDIT);
-            scripts_.push_back(script);
-        }
+        Script script(txin.scriptSig);
+        signinghashes.push_back(sighashcache.getHash(i, script.txinscript(Script::SIGN), SIGHASH_ALL));
+        std::vector<SigCheck> inputchecks = script.sigchecks(signinghashes.back());
+        checks.insert(checks.end(), inputchecks.begin(), inputchecks.end());
         i++;
     }
+
+    std::map<SigCheck, bool> results;
+    std::vector<bool> batchresults = SigVerifier::getDefault().verify(checks);
+    for (i = 0; i < checks.size(); i++) { results[checks[i]] = batchresults[i]; }
+
+    sigchecker_t sigchecker = [&](const SigCheck& check)
+    {
+        auto it = results.find(check);
+        return (it != results.end()) ? it->second : SigVerifier::getDefault().verify(check);
+    };
+
+    scripts_.clear();
+    for (i = 0; i < tx.inputs.size(); i++)
+    {
+        Script script(tx.inputs[i].scriptSig, signinghashes[i], clearinvalidsigs, sigchecker);
+        tx_.inputs[i].scriptSig = script.txinscript((script.sigsneeded() == 0) ? Script::BROADCAST : Script::EDIT);
+        scripts_.push_back(script);
+    }
 }
 
 std::vector<bytes_t> Signer::sign(const std::vector<secure_bytes_t>& privkeys)
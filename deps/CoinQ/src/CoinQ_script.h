@@ -10,11 +10,13 @@
 #define _COINQ_SCRIPT_H_
 
 #include "CoinQ_txs.h"
+#include "CoinQ_sigverifier.h"
 
 #include <CoinCore/CoinNodeData.h>
 #include <CoinCore/typedefs.h>
 
 #include <utility>
+#include <functional>
 
 namespace CoinQ {
 namespace Script {
@@ -73,6 +75,9 @@ uchar_vector getTxOutScriptForAddress(const std::string& address, const unsigned
 std::string getAddressForTxOutScript(const bytes_t& txoutscript, const unsigned char addressVersions[]);
 
 
+// Returns true iff the signature in check is valid.
+typedef std::function<bool(const SigCheck& /*check*/)> sigchecker_t;
+
 class Script
 {
 public:
@@ -84,6 +89,9 @@ public:
     // If clearinvalidsigs is true, invalid signatures are cleared. Otherwise, an exception is thrown if signatures are invalid.
     explicit Script(const bytes_t& txinscript, const bytes_t& signinghash = bytes_t(), bool clearinvalidsigs = false);
 
+    // Same as above but signatures are checked by sigchecker instead of the default SigVerifier.
+    Script(const bytes_t& txinscript, const bytes_t& signinghash, bool clearinvalidsigs, const sigchecker_t& sigchecker);
+
     type_t type() const { return type_; }
     unsigned int minsigs() const { return minsigs_; }
     const std::vector<bytes_t>& pubkeys() const { return pubkeys_; }
@@ -108,6 +116,7 @@ public:
     std::vector<bytes_t> missingsigs() const; // returns pubkeys for which we are still missing signatures
     std::vector<bytes_t> presentsigs() const; // returns pubkeys for which we have signatures
     bool addSig(const bytes_t& pubkey, const bytes_t& sig); // returns true iff signature was absent and has been added
+    std::vector<SigCheck> sigchecks(const bytes_t& signinghash) const; // checks the constructor makes against signinghash if all signatures are valid. sigs must not have been checked yet.
     void clearSigs(); // resets all signatures to 0-length placeholders
     unsigned int mergesigs(const Script& other); // merges the signatures from another script that is otherwise identical. returns number of signatures added.
 
@@ -130,6 +139,7 @@ public:
     Signer() : isSigned_(false) { }
     explicit Signer(const Coin::Transaction& tx, bool clearinvalidsigs = false) { setTx(tx, clearinvalidsigs); }
 
+    // Signatures of all inputs are verified in one parallel batch with the default SigVerifier.
     void setTx(const Coin::Transaction& tx, bool clearinvalidsigs = false);
     const Coin::Transaction& getTx() const { return tx_; }
 
@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_sigverifier.cpp
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include "CoinQ_sigverifier.h"
+
+#include <CoinCore/secp256k1.h>
+
+using namespace CoinCrypto;
+
+namespace CoinQ {
+namespace Script {
+
+bool SigCheck::operator<(const SigCheck& rhs) const
+{
+    if (pubkey != rhs.pubkey) return pubkey < rhs.pubkey;
+    if (hash != rhs.hash) return hash < rhs.hash;
+    return signature < rhs.signature;
+}
+
+boost::thread_specific_ptr<SigVerifier::key_cache_t> SigVerifier::s_keys;
+
+SigVerifier::SigVerifier(unsigned int nThreads)
+    : m_checks(nullptr), m_nextCheck(0), m_pendingChecks(0), m_bStop(false)
+{
+    if (nThreads == 0) { nThreads = boost::thread::hardware_concurrency(); }
+
+    // The calling thread verifies too, so it counts as one of the threads.
+    for (unsigned int i = 1; i < nThreads; i++)
+    {
+        m_threads.push_back(new boost::thread(&SigVerifier::workerLoop, this));
+    }
+}
+
+SigVerifier::~SigVerifier()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_jobMutex);
+        m_bStop = true;
+    }
+    m_jobCond.notify_all();
+
+    for (auto thread: m_threads)
+    {
+        thread->join();
+        delete thread;
+    }
+}
+
+SigVerifier& SigVerifier::getDefault()
+{
+    static SigVerifier verifier;
+    return verifier;
+}
+
+std::vector<bool> SigVerifier::verify(const std::vector<SigCheck>& checks)
+{
+    // Parse all keys up front so bad pubkeys throw from the calling thread. Workers parse their own copies.
+    for (auto& check: checks) { getKey(check.pubkey); }
+
+    if (m_threads.empty() || checks.size() < 2)
+    {
+        std::vector<bool> results;
+        results.reserve(checks.size());
+        for (auto& check: checks) { results.push_back(verifyCheck(check)); }
+        return results;
+    }
+
+    boost::lock_guard<boost::mutex> batchLock(m_batchMutex);
+    {
+        boost::lock_guard<boost::mutex> lock(m_jobMutex);
+        m_checks = &checks;
+        m_results.assign(checks.size(), 0);
+        m_nextCheck = 0;
+        m_pendingChecks = checks.size();
+    }
+    m_jobCond.notify_all();
+
+    std::size_t i;
+    while (claimCheck(i))
+    {
+        finishCheck(i, verifyCheck(checks[i]));
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_jobMutex);
+    while (m_pendingChecks > 0) { m_doneCond.wait(lock); }
+    m_checks = nullptr;
+
+    return std::vector<bool>(m_results.begin(), m_results.end());
+}
+
+bool SigVerifier::verify(const SigCheck& check)
+{
+    return verifyCheck(check);
+}
+
+SigVerifier::key_t SigVerifier::getKey(const bytes_t& pubkey)
+{
+    key_cache_t* keys = s_keys.get();
+    if (!keys)
+    {
+        keys = new key_cache_t();
+        s_keys.reset(keys);
+    }
+
+    auto it = keys->find(pubkey);
+    if (it != keys->end()) return it->second;
+
+    key_t key(new secp256k1_key());
+    key->setPubKey(pubkey);
+
+    if (keys->size() >= MAX_CACHED_KEYS) { keys->clear(); }
+    (*keys)[pubkey] = key;
+    return key;
+}
+
+bool SigVerifier::verifyCheck(const SigCheck& check)
+{
+    return secp256k1_verify(*getKey(check.pubkey), check.hash, check.signature);
+}
+
+bool SigVerifier::claimCheck(std::size_t& i)
+{
+    boost::lock_guard<boost::mutex> lock(m_jobMutex);
+    if (!m_checks || m_nextCheck >= m_checks->size()) return false;
+    i = m_nextCheck++;
+    return true;
+}
+
+void SigVerifier::finishCheck(std::size_t i, bool result)
+{
+    bool bDone;
+    {
+        boost::lock_guard<boost::mutex> lock(m_jobMutex);
+        m_results[i] = result;
+        bDone = (--m_pendingChecks == 0);
+    }
+    if (bDone) { m_doneCond.notify_all(); }
+}
+
+void SigVerifier::workerLoop()
+{
+    while (true)
+    {
+        const SigCheck* check;
+        std::size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(m_jobMutex);
+            while (!m_bStop && (!m_checks || m_nextCheck >= m_checks->size())) { m_jobCond.wait(lock); }
+            if (m_bStop) return;
+
+            i = m_nextCheck++;
+            check = &(*m_checks)[i];
+        }
+
+        finishCheck(i, verifyCheck(*check));
+    }
+}
+
+}
+}
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// CoinQ_sigverifier.h
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#ifndef _COINQ_SIGVERIFIER_H_
+#define _COINQ_SIGVERIFIER_H_
+
+#include <CoinCore/typedefs.h>
+
+#include <boost/thread.hpp>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace CoinCrypto { class secp256k1_key; }
+
+namespace CoinQ {
+namespace Script {
+
+struct SigCheck
+{
+    SigCheck() { }
+    SigCheck(const bytes_t& pubkey_, const bytes_t& hash_, const bytes_t& signature_) : pubkey(pubkey_), hash(hash_), signature(signature_) { }
+
+    bool operator<(const SigCheck& rhs) const;
+
+    bytes_t pubkey;
+    bytes_t hash;
+    bytes_t signature; // DER encoded, without the hash type byte
+};
+
+/*
+ * SigVerifier - verifies batches of signatures on a pool of worker threads.
+ *      Parsed pubkeys are cached so keys shared across inputs are only decoded once. OpenSSL 1.0 EC_KEYs
+ *      cannot be shared between threads without locking callbacks, so each thread keeps its own cache.
+*/
+class SigVerifier
+{
+public:
+    // nThreads = 0 uses one thread per hardware core. The calling thread always takes part.
+    explicit SigVerifier(unsigned int nThreads = 0);
+    ~SigVerifier();
+
+    static SigVerifier& getDefault();
+
+    unsigned int getThreadCount() const { return m_threads.size() + 1; }
+
+    // Returns results in the order of checks. Throws if a pubkey cannot be parsed.
+    std::vector<bool> verify(const std::vector<SigCheck>& checks);
+    bool verify(const SigCheck& check);
+
+    static const unsigned int MAX_CACHED_KEYS = 10000; // per thread
+
+private:
+    typedef std::shared_ptr<CoinCrypto::secp256k1_key> key_t;
+    typedef std::map<bytes_t, key_t> key_cache_t;
+    static boost::thread_specific_ptr<key_cache_t> s_keys;
+    static key_t getKey(const bytes_t& pubkey);
+    static bool verifyCheck(const SigCheck& check);
+
+    // Batch state - m_batchMutex serializes callers, m_jobMutex guards the fields below it.
+    boost::mutex m_batchMutex;
+    boost::mutex m_jobMutex;
+    boost::condition_variable m_jobCond;
+    boost::condition_variable m_doneCond;
+    const std::vector<SigCheck>* m_checks;
+    std::vector<unsigned char> m_results;
+    std::size_t m_nextCheck;
+    std::size_t m_pendingChecks;
+    bool m_bStop;
+
+    std::vector<boost::thread*> m_threads;
+    void workerLoop();
+    bool claimCheck(std::size_t& i);
+    void finishCheck(std::size_t i, bool result);
+};
+
+}
+}
+
+#endif // _COINQ_SIGVERIFIER_H_
@@ -68,7 +68,7 @@ void NetworkSync::initBlockTree(const QString& blockTreeFile)
     try {
         blockTree.loadFromFile(blockTreeFile.toStdString());
         blockTreeFlushed = true;
-        emit status(tr("Best Height: ") + QString::number(blockTree.getBestHeight()) + " / " + tr("Total Work: ") + QString::fromStdString(blockTree.getTotalWork().getDec()));
+        emit status(tr("Best Height: ") + QString::number(blockTree.getBestHeight()) + " / " + tr("Total Work: ") + QString::fromStdString(blockTree.getTotalWork().GetDec()));
         return;
     }
     catch (const std::exception& e) {
@@ -95,7 +95,7 @@ void NetworkSync::initBlockFilter()
         uchar_vector hash = header.getHashLittleEndian();
         emit status(tr("Added to best chain: ") + QString::fromStdString(hash.getHex()) +
              tr(" Height: ") + QString::number(header.height) +
-             tr(" ChainWork: ") + QString::fromStdString(header.chainWork.getDec()));
+             tr(" ChainWork: ") + QString::fromStdString(header.chainWork.GetDec()));
     });
 
     blockFilter.clear();
@@ -103,7 +103,7 @@ void NetworkSync::initBlockFilter()
         uchar_vector blockHash = block.blockHeader.getHashLittleEndian();
         emit status(tr("Got block: ") + QString::fromStdString(blockHash.getHex()) +
             tr(" height: ") + QString::number(block.height) +
-            tr(" chainWork: ") + QString::fromStdString(block.chainWork.getDec()) +
+            tr(" chainWork: ") + QString::fromStdString(block.chainWork.GetDec()) +
             tr(" # txs: ") + QString::number(block.txs.size()));
         for (auto& tx: block.txs) {
             notifyTx(tx);
@@ -294,9 +294,9 @@ void NetworkSync::start(const QString& host, int port)
 
                 std::cout << "Processed " << headers.headers.size() << " headers."
                      << " mBestHeight: " << blockTree.getBestHeight()
-                     << " mTotalWork: " << blockTree.getTotalWork().getDec()
+                     << " mTotalWork: " << blockTree.getTotalWork().GetDec()
                      << " Attempting to fetch more headers..." << std::endl;
-                emit status(tr("Best Height: ") + QString::number(blockTree.getBestHeight()) + " / " + tr("Total Work: ") + QString::fromStdString(blockTree.getTotalWork().getDec()));
+                emit status(tr("Best Height: ") + QString::number(blockTree.getBestHeight()) + " / " + tr("Total Work: ") + QString::fromStdString(blockTree.getTotalWork().GetDec()));
                 peer.getHeaders(blockTree.getLocatorHashes(1));
             }
             else {
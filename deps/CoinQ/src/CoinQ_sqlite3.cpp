@@ -61,7 +61,7 @@ void CoinQBlockTreeSqlite3::open(const std::string& filename, const Coin::CoinBl
         sql << "INSERT INTO `block_headers` (`hash`, `in_best_chain`, `height`, `chain_work`, `version`, `prev_block_hash`, `merkle_root`, `timestamp`, `bits`, `nonce`)"
             << " VALUES ('"
             << genesisHeaderHash.getHex() << "',1,0,'"
-            << genesisHeader.chainWork.getDec() << "',"
+            << genesisHeader.chainWork.GetDec() << "',"
             << genesisHeader.version << ",'"
             << genesisHeader.prevBlockHash.getHex() << "','"
             << genesisHeader.merkleRoot.getHex() << "',"
@@ -111,8 +111,8 @@ bool CoinQBlockTreeSqlite3::setBestChain(const std::string& hash)
 
         prevHash = (char*)stmt.getText(4);
 
-        BigInt chainWork;
-        chainWork.setDec((char*)stmt.getText(8));
+        uint256 chainWork;
+        chainWork.SetDec((char*)stmt.getText(8));
 
         newBestChain.push_back(ChainHeader(stmt.getInt64(0), stmt.getInt64(1), stmt.getInt64(2), stmt.getInt64(3),
             uchar_vector(prevHash), uchar_vector((char*)stmt.getText(5)), true, bestHeight, chainWork));
@@ -129,8 +129,8 @@ bool CoinQBlockTreeSqlite3::setBestChain(const std::string& hash)
         << " FROM `block_headers` WHERE `in_best_chain` != 0 AND `height` > " << bestHeight;
     stmt.prepare(db, sql.str());
     while (stmt.step() == SQLITE_ROW) {
-        BigInt chainWork;
-        chainWork.setDec((char*)stmt.getText(7));
+        uint256 chainWork;
+        chainWork.SetDec((char*)stmt.getText(7));
 
         oldBestChain.push_back(ChainHeader(stmt.getInt64(0), stmt.getInt64(1), stmt.getInt64(2), stmt.getInt64(3),
             uchar_vector((char*)stmt.getText(4)), uchar_vector((char*)stmt.getText(5)), false, stmt.getInt(6), chainWork));
@@ -187,7 +187,7 @@ bool CoinQBlockTreeSqlite3::insertHeader(const Coin::CoinBlockHeader& header)
 
     ChainHeader chainHeader(header);
     chainHeader.height = stmt.getInt(0) + 1;
-    chainHeader.chainWork.setDec((char*)stmt.getText(1));
+    chainHeader.chainWork.SetDec((char*)stmt.getText(1));
     chainHeader.chainWork += chainHeader.getWork();
     std::string chainHeaderHashStr = chainHeader.getHashLittleEndian().getHex();
 
@@ -197,7 +197,7 @@ bool CoinQBlockTreeSqlite3::insertHeader(const Coin::CoinBlockHeader& header)
         << " VALUES ('"
         << chainHeaderHashStr << "',0,"
         << chainHeader.height << ",'"
-        << chainHeader.chainWork.getDec() << "',"
+        << chainHeader.chainWork.GetDec() << "',"
         << chainHeader.version << ",'"
         << chainHeader.prevBlockHash.getHex() << "','"
         << chainHeader.merkleRoot.getHex() << "',"
@@ -240,7 +240,7 @@ int CoinQBlockTreeSqlite3::getBestHeight() const
     return stmt.getInt(0);
 }
 
-BigInt CoinQBlockTreeSqlite3::getTotalWork() const
+uint256 CoinQBlockTreeSqlite3::getTotalWork() const
 {
     if (!db.isOpen()) {
         throw std::runtime_error("Database is not open.");
@@ -255,8 +255,8 @@ BigInt CoinQBlockTreeSqlite3::getTotalWork() const
         throw std::runtime_error("Tree is empty.");
     }
 
-    BigInt work;
-    work.setDec((char*)stmt.getText(1));
+    uint256 work;
+    work.SetDec((char*)stmt.getText(1));
 
     return work;
 }
@@ -387,7 +387,7 @@ bool CoinQTxStoreSqlite3::insert(const ChainTransaction& tx)
             sql << "INSERT OR IGNORE INTO `block_headers` (`hash`, `height`, `chain_work`, `version`, `prev_block_hash`, `merkle_root`, `timestamp`, `bits`, `nonce`) "
                 <<      "VALUES ('" << header.getHashLittleEndian().getHex() << "', "
                                     << header.height << ", '"
-                                    << header.chainWork.getDec() << "', "
+                                    << header.chainWork.GetDec() << "', "
                                     << header.version << ", '"
                                     << header.prevBlockHash.getHex() << "', '"
                                     << header.merkleRoot.getHex() << "', "
@@ -604,7 +604,7 @@ bool CoinQTxStoreSqlite3::getTx(uint64_t txId, ChainTransaction& tx) const
         ChainHeader& header = tx.blockHeader;
         header.inBestChain = true;
         header.height = (int)stmt.getInt(0);
-        header.chainWork.setHex((char*)stmt.getText(1));
+        header.chainWork.SetHex((char*)stmt.getText(1));
         header.version = (uint32_t)stmt.getInt(2);
         header.prevBlockHash.setHex((char*)stmt.getText(3));
         header.merkleRoot.setHex((char*)stmt.getText(4));
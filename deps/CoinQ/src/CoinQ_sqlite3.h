@@ -59,7 +59,7 @@ public:
     ChainHeader getHeader(int height) const { return ChainHeader(); } // Use -1 to get top block
 
     int getBestHeight() const;
-    BigInt getTotalWork() const;
+    uint256 getTotalWork() const;
 
     std::vector<uchar_vector> getLocatorHashes(int maxSize) const;
 
@@ -24,7 +24,7 @@ bool initBlockTree(CoinQBlockTreeMem& blockTree, const CoinBlockHeader& genesisB
             blockTree.loadFromFile(filename);
             std::cout << "Done. "
                       << " mBestHeight: " << blockTree.getBestHeight()
-                      << " mTotalWork: " << blockTree.getTotalWork().getDec() << std::endl;
+                      << " mTotalWork: " << blockTree.getTotalWork().GetDec() << std::endl;
             return true;
         }
         catch (const std::exception& e) {
@@ -44,13 +44,13 @@ void onDoneSync(CoinQPeer& peer, ICoinQBlockTree& blockTree)
     blockTree.subscribeAddBestChain([&](const ChainHeader& header) {
         cout << "Added to best chain:     " << header.getHashLittleEndian().getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
     });
 
     blockTree.subscribeRemoveBestChain([&](const ChainHeader& header) {
         cout << "Removed from best chain: " << header.getHashLittleEndian().getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
     });
 
     int maxHeight = blockTree.getBestHeight();
@@ -133,7 +133,7 @@ int main(int argc, char** argv)
 
                 cout << "Processed " << headers.headers.size() << " headers."
                      << " mBestHeight: " << blockTree.getBestHeight()
-                     << " mTotalWork: " << blockTree.getTotalWork().getDec()
+                     << " mTotalWork: " << blockTree.getTotalWork().GetDec()
                      << " Attempting to fetch more headers..." << endl;
                 peer.getHeaders(blockTree.getLocatorHashes(1));
             }
@@ -158,7 +158,7 @@ int main(int argc, char** argv)
         for (unsigned int i = 0; i < block.txs.size(); i++) {
             txFilter.push(ChainTransaction(block.txs[i], block.getHeader(), i));
         }
-        cout << "Got block: " << block.getHashLittleEndian().getHex() << " height: " << block.height << " chainWork: " << block.chainWork.getDec() << endl;
+        cout << "Got block: " << block.getHashLittleEndian().getHex() << " height: " << block.height << " chainWork: " << block.chainWork.GetDec() << endl;
     });
 
     peer.subscribeBlock([&](const CoinBlock& block) {
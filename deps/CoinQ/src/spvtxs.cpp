@@ -26,7 +26,7 @@ void onDoneSync(CoinQPeer& peer, ICoinQBlockTree& blockTree, ICoinQTxStore& txSt
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Added to best chain:     " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
     });
 
     if (resyncHeight > -1) {
@@ -61,7 +61,7 @@ int main(int argc, char** argv)
         blockTree.open(blockTreeFile, kGenesisBlock);
         std::cout << "Done. "
                   << " mBestHeight: " << blockTree.getBestHeight()
-                  << " mTotalWork: " << blockTree.getTotalWork().getDec() << std::endl;
+                  << " mTotalWork: " << blockTree.getTotalWork().GetDec() << std::endl;
     }
     catch (const std::exception& e) {
         std::cout << std::endl;
@@ -143,7 +143,7 @@ int main(int argc, char** argv)
 
                 cout << "Processed " << headers.headers.size() << " headers."
                      << " mBestHeight: " << blockTree.getBestHeight()
-                     << " mTotalWork: " << blockTree.getTotalWork().getDec()
+                     << " mTotalWork: " << blockTree.getTotalWork().GetDec()
                      << " Attempting to fetch more headers..." << endl;
                 peer.getHeaders(blockTree.getLocatorHashes(1));
             }
@@ -160,7 +160,7 @@ int main(int argc, char** argv)
     CoinQBestChainBlockFilter blockFilter(&blockTree);
     blockFilter.connect([&](const ChainBlock& block) {
         uchar_vector blockHash = block.blockHeader.getHashLittleEndian();
-        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.getDec() << endl;
+        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.GetDec() << endl;
         for (unsigned int i = 0; i < block.txs.size(); i++) {
             txFilter.push(ChainTransaction(block.txs[i], block.getHeader(), i));
         }
@@ -176,7 +176,7 @@ int main(int argc, char** argv)
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Removed from best chain: " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
         if (txStore.isOpen()) {
             txStore.unconfirm(hash);
         }
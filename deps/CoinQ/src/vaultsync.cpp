@@ -73,7 +73,7 @@ bool initBlockTree(CoinQBlockTreeMem& blockTree, const Coin::CoinBlockHeader& ge
             blockTree.loadFromFile(filename);
             std::cout << "Done. "
                       << " mBestHeight: " << blockTree.getBestHeight()
-                      << " mTotalWork: " << blockTree.getTotalWork().getDec() << std::endl;
+                      << " mTotalWork: " << blockTree.getTotalWork().GetDec() << std::endl;
             return true;
         }
         catch (const std::exception& e) {
@@ -99,7 +99,7 @@ void onDoneSync(CoinQ::Peer& peer, ICoinQBlockTree& blockTree, Vault& vault, boo
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Added to best chain:     " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
  
 //        txStore.setBestHeight(header.height);
 //        wsServer.setBestHeader(header);
@@ -219,7 +219,7 @@ cli::result_t cmd_sync(bool bHelp, const cli::params_t& params)
  
                 cout << "Processed " << headers.headers.size() << " headers."
                      << " mBestHeight: " << blockTree.getBestHeight()
-                     << " mTotalWork: " << blockTree.getTotalWork().getDec()
+                     << " mTotalWork: " << blockTree.getTotalWork().GetDec()
                      << " Attempting to fetch more headers..." << endl;
                 peer.getHeaders(blockTree.getLocatorHashes(1));
             }
@@ -246,7 +246,7 @@ cli::result_t cmd_sync(bool bHelp, const cli::params_t& params)
     CoinQBestChainBlockFilter blockFilter(&blockTree);
     blockFilter.connect([&](const ChainBlock& block) {
         uchar_vector blockHash = block.blockHeader.getHashLittleEndian();
-        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.getDec() << endl;
+        cout << "Got block: " << blockHash.getHex() << " height: " << block.height << " chainWork: " << block.chainWork.GetDec() << endl;
         for (auto& coin_tx: block.txs) {
             std::shared_ptr<Tx> tx(new Tx());
             tx->set(coin_tx);
@@ -284,7 +284,7 @@ cli::result_t cmd_sync(bool bHelp, const cli::params_t& params)
         uchar_vector hash = header.getHashLittleEndian();
         cout << "Removed from best chain: " << hash.getHex()
              << " Height: " << header.height
-             << " ChainWork: " << header.chainWork.getDec() << endl;
+             << " ChainWork: " << header.chainWork.GetDec() << endl;
     });
 
     peer.subscribeBlock([&](CoinQ::Peer& peer, const Coin::CoinBlock& block) {
@@ -0,0 +1,240 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// sigverifier_test.cpp
+//
+// Checks that SigVerifier and Signer give the same results as serial verification.
+//
+// Copyright (c) 2014 Eric Lombrozo
+//
+// All Rights Reserved.
+
+#include <CoinQ_script.h>
+#include <CoinQ_sigverifier.h>
+
+#include <CoinCore/CoinNodeData.h>
+#include <CoinCore/random.h>
+#include <CoinCore/secp256k1.h>
+
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace CoinCrypto;
+using namespace CoinQ::Script;
+using namespace std;
+
+const unsigned int KEY_COUNT = 20;
+const unsigned int CHECK_COUNT = 500;
+const unsigned int ROUNDS = 5;
+const unsigned int CALLER_THREADS = 4;
+const unsigned int INPUT_COUNT = 30;
+
+// Uses a fresh key for every check so nothing is shared with SigVerifier.
+bool serialVerify(const SigCheck& check)
+{
+    secp256k1_key key;
+    key.setPubKey(check.pubkey);
+    return secp256k1_verify(key, check.hash, check.signature);
+}
+
+struct TestKey
+{
+    secp256k1_key key;
+    bytes_t pubkey;
+};
+
+vector<TestKey> makeKeys(unsigned int count)
+{
+    vector<TestKey> keys(count);
+    for (auto& key: keys)
+    {
+        key.key.newKey();
+        key.pubkey = key.key.getPubKey();
+    }
+    return keys;
+}
+
+// Valid checks with some corrupted signatures and repeats mixed in
+vector<SigCheck> makeChecks(const vector<TestKey>& keys, unsigned int count)
+{
+    vector<SigCheck> checks;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (i % 7 == 6)
+        {
+            checks.push_back(checks[i / 2]);
+            continue;
+        }
+
+        const TestKey& key = keys[i % keys.size()];
+        bytes_t hash = random_bytes(32);
+        bytes_t signature = secp256k1_sign(key.key, hash);
+        if (i % 5 == 4) { hash[0] ^= 0x01; }
+        checks.push_back(SigCheck(key.pubkey, hash, signature));
+    }
+    return checks;
+}
+
+void checkResults(const vector<SigCheck>& checks, const vector<bool>& expected, const vector<bool>& results, const string& name)
+{
+    if (results.size() != checks.size()) throw runtime_error(name + " - wrong result count.");
+    for (unsigned int i = 0; i < checks.size(); i++)
+    {
+        if (results[i] != expected[i]) throw runtime_error(name + " - result differs from serial verification.");
+    }
+}
+
+void testVerifier(const vector<TestKey>& keys)
+{
+    vector<SigCheck> checks = makeChecks(keys, CHECK_COUNT);
+    vector<bool> expected;
+    for (auto& check: checks) { expected.push_back(serialVerify(check)); }
+
+    SigVerifier verifier(4);
+    for (unsigned int i = 0; i < ROUNDS; i++)
+    {
+        checkResults(checks, expected, verifier.verify(checks), "SigVerifier::verify");
+    }
+
+    // Several callers share one verifier.
+    vector<string> errors(CALLER_THREADS);
+    boost::thread_group callers;
+    for (unsigned int i = 0; i < CALLER_THREADS; i++)
+    {
+        callers.create_thread([&, i]()
+        {
+            try
+            {
+                for (unsigned int j = 0; j < ROUNDS; j++)
+                {
+                    checkResults(checks, expected, verifier.verify(checks), "Concurrent SigVerifier::verify");
+                }
+            }
+            catch (const exception& e)
+            {
+                errors[i] = e.what();
+            }
+        });
+    }
+    callers.join_all();
+    for (auto& error: errors) { if (!error.empty()) throw runtime_error(error); }
+
+    for (unsigned int i = 0; i < checks.size(); i++)
+    {
+        if (verifier.verify(checks[i]) != expected[i]) throw runtime_error("Single check SigVerifier::verify - result differs from serial verification.");
+    }
+}
+
+// Builds a transaction spending 2 of 3 multisig inputs. Every fifth input has its signatures out of
+// place, which makes Signer fall back to single checks. If bCorrupt is set every third input has an
+// invalid signature.
+Coin::Transaction makeTx(const vector<TestKey>& keys, bool bCorrupt)
+{
+    vector<Script> scripts;
+    Coin::Transaction tx;
+    for (unsigned int i = 0; i < INPUT_COUNT; i++)
+    {
+        vector<bytes_t> pubkeys;
+        for (unsigned int j = 0; j < 3; j++) { pubkeys.push_back(keys[(i + j) % keys.size()].pubkey); }
+        scripts.push_back(Script(Script::PAY_TO_MULTISIG_SCRIPT_HASH, 2, pubkeys));
+        tx.addInput(Coin::TxIn(Coin::OutPoint(random_bytes(32), i), scripts.back().txinscript(Script::EDIT), 0xffffffff));
+    }
+    tx.addOutput(Coin::TxOut(100000, uchar_vector("76a914000000000000000000000000000000000000000088ac")));
+
+    Coin::Transaction unsignedTx(tx);
+    unsignedTx.clearScriptSigs();
+    Coin::SigHashCache sighashcache(unsignedTx);
+    for (unsigned int i = 0; i < INPUT_COUNT; i++)
+    {
+        Script& script = scripts[i];
+        bytes_t hash = sighashcache.getHash(i, script.txinscript(Script::SIGN), SIGHASH_ALL);
+        bool bMisaligned = (i % 5 == 4);
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            if (bMisaligned && j == 1) continue;
+            if (!bMisaligned && j == 2) continue;
+
+            bytes_t sig = secp256k1_sign(keys[(i + j) % keys.size()].key, hash);
+            if (bCorrupt && i % 3 == 2 && j == 0) { sig[10] ^= 0x01; }
+            sig.push_back(SIGHASH_ALL);
+            script.addSig(script.pubkeys()[j], sig);
+        }
+        tx.inputs[i].scriptSig = script.txinscript(bMisaligned ? Script::BROADCAST : Script::EDIT);
+    }
+    return tx;
+}
+
+void testSigner(const vector<TestKey>& keys, bool clearinvalidsigs, bool bCorrupt)
+{
+    Coin::Transaction tx = makeTx(keys, bCorrupt);
+
+    Coin::Transaction unsignedTx(tx);
+    unsignedTx.clearScriptSigs();
+    Coin::SigHashCache sighashcache(unsignedTx);
+
+    vector<Script> expected;
+    try
+    {
+        for (unsigned int i = 0; i < tx.inputs.size(); i++)
+        {
+            bytes_t hash = sighashcache.getHash(i, Script(tx.inputs[i].scriptSig).txinscript(Script::SIGN), SIGHASH_ALL);
+            expected.push_back(Script(tx.inputs[i].scriptSig, hash, clearinvalidsigs, &serialVerify));
+        }
+    }
+    catch (const exception& e)
+    {
+        // Serial verification rejects the transaction so Signer must too.
+        try
+        {
+            Signer signer(tx, clearinvalidsigs);
+        }
+        catch (const exception& e2)
+        {
+            if (string(e.what()) != e2.what()) throw runtime_error("Signer - error differs from serial verification.");
+            return;
+        }
+        throw runtime_error("Signer - accepted a transaction serial verification rejects.");
+    }
+
+    Signer signer(tx, clearinvalidsigs);
+    const scripts_t& scripts = signer.getScripts();
+    if (scripts.size() != tx.inputs.size()) throw runtime_error("Signer - wrong script count.");
+
+    for (unsigned int i = 0; i < tx.inputs.size(); i++)
+    {
+        if (scripts[i].sigs() != expected[i].sigs() || scripts[i].sigsneeded() != expected[i].sigsneeded())
+            throw runtime_error("Signer - script differs from serial verification.");
+
+        bytes_t scriptSig = expected[i].txinscript((expected[i].sigsneeded() == 0) ? Script::BROADCAST : Script::EDIT);
+        if (signer.getTx().inputs[i].scriptSig != scriptSig) throw runtime_error("Signer - scriptSig differs from serial verification.");
+    }
+}
+
+int main()
+{
+    try
+    {
+        cout << "Creating keys..." << flush;
+        vector<TestKey> keys = makeKeys(KEY_COUNT);
+        cout << "done." << endl;
+
+        cout << "Testing SigVerifier..." << flush;
+        testVerifier(keys);
+        cout << "passed." << endl;
+
+        cout << "Testing Signer..." << flush;
+        testSigner(keys, false, false);
+        testSigner(keys, true, false);
+        testSigner(keys, false, true);
+        testSigner(keys, true, true);
+        cout << "passed." << endl;
+    }
+    catch (const exception& e)
+    {
+        cout << endl << "Error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -169,6 +169,7 @@ MainWindow::MainWindow() :
     synchedVault.subscribeTxInserted([this](std::shared_ptr<CoinDB::Tx> /*tx*/) { if (isSynched()) emit signal_newTx(); });
     synchedVault.subscribeTxUpdated([this](std::shared_ptr<CoinDB::Tx> /*tx*/) { if (isSynched()) emit signal_newTx(); });
     synchedVault.subscribeMerkleBlockInserted([this](std::shared_ptr<CoinDB::MerkleBlock> /*merkleblock*/) { emit signal_newBlock(); });
+    synchedVault.subscribeReorg([this](uint32_t /*forkHeight*/, CoinDB::ids_t /*txIds*/) { emit signal_newBlock(); });
 
     connect(this, SIGNAL(signal_newTx()), this, SLOT(newTx()));
     connect(this, SIGNAL(signal_newBlock()), this, SLOT(newBlock()));
@@ -269,7 +270,7 @@ void MainWindow::loadHeaders()
     synchedVault.loadHeaders(blockTreeFile.toStdString(), false,
         [this](const CoinQBlockTreeMem& blockTree) {
             std::stringstream progress;
-            progress << "Height: " << blockTree.getBestHeight() << " / " << "Total Work: " << blockTree.getTotalWork().getDec();
+            progress << "Height: " << blockTree.getBestHeight() << " / " << "Total Work: " << blockTree.getTotalWork().GetDec();
             emit headersLoadProgress(QString::fromStdString(progress.str()));
             return true;
         });
@@ -1390,7 +1391,7 @@ void MainWindow::deleteAccount()
         try {
             accountModel->deleteAccount(accountName);
             accountView->updateColumns();
-            synchedVault.updateBloomFilter();
+            synchedVault.updateBloomFilter(true);
             //networkSync.setBloomFilter(accountModel->getBloomFilter(0.0001, 0, 0));
         }
         catch (const exception& e) {
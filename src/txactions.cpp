@@ -122,14 +122,21 @@ void TxActions::searchTx()
             // TODO: faster search
             QStandardItem* hashItem = nullptr;
             int row = 0;
-            for (; row < m_txModel->rowCount(); row++)
+            while (true)
             {
-                QStandardItem* item = m_txModel->item(row, 8);
-                if (item->text().left(txhash.size()) == txhash)
+                for (; row < m_txModel->rowCount(); row++)
                 {
-                    hashItem = item;
-                    break;
+                    QStandardItem* item = m_txModel->item(row, 8);
+                    if (item->text().left(txhash.size()) == txhash)
+                    {
+                        hashItem = item;
+                        break;
+                    }
                 }
+
+                // Older transactions are only loaded once the view scrolls to them.
+                if (hashItem || !m_txModel->canFetchMore(QModelIndex())) break;
+                m_txModel->fetchMore(QModelIndex());
             }
 
             if (!hashItem) throw std::runtime_error("Transaction not found.");
@@ -29,8 +29,10 @@ using namespace CoinDB;
 using namespace CoinQ::Script;
 using namespace std;
 
+const unsigned int TX_PAGE_SIZE = 200;
+
 TxModel::TxModel(QObject* parent)
-    : QStandardItemModel(parent)
+    : QStandardItemModel(parent), vault(nullptr), bestHeight(0), runningBalance(0)
 {
     base58_versions[0] = getCoinParams().pay_to_pubkey_hash_version();
     base58_versions[1] = getCoinParams().pay_to_script_hash_version();
@@ -41,7 +43,7 @@ TxModel::TxModel(QObject* parent)
 }
 
 TxModel::TxModel(CoinDB::Vault* vault, const QString& accountName, QObject* parent)
-    : QStandardItemModel(parent)
+    : QStandardItemModel(parent), vault(nullptr), bestHeight(0), runningBalance(0)
 {
     base58_versions[0] = getCoinParams().pay_to_pubkey_hash_version();
     base58_versions[1] = getCoinParams().pay_to_script_hash_version();
@@ -122,142 +124,185 @@ void TxModel::update()
 
     removeRows(0, rowCount());
 
+    cursor = HistoryCursor();
+    lastTxHash.clear();
+
     if (!vault || accountName.isEmpty()) return;
 
     std::shared_ptr<BlockHeader> bestHeader = vault->getBestBlockHeader();
+    bestHeight = bestHeader ? bestHeader->height() : 0;
 
-    std::vector<TxOutView> txoutviews = vault->getTxOutViews(accountName.toStdString(), "", TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, true);
-    bytes_t last_txhash;
-    QList<SortableRow> rows;
-    for (auto& item: txoutviews) {
-        QList<QStandardItem*> row;
-
-        QDateTime utc;
-        utc.setTime_t(item.tx_timestamp);
-        QString time = utc.toLocalTime().toString();
-
-        QString description = QString::fromStdString(item.role_label());
-
-        // The type stuff is just to test the new db schema. It's all wrong, we're not going to use TxOutViews for this.
-        TxType txType;
-        QString type;
-        QString amount;
-        QString fee;
-        int64_t value = 0;
-        bytes_t this_txhash = item.tx_status == Tx::UNSIGNED ? item.tx_unsigned_hash : item.tx_hash;
-        switch (item.role_flags) {
-        case TxOut::ROLE_NONE:
-            txType = NONE;
-            type = tr("None");
-            break;
-
-        case TxOut::ROLE_SENDER:
-            txType = SEND;
-            type = tr("Send");
-            amount = "-";
-            value -= item.value;
-            if (item.tx_has_all_outpoints && item.tx_fee() > 0) {
-                if (this_txhash != last_txhash) {
-                    fee = "-";
-                    //fee += QString::number(item.tx_fee()/(1.0 * currency_divisor), 'g', 8);
-                    fee += getFormattedCurrencyAmount(item.tx_fee());
-                    value -= item.tx_fee();
-                    last_txhash = this_txhash;
-                }
-                else {
-                    fee = "||";
-                }
-            }
-            break;
-
-        case TxOut::ROLE_RECEIVER:
-            txType = RECEIVE;
-            type = tr("Receive");
-            amount = "+";
-            value += item.value;
-            break;
-
-        default:
-            txType = UNKNOWN;
-            type = tr("Unknown");
-        }
+    // The top row shows the whole balance and each row below it shows the balance before the row above it.
+    runningBalance = (int64_t)vault->getAccountBalance(accountName.toStdString(), 0);
 
-        //amount += QString::number(item.value/(1.0 * currency_divisor), 'g', 8);
-        amount += getFormattedCurrencyAmount(item.value);
+    // Unconfirmed transactions are few, so they are all loaded and sorted here, above the confirmed ones.
+    std::vector<TxOutView> items = vault->getTxOutViews(accountName.toStdString(), "", TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL & ~Tx::CONFIRMED);
 
-        uint32_t nConfirmations = 0;
-        QString confirmations;
-        if (item.tx_status >= Tx::PROPAGATED) {
-            if (bestHeader && item.height) {
-                nConfirmations = bestHeader->height() + 1 - item.height;
-                confirmations = QString::number(nConfirmations);
-            }
-            else {
-                confirmations = "0";
-            }
-        }
-        else if (item.tx_status == Tx::UNSIGNED) {
-            confirmations = tr("Unsigned");
-        }
-        else if (item.tx_status == Tx::UNSENT) {
-            confirmations = tr("Unsent");
-        }
-        QStandardItem* confirmationsItem = new QStandardItem(confirmations);
-        confirmationsItem->setData(item.tx_status, Qt::UserRole);
-        confirmationsItem->setData((int)nConfirmations, Qt::UserRole + 1);
+    QList<SortableRow> rows;
+    for (auto& item: items) {
+        int64_t value;
+        QList<QStandardItem*> row = createRow(item, value);
+        rows.append(SortableRow(row, item.tx_status, 0, value, item.tx_index));
+    }
+
+    qSort(rows.begin(), rows.end(), [](const SortableRow& a, const SortableRow& b) {
+        // order by status first (unsigned, then unsent, sent, propagated and canceled)
+        if (a.status() < b.status()) return true;
+        if (a.status() > b.status()) return false;
 
-        QString address = QString::fromStdString(getAddressForTxOutScript(item.script, base58_versions));
-        QString hash = QString::fromStdString(uchar_vector(this_txhash).getHex());
+        // if one value is positive and the other is negative, sort so that running balance remains positive
+        if (a.value() < 0 && b.value() > 0) return true;
+        if (a.value() > 0 && b.value() < 0) return false;
 
-        row.append(new QStandardItem(time));
-        row.append(new QStandardItem(description));
+        // otherwise sort by ascending tx index
+        return (a.txindex() < b.txindex());
+    });
 
-        QStandardItem* typeItem = new QStandardItem(type);
-        typeItem->setData(txType, Qt::UserRole);
-        row.append(typeItem);
+    for (auto& row: rows) {
+        setRowBalance(row.row(), row.value());
+        appendRow(row.row());
+    }
 
-        row.append(new QStandardItem(amount));
-        row.append(new QStandardItem(fee));
-        row.append(new QStandardItem("")); // placeholder for balance, once sorted
-        row.append(confirmationsItem);
-        row.append(new QStandardItem(address));
+    fetchMore(QModelIndex());
+}
 
-        // Store the tx hash and tx index to uniquely identify the output.
-        QStandardItem* hashItem = new QStandardItem(hash);
-        hashItem->setData(item.tx_index, Qt::UserRole);
-        row.append(hashItem);
+bool TxModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && vault && !accountName.isEmpty() && !cursor.end;
+}
 
-        rows.append(SortableRow(row, item.tx_status, nConfirmations, value, item.tx_index));
+void TxModel::fetchMore(const QModelIndex& parent)
+{
+    if (!canFetchMore(parent)) return;
+
+    HistoryFilter filter;
+    filter.account_name = accountName.toStdString();
+    filter.tx_status_flags = Tx::CONFIRMED;
+
+    try {
+        // Pages come newest first, which is the display order.
+        std::vector<TxOutView> items = vault->getTxOutViewPage(filter, cursor, TX_PAGE_SIZE);
+        for (auto& item: items) {
+            int64_t value;
+            QList<QStandardItem*> row = createRow(item, value);
+            setRowBalance(row, value);
+            appendRow(row);
+        }
+    }
+    catch (const std::exception& e) {
+        cursor.end = true;
+        emit error(QString::fromStdString(e.what()));
     }
+}
 
-    qSort(rows.begin(), rows.end(), [](const SortableRow& a, const SortableRow& b) {
-        // order by status first (unsigned, then propagated, then confirmed)
-        if (a.status() < b.status()) return true;
-        if (a.status() > b.status()) return false;
+// Sets value to the change the row makes to the balance.
+QList<QStandardItem*> TxModel::createRow(const TxOutView& item, int64_t& value)
+{
+    QList<QStandardItem*> row;
+
+    QDateTime utc;
+    utc.setTime_t(item.tx_timestamp);
+    QString time = utc.toLocalTime().toString();
+
+    QString description = QString::fromStdString(item.role_label());
+
+    // The type stuff is just to test the new db schema. It's all wrong, we're not going to use TxOutViews for this.
+    TxType txType;
+    QString type;
+    QString amount;
+    QString fee;
+    value = 0;
+    bytes_t this_txhash = item.tx_status == Tx::UNSIGNED ? item.tx_unsigned_hash : item.tx_hash;
+    switch (item.role_flags) {
+    case TxOut::ROLE_NONE:
+        txType = NONE;
+        type = tr("None");
+        break;
+
+    case TxOut::ROLE_SENDER:
+        txType = SEND;
+        type = tr("Send");
+        amount = "-";
+        value -= item.value;
+        if (item.tx_has_all_outpoints && item.tx_fee() > 0) {
+            if (this_txhash != lastTxHash) {
+                fee = "-";
+                //fee += QString::number(item.tx_fee()/(1.0 * currency_divisor), 'g', 8);
+                fee += getFormattedCurrencyAmount(item.tx_fee());
+                value -= item.tx_fee();
+                lastTxHash = this_txhash;
+            }
+            else {
+                fee = "||";
+            }
+        }
+        break;
+
+    case TxOut::ROLE_RECEIVER:
+        txType = RECEIVE;
+        type = tr("Receive");
+        amount = "+";
+        value += item.value;
+        break;
+
+    default:
+        txType = UNKNOWN;
+        type = tr("Unknown");
+    }
 
-        // if confirmation counts are equal
-        if (a.nConfirmations() == b.nConfirmations()) {
-            // if one value is positive and the other is negative, sort so that running balance remains positive
-            if (a.value() < 0 && b.value() > 0) return true;
-            if (a.value() > 0 && b.value() < 0) return false;
+    //amount += QString::number(item.value/(1.0 * currency_divisor), 'g', 8);
+    amount += getFormattedCurrencyAmount(item.value);
 
-            // otherwise sort by ascending tx index
-            return (a.txindex() < b.txindex());
+    uint32_t nConfirmations = 0;
+    QString confirmations;
+    if (item.tx_status >= Tx::PROPAGATED) {
+        if (bestHeight && item.height) {
+            nConfirmations = bestHeight + 1 - item.height;
+            confirmations = QString::number(nConfirmations);
         }
+        else {
+            confirmations = "0";
+        }
+    }
+    else if (item.tx_status == Tx::UNSIGNED) {
+        confirmations = tr("Unsigned");
+    }
+    else if (item.tx_status == Tx::UNSENT) {
+        confirmations = tr("Unsent");
+    }
+    QStandardItem* confirmationsItem = new QStandardItem(confirmations);
+    confirmationsItem->setData(item.tx_status, Qt::UserRole);
+    confirmationsItem->setData((int)nConfirmations, Qt::UserRole + 1);
 
-        // otherwise sort by ascending confirmation count
-        return (a.nConfirmations() < b.nConfirmations());
-    });
+    QString address = QString::fromStdString(getAddressForTxOutScript(item.script, base58_versions));
+    QString hash = QString::fromStdString(uchar_vector(this_txhash).getHex());
 
-    // iterate in reverse order to compute running balance
-    int64_t balance = 0;
-    for (int i = rows.size() - 1; i >= 0; i--) {
-        balance += rows[i].value();
-        (rows[i].row())[5]->setText(getFormattedCurrencyAmount(balance));
-    }
+    row.append(new QStandardItem(time));
+    row.append(new QStandardItem(description));
 
-    // iterate in forward order to display
-    for (auto& row: rows) appendRow(row.row());
+    QStandardItem* typeItem = new QStandardItem(type);
+    typeItem->setData(txType, Qt::UserRole);
+    row.append(typeItem);
+
+    row.append(new QStandardItem(amount));
+    row.append(new QStandardItem(fee));
+    row.append(new QStandardItem("")); // placeholder for balance, set once the row's position is known
+    row.append(confirmationsItem);
+    row.append(new QStandardItem(address));
+
+    // Store the tx hash and tx index to uniquely identify the output.
+    QStandardItem* hashItem = new QStandardItem(hash);
+    hashItem->setData(item.tx_index, Qt::UserRole);
+    row.append(hashItem);
+
+    return row;
+}
+
+// Rows must be passed in display order.
+void TxModel::setRowBalance(QList<QStandardItem*>& row, int64_t value)
+{
+    row[5]->setText(getFormattedCurrencyAmount(runningBalance));
+    runningBalance -= value;
 }
 
 bytes_t TxModel::getTxHash(int row) const
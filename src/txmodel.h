@@ -49,6 +49,10 @@ public:
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
     bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole);
     Qt::ItemFlags flags(const QModelIndex& index) const;
+
+    // Confirmed rows are read a page at a time as the view scrolls. Unconfirmed rows are all loaded by update().
+    bool canFetchMore(const QModelIndex& parent) const;
+    void fetchMore(const QModelIndex& parent);
  
 signals:
     void txSigned(const QString& keychainNames);
@@ -60,10 +64,17 @@ private:
     QString currencySymbol;
 
     void setColumns();
+    QList<QStandardItem*> createRow(const CoinDB::TxOutView& item, int64_t& value);
+    void setRowBalance(QList<QStandardItem*>& row, int64_t value);
 
     CoinDB::Vault* vault;
     QString accountName; // empty when not loaded
     uint64_t confirmedBalance;
     uint64_t pendingBalance;
+
+    uint32_t bestHeight;
+    CoinDB::HistoryCursor cursor;
+    int64_t runningBalance; // balance after the next row to be appended
+    bytes_t lastTxHash; // the fee is shown on the first row of each transaction
 };
 
@@ -426,11 +426,14 @@ cli::result_t cmd_history(const cli::params_t& params)
     
     Vault vault(params[0], false);
     uint32_t best_height = vault.getBestHeight();
-    vector<TxOutView> txOutViews = vault.getTxOutViews(account_name, bin_name, TxOut::ROLE_BOTH, TxOut::BOTH, Tx::ALL, hide_change);
+    HistoryFilter filter;
+    filter.account_name = account_name;
+    filter.bin_name = bin_name;
+    filter.hide_change = hide_change;
+
     stringstream ss;
     ss << formattedTxOutViewHeader();
-    for (auto& txOutView: txOutViews)
-        ss << endl << formattedTxOutView(txOutView, best_height);
+    vault.streamTxOutViews(filter, [&](const TxOutView& txOutView) -> bool { ss << endl << formattedTxOutView(txOutView, best_height); return true; });
     return ss.str();
 }
 